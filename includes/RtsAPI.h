@@ -145,6 +145,10 @@ typedef struct GCDetails_ {
   uint64_t par_max_copied_bytes;
   // In parallel GC, the amount of balanced data copied by all threads
   uint64_t par_balanced_copied_bytes;
+    // In parallel GC, the number of todo blocks stolen from other threads
+  uint64_t par_steal_success;
+    // In parallel GC, the number of attempts to steal work that found none
+  uint64_t par_steal_fail;
     // The time elapsed during synchronisation before GC
   Time sync_elapsed_ns;
     // The CPU time used during GC itself
@@ -237,17 +241,17 @@ typedef struct _RTSStats {
   // -----------------------------------
   // Internal Counters
 
-    // The number of times a GC thread spun on its 'gc_spin' lock.
+    // The number of times a GC thread spun waiting to start a GC.
     // Will be zero if the rts was not built with PROF_SPIN
   uint64_t gc_spin_spin;
-    // The number of times a GC thread yielded on its 'gc_spin' lock.
+    // The number of times a GC thread parked (slept) waiting to start a GC.
     // Will be zero if the rts was not built with PROF_SPIN
   uint64_t gc_spin_yield;
-    // The number of times a GC thread spun on its 'mut_spin' lock.
+    // The number of times a GC thread spun waiting to return to the mutator.
     // Will be zero if the rts was not built with PROF_SPIN
   uint64_t mut_spin_spin;
-    // The number of times a GC thread yielded on its 'mut_spin' lock.
-    // Will be zero if the rts was not built with PROF_SPIN
+    // The number of times a GC thread parked (slept) waiting to return to the
+    // mutator. Will be zero if the rts was not built with PROF_SPIN
   uint64_t mut_spin_yield;
     // The number of times a GC thread has checked for work across all parallel
     // GCs
@@ -258,6 +262,11 @@ typedef struct _RTSStats {
     // The number of times a GC thread has iterated it's outer loop across all
     // parallel GCs
   uint64_t scav_find_work;
+    // The number of todo blocks stolen by GC threads across all parallel GCs
+  uint64_t steal_success;
+    // The number of times a GC thread tried to steal work and found none
+    // across all parallel GCs
+  uint64_t steal_fail;
 
   // ----------------------------------
   // Concurrent garbage collector
@@ -154,12 +154,27 @@
 #define EVENT_CONC_UPD_REM_SET_FLUSH       206
 #define EVENT_NONMOVING_HEAP_CENSUS        207
 
+#define EVENT_EVENTLOG_DROPPED             208 /* (dropped_events) */
+
+#define EVENT_C_FINALIZERS_QUEUED          209 /* (n_finalizers, queue_depth) */
+#define EVENT_C_FINALIZERS_RAN             210 /* (n_finalizers, latency) */
+
+#define EVENT_STM_COMMIT                   211 /* (thread, reads, writes) */
+#define EVENT_STM_ABORT                    212 /* (thread, tvar, tvar_conflicts,
+                                                   consecutive_aborts) */
+#define EVENT_MVAR_COUNTERS                213 /* (blocks, block_ns, handoffs,
+                                                   handoff_ns, max_handoff_ns,
+                                                   batched) */
+#define EVENT_GC_SYNC_LAST                 214 /* (cap, thread, sync_ns,
+                                                   info, ccs) */
+#define EVENT_STEAL_THREAD                 215 /* (thread, victim_cap) */
+
 /*
  * The highest event code +1 that ghc itself emits. Note that some event
  * ranges higher than this are reserved but not currently emitted by ghc.
  * This must match the size of the EventDesc[] array in EventLog.c
  */
-#define NUM_GHC_EVENT_TAGS        208
+#define NUM_GHC_EVENT_TAGS        216
 
 #if 0  /* DEPRECATED EVENTS: */
 /* we don't actually need to record the thread, it's implicit */
@@ -43,6 +43,14 @@ typedef struct {
  */
 extern const EventLogWriter FileEventLogWriter;
 
+#if !defined(mingw32_HOST_OS)
+/*
+ * An EventLogWriter which streams eventlogs to the Unix domain socket
+ * given by +RTS --eventlog-socket=<path>.
+ */
+extern const EventLogWriter SocketEventLogWriter;
+#endif
+
 enum EventLogStatus {
   /* The runtime system wasn't compiled with eventlog support. */
   EVENTLOG_NOT_SUPPORTED,
@@ -55,6 +55,8 @@ typedef struct _GC_FLAGS {
     bool         useNonmoving; // default = false
     bool         nonmovingSelectorOpt; // Do selector optimization in the
                                        // non-moving heap, default = false
+    uint32_t     nonmovingMarkThreads; // Number of threads marking the
+                                       // non-moving heap, default = 1
     uint32_t     generations;
     bool squeezeUpdFrames;
 
@@ -68,9 +70,13 @@ typedef struct _GC_FLAGS {
     Time    idleGCDelayTime;    /* units: TIME_RESOLUTION */
     Time    interIdleGCWait;    /* units: TIME_RESOLUTION */
     bool doIdleGC;
+    Time    idleGCSlice;        /* units: TIME_RESOLUTION, 0 == off */
 
     Time    longGCSync;         /* units: TIME_RESOLUTION */
 
+    uint32_t finalizerThreads;  /* OS threads running C finalizers, or 0 to
+                                 * run them on idle capabilities */
+
     StgWord heapBase;           /* address to ask the OS for memory */
 
     StgWord allocLimitGrace;    /* units: *blocks*
@@ -89,6 +95,11 @@ typedef struct _GC_FLAGS {
 
     bool numa;                   /* Use NUMA */
     StgWord numaMask;
+
+    uint32_t hugePages;          /* Back the heap with huge pages */
+#define HUGE_PAGES_NONE    0
+#define HUGE_PAGES_THP     1     /* '--huge-pages', transparent huge pages */
+#define HUGE_PAGES_HUGETLB 2     /* '--huge-pages=hugetlb', MAP_HUGETLB */
 } GC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -177,7 +188,13 @@ typedef struct _TRACE_FLAGS {
     bool sparks_sampled; /* trace spark events by a sampled method */
     bool sparks_full;    /* trace spark events 100% accurately */
     bool user;           /* trace user events (emitted from Haskell code) */
+    bool stm;            /* trace STM commits and aborts */
     char *trace_output;  /* output filename for eventlog */
+    char *trace_socket;  /* Unix socket to stream the eventlog to, or NULL */
+    bool async_writer;   /* write the eventlog from a separate thread */
+    StgWord64 buffer_size;          /* size of each eventlog buffer */
+    StgWord64 flight_recorder_size; /* keep this much per cap in memory
+                                       rather than writing it out, or 0 */
 } TRACE_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -224,12 +241,16 @@ typedef struct _MISC_FLAGS {
     bool linkerAlwaysPic;        /* Assume the object code is always PIC */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    bool ioUring;                /* use io_uring to wait for I/O in the
+                                  * non-threaded RTS, if available */
 } MISC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _PAR_FLAGS {
   uint32_t       nCapabilities;  /* number of threads to run simultaneously */
   bool           migrate;        /* migrate threads between capabilities */
+  bool           stealThreads;   /* let idle capabilities steal new threads
+                                  * (see rts/Schedule.c) */
   uint32_t       maxLocalSparks;
   bool           parGcEnabled;   /* enable parallel GC */
   uint32_t       parGcGen;       /* do parallel GC in this generation
@@ -253,6 +274,10 @@ typedef struct _PAR_FLAGS {
                                   * GC (default: use all nNodes). */
 
   bool           setAffinity;    /* force thread affinity with CPUs */
+  bool           stmVersionClock; /* STM: validate reads against a global
+                                   * version clock (see rts/STM.c) */
+  uint32_t       stmMaxAborts;   /* STM: serialise a transaction after
+                                  * this many aborts in a row (0: never) */
 } PAR_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -181,6 +181,9 @@ extern void closeCondition        ( Condition* pCond );
 extern bool broadcastCondition    ( Condition* pCond );
 extern bool signalCondition       ( Condition* pCond );
 extern bool waitCondition         ( Condition* pCond, Mutex* pMut );
+// returns false if the timeout expired before the condition was signalled
+extern bool timedWaitCondition    ( Condition* pCond, Mutex* pMut,
+                                    Time timeout );
 
 //
 // Mutexes
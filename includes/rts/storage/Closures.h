@@ -343,6 +343,10 @@ typedef struct {
   StgClosure                *volatile current_value;
   StgTVarWatchQueue         *volatile first_watch_queue_entry;
   StgInt                     volatile num_updates;
+  StgWord                    volatile num_conflicts; // commits that failed
+                                                     // because of this TVar,
+                                                     // see Note [STM contention
+                                                     // management]
 } StgTVar;
 
 /* new_value == expected_value for read-only accesses */
@@ -378,6 +382,7 @@ struct StgTRecHeader_ {
   struct StgTRecHeader_     *enclosing_trec;
   StgTRecChunk              *current_chunk;
   TRecState                  state;
+  StgWord                    read_version; // see Note [STM version clock]
 };
 
 typedef struct {
@@ -412,6 +417,8 @@ typedef struct MessageWakeup_ {
     StgHeader header;
     Message  *link;
     StgTSO   *tso;
+    StgWord   sent;     // getMonotonicNSec() when sent, or 0; see
+                        // Note [MVar wakeup statistics] in rts/Threads.c
 } MessageWakeup;
 
 typedef struct MessageThrowTo_ {
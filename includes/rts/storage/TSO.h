@@ -173,6 +173,19 @@ typedef struct StgTSO_ {
      */
     StgWord32  tot_stack_size;
 
+    /*
+     * When the thread last blocked on an MVar, if we are keeping MVar
+     * statistics (see Note [MVar wakeup statistics] in rts/Threads.c).
+     */
+    StgWord64  block_start;
+
+    /*
+     * Whether the thread is on its Capability's offered_threads deque
+     * for other Capabilities to steal (see Note [Work-stealing run
+     * queues] in rts/Schedule.c).
+     */
+    StgWord    offered;
+
 #if defined(TICKY_TICKY)
     /* TICKY-specific stuff would go here. */
 #endif
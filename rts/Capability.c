@@ -90,13 +90,46 @@ globalWorkToDo (void)
 #endif
 
 #if defined(THREADED_RTS)
+/* Try to steal a spark from another capability's pool, skipping fizzled
+ * ones.  Sets *retry if we lost a race with another thief. */
+static StgClosure *
+stealSparkFrom (Capability *cap, Capability *robbed, bool *retry)
+{
+  StgClosurePtr spark;
+
+  if (emptySparkPoolCap(robbed)) // nothing to steal here
+      return NULL;
+
+  spark = tryStealSpark(robbed->sparks);
+  while (spark != NULL && fizzledSpark(spark)) {
+      cap->spark_stats.fizzled++;
+      traceEventSparkFizzle(cap);
+      spark = tryStealSpark(robbed->sparks);
+  }
+  if (spark == NULL && !emptySparkPoolCap(robbed)) {
+      // we conflicted with another thread while trying to steal;
+      // try again later.
+      *retry = true;
+  }
+
+  if (spark != NULL) {
+      cap->spark_stats.converted++;
+      cap->spark_stats.stolen++;
+      if (robbed->node != cap->node) {
+          cap->spark_stats.stolen_remote++;
+      }
+      traceEventSparkSteal(cap, robbed->no);
+  }
+  return spark;
+}
+
 StgClosure *
 findSpark (Capability *cap)
 {
   Capability *robbed;
   StgClosurePtr spark;
   bool retry;
-  uint32_t i = 0;
+  uint32_t i = 0, remote;
 
   if (!emptyRunQueue(cap) || cap->n_returning_tasks != 0) {
       // If there are other threads, don't try to run any new
@@ -138,35 +171,23 @@ findSpark (Capability *cap)
                  "cap %d: Trying to steal work from other capabilities",
                  cap->no);
 
-      /* visit cap.s 0..n-1 in sequence until a theft succeeds. We could
-      start at a random place instead of 0 as well.  */
-      for ( i=0 ; i < n_capabilities ; i++ ) {
-          robbed = capabilities[i];
-          if (cap == robbed)  // ourselves...
-              continue;
-
-          if (emptySparkPoolCap(robbed)) // nothing to steal here
-              continue;
-
-          spark = tryStealSpark(robbed->sparks);
-          while (spark != NULL && fizzledSpark(spark)) {
-              cap->spark_stats.fizzled++;
-              traceEventSparkFizzle(cap);
-              spark = tryStealSpark(robbed->sparks);
-          }
-          if (spark == NULL && !emptySparkPoolCap(robbed)) {
-              // we conflicted with another thread while trying to steal;
-              // try again later.
-              retry = true;
-          }
-
-          if (spark != NULL) {
-              cap->spark_stats.converted++;
-              traceEventSparkSteal(cap, robbed->no);
-
-              return spark;
+      /* visit the other cap.s in sequence, starting after our own, until
+      a theft succeeds.  With NUMA, first try the capabilities on our own
+      node, whose sparks' data is most likely to be in local memory, and
+      only then go further afield.  */
+      for (remote = 0; remote < (n_numa_nodes > 1 ? 2 : 1); remote++) {
+          for ( i=1 ; i < n_capabilities ; i++ ) {
+              robbed = capabilities[(cap->no + i) % n_capabilities];
+              if (n_numa_nodes > 1 &&
+                  (robbed->node != cap->node) != (remote != 0))
+                  continue;
+
+              spark = stealSparkFrom(cap, robbed, &retry);
+              if (spark != NULL) {
+                  return spark;
+              }
+              // otherwise: no success, try next one
           }
-          // otherwise: no success, try next one
       }
   } while (retry);
 
@@ -174,6 +195,65 @@ findSpark (Capability *cap)
   return NULL;
 }
 
+/* Capabilities are assigned to logical NUMA nodes round-robin (see
+ * capNoToNumaNode), so the enabled ones on the node of Capability no are
+ * node, node + n_numa_nodes, ... below enabled_capabilities.  Spread the
+ * disabled ones across those, falling back to any enabled Capability if
+ * the node has none left.  Without NUMA this is no % enabled_capabilities. */
+Capability *
+enabledCapabilityNear (uint32_t no)
+{
+    uint32_t node = capNoToNumaNode(no);
+    uint32_t n_on_node;
+
+    if (node >= enabled_capabilities) {
+        return capabilities[no % enabled_capabilities];
+    }
+    n_on_node = (enabled_capabilities - node + n_numa_nodes - 1) / n_numa_nodes;
+    return capabilities[node + n_numa_nodes * ((no / n_numa_nodes) % n_on_node)];
+}
+
+/* The code a thread that has just returned to the scheduler was running:
+ * the return address on top of its stack, looking through the frames that
+ * the heap and stack check failure code pushes to save R1, or for
+ * stg_enter, the closure it was about to enter. */
+static StgWord
+stoppedThreadInfo (StgTSO *tso)
+{
+    StgPtr sp;
+
+    if (tso->what_next != ThreadRunGHC) {
+        return 0;
+    }
+    sp = tso->stackobj->sp;
+    if (sp[0] == (W_)&stg_enter_info) {
+        return (StgWord)UNTAG_CLOSURE((StgClosure *)sp[1])->header.info;
+    }
+    if (sp[0] == (W_)&stg_ret_p_info || sp[0] == (W_)&stg_ret_n_info) {
+        sp += 2;
+    } else if (sp[0] == (W_)&stg_ret_v_info) {
+        sp += 1;
+    }
+    return sp[0];
+}
+
+void
+recordSyncStop (Capability *cap, StgTSO *tso)
+{
+    PendingSync *sync = pending_sync;
+
+    // only the first stop for each sync counts
+    if (sync == NULL || cap->sync_stop.elapsed >= sync->start) {
+        return;
+    }
+    cap->sync_stop.elapsed = getProcessElapsedTime();
+    cap->sync_stop.tso = tso == NULL ? 0 : tso->id;
+    cap->sync_stop.info = tso == NULL ? 0 : stoppedThreadInfo(tso);
+#if defined(PROFILING)
+    cap->sync_stop.ccs = tso == NULL ? NULL : cap->r.rCCCS;
+#endif
+}
+
 // Returns True if any spark pool is non-empty at this moment in time
 // The result is only valid for an instant, of course, so in a sense
 // is immediately invalid, and should not be relied upon for
@@ -266,6 +346,8 @@ initCapability (Capability *cap, uint32_t i)
     cap->n_returning_tasks  = 0;
     cap->inbox              = (Message*)END_TSO_QUEUE;
     cap->putMVars           = NULL;
+    cap->wakeup_batch_depth = 0;
+    cap->n_wakeup_batches   = 0;
     cap->sparks             = allocSparkPool();
     cap->spark_stats.created    = 0;
     cap->spark_stats.dud        = 0;
@@ -273,6 +355,17 @@ initCapability (Capability *cap, uint32_t i)
     cap->spark_stats.converted  = 0;
     cap->spark_stats.gcd        = 0;
     cap->spark_stats.fizzled    = 0;
+    cap->spark_stats.stolen     = 0;
+    cap->spark_stats.stolen_remote = 0;
+    cap->threads_migrated   = 0;
+    cap->threads_migrated_remote = 0;
+    cap->offered_threads    = NULL;
+    if (RtsFlags.ParFlags.stealThreads) {
+        cap->offered_threads = newWSDeque(OFFERED_THREADS_SIZE);
+    }
+    cap->threads_stolen     = 0;
+    cap->threads_stolen_remote = 0;
+    memset(&cap->sync_stop, 0, sizeof(SyncStop));
 #if !defined(mingw32_HOST_OS)
     cap->io_manager_control_wr_fd = -1;
 #endif
@@ -304,8 +397,15 @@ initCapability (Capability *cap, uint32_t i)
     cap->free_tvar_watch_queues = END_STM_WATCH_QUEUE;
     cap->free_trec_chunks = END_STM_CHUNK_LIST;
     cap->free_trec_headers = NO_TREC;
+    memset(&cap->stm_free_list_sizes, 0, sizeof(cap->stm_free_list_sizes));
     cap->transaction_tokens = 0;
+    cap->stm_aborts = 0;
+    cap->stm_conflict = NULL;
+    memset(&cap->stm_stats, 0, sizeof(cap->stm_stats));
+    memset(&cap->mvar_stats, 0, sizeof(cap->mvar_stats));
     cap->context_switch = 0;
+    memset(&cap->block_cache, 0, sizeof(cap->block_cache));
+    cap->n_spt_cache = 0;
     cap->pinned_object_block = NULL;
     cap->pinned_object_blocks = NULL;
 
@@ -575,6 +675,7 @@ releaseCapability_ (Capability* cap,
     // anything else to do, give the Capability to a worker thread.
     if (always_wakeup ||
         !emptyRunQueue(cap) || !emptyInbox(cap) ||
+        !emptyOfferedThreadsCap(cap) ||
         (!cap->disabled && !emptySparkPoolCap(cap)) || globalWorkToDo()) {
         if (cap->spare_workers) {
             giveCapabilityToTask(cap, cap->spare_workers);
@@ -867,6 +968,7 @@ yieldCapability (Capability** pCap, Task *task, bool gcAllowed)
         PendingSync *sync = pending_sync;
 
         if (sync) {
+            recordSyncStop(cap, NULL);
             switch (sync->type) {
             case SYNC_GC_PAR:
                 if (! sync->idle[cap->no]) {
@@ -874,6 +976,7 @@ yieldCapability (Capability** pCap, Task *task, bool gcAllowed)
                     gcWorkerThread(cap);
                     traceEventGcEnd(cap);
                     traceSparkCounters(cap);
+                    traceMVarCounters(cap);
                     // See Note [migrated bound threads 2]
                     if (task->cap == cap) {
                         return true;
@@ -1116,6 +1219,7 @@ shutdownCapability (Capability *cap USED_IF_THREADS,
         }
 
         traceSparkCounters(cap);
+        traceMVarCounters(cap);
         RELEASE_LOCK(&cap->lock);
         break;
     }
@@ -1149,6 +1253,9 @@ freeCapability (Capability *cap)
     stgFree(cap->saved_mut_lists);
 #if defined(THREADED_RTS)
     freeSparkPool(cap->sparks);
+    if (cap->offered_threads != NULL) {
+        freeWSDeque(cap->offered_threads);
+    }
 #endif
     traceCapsetRemoveCap(CAPSET_OSPROCESS_DEFAULT, cap->no);
     traceCapsetRemoveCap(CAPSET_CLOCKDOMAIN_DEFAULT, cap->no);
@@ -1204,10 +1311,11 @@ markCapability (evac_fn evac, void *user, Capability *cap,
     if (!no_mark_sparks) {
         traverseSparkQueue (evac, user, cap);
     }
+    markOfferedThreads(evac, user, cap);
 #endif
 
-    // Free STM structures for this Capability
-    stmPreGCHook(cap);
+    // Keep the STM free lists for this Capability
+    stmMarkFreeLists(evac, user, cap);
 }
 
 void
@@ -1222,7 +1330,7 @@ markCapabilities (evac_fn evac, void *user)
 #if defined(THREADED_RTS)
 bool checkSparkCountInvariant (void)
 {
-    SparkCounters sparks = { 0, 0, 0, 0, 0, 0 };
+    SparkCounters sparks = { 0, 0, 0, 0, 0, 0, 0, 0 };
     StgWord64 remaining = 0;
     uint32_t i;
 
@@ -24,9 +24,26 @@
 #include "Task.h"
 #include "Sparks.h"
 #include "sm/NonMovingMark.h" // for MarkQueue
+#include "sm/BlockAlloc.h" // for BlockCache
+#include "StablePtr.h" // for STABLE_PTR_CACHE_SIZE
+#include "STM.h" // for StmCounters
+#include "Threads.h" // for MVarCounters, WakeupBatch
 
 #include "BeginPrivate.h"
 
+#if defined(THREADED_RTS)
+// What a Capability was running when it stopped for the last sync; see
+// Note [Time to safepoint] in Schedule.c
+typedef struct {
+    Time elapsed;            // when it stopped
+    StgThreadID tso;         // the thread it had been running, or 0
+    StgWord info;            // the info pointer of that thread's code, or 0
+#if defined(PROFILING)
+    CostCentreStack *ccs;    // and its cost-centre stack, or NULL
+#endif
+} SyncStop;
+#endif
+
 struct Capability_ {
     // State required by the STG virtual machine when running Haskell
     // code.  During STG execution, the BaseReg register always points
@@ -88,6 +105,18 @@ struct Capability_ {
     // The update remembered set for the non-moving collector
     UpdRemSet upd_rem_set;
 
+    // Small block groups cached for this Capability's allocBlock_lock etc.
+    // Only used in the threaded RTS; see Note [Per-capability block caches]
+    // in BlockAlloc.c.
+    BlockCache block_cache;
+
+    // Free stable pointer table slots, for getStablePtr() and
+    // freeStablePtr() to use without taking stable_ptr_mutex. Only used in
+    // the threaded RTS; see Note [Per-capability stable pointer caches] in
+    // StablePtr.c.
+    StgWord  spt_cache[STABLE_PTR_CACHE_SIZE];
+    uint32_t n_spt_cache;
+
     // block for allocating pinned objects into
     bdescr *pinned_object_block;
     // full pinned object blocks allocated since the last GC
@@ -146,21 +175,56 @@ struct Capability_ {
     // can't go on the inbox queue: the GC would get confused.
     struct PutMVar_ *putMVars;
 
+    // Wakeup messages for other Capabilities held back while we wake up
+    // a batch of threads; see Note [Batched wakeups] in Threads.c.
+    // Only touched by the running task.
+    uint32_t wakeup_batch_depth;
+    uint32_t n_wakeup_batches;
+    WakeupBatch wakeup_batches[WAKEUP_BATCH_CAPS];
+
     SparkPool *sparks;
 
     // Stats on spark creation/conversion
     SparkCounters spark_stats;
+
+    // Threads migrated away from this Capability, and how many of those
+    // went to a Capability on another NUMA node
+    StgWord threads_migrated;
+    StgWord threads_migrated_remote;
+
+    // New threads that idle Capabilities may steal, with +RTS -qs (NULL
+    // otherwise).  See Note [Work-stealing run queues] in Schedule.c.
+    WSDeque *offered_threads;
+
+    // Threads this Capability has stolen from others, and how many of
+    // those came from another NUMA node
+    StgWord threads_stolen;
+    StgWord threads_stolen_remote;
+
+    // When this Capability stopped for the last sync, and what it was doing
+    SyncStop sync_stop;
 #if !defined(mingw32_HOST_OS)
     // IO manager for this cap
     int io_manager_control_wr_fd;
 #endif
 #endif
 
+    // Stats on MVar blocking and handoffs, see
+    // Note [MVar wakeup statistics] in Threads.c
+    MVarCounters mvar_stats;
+
     // Per-capability STM-related data
     StgTVarWatchQueue *free_tvar_watch_queues;
     StgTRecChunk *free_trec_chunks;
     StgTRecHeader *free_trec_headers;
+    StmFreeListSizes stm_free_list_sizes;
     uint32_t transaction_tokens;
+    uint32_t stm_aborts;        // top-level commits failed in a row
+    StgTVar *stm_conflict;      // TVar that failed the current commit,
+                                // see Note [STM contention management]
+
+    // Stats on STM commits, aborts and allocation
+    StmCounters stm_stats;
 } // typedef Capability is defined in RtsAPI.h
   // We never want a Capability to overlap a cache line with anything
   // else, so round it up to a cache line size:
@@ -276,6 +340,7 @@ typedef struct {
                                 // cycle. Only available when doing GC (when
                                 // type is SYNC_GC_*).
     Task *task;                 // The Task performing the sync
+    Time start;                 // When the sync was requested
 } PendingSync;
 
 //
@@ -334,6 +399,18 @@ bool tryGrabCapability (Capability *cap, Task *task);
 //
 StgClosure *findSpark (Capability *cap);
 
+// An enabled Capability to take over the work of Capability number no,
+// on the same NUMA node if there is one.
+//
+Capability *enabledCapabilityNear (uint32_t no);
+
+INLINE_HEADER void countThreadMigration (Capability *from, Capability *to);
+
+// Record that cap has stopped for the pending sync, after running tso
+// (which may be NULL); see Note [Time to safepoint] in Schedule.c
+//
+void recordSyncStop (Capability *cap, StgTSO *tso);
+
 // True if any capabilities have sparks
 //
 bool anySparks (void);
@@ -342,6 +419,8 @@ INLINE_HEADER bool emptySparkPoolCap (Capability *cap);
 INLINE_HEADER uint32_t sparkPoolSizeCap  (Capability *cap);
 INLINE_HEADER void    discardSparksCap  (Capability *cap);
 
+INLINE_HEADER bool emptyOfferedThreadsCap (Capability *cap);
+
 #else // !THREADED_RTS
 
 // Grab a capability.  (Only in the non-threaded RTS; in the threaded
@@ -400,6 +479,17 @@ typedef struct PutMVar_ {
 
 INLINE_HEADER bool emptyInbox(Capability *cap);
 
+// Atomic, as a Capability that steals an offered thread counts the
+// migration against the Capability it took it from (claimOfferedThread())
+INLINE_HEADER void
+countThreadMigration (Capability *from, Capability *to)
+{
+    atomic_inc(&from->threads_migrated, 1);
+    if (from->node != to->node) {
+        atomic_inc(&from->threads_migrated_remote, 1);
+    }
+}
+
 #endif // THREADED_RTS
 
 /* -----------------------------------------------------------------------------
@@ -446,6 +536,13 @@ sparkPoolSizeCap (Capability *cap)
 INLINE_HEADER void
 discardSparksCap (Capability *cap)
 { discardSparks(cap->sparks); }
+
+INLINE_HEADER bool
+emptyOfferedThreadsCap (Capability *cap)
+{
+    return cap->offered_threads == NULL
+        || looksEmptyWSDeque(cap->offered_threads);
+}
 #endif
 
 INLINE_HEADER void
@@ -3,9 +3,8 @@
  * (c) The AQUA Project, Glasgow University, 1995-1998
  * (c) The GHC Team, 1999
  *
- * Dynamically expanding linear hash tables, as described in
- * Per-\AAke Larson, ``Dynamic Hash Tables,'' CACM 31(4), April 1988,
- * pp. 446 -- 457.
+ * Open-addressing hash tables using Robin Hood hashing with backward-shift
+ * deletion.  See Note [Robin Hood hash tables].
  * -------------------------------------------------------------------------- */
 
 #include "PosixSource.h"
@@ -17,38 +16,67 @@
 
 #include <string.h>
 
-#define HSEGSIZE    1024    /* Size of a single hash table segment */
-                            /* Also the minimum size of a hash table */
-#define HDIRSIZE    1024    /* Size of the segment directory */
-                            /* Maximum hash table size is HSEGSIZE * HDIRSIZE */
-#define HLOAD       5       /* Maximum average load of a single hash bucket */
-
-#define HCHUNK      (1024 * sizeof(W_) / sizeof(HashList))
-                            /* Number of HashList cells to allocate in one go */
-
-
-/* Linked list of (key, data) pairs for separate chaining */
-typedef struct hashlist {
+#define HINITSIZE   32      /* Initial number of slots (a power of 2) */
+#define HLOAD_NUM   3       /* Grow the table when more than */
+#define HLOAD_DEN   4       /* HLOAD_NUM/HLOAD_DEN of the slots are full */
+
+/* Note [Robin Hood hash tables]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A HashTable is a single power-of-two sized array of slots, probed
+   linearly.  Previously we used Larson's dynamic linear hashing with
+   separately chained HashList cells, so every lookup chased at least
+   one pointer per entry in the bucket; with open addressing a lookup
+   usually touches one or two cache lines.
+
+   Each slot holds a key, its data, and 32 bits of the key's hash.  A
+   hash of 0 marks an empty slot (hashes that really are 0 are mapped to
+   1).  The home slot of an entry is (hash & mask), and its probe
+   distance is how far it sits past its home slot.  Keeping the hash in
+   the slot means a probe only compares keys (which for string tables
+   means a strcmp) when the full hash matches, and growing the table
+   never calls the hash function.  We keep the hash next to the key
+   rather than in a separate array of hashes so that a lookup in a big
+   table usually costs a single cache miss rather than two.
+
+   Insertion uses the Robin Hood rule: walking forward from the home
+   slot, the entry being placed takes over the first slot whose occupant
+   is closer to its own home, and the evicted occupant carries on
+   looking for a slot.  This keeps each run of entries sorted by home
+   slot and keeps the variance of probe lengths small, and a lookup can
+   stop as soon as it meets an entry with a shorter probe distance than
+   its own.  We grow the table at a load factor of 3/4: higher loads
+   still give short lookups, but every insertion has to find an empty
+   slot, and the expected distance to one grows quadratically with
+   1/(1 - load).  Removal shifts the
+   following entries back by one slot until it reaches an empty slot or
+   an entry in its home slot, so there are no tombstones.
+
+   Inserting a key that is already present adds a second entry rather
+   than overwriting the first, and lookups must return the most recently
+   inserted one (the chained table behaved like this, and removing the
+   newer entry uncovers the older one).  Entries with equal keys have
+   equal hashes, so on insertion an entry also takes over a slot whose
+   occupant has the same probe distance *and* the same hash.  That puts
+   the new entry in front of any existing entries for its key, and moves
+   those along without reordering them.  When growing the table we walk
+   the old slots starting from an empty one, so that each run is visited
+   in order, and append entries behind those with the same hash instead.
+
+   The hash functions (hashWord, hashStr, and user-supplied ones, which
+   are usually built on hashWord) return a full-width hash rather than a
+   bucket index; the table does the masking itself.
+*/
+
+typedef struct {
     StgWord key;
     const void *data;
-    struct hashlist *next;  /* Next cell in bucket chain (same hash value) */
-} HashList;
-
-typedef struct chunklist {
-  HashList *chunk;
-  struct chunklist *next;
-} HashListChunk;
+    StgWord32 hash;         /* Hash of the key, or 0 if the slot is empty */
+} HashEntry;
 
 struct hashtable {
-    int split;              /* Next bucket to split when expanding */
-    int max;                /* Max bucket of smaller table */
-    int mask1;              /* Mask for doing the mod of h_1 (smaller table) */
-    int mask2;              /* Mask for doing the mod of h_2 (larger table) */
+    StgWord mask;           /* Number of slots - 1 */
     int kcount;             /* Number of keys */
-    int bcount;             /* Number of buckets */
-    HashList **dir[HDIRSIZE];   /* Directory of segments */
-    HashList *freeList;         /* free list of HashLists */
-    HashListChunk *chunks;
+    HashEntry *entries;     /* The slots */
 };
 
 /* Create an identical structure, but is distinct on a type level,
@@ -58,29 +86,33 @@ struct hashtable {
 struct strhashtable { struct hashtable table; };
 
 /* -----------------------------------------------------------------------------
- * Hash first using the smaller table.  If the bucket is less than the
- * next bucket to be split, re-hash using the larger table.
+ * Hash functions.  These return a well-mixed hash of the key; it is up to
+ * the table to reduce it to a slot index.
  * -------------------------------------------------------------------------- */
 int
-hashWord(const HashTable *table, StgWord key)
+hashWord(const HashTable *table STG_UNUSED, StgWord key)
 {
-    int bucket;
-
-    /* Strip the boring zero bits */
-    key >>= sizeof(StgWord);
-
-    /* Mod the size of the hash table (a power of 2) */
-    bucket = key & table->mask1;
-
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = key & table->mask2;
-    }
-    return bucket;
+    /* The finaliser of MurmurHash3: keys are often pointers, whose low bits
+     * are zero and high bits all the same, so every bit of the key needs to
+     * affect the low bits of the hash. */
+#if SIZEOF_VOID_P == 8
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    key *= UINT64_C(0xc4ceb9fe1a85ec53);
+    key ^= key >> 33;
+#else
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+#endif
+    return (int)key;
 }
 
 int
-hashStr(const HashTable *table, StgWord w)
+hashStr(const HashTable *table STG_UNUSED, StgWord w)
 {
     const char *key = (char*) w;
 #if defined(x86_64_HOST_ARCH)
@@ -88,16 +120,7 @@ hashStr(const HashTable *table, StgWord w)
 #else
     StgWord h = XXH32 (key, strlen(key), 1048583);
 #endif
-
-    /* Mod the size of the hash table (a power of 2) */
-    int bucket = h & table->mask1;
-
-    if (bucket < table->split) {
-        /* Mod the size of the expanded hash table (also a power of 2) */
-        bucket = h & table->mask2;
-    }
-
-    return bucket;
+    return (int)h;
 }
 
 STATIC_INLINE int
@@ -112,102 +135,116 @@ compareStr(StgWord key1, StgWord key2)
     return (strcmp((char *)key1, (char *)key2) == 0);
 }
 
+/* The hash stored in a slot; 0 is reserved for empty slots. */
+STATIC_INLINE StgWord32
+slotHash(int h)
+{
+    StgWord32 w = (StgWord32)h;
+    return w == 0 ? 1 : w;
+}
+
+/* How far the entry with hash h in slot i is from its home slot. */
+STATIC_INLINE StgWord
+probeDistance(const HashTable *table, StgWord32 h, StgWord i)
+{
+    return (i - h) & table->mask;
+}
 
 /* -----------------------------------------------------------------------------
- * Allocate a new segment of the dynamically growing hash table.
+ * Allocate the slots of a table with the given (power of 2) number of
+ * slots, all empty.
  * -------------------------------------------------------------------------- */
 
-STATIC_INLINE void
-allocSegment(HashTable *table, int segment)
+static void
+allocSlots(HashTable *table, StgWord size)
 {
-    table->dir[segment] = stgMallocBytes(HSEGSIZE * sizeof(HashList *),
-                                         "allocSegment");
+    table->entries = stgCallocBytes(size, sizeof(HashEntry), "allocSlots");
+    table->mask = size - 1;
 }
 
-
 /* -----------------------------------------------------------------------------
- * Expand the larger hash table by one bucket, and split one bucket
- * from the smaller table into two parts.  Only the bucket referenced
- * by @table->split@ is affected by the expansion.
+ * Place an entry, following the Robin Hood rule.  If `shadow` is true the
+ * entry goes in front of existing entries with the same hash, otherwise
+ * behind them; see Note [Robin Hood hash tables].
  * -------------------------------------------------------------------------- */
 
 STATIC_INLINE void
-expand(HashTable *table, HashFunction f)
+placeEntry(HashTable *table, StgWord32 h, StgWord key, const void *data,
+           bool shadow)
 {
-    int oldsegment;
-    int oldindex;
-    int newbucket;
-    int newsegment;
-    int newindex;
-    HashList *hl;
-    HashList *next;
-    HashList *old, *new;
-
-    if (table->split + table->max >= HDIRSIZE * HSEGSIZE)
-        /* Wow!  That's big.  Too big, so don't expand. */
-        return;
-
-    /* Calculate indices of bucket to split */
-    oldsegment = table->split / HSEGSIZE;
-    oldindex = table->split % HSEGSIZE;
-
-    newbucket = table->max + table->split;
-
-    /* And the indices of the new bucket */
-    newsegment = newbucket / HSEGSIZE;
-    newindex = newbucket % HSEGSIZE;
-
-    if (newindex == 0)
-        allocSegment(table, newsegment);
-
-    if (++table->split == table->max) {
-        table->split = 0;
-        table->max *= 2;
-        table->mask1 = table->mask2;
-        table->mask2 = table->mask2 << 1 | 1;
+    StgWord i = h & table->mask;
+    StgWord dist = 0;
+
+    for (;;) {
+        StgWord32 sh = table->entries[i].hash;
+        if (sh == 0) {
+            table->entries[i].hash = h;
+            table->entries[i].key = key;
+            table->entries[i].data = data;
+            return;
+        }
+        StgWord d = probeDistance(table, sh, i);
+        if (d < dist || (shadow && d == dist && sh == h)) {
+            HashEntry e = table->entries[i];
+            table->entries[i].hash = h;
+            table->entries[i].key = key;
+            table->entries[i].data = data;
+            h = sh;
+            key = e.key;
+            data = e.data;
+            dist = d;
+        }
+        i = (i + 1) & table->mask;
+        dist++;
     }
-    table->bcount++;
-
-    /* Split the bucket, paying no attention to the original order */
-
-    old = new = NULL;
-    for (hl = table->dir[oldsegment][oldindex]; hl != NULL; hl = next) {
-        next = hl->next;
-        if (f(table, hl->key) == newbucket) {
-            hl->next = new;
-            new = hl;
-        } else {
-            hl->next = old;
-            old = hl;
+}
+
+/* -----------------------------------------------------------------------------
+ * Double the number of slots and re-insert every entry.
+ * -------------------------------------------------------------------------- */
+
+static void
+expand(HashTable *table)
+{
+    StgWord old_size = table->mask + 1;
+    HashEntry *old_entries = table->entries;
+    StgWord start;
+
+    allocSlots(table, old_size * 2);
+
+    /* Start from an empty slot, so that each run is re-inserted in order.
+     * There always is one, because the load factor is below 1. */
+    for (start = 0; old_entries[start].hash != 0; start++);
+
+    for (StgWord n = 0; n < old_size; n++) {
+        StgWord i = (start + n) & (old_size - 1);
+        if (old_entries[i].hash != 0) {
+            placeEntry(table, old_entries[i].hash, old_entries[i].key,
+                       old_entries[i].data, false);
         }
     }
-    table->dir[oldsegment][oldindex] = old;
-    table->dir[newsegment][newindex] = new;
 
-    return;
+    stgFree(old_entries);
 }
 
 STATIC_INLINE void*
 lookupHashTable_inlined(const HashTable *table, StgWord key,
                         HashFunction f, CompareFunction cmp)
 {
-    int bucket;
-    int segment;
-    int index;
-
-    HashList *hl;
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (cmp(hl->key, key))
-            return (void *) hl->data;
+    const StgWord32 h = slotHash(f(table, key));
+    StgWord i = h & table->mask;
+
+    for (StgWord dist = 0; ; dist++) {
+        StgWord32 sh = table->entries[i].hash;
+        if (sh == 0 || probeDistance(table, sh, i) < dist) {
+            /* It's not there */
+            return NULL;
+        }
+        if (sh == h && cmp(table->entries[i].key, key)) {
+            return (void *) table->entries[i].data;
+        }
+        i = (i + 1) & table->mask;
     }
-
-    /* It's not there */
-    return NULL;
 }
 
 void *
@@ -236,94 +273,30 @@ lookupStrHashTable(const StrHashTable* table, const char* key)
 // If the table is modified concurrently, the function behavior is undefined.
 //
 int keysHashTable(HashTable *table, StgWord keys[], int szKeys) {
-    int segment, index;
     int k = 0;
-    HashList *hl;
-
-
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
 
-    while (segment >= 0 && k < szKeys) {
-        while (index >= 0 && k < szKeys) {
-            hl = table->dir[segment][index];
-            while (hl && k < szKeys) {
-                keys[k] = hl->key;
-                k += 1;
-                hl = hl->next;
-            }
-            index--;
+    for (StgWord i = 0; i <= table->mask && k < szKeys; i++) {
+        if (table->entries[i].hash != 0) {
+            keys[k] = table->entries[i].key;
+            k += 1;
         }
-        segment--;
-        index = HSEGSIZE - 1;
     }
     return k;
 }
 
-/* -----------------------------------------------------------------------------
- * We allocate the hashlist cells in large chunks to cut down on malloc
- * overhead.  Although we keep a free list of hashlist cells, we make
- * no effort to actually return the space to the malloc arena.
- * -------------------------------------------------------------------------- */
-
-static HashList *
-allocHashList (HashTable *table)
-{
-    HashList *hl, *p;
-    HashListChunk *cl;
-
-    if ((hl = table->freeList) != NULL) {
-        table->freeList = hl->next;
-    } else {
-        hl = stgMallocBytes(HCHUNK * sizeof(HashList), "allocHashList");
-        cl = stgMallocBytes(sizeof (*cl), "allocHashList: chunkList");
-        cl->chunk = hl;
-        cl->next = table->chunks;
-        table->chunks = cl;
-
-        table->freeList = hl + 1;
-        for (p = table->freeList; p < hl + HCHUNK - 1; p++)
-            p->next = p + 1;
-        p->next = NULL;
-    }
-    return hl;
-}
-
-static void
-freeHashList (HashTable *table, HashList *hl)
-{
-    hl->next = table->freeList;
-    table->freeList = hl;
-}
-
 STATIC_INLINE void
 insertHashTable_inlined(HashTable *table, StgWord key,
                         const void *data, HashFunction f)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-
     // Disable this assert; sometimes it's useful to be able to
     // overwrite entries in the hash table.
     // ASSERT(lookupHashTable(table, key) == NULL);
 
-    /* When the average load gets too high, we expand the table */
-    if (++table->kcount >= HLOAD * table->bcount)
-        expand(table, f);
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
+    /* When the load gets too high, we expand the table */
+    if ((StgWord)++table->kcount * HLOAD_DEN > (table->mask + 1) * HLOAD_NUM)
+        expand(table);
 
-    hl = allocHashList(table);
-
-    hl->key = key;
-    hl->data = data;
-    hl->next = table->dir[segment][index];
-    table->dir[segment][index] = hl;
+    placeEntry(table, slotHash(f(table, key)), key, data, true);
 }
 
 void
@@ -349,27 +322,31 @@ STATIC_INLINE void*
 removeHashTable_inlined(HashTable *table, StgWord key, const void *data,
                         HashFunction f, CompareFunction cmp)
 {
-    int bucket;
-    int segment;
-    int index;
-    HashList *hl;
-    HashList *prev = NULL;
-
-    bucket = f(table, key);
-    segment = bucket / HSEGSIZE;
-    index = bucket % HSEGSIZE;
-
-    for (hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-        if (cmp(hl->key, key) && (data == NULL || hl->data == data)) {
-            if (prev == NULL)
-                table->dir[segment][index] = hl->next;
-            else
-                prev->next = hl->next;
-            freeHashList(table,hl);
+    const StgWord32 h = slotHash(f(table, key));
+    StgWord i = h & table->mask;
+
+    for (StgWord dist = 0; ; dist++) {
+        StgWord32 sh = table->entries[i].hash;
+        if (sh == 0 || probeDistance(table, sh, i) < dist) {
+            break;
+        }
+        if (sh == h && cmp(table->entries[i].key, key) &&
+            (data == NULL || table->entries[i].data == data)) {
+            void *found = (void *) table->entries[i].data;
+
+            /* Shift the rest of the run back by one slot */
+            StgWord next = (i + 1) & table->mask;
+            while (table->entries[next].hash != 0 &&
+                   probeDistance(table, table->entries[next].hash, next) != 0) {
+                table->entries[i] = table->entries[next];
+                i = next;
+                next = (next + 1) & table->mask;
+            }
+            table->entries[i].hash = 0;
             table->kcount--;
-            return (void *) hl->data;
+            return found;
         }
-        prev = hl;
+        i = (i + 1) & table->mask;
     }
 
     /* It's not there */
@@ -406,34 +383,13 @@ removeStrHashTable(StrHashTable *table, const char * key, const void *data)
 void
 freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 {
-    long segment;
-    long index;
-    HashList *hl;
-    HashList *next;
-    HashListChunk *cl, *cl_next;
-
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    segment = (table->max + table->split - 1) / HSEGSIZE;
-    index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (hl = table->dir[segment][index]; hl != NULL; hl = next) {
-                next = hl->next;
-                if (freeDataFun != NULL)
-                    (*freeDataFun)((void *) hl->data);
-            }
-            index--;
+    if (freeDataFun != NULL) {
+        for (StgWord i = 0; i <= table->mask; i++) {
+            if (table->entries[i].hash != 0)
+                (*freeDataFun)((void *) table->entries[i].data);
         }
-        stgFree(table->dir[segment]);
-        segment--;
-        index = HSEGSIZE - 1;
-    }
-    for (cl = table->chunks; cl != NULL; cl = cl_next) {
-        cl_next = cl->next;
-        stgFree(cl->chunk);
-        stgFree(cl);
     }
+    stgFree(table->entries);
     stgFree(table);
 }
 
@@ -444,67 +400,35 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 void
 mapHashTable(HashTable *table, void *data, MapHashFn fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                fn(data, hl->key, hl->data);
-            }
-            index--;
-        }
-        segment--;
-        index = HSEGSIZE - 1;
+    for (StgWord i = 0; i <= table->mask; i++) {
+        if (table->entries[i].hash != 0)
+            fn(data, table->entries[i].key, table->entries[i].data);
     }
 }
 
 void
 mapHashTableKeys(HashTable *table, void *data, MapHashFnKeys fn)
 {
-    /* The last bucket with something in it is table->max + table->split - 1 */
-    long segment = (table->max + table->split - 1) / HSEGSIZE;
-    long index = (table->max + table->split - 1) % HSEGSIZE;
-
-    while (segment >= 0) {
-        while (index >= 0) {
-            for (HashList *hl = table->dir[segment][index]; hl != NULL; hl = hl->next) {
-                fn(data, &hl->key, hl->data);
-            }
-            index--;
-        }
-        segment--;
-        index = HSEGSIZE - 1;
+    for (StgWord i = 0; i <= table->mask; i++) {
+        if (table->entries[i].hash != 0)
+            fn(data, &table->entries[i].key, table->entries[i].data);
     }
 }
 
 /* -----------------------------------------------------------------------------
- * When we initialize a hash table, we set up the first segment as well,
- * initializing all of the first segment's hash buckets to NULL.
+ * When we initialize a hash table, we allocate a small array of empty slots;
+ * it is doubled whenever it gets too full.
  * -------------------------------------------------------------------------- */
 
 HashTable *
 allocHashTable(void)
 {
     HashTable *table;
-    HashList **hb;
 
     table = stgMallocBytes(sizeof(HashTable),"allocHashTable");
 
-    allocSegment(table, 0);
-
-    for (hb = table->dir[0]; hb < table->dir[0] + HSEGSIZE; hb++)
-        *hb = NULL;
-
-    table->split = 0;
-    table->max = HSEGSIZE;
-    table->mask1 = HSEGSIZE - 1;
-    table->mask2 = 2 * HSEGSIZE - 1;
+    allocSlots(table, HINITSIZE);
     table->kcount = 0;
-    table->bcount = HSEGSIZE;
-    table->freeList = NULL;
-    table->chunks = NULL;
 
     return table;
 }
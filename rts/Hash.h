@@ -63,6 +63,10 @@ void *      removeStrHashTable ( StrHashTable *table, const char * key,
  * it's not guaranteed. Either way, the functions are parameters
  * as the types should be statically known and thus
  * storing them is unnecessary.
+ *
+ * A HashFunction returns a hash of the whole key, not a bucket index; the
+ * table reduces it to a slot itself.  Hashes of custom keys are most easily
+ * built by combining the key's words into one and passing it to hashWord.
  */
 typedef int HashFunction(const HashTable *table, StgWord key);
 typedef int CompareFunction(StgWord key1, StgWord key2);
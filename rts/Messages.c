@@ -22,11 +22,20 @@
 #if defined(THREADED_RTS)
 
 void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
+{
+    sendMessages(from_cap, to_cap, msg, msg);
+}
+
+// Send a chain of messages, linked through their link fields from head to
+// tail, taking the lock and interrupting to_cap only once.  They will be
+// executed in order.  See Note [Batched wakeups] in Threads.c.
+void sendMessages(Capability *from_cap, Capability *to_cap,
+                  Message *head, Message *tail)
 {
     ACQUIRE_LOCK(&to_cap->lock);
 
+    for (Message *msg = head; ; msg = msg->link) {
 #if defined(DEBUG)
-    {
         const StgInfoTable *i = msg->header.info;
         if (i != &stg_MSG_THROWTO_info &&
             i != &stg_MSG_BLACKHOLE_info &&
@@ -35,13 +44,13 @@ void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
             i != &stg_WHITEHOLE_info) {
             barf("sendMessage: %p", i);
         }
-    }
 #endif
+        recordClosureMutated(from_cap,(StgClosure*)msg);
+        if (msg == tail) break;
+    }
 
-    msg->link = to_cap->inbox;
-    to_cap->inbox = msg;
-
-    recordClosureMutated(from_cap,(StgClosure*)msg);
+    tail->link = to_cap->inbox;
+    to_cap->inbox = head;
 
     if (to_cap->running_task == NULL) {
         to_cap->running_task = myTask();
@@ -72,9 +81,13 @@ loop:
     i = m->header.info;
     if (i == &stg_MSG_TRY_WAKEUP_info)
     {
-        StgTSO *tso = ((MessageWakeup *)m)->tso;
+        MessageWakeup *w = (MessageWakeup *)m;
+        StgTSO *tso = w->tso;
         debugTraceCap(DEBUG_sched, cap, "message: try wakeup thread %ld",
                       (W_)tso->id);
+        if (w->sent != 0) {
+            countMVarHandoff(cap, tso, w->sent);
+        }
         tryWakeupThread(cap, tso);
     }
     else if (i == &stg_MSG_THROWTO_info)
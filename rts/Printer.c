@@ -367,7 +367,10 @@ printClosure( const StgClosure *obj )
     case TVAR:
         {
           StgTVar* tv = (StgTVar*)obj;
-          debugBelch("TVAR(value=%p, wq=%p, num_updates=%" FMT_Word ")\n", tv->current_value, tv->first_watch_queue_entry, tv->num_updates);
+          debugBelch("TVAR(value=%p, wq=%p, num_updates=%" FMT_Word
+                     ", num_conflicts=%" FMT_Word ")\n", tv->current_value,
+                     tv->first_watch_queue_entry, tv->num_updates,
+                     tv->num_conflicts);
           break;
         }
 
@@ -21,6 +21,8 @@
 #include "Messages.h"
 #if defined(mingw32_HOST_OS)
 #include "win32/IOManager.h"
+#else
+#include "posix/Select.h"
 #endif
 
 static void blockedThrowTo (Capability *cap,
@@ -233,7 +235,6 @@ throwToMsg (Capability *cap, MessageThrowTo *msg)
 {
     StgWord status;
     StgTSO *target = msg->target;
-    Capability *target_cap;
 
     goto check_target;
 
@@ -259,9 +260,11 @@ check_target:
     traceThreadStatus(DEBUG_sched, target);
 #endif
 
-    target_cap = target->cap;
-    if (target->cap != cap) {
-        throwToSendMsg(cap, target_cap, msg);
+    // ownsThread() also takes back a thread that we had offered to
+    // other Capabilities, see Note [Work-stealing run queues] in
+    // Schedule.c
+    if (!ownsThread(cap, target)) {
+        throwToSendMsg(cap, target->cap, msg);
         return THROWTO_BLOCKED;
     }
 
@@ -704,8 +707,10 @@ removeFromQueues(Capability *cap, StgTSO *tso)
   case BlockedOnWrite:
 #if defined(mingw32_HOST_OS)
   case BlockedOnDoProc:
-#endif
       removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+#else
+      removeFromFdQueue(cap, tso);
+#endif
 #if defined(mingw32_HOST_OS)
       /* (Cooperatively) signal that the worker thread should abort
        * the request.
@@ -164,6 +164,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.oldGenFactor       = 2;
     RtsFlags.GcFlags.useNonmoving       = false;
     RtsFlags.GcFlags.nonmovingSelectorOpt = false;
+    RtsFlags.GcFlags.nonmovingMarkThreads = 1;
     RtsFlags.GcFlags.generations        = 2;
     RtsFlags.GcFlags.squeezeUpdFrames   = true;
     RtsFlags.GcFlags.compact            = false;
@@ -171,6 +172,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.sweep              = false;
     RtsFlags.GcFlags.idleGCDelayTime    = USToTime(300000); // 300ms
     RtsFlags.GcFlags.interIdleGCWait    = 0;
+    RtsFlags.GcFlags.idleGCSlice        = 0;
 #if defined(THREADED_RTS)
     RtsFlags.GcFlags.doIdleGC           = true;
 #else
@@ -180,8 +182,10 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.allocLimitGrace    = (100*1024) / BLOCK_SIZE;
     RtsFlags.GcFlags.numa               = false;
     RtsFlags.GcFlags.numaMask           = 1;
+    RtsFlags.GcFlags.hugePages          = HUGE_PAGES_NONE;
     RtsFlags.GcFlags.ringBell           = false;
     RtsFlags.GcFlags.longGCSync         = 0; /* detection turned off */
+    RtsFlags.GcFlags.finalizerThreads   = 0;
 
     RtsFlags.DebugFlags.scheduler       = false;
     RtsFlags.DebugFlags.interpreter     = false;
@@ -234,7 +238,12 @@ void initRtsFlagsDefaults(void)
     RtsFlags.TraceFlags.sparks_sampled= false;
     RtsFlags.TraceFlags.sparks_full   = false;
     RtsFlags.TraceFlags.user          = false;
+    RtsFlags.TraceFlags.stm           = false;
     RtsFlags.TraceFlags.trace_output  = NULL;
+    RtsFlags.TraceFlags.trace_socket  = NULL;
+    RtsFlags.TraceFlags.async_writer  = false;
+    RtsFlags.TraceFlags.buffer_size   = 2 * 1024 * 1024;
+    RtsFlags.TraceFlags.flight_recorder_size = 0;
 #endif
 
 #if defined(PROFILING)
@@ -254,10 +263,12 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.internalCounters        = false;
     RtsFlags.MiscFlags.linkerAlwaysPic         = DEFAULT_LINKER_ALWAYS_PIC;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+    RtsFlags.MiscFlags.ioUring                 = false;
 
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.nCapabilities     = 1;
     RtsFlags.ParFlags.migrate           = true;
+    RtsFlags.ParFlags.stealThreads      = false;
     RtsFlags.ParFlags.parGcEnabled      = 1;
     RtsFlags.ParFlags.parGcGen          = 0;
     RtsFlags.ParFlags.parGcLoadBalancingEnabled = true;
@@ -265,10 +276,12 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
     RtsFlags.ParFlags.setAffinity       = 0;
+    RtsFlags.ParFlags.stmVersionClock   = false;
+    RtsFlags.ParFlags.stmMaxAborts      = 8;
 #endif
 
 #if defined(THREADED_RTS)
-    RtsFlags.ParFlags.maxLocalSparks    = 4096;
+    RtsFlags.ParFlags.maxLocalSparks    = 1048576;
 #endif /* THREADED_RTS */
 
 #if defined(TICKY_TICKY)
@@ -312,6 +325,14 @@ usage_text[] = {
 "            will be searched from. This is useful if the default address",
 "            clashes with some third-party library.",
 "  -xn       Use the non-moving collector for the old generation.",
+#if defined(THREADED_RTS)
+"  --nonmoving-mark-threads=<n>",
+"            Use <n> threads to mark the heap in the non-moving collector",
+"            (default: 1)",
+"  --finalizer-threads=<n>",
+"            Run C finalizers on <n> dedicated OS threads instead of on idle",
+"            capabilities (default: 0, 0 == off)",
+#endif
 "  -m<n>     Minimum % of heap which must be available (default 3%)",
 "  -G<n>     Number of generations (default: 2)",
 "  -c<n>     Use in-place compaction instead of copying in the oldest generation",
@@ -320,8 +341,13 @@ usage_text[] = {
 "  -c       Use in-place compaction for all oldest generation collections",
 "           (the default is to use copying)",
 "  -w       Use mark-region for the oldest generation (experimental)",
+"  --huge-pages[=hugetlb]",
+"            Back the heap with 2MB transparent huge pages, or with",
+"            pages from the hugetlbfs pool if =hugetlb is given",
 #if defined(THREADED_RTS)
 "  -I<sec>  Perform full GC after <sec> idle time (default: 0.3, 0 == off)",
+"  -Is[<sec>] Let idle capabilities help the nonmoving collector in slices",
+"           of at most <sec> (default: off; 0.001 if <sec> is omitted)",
 #endif
 "",
 "  -T         Collect GC statistics (useful for in-program statistics access)",
@@ -383,6 +409,7 @@ usage_text[] = {
 "                s    scheduler events",
 "                g    GC and heap events",
 "                n    non-moving GC heap census events",
+"                m    STM commit and abort events",
 "                p    par spark events (sampled)",
 "                f    par spark events (full detail)",
 "                u    user events (emitted from Haskell code)",
@@ -392,6 +419,21 @@ usage_text[] = {
 #  endif
 "               -x    disable an event class, for any flag above",
 "             the initial enabled event classes are 'sgpu'",
+#  if defined(THREADED_RTS)
+"  --eventlog-async",
+"             Write the eventlog from a separate thread, dropping events",
+"             rather than stalling when it falls behind",
+#  endif
+#  if !defined(mingw32_HOST_OS)
+"  --eventlog-socket=<path>",
+"             Stream the eventlog to the Unix domain socket <path>",
+#  endif
+"  --eventlog-buffer-size=<size>",
+"             Size of each capability's event buffer (default: 2m)",
+"  --eventlog-flight-recorder[=<size>]",
+"             Keep only the last <size> bytes of events per capability in",
+"             memory (default: 8m), and write them out on exit, on a crash",
+"             or on SIGUSR2",
 #endif
 
 "  -i<sec>  Time between heap profile samples (seconds, default: 0.1)",
@@ -448,11 +490,18 @@ usage_text[] = {
 "  -qn<n>    Use <n> threads for parallel GC (defaults to value of -N)",
 "  -qa       Use the OS to set thread affinity (experimental)",
 "  -qm       Don't automatically migrate threads between CPUs",
+"  -qs       Let idle processors steal newly created threads",
 "  -qi<n>    If a processor has been idle for the last <n> GCs, do not",
 "            wake it up for a non-load-balancing parallel GC.",
 "            (0 disables,  default: 0)",
 "  --numa[=<node_mask>]",
 "            Use NUMA, nodes given by <node_mask> (default: off)",
+"  --stm-version-clock",
+"            Validate STM reads against a global version clock, so that",
+"            read-only transactions commit without touching their TVars",
+"  --stm-max-aborts=<n>",
+"            Run a transaction serialised with other contended transactions",
+"            after <n> aborts in a row (default: 8, 0 == never)",
 #if defined(DEBUG)
 "  --debug-numa[=<num_nodes>]",
 "            Pretend NUMA: like --numa, but without the system calls.",
@@ -462,6 +511,11 @@ usage_text[] = {
 #endif
 "  --install-signal-handlers=<yes|no>",
 "            Install signal handlers (default: yes)",
+#if !defined(THREADED_RTS) && defined(linux_HOST_OS)
+"  --io-uring",
+"            Wait for I/O using io_uring rather than epoll, if the kernel",
+"            supports it",
+#endif
 #if defined(mingw32_HOST_OS)
 "  --install-seh-handlers=<yes|no>",
 "            Install exception handlers (default: yes)",
@@ -475,7 +529,8 @@ usage_text[] = {
 "            made to resolve addresses to names. (default: yes)",
 #endif
 #if defined(THREADED_RTS)
-"  -e<n>     Maximum number of outstanding local sparks (default: 4096)",
+"  -e<n>     Maximum number of outstanding local sparks; spark pools grow",
+"            on demand up to this size (default: 1048576)",
 #endif
 #if defined(x86_64_HOST_ARCH)
 #if !DEFAULT_LINKER_ALWAYS_PIC
@@ -928,6 +983,74 @@ error = true;
                       OPTION_UNSAFE;
                       RtsFlags.MiscFlags.disableDelayedOsMemoryReturn = true;
                   }
+                  else if (strequal("huge-pages",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.hugePages = HUGE_PAGES_THP;
+                  }
+                  else if (strequal("huge-pages=hugetlb",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.hugePages = HUGE_PAGES_HUGETLB;
+                  }
+                  else if (strequal("eventlog-async",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(THREADED_BUILD_ONLY(
+                          RtsFlags.TraceFlags.async_writer = true;
+                          ));
+                  }
+                  else if (!strncmp("eventlog-socket=",
+                                    &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+#if defined(mingw32_HOST_OS)
+                      errorBelch("%s: not supported on Windows",
+                                 rts_argv[arg]);
+                      error = true;
+#else
+                      TRACING_BUILD_ONLY(
+                          if (strlen(&rts_argv[arg][18]) == 0) {
+                              errorBelch("%s: expects a socket path",
+                                         rts_argv[arg]);
+                              error = true;
+                          } else {
+                              RtsFlags.TraceFlags.trace_socket =
+                                  strdup(&rts_argv[arg][18]);
+                          }
+                          );
+#endif
+                  }
+                  else if (!strncmp("eventlog-buffer-size=",
+                                    &rts_argv[arg][2], 21)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.buffer_size =
+                              decodeSize(rts_argv[arg], 23, 64 * 1024,
+                                         HS_INT32_MAX);
+                          );
+                  }
+                  else if (strequal("eventlog-flight-recorder",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.flight_recorder_size =
+                              8 * 1024 * 1024;
+                          );
+                  }
+                  else if (!strncmp("eventlog-flight-recorder=",
+                                    &rts_argv[arg][2], 25)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.flight_recorder_size =
+                              decodeSize(rts_argv[arg], 27, 64 * 1024,
+                                         HS_INT_MAX);
+                          );
+                  }
+                  else if (strequal("io-uring",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.ioUring = true;
+                  }
                   else if (strequal("internal-counters",
                                     &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -945,6 +1068,55 @@ error = true;
                       RtsFlags.GcFlags.useNonmoving = true;
                   }
 #if defined(THREADED_RTS)
+                  else if (!strncmp("nonmoving-mark-threads=",
+                                    &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      int threads = strtol(rts_argv[arg]+25,
+                                           (char **) NULL, 10);
+                      if (threads <= 0) {
+                          errorBelch("%s: must be 1 or greater",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.GcFlags.nonmovingMarkThreads = threads;
+                      }
+                  }
+                  else if (!strncmp("finalizer-threads=",
+                                    &rts_argv[arg][2], 18)) {
+                      OPTION_SAFE;
+                      int threads = strtol(rts_argv[arg]+20,
+                                           (char **) NULL, 10);
+                      if (threads < 0) {
+                          errorBelch("%s: must be 0 or greater",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.GcFlags.finalizerThreads = threads;
+                      }
+                  }
+                  else if (strequal("stm-version-clock",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+#if SIZEOF_VOID_P == 8
+                      RtsFlags.ParFlags.stmVersionClock = true;
+#else
+                      errorBelch("%s: not supported on 32-bit platforms",
+                                 rts_argv[arg]);
+                      error = true;
+#endif
+                  }
+                  else if (!strncmp("stm-max-aborts=",
+                                    &rts_argv[arg][2], 15)) {
+                      OPTION_SAFE;
+                      int n = strtol(rts_argv[arg]+17, (char **) NULL, 10);
+                      if (n < 0) {
+                          errorBelch("%s: must be 0 or greater",
+                                     rts_argv[arg]);
+                          error = true;
+                      } else {
+                          RtsFlags.ParFlags.stmMaxAborts = n;
+                      }
+                  }
                   else if (!strncmp("numa", &rts_argv[arg][2], 4)) {
                       if (!osBuiltWithNumaSupport()) {
                           errorBelch("%s: This GHC build was compiled without NUMA support.",
@@ -1197,6 +1369,14 @@ error = true;
                           RtsFlags.GcFlags.interIdleGCWait = fsecondsToTime(atof(rts_argv[arg]+3));
                       }
                       break;
+                  /* length of idle-time nonmoving GC slices */
+                  case 's':
+                      if (rts_argv[arg][3] == '\0') {
+                          RtsFlags.GcFlags.idleGCSlice = MSToTime(1);
+                      } else {
+                          RtsFlags.GcFlags.idleGCSlice = fsecondsToTime(atof(rts_argv[arg]+3));
+                      }
+                      break;
                   /* idle delay before GC */
                   case '\0':
                       /* use default */
@@ -1465,6 +1645,9 @@ error = true;
                     case 'm':
                         RtsFlags.ParFlags.migrate = false;
                         break;
+                    case 's':
+                        RtsFlags.ParFlags.stealThreads = true;
+                        break;
                     case 'w':
                         // -qw was removed; accepted for backwards compat
                         break;
@@ -2229,6 +2412,10 @@ static void read_trace_flags(const char *arg)
             RtsFlags.TraceFlags.nonmoving_gc = enabled;
             enabled = true;
             break;
+        case 'm':
+            RtsFlags.TraceFlags.stm = enabled;
+            enabled = true;
+            break;
         case 'u':
             RtsFlags.TraceFlags.user      = enabled;
             enabled = true;
@@ -250,6 +250,11 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     /* initialise the stable name table */
     initStableNameTable();
 
+#if defined(THREADED_RTS)
+    /* start the C finalizer threads, if any */
+    initCFinalizerThreads();
+#endif
+
     /* Add some GC roots for things in the base package that the RTS
      * knows about.  We don't know whether these turn out to be CAFs
      * or refer to CAFs, but we have to assume that they might.
@@ -392,6 +397,11 @@ hs_exit_(bool wait_foreign)
      * collection if it's running */
     exitScheduler(wait_foreign);
 
+#if defined(THREADED_RTS)
+    /* run the C finalizers queued by the last GC and stop the threads */
+    exitCFinalizerThreads();
+#endif
+
     /* run C finalizers for all active weak pointers */
     for (i = 0; i < n_capabilities; i++) {
         runAllCFinalizers(capabilities[i]->weak_ptr_list_hd);
@@ -38,7 +38,8 @@
  *
  * STM_FG_LOCKS uses fine-grained locking -- locking is done on a per-TVar basis
  * and, when committing a transaction, no locks are acquired for TVars that have
- * been read but not updated.
+ * been read but not updated.  At runtime, STM_FG_LOCKS can also check reads
+ * against a global version clock, see Note [STM version clock].
  *
  * Concurrency control is implemented in the functions:
  *
@@ -336,6 +337,75 @@ static StgBool cond_lock_tvar(Capability *cap,
 
 /*......................................................................*/
 
+/* Note [STM version clock]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ * With STM_FG_LOCKS a commit validates every TVar the transaction read:
+ * validate_and_acquire_ownership and check_read_only each load the TVar's
+ * current_value and num_updates, so even a transaction that only reads
+ * touches the cache line of every TVar in its read set twice more at commit
+ * time, and these lines are the ones other capabilities are writing.
+ *
+ * The +RTS --stm-version-clock flag switches the STM_FG_LOCKS build to a
+ * scheme in the style of TL2 ("Transactional Locking II", Dice, Shalev and
+ * Shavit, DISC 2006), keeping the per-TVar locks described above:
+ *
+ *  - stm_clock is a global counter, bumped once by every committing
+ *    transaction that updates a TVar.  Each TVar's num_updates field holds
+ *    the stm_clock value of the last commit that wrote it.
+ *
+ *  - A top-level transaction samples stm_clock into its TRec's
+ *    read_version when it starts; nested TRecs inherit their parent's.
+ *
+ *  - When a TVar is first read from memory, read_versioned_value reads its
+ *    version on both sides of the value, so the pair is consistent.  If the
+ *    version is newer than read_version, somebody committed to the TVar
+ *    after we started, and what we have read so far may not be a snapshot
+ *    together with this value.  Rather than aborting at once we try to
+ *    extend read_version to the current clock by checking that every TVar
+ *    in the nest still holds the value we saw (extend_read_version); if any
+ *    doesn't the nest is condemned, otherwise we read the TVar again.
+ *
+ *  - So every value a transaction has read belongs to a snapshot taken at
+ *    read_version, and a read-only transaction can commit without looking
+ *    at its TVars at all.  An updating transaction locks the TVars it
+ *    writes, takes a write version from stm_clock and, only if some other
+ *    transaction committed since read_version, checks its read-only
+ *    entries.  It then stores the write version and the new value into each
+ *    updated TVar.  Commit-time work is thus proportional to the write set,
+ *    plus the read set only under contention.
+ *
+ *  - A nested transaction's reads are already consistent with its parent's,
+ *    so stmCommitNestedTransaction just merges its entries into the parent;
+ *    the top-level commit does the validation.
+ *
+ * Validation during GC and blocking (stmValidateNestOfTransactions, stmWait,
+ * stmReWait) is unchanged.  Versions are compared by magnitude, so the clock
+ * must never wrap around: the flag is only accepted on 64-bit platforms.
+ *
+ * The flag is off by default: the clock is a single shared cache line that
+ * every updating commit writes, which costs more than it saves for
+ * write-heavy workloads on many cores.
+ */
+
+#if defined(STM_FG_LOCKS)
+static volatile StgWord stm_clock = 0;
+#define USE_VERSION_CLOCK (RtsFlags.ParFlags.stmVersionClock)
+#else
+#define USE_VERSION_CLOCK false
+#endif
+
+static StgWord read_stm_clock(void) {
+#if defined(STM_FG_LOCKS)
+  StgWord result = stm_clock;
+  load_load_barrier();
+  return result;
+#else
+  return 0;
+#endif
+}
+
+/*......................................................................*/
+
 // Helper functions for thread blocking and unblocking
 
 static void park_tso(StgTSO *tso) {
@@ -381,11 +451,17 @@ static void unpark_waiters_on(Capability *cap, StgTVar *s) {
     trail = q;
   }
   q = trail;
+  if (q == END_STM_WATCH_QUEUE) {
+    return;
+  }
+  // see Note [Batched wakeups] in Threads.c
+  beginWakeupBatch(cap);
   for (;
        q != END_STM_WATCH_QUEUE;
        q = q -> prev_queue_entry) {
       unpark_tso(cap, (StgTSO *)(q -> closure));
   }
+  endWakeupBatch(cap);
 }
 
 /*......................................................................*/
@@ -397,6 +473,7 @@ static StgTVarWatchQueue *new_stg_tvar_watch_queue(Capability *cap,
   StgTVarWatchQueue *result;
   result = (StgTVarWatchQueue *)allocate(cap, sizeofW(StgTVarWatchQueue));
   SET_HDR (result, &stg_TVAR_WATCH_QUEUE_info, CCS_SYSTEM);
+  cap -> stm_stats.allocated ++;
   result -> closure = closure;
   return result;
 }
@@ -405,6 +482,7 @@ static StgTRecChunk *new_stg_trec_chunk(Capability *cap) {
   StgTRecChunk *result;
   result = (StgTRecChunk *)allocate(cap, sizeofW(StgTRecChunk));
   SET_HDR (result, &stg_TREC_CHUNK_info, CCS_SYSTEM);
+  cap -> stm_stats.allocated ++;
   result -> prev_chunk = END_STM_CHUNK_LIST;
   result -> next_entry_idx = 0;
   return result;
@@ -415,6 +493,7 @@ static StgTRecHeader *new_stg_trec_header(Capability *cap,
   StgTRecHeader *result;
   result = (StgTRecHeader *) allocate(cap, sizeofW(StgTRecHeader));
   SET_HDR (result, &stg_TREC_HEADER_info, CCS_SYSTEM);
+  cap -> stm_stats.allocated ++;
 
   result -> enclosing_trec = enclosing_trec;
   result -> current_chunk = new_stg_trec_chunk(cap);
@@ -435,8 +514,38 @@ static StgTRecHeader *new_stg_trec_header(Capability *cap,
 // Allocation / deallocation functions that retain per-capability lists
 // of closures that can be re-used
 
+/* Note [STM free lists]
+ * ~~~~~~~~~~~~~~~~~~~~~
+ * Every transaction needs a TRec header and enough TRec chunks for the
+ * TVars it touches, and every thread blocked in retry# needs a watch queue
+ * entry per TVar.  These are heap closures, so each Capability keeps free
+ * lists of them to avoid allocating afresh for every transaction.
+ *
+ * The free lists used to be dropped at every GC, so a program whose
+ * transactions span a GC, or that does nothing but run short transactions
+ * (and so fills the nursery with TRecs), kept allocating new ones.  Instead
+ * we now keep the free lists alive across GCs (stmMarkFreeLists, called from
+ * markCapability), and size them according to demand: each list records the
+ * fewest closures it has held since the last GC, and before each GC
+ * (stmPreGCHook) we release half of those, which have not been needed all
+ * along.  So a list grows to the number of closures the Capability's
+ * transactions have in flight at once, and shrinks again geometrically when
+ * the workload changes.  STM_FREE_LIST_MAX bounds each list.
+ *
+ * Free closures don't point at anything the mutator can see (see the free_*
+ * functions below), so that they don't keep old values alive.  Once they have
+ * been promoted they stay on the mutable list, which is why the lists are
+ * bounded and trimmed, as are all TREC_CHUNKs and MUT_PRIMs in the old
+ * generation.  With the nonmoving collector, which has no write barrier for
+ * the entries of TRec chunks (see mark_trec_header in NonMovingMark.c), we
+ * drop the free lists at each GC as before.
+ */
+
+#define STM_FREE_LIST_MAX 1024
+
 static StgTVarWatchQueue *alloc_stg_tvar_watch_queue(Capability *cap,
                                                      StgClosure *closure) {
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
   StgTVarWatchQueue *result = NULL;
   if (cap -> free_tvar_watch_queues == END_STM_WATCH_QUEUE) {
     result = new_stg_tvar_watch_queue(cap, closure);
@@ -444,6 +553,10 @@ static StgTVarWatchQueue *alloc_stg_tvar_watch_queue(Capability *cap,
     result = cap -> free_tvar_watch_queues;
     result -> closure = closure;
     cap -> free_tvar_watch_queues = result -> next_queue_entry;
+    cap -> stm_stats.reused ++;
+    if (--sz -> n_watch_queues < sz -> min_watch_queues) {
+      sz -> min_watch_queues = sz -> n_watch_queues;
+    }
   }
   return result;
 }
@@ -451,12 +564,19 @@ static StgTVarWatchQueue *alloc_stg_tvar_watch_queue(Capability *cap,
 static void free_stg_tvar_watch_queue(Capability *cap,
                                       StgTVarWatchQueue *wq) {
 #if defined(REUSE_MEMORY)
-  wq -> next_queue_entry = cap -> free_tvar_watch_queues;
-  cap -> free_tvar_watch_queues = wq;
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
+  if (sz -> n_watch_queues < STM_FREE_LIST_MAX) {
+    wq -> closure = (StgClosure *) END_TSO_QUEUE;
+    wq -> prev_queue_entry = END_STM_WATCH_QUEUE;
+    wq -> next_queue_entry = cap -> free_tvar_watch_queues;
+    cap -> free_tvar_watch_queues = wq;
+    sz -> n_watch_queues ++;
+  }
 #endif
 }
 
 static StgTRecChunk *alloc_stg_trec_chunk(Capability *cap) {
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
   StgTRecChunk *result = NULL;
   if (cap -> free_trec_chunks == END_STM_CHUNK_LIST) {
     result = new_stg_trec_chunk(cap);
@@ -465,6 +585,10 @@ static StgTRecChunk *alloc_stg_trec_chunk(Capability *cap) {
     cap -> free_trec_chunks = result -> prev_chunk;
     result -> prev_chunk = END_STM_CHUNK_LIST;
     result -> next_entry_idx = 0;
+    cap -> stm_stats.reused ++;
+    if (--sz -> n_chunks < sz -> min_chunks) {
+      sz -> min_chunks = sz -> n_chunks;
+    }
   }
   return result;
 }
@@ -472,19 +596,29 @@ static StgTRecChunk *alloc_stg_trec_chunk(Capability *cap) {
 static void free_stg_trec_chunk(Capability *cap,
                                 StgTRecChunk *c) {
 #if defined(REUSE_MEMORY)
-  c -> prev_chunk = cap -> free_trec_chunks;
-  cap -> free_trec_chunks = c;
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
+  if (sz -> n_chunks < STM_FREE_LIST_MAX) {
+    c -> next_entry_idx = 0;
+    c -> prev_chunk = cap -> free_trec_chunks;
+    cap -> free_trec_chunks = c;
+    sz -> n_chunks ++;
+  }
 #endif
 }
 
 static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
                                             StgTRecHeader *enclosing_trec) {
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
   StgTRecHeader *result = NULL;
   if (cap -> free_trec_headers == NO_TREC) {
     result = new_stg_trec_header(cap, enclosing_trec);
   } else {
     result = cap -> free_trec_headers;
     cap -> free_trec_headers = result -> enclosing_trec;
+    cap -> stm_stats.reused ++;
+    if (--sz -> n_headers < sz -> min_headers) {
+      sz -> min_headers = sz -> n_headers;
+    }
     result -> enclosing_trec = enclosing_trec;
     result -> current_chunk -> next_entry_idx = 0;
     if (enclosing_trec == NO_TREC) {
@@ -501,15 +635,20 @@ static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
 static void free_stg_trec_header(Capability *cap,
                                  StgTRecHeader *trec) {
 #if defined(REUSE_MEMORY)
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
   StgTRecChunk *chunk = trec -> current_chunk -> prev_chunk;
   while (chunk != END_STM_CHUNK_LIST) {
     StgTRecChunk *prev_chunk = chunk -> prev_chunk;
     free_stg_trec_chunk(cap, chunk);
     chunk = prev_chunk;
   }
-  trec -> current_chunk -> prev_chunk = END_STM_CHUNK_LIST;
-  trec -> enclosing_trec = cap -> free_trec_headers;
-  cap -> free_trec_headers = trec;
+  if (sz -> n_headers < STM_FREE_LIST_MAX) {
+    trec -> current_chunk -> prev_chunk = END_STM_CHUNK_LIST;
+    trec -> current_chunk -> next_entry_idx = 0;
+    trec -> enclosing_trec = cap -> free_trec_headers;
+    cap -> free_trec_headers = trec;
+    sz -> n_headers ++;
+  }
 #endif
 }
 
@@ -755,6 +894,14 @@ static void revert_ownership(Capability *cap STG_UNUSED,
 #endif
 }
 
+// note_conflict : record that s made the current transaction on cap fail
+// validation.  See Note [STM contention management].
+
+static void note_conflict(Capability *cap, StgTVar *s) {
+  s -> num_conflicts ++;
+  cap -> stm_conflict = s;
+}
+
 /*......................................................................*/
 
 // validate_and_acquire_ownership : this performs the twin functions
@@ -793,6 +940,7 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
         TRACE("%p : trying to acquire %p", trec, s);
         if (!cond_lock_tvar(cap, trec, s, e -> expected_value)) {
           TRACE("%p : failed to acquire %p", trec, s);
+          note_conflict(cap, s);
           result = false;
           BREAK_FOR_EACH;
         }
@@ -802,12 +950,14 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
           TRACE("%p : will need to check %p", trec, s);
           if (s -> current_value != e -> expected_value) {
             TRACE("%p : doesn't match", trec);
+            note_conflict(cap, s);
             result = false;
             BREAK_FOR_EACH;
           }
           e -> num_updates = s -> num_updates;
           if (s -> current_value != e -> expected_value) {
             TRACE("%p : doesn't match (race)", trec);
+            note_conflict(cap, s);
             result = false;
             BREAK_FOR_EACH;
           } else {
@@ -836,7 +986,8 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
 // Keir Fraser's PhD dissertation "Practical lock-free programming" discuss
 // this kind of algorithm.
 
-static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
+static StgBool check_read_only(Capability *cap STG_UNUSED,
+                               StgTRecHeader *trec STG_UNUSED) {
   StgBool result = true;
 
   ASSERT(config_use_read_phase);
@@ -853,6 +1004,7 @@ static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
         if (s -> current_value != e -> expected_value ||
             s -> num_updates != e -> num_updates) {
           TRACE("%p : mismatch", trec);
+          note_conflict(cap, s);
           result = false;
           BREAK_FOR_EACH;
         }
@@ -866,15 +1018,109 @@ static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
 
 /************************************************************************/
 
+// free_list_target : how many closures to keep on a free list of n closures,
+// at least min of which have not been used since the last GC.  See
+// Note [STM free lists].
+
+static uint32_t free_list_target(uint32_t n, uint32_t min) {
+  if (RtsFlags.GcFlags.useNonmoving) {
+    return 0;
+  }
+  return n - min / 2;
+}
+
 void stmPreGCHook (Capability *cap) {
+  StmFreeListSizes *sz = &cap -> stm_free_list_sizes;
+  uint32_t i, keep;
+
   lock_stm(NO_TREC);
   TRACE("stmPreGCHook");
-  cap->free_tvar_watch_queues = END_STM_WATCH_QUEUE;
-  cap->free_trec_chunks = END_STM_CHUNK_LIST;
-  cap->free_trec_headers = NO_TREC;
+
+  keep = free_list_target(sz -> n_watch_queues, sz -> min_watch_queues);
+  if (keep == 0) {
+    cap -> free_tvar_watch_queues = END_STM_WATCH_QUEUE;
+  } else if (keep < sz -> n_watch_queues) {
+    StgTVarWatchQueue *q = cap -> free_tvar_watch_queues;
+    for (i = 1; i < keep; i++) {
+      q = q -> next_queue_entry;
+    }
+    q -> next_queue_entry = END_STM_WATCH_QUEUE;
+  }
+  sz -> n_watch_queues = sz -> min_watch_queues = keep;
+
+  keep = free_list_target(sz -> n_chunks, sz -> min_chunks);
+  if (keep == 0) {
+    cap -> free_trec_chunks = END_STM_CHUNK_LIST;
+  } else if (keep < sz -> n_chunks) {
+    StgTRecChunk *c = cap -> free_trec_chunks;
+    for (i = 1; i < keep; i++) {
+      c = c -> prev_chunk;
+    }
+    c -> prev_chunk = END_STM_CHUNK_LIST;
+  }
+  sz -> n_chunks = sz -> min_chunks = keep;
+
+  keep = free_list_target(sz -> n_headers, sz -> min_headers);
+  if (keep == 0) {
+    cap -> free_trec_headers = NO_TREC;
+  } else if (keep < sz -> n_headers) {
+    StgTRecHeader *t = cap -> free_trec_headers;
+    for (i = 1; i < keep; i++) {
+      t = t -> enclosing_trec;
+    }
+    t -> enclosing_trec = NO_TREC;
+  }
+  sz -> n_headers = sz -> min_headers = keep;
+
   unlock_stm(NO_TREC);
 }
 
+void stmMarkFreeLists (evac_fn evac, void *user, Capability *cap) {
+  evac(user, (StgClosure **)(void *)&cap -> free_tvar_watch_queues);
+  evac(user, (StgClosure **)(void *)&cap -> free_trec_chunks);
+  evac(user, (StgClosure **)(void *)&cap -> free_trec_headers);
+}
+
+#if defined(TRACING)
+#define STM_TRACING RTS_UNLIKELY(TRACE_stm)
+#else
+#define STM_TRACING false
+#endif
+
+static void release_serial_token(StgTSO *tso);
+
+// count_commit : record a top-level commit attempt in the Capability's
+// stats for +RTS -s and in the eventlog, and keep track of how many commits
+// in a row have failed.  Counting the read and write sets means another pass
+// over the TRec, so we only do that when stats or events were asked for.
+
+static void count_commit(Capability *cap, StgTRecHeader *trec, StgBool committed) {
+  uint32_t reads = 0, writes = 0;
+
+  if (RtsFlags.GcFlags.giveStats != NO_GC_STATS || STM_TRACING) {
+    FOR_EACH_ENTRY(trec, e, {
+      if (entry_is_update(e)) {
+        writes ++;
+      } else {
+        reads ++;
+      }
+    });
+    cap -> stm_stats.reads += reads;
+    cap -> stm_stats.writes += writes;
+  }
+
+  if (committed) {
+    cap -> stm_stats.commits ++;
+    cap -> stm_aborts = 0;
+    release_serial_token(cap -> r.rCurrentTSO);
+    traceSTMCommit(cap, reads, writes);
+  } else {
+    cap -> stm_stats.aborts ++;
+    cap -> stm_aborts ++;
+    traceSTMAbort(cap, cap -> stm_conflict, cap -> stm_aborts);
+  }
+}
+
 /************************************************************************/
 
 // check_read_only relies on version numbers held in TVars' "num_updates"
@@ -914,6 +1160,117 @@ static void getToken(Capability *cap STG_UNUSED) {
 
 /*......................................................................*/
 
+/* Note [STM contention management]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A transaction that fails to commit is simply run again, so when several
+   Capabilities keep updating the same TVars they can go on invalidating
+   each other's work with little progress being made.  In the threaded RTS
+   we damp this in two ways:
+
+    - Backoff.  Before restarting a top-level transaction after a failed
+      commit, the Capability spins for a while: twice as long for each
+      commit that has failed in a row (capped at 2^STM_BACKOFF_MAX_SHIFT
+      iterations), plus some jitter derived from the Capability number so
+      that rivals don't all come back at once.
+
+    - Serialisation.  After +RTS --stm-max-aborts=<n> failed commits in a
+      row on a Capability, the thread starting the next transaction there
+      takes stm_serial_owner.  While it is held, other threads wait before
+      starting a top-level transaction, so the unlucky one gets a clear run.
+      The token belongs to the thread, not the Capability, and the thread
+      gives it back when its transaction commits, blocks in retry#, or
+      aborts (say, because of an exception), whichever Capability that
+      happens on.  It also gives it back whenever it stops running
+      (stmThreadDescheduled()), so a thread that is preempted, blocks,
+      migrates or is killed never holds the token while it isn't running.
+      An abort on behalf of another thread (raiseAsync()) can therefore
+      never be for the owner, which is why stmAbortTransaction() only
+      releases the token for the thread running on the Capability.
+
+   Both are soft: all the waiting is bounded by STM_SERIAL_MAX_SPINS, so a
+   token holder that is stuck in a long transaction can't stall everyone
+   else, who just go ahead without it.  None of this affects correctness,
+   only who is likely to win a conflict.
+
+   The abort count is kept per Capability rather than per thread.  That's
+   good enough: what we want to damp is a Capability whose transactions keep
+   failing, whichever thread is running them.
+
+   Every failed validation also bumps num_conflicts in the TVar at fault
+   (racily, it's only a statistic) and remembers it in cap->stm_conflict,
+   which the STM abort event reports along with the count (+RTS -lm), so
+   that the hot TVars in a program can be found from its eventlog.
+   stm_conflict is reset at the start of each commit and only read in the
+   same commit, so the GC can't have moved the TVar in between.
+*/
+
+#if defined(THREADED_RTS)
+#define STM_BACKOFF_MAX_SHIFT 10
+#define STM_SERIAL_MAX_SPINS  (1 << 14)
+
+// The id of the thread running serialised, or 0.  Thread ids start at 1;
+// we keep the id rather than the TSO because the GC moves TSOs.
+static volatile StgWord stm_serial_owner = 0;
+
+static void stm_backoff(Capability *cap) {
+  uint32_t aborts = cap -> stm_aborts;
+  uint32_t max_aborts = RtsFlags.ParFlags.stmMaxAborts;
+  StgWord me = (StgWord) cap -> r.rCurrentTSO -> id;
+
+  if (aborts > 0) {
+    uint32_t shift = stg_min(aborts, STM_BACKOFF_MAX_SHIFT);
+    uint32_t jitter = ((cap -> no + 1) * 2654435761u) ^ (aborts * 40503u);
+    uint32_t spins = (1u << shift) + (jitter & ((1u << shift) - 1));
+    TRACE("%p : backing off for %d spins after %d aborts", cap, spins, aborts);
+    for (uint32_t i = 0; i < spins; i++) {
+      busy_wait_nop();
+    }
+  }
+
+  if (max_aborts != 0 && aborts >= max_aborts) {
+    if (stm_serial_owner != me) {
+      for (uint32_t i = 0; i < STM_SERIAL_MAX_SPINS; i++) {
+        if (cas(&stm_serial_owner, 0, me) == 0) {
+          TRACE("%p : running serialised after %d aborts", cap, aborts);
+          cap -> stm_stats.serialised ++;
+          break;
+        }
+        busy_wait_nop();
+      }
+    }
+  } else {
+    for (uint32_t i = 0; i < STM_SERIAL_MAX_SPINS; i++) {
+      StgWord owner = stm_serial_owner;
+      if (owner == 0 || owner == me) {
+        break;
+      }
+      busy_wait_nop();
+    }
+  }
+}
+
+static void release_serial_token(StgTSO *tso) {
+  if (stm_serial_owner == (StgWord) tso -> id) {
+    write_barrier();
+    stm_serial_owner = 0;
+  }
+}
+#else
+static void stm_backoff(Capability *cap STG_UNUSED) {
+  // Nothing
+}
+
+static void release_serial_token(StgTSO *tso STG_UNUSED) {
+  // Nothing
+}
+#endif
+
+void stmThreadDescheduled(StgTSO *tso) {
+  release_serial_token(tso);
+}
+
+/*......................................................................*/
+
 StgTRecHeader *stmStartTransaction(Capability *cap,
                                    StgTRecHeader *outer) {
   StgTRecHeader *t;
@@ -923,7 +1280,13 @@ StgTRecHeader *stmStartTransaction(Capability *cap,
 
   getToken(cap);
 
+  if (outer == NO_TREC) {
+    stm_backoff(cap);
+  }
+
   t = alloc_stg_trec_header(cap, outer);
+  t -> read_version = (outer == NO_TREC) ? read_stm_clock()
+                                         : outer -> read_version;
   TRACE("%p : stmStartTransaction()=%p", outer, t);
   return t;
 }
@@ -952,6 +1315,12 @@ void stmAbortTransaction(Capability *cap,
       TRACE("%p : stmAbortTransaction aborting waiting transaction", trec);
       remove_watch_queue_entries_for_trec(cap, trec);
     }
+    // Only a running thread can hold the token; see
+    // Note [STM contention management]
+    StgTSO *tso = cap -> r.rCurrentTSO;
+    if (tso != NULL && tso -> trec == trec) {
+      release_serial_token(tso);
+    }
 
   } else {
     // We're a nested transaction: merge our read set into our parent's
@@ -1061,6 +1430,106 @@ static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeade
 
 /*......................................................................*/
 
+#if defined(STM_FG_LOCKS)
+// acquire_updates : lock the TVars that trec updates, recording in
+// *has_updates whether there were any.  Unlike validate_and_acquire_ownership
+// this doesn't look at the TVars that were only read.
+
+static StgBool acquire_updates(Capability *cap,
+                               StgTRecHeader *trec,
+                               StgBool *has_updates) {
+  StgBool result = (trec -> state != TREC_CONDEMNED) && !shake();
+
+  *has_updates = false;
+  if (result) {
+    FOR_EACH_ENTRY(trec, e, {
+      if (entry_is_update(e)) {
+        *has_updates = true;
+        if (!cond_lock_tvar(cap, trec, e -> tvar, e -> expected_value)) {
+          TRACE("%p : failed to acquire %p", trec, e -> tvar);
+          note_conflict(cap, e -> tvar);
+          result = false;
+          BREAK_FOR_EACH;
+        }
+      }
+    });
+  }
+
+  if (!result) {
+    revert_ownership(cap, trec, false);
+  }
+  return result;
+}
+
+// check_read_versions : check that no TVar that trec only read has been
+// written since its read_version.  A TVar locked by a rival commit holds the
+// rival's TRec, so the value check also catches commits in progress.
+
+static StgBool check_read_versions(Capability *cap, StgTRecHeader *trec) {
+  StgBool result = true;
+
+  FOR_EACH_ENTRY(trec, e, {
+    if (entry_is_read_only(e)) {
+      StgTVar *s = e -> tvar;
+      if (s -> current_value != e -> expected_value ||
+          (StgWord) s -> num_updates > trec -> read_version) {
+        TRACE("%p : read of %p invalidated", trec, s);
+        note_conflict(cap, s);
+        result = false;
+        BREAK_FOR_EACH;
+      }
+    }
+  });
+
+  return result;
+}
+
+// commit_with_version_clock : commit a top-level transaction whose reads
+// were checked against read_version as it ran.  See Note [STM version clock].
+
+static StgBool commit_with_version_clock(Capability *cap, StgTRecHeader *trec) {
+  StgBool has_updates;
+
+  if (!acquire_updates(cap, trec, &has_updates)) {
+    return false;
+  }
+
+  if (!has_updates) {
+    // Everything we read was consistent at read_version, which is the
+    // linearization point of a read-only transaction.
+    TRACE("%p : read-only commit at version %" FMT_Word, trec,
+          trec -> read_version);
+    return true;
+  }
+
+  StgWord write_version = atomic_inc(&stm_clock, 1);
+
+  // If nobody else committed since we started there is nothing to check.
+  if (write_version != trec -> read_version + 1 &&
+      !check_read_versions(cap, trec)) {
+    revert_ownership(cap, trec, false);
+    return false;
+  }
+
+  FOR_EACH_ENTRY(trec, e, {
+    if (entry_is_update(e)) {
+      StgTVar *s = e -> tvar;
+      ACQ_ASSERT(tvar_is_locked(s, trec));
+      TRACE("%p : writing %p to %p at version %" FMT_Word ", waking waiters",
+            trec, e -> new_value, s, write_version);
+      unpark_waiters_on(cap, s);
+      // the version must be visible before the lock is released, see
+      // read_versioned_value
+      s -> num_updates = write_version;
+      write_barrier();
+      unlock_tvar(cap, trec, s, e -> new_value, true);
+    }
+  });
+
+  return true;
+}
+#endif
+
 StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   StgInt64 max_commits_at_start = max_commits;
 
@@ -1073,6 +1542,19 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
+  cap -> stm_conflict = NULL;
+
+#if defined(STM_FG_LOCKS)
+  if (USE_VERSION_CLOCK) {
+    bool result = commit_with_version_clock(cap, trec);
+    unlock_stm(trec);
+    count_commit(cap, trec, result);
+    free_stg_trec_header(cap, trec);
+    TRACE("%p : stmCommitTransaction()=%d", trec, result);
+    return result;
+  }
+#endif
+
   // Use a read-phase (i.e. don't lock TVars we've read but not updated) if
   // the configuration lets us use a read phase.
 
@@ -1085,7 +1567,7 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
       StgInt64 max_commits_at_end;
       StgInt64 max_concurrent_commits;
       TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
+      result = check_read_only(cap, trec);
       TRACE("%p : read-check %s", trec, result ? "succeeded" : "failed");
 
       max_commits_at_end = max_commits;
@@ -1126,6 +1608,7 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
   unlock_stm(trec);
 
+  count_commit(cap, trec, result);
   free_stg_trec_header(cap, trec);
 
   TRACE("%p : stmCommitTransaction()=%d", trec, result);
@@ -1135,6 +1618,23 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
 /*......................................................................*/
 
+// merge_nested_transaction : with the version clock a nested transaction's
+// reads are consistent with its parent's at read_version, so there is
+// nothing to validate: merge its entries into the parent and leave the
+// checking to the top-level commit.  See Note [STM version clock].
+
+static StgBool merge_nested_transaction(Capability *cap, StgTRecHeader *trec) {
+  StgTRecHeader *et = trec -> enclosing_trec;
+
+  if (trec -> state == TREC_CONDEMNED) {
+    return false;
+  }
+  FOR_EACH_ENTRY(trec, e, {
+    merge_update_into(cap, et, e -> tvar, e -> expected_value, e -> new_value);
+  });
+  return true;
+}
+
 StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
   StgTRecHeader *et;
   ASSERT(trec != NO_TREC && trec -> enclosing_trec != NO_TREC);
@@ -1144,13 +1644,22 @@ StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
   lock_stm(trec);
 
   et = trec -> enclosing_trec;
+
+  if (USE_VERSION_CLOCK) {
+    bool result = merge_nested_transaction(cap, trec);
+    unlock_stm(trec);
+    free_stg_trec_header(cap, trec);
+    TRACE("%p : stmCommitNestedTransaction()=%d", trec, result);
+    return result;
+  }
+
   bool result = validate_and_acquire_ownership(cap, trec, (!config_use_read_phase), true);
   if (result) {
     // We now know that all the updated locations hold their expected values.
 
     if (config_use_read_phase) {
       TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
+      result = check_read_only(cap, trec);
     }
     if (result) {
       // We now know that all of the read-only locations held their expected values
@@ -1206,6 +1715,9 @@ StgBool stmWait(Capability *cap, StgTSO *tso, StgTRecHeader *trec) {
     build_watch_queue_entries_for_trec(cap, tso, trec);
     park_tso(tso);
     trec -> state = TREC_WAITING;
+    cap -> stm_stats.retries ++;
+    cap -> stm_aborts = 0;
+    release_serial_token(tso);
 
     // We haven't released ownership of the transaction yet.  The TSO
     // has been put on the wait queue for the TVars it is waiting for,
@@ -1282,6 +1794,71 @@ static StgClosure *read_current_value(StgTRecHeader *trec STG_UNUSED, StgTVar *t
   return result;
 }
 
+#if defined(STM_FG_LOCKS)
+// extend_read_version : move the read_version of a nest of transactions up
+// to the current clock, if everything read so far still holds the value we
+// saw.  Otherwise condemn the nest.  See Note [STM version clock].
+
+static StgBool extend_read_version(StgTRecHeader *trec) {
+  StgWord now = read_stm_clock();
+  StgTRecHeader *t;
+
+  TRACE("%p : extending read version %" FMT_Word " to %" FMT_Word,
+        trec, trec -> read_version, now);
+  for (t = trec; t != NO_TREC; t = t -> enclosing_trec) {
+    StgBool valid = true;
+    FOR_EACH_ENTRY(t, e, {
+      if (e -> tvar -> current_value != e -> expected_value) {
+        valid = false;
+        BREAK_FOR_EACH;
+      }
+    });
+    if (!valid) {
+      TRACE("%p : cannot extend read version, condemning", trec);
+      for (t = trec; t != NO_TREC; t = t -> enclosing_trec) {
+        t -> state = TREC_CONDEMNED;
+      }
+      return false;
+    }
+  }
+
+  for (t = trec; t != NO_TREC; t = t -> enclosing_trec) {
+    t -> read_version = now;
+  }
+  return true;
+}
+#endif
+
+// read_versioned_value : read a TVar that the nest of transactions hasn't
+// seen yet, making sure that its value is consistent with everything
+// else the nest has read.
+
+static StgClosure *read_versioned_value(StgTRecHeader *trec, StgTVar *tvar) {
+#if defined(STM_FG_LOCKS)
+  if (USE_VERSION_CLOCK) {
+    StgClosure *result;
+    StgWord version;
+
+    while (true) {
+      do {
+        version = tvar -> num_updates;
+        load_load_barrier();
+        result = read_current_value(trec, tvar);
+        load_load_barrier();
+      } while ((StgWord) tvar -> num_updates != version);
+
+      if (version <= trec -> read_version ||
+          trec -> state == TREC_CONDEMNED ||
+          !extend_read_version(trec)) {
+        return result;
+      }
+      // read it again, it may have changed before the clock we extended to
+    }
+  }
+#endif
+  return read_current_value(trec, tvar);
+}
+
 /*......................................................................*/
 
 StgClosure *stmReadTVar(Capability *cap,
@@ -1311,7 +1888,7 @@ StgClosure *stmReadTVar(Capability *cap,
     }
   } else {
     // No entry found
-    StgClosure *current_value = read_current_value(trec, tvar);
+    StgClosure *current_value = read_versioned_value(trec, tvar);
     TRecEntry *new_entry = get_new_entry(cap, trec);
     new_entry -> tvar = tvar;
     new_entry -> expected_value = current_value;
@@ -39,16 +39,50 @@
 #define STM_UNIPROC
 #endif
 
+#include "sm/GC.h" // for evac_fn
+
 #include "BeginPrivate.h"
 
+/*----------------------------------------------------------------------
+
+   Statistics
+   ----------
+*/
+
+/* Per-Capability counters, summed for +RTS -s */
+typedef struct {
+    StgWord commits;    /* top-level transactions committed */
+    StgWord aborts;     /* top-level commits that failed validation */
+    StgWord retries;    /* transactions that blocked in retry# */
+    StgWord reads;      /* TVars read but not written, summed over all
+                         * top-level commit attempts */
+    StgWord writes;     /* TVars written, likewise */
+    StgWord allocated;  /* TRec headers, TRec chunks and watch queue
+                         * entries allocated in the heap */
+    StgWord reused;     /* ... and taken from the Capability's free lists */
+    StgWord serialised; /* transactions run serialised after repeated
+                         * aborts, see Note [STM contention management] */
+} StmCounters;
+
+/* Occupancy of a Capability's free lists, see Note [STM free lists] */
+typedef struct {
+    uint32_t n_headers, n_chunks, n_watch_queues;
+    uint32_t min_headers, min_chunks, min_watch_queues;
+                        /* fewest on each list since the last GC */
+} StmFreeListSizes;
+
 /*----------------------------------------------------------------------
 
    GC interaction
    --------------
 */
 
+/* Trim the Capability's free lists before a GC */
 void stmPreGCHook(Capability *cap);
 
+/* Mark what is left of them during the GC */
+void stmMarkFreeLists(evac_fn evac, void *user, Capability *cap);
+
 /*----------------------------------------------------------------------
 
    Transaction context management
@@ -82,6 +116,14 @@ void stmFreeAbortedTRec(Capability *cap, StgTRecHeader *trec);
 
 void stmCondemnTransaction(Capability *cap, StgTRecHeader *trec);
 
+/*
+ * Called by the scheduler whenever tso stops running, to give back the
+ * token for running serialised if tso holds it.  See Note [STM contention
+ * management].
+ */
+
+void stmThreadDescheduled(StgTSO *tso);
+
 /*----------------------------------------------------------------------
 
    Validation
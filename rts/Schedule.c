@@ -34,6 +34,8 @@
 #include "AwaitEvent.h"
 #if defined(mingw32_HOST_OS)
 #include "win32/IOManager.h"
+#else
+#include "posix/Select.h"
 #endif
 #include "Trace.h"
 #include "RaiseAsync.h"
@@ -155,6 +157,9 @@ static void scheduleDetectDeadlock (Capability **pcap, Task *task);
 static void schedulePushWork(Capability *cap, Task *task);
 #if defined(THREADED_RTS)
 static void scheduleActivateSpark(Capability *cap);
+static bool offerThread(Capability *cap, StgTSO *tso);
+static void scheduleStealThread(Capability *cap);
+static void reclaimOfferedThreads(Capability *cap);
 #endif
 static void schedulePostRunThread(Capability *cap, StgTSO *t);
 static bool scheduleHandleHeapOverflow( Capability *cap, StgTSO *t );
@@ -164,6 +169,9 @@ static void scheduleHandleThreadBlocked( StgTSO *t );
 static bool scheduleHandleThreadFinished( Capability *cap, Task *task,
                                           StgTSO *t );
 static bool scheduleNeedHeapProfile(bool ready_to_gc);
+#if defined(TRACING)
+static void scheduleDumpEventLog(Capability **pcap, Task *task);
+#endif
 static void scheduleDoGC( Capability **pcap, Task *task,
                           bool force_major, bool deadlock_detect );
 
@@ -287,6 +295,12 @@ schedule (Capability *initialCapability, Task *task)
         barf("sched_state: %" FMT_Word, sched_state);
     }
 
+#if defined(TRACING)
+    if (eventlog_dump_requested) {
+        scheduleDumpEventLog(&cap,task);
+    }
+#endif
+
     scheduleFindWork(&cap);
 
     /* work pushing, currently relevant only for THREADED_RTS:
@@ -380,7 +394,7 @@ schedule (Capability *initialCapability, Task *task)
     // it was originally on.
 #if defined(THREADED_RTS)
     if (cap->disabled && !t->bound) {
-        Capability *dest_cap = capabilities[cap->no % enabled_capabilities];
+        Capability *dest_cap = enabledCapabilityNear(cap->no);
         migrateThread(cap, t, dest_cap);
         continue;
     }
@@ -489,6 +503,8 @@ run_thread:
     // don't want it set when not running a Haskell thread.
     cap->r.rCurrentTSO = NULL;
 
+    stmThreadDescheduled(t);
+
     // And save the current errno in this thread.
     // XXX: possibly bogus for SMP because this thread might already
     // be running again, see code below.
@@ -517,6 +533,13 @@ run_thread:
     ASSERT_FULL_CAPABILITY_INVARIANTS(cap,task);
     ASSERT(t->cap == cap);
 
+#if defined(THREADED_RTS)
+    // See Note [Time to safepoint]
+    if (RTS_UNLIKELY(pending_sync != NULL)) {
+        recordSyncStop(cap, t);
+    }
+#endif
+
     // ----------------------------------------------------------------------
 
     // Costs for the scheduler are assigned to CCS_SYSTEM
@@ -629,6 +652,7 @@ scheduleFindWork (Capability **pcap)
     scheduleCheckBlockedThreads(*pcap);
 
 #if defined(THREADED_RTS)
+    if ((*pcap)->offered_threads != NULL) { scheduleStealThread(*pcap); }
     if (emptyRunQueue(*pcap)) { scheduleActivateSpark(*pcap); }
 #endif
 }
@@ -717,7 +741,7 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
 #if defined(THREADED_RTS)
 
     Capability *free_caps[n_capabilities], *cap0;
-    uint32_t i, n_wanted_caps, n_free_caps;
+    uint32_t i, n_wanted_caps, n_free_caps, remote;
 
     uint32_t spare_threads = cap->n_run_queue > 0 ? cap->n_run_queue - 1 : 0;
 
@@ -731,21 +755,32 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
     n_wanted_caps = sparkPoolSizeCap(cap) + spare_threads;
     if (n_wanted_caps == 0) return;
 
-    // First grab as many free Capabilities as we can.  ToDo: we should use
-    // capabilities on the same NUMA node preferably, but not exclusively.
-    for (i = (cap->no + 1) % n_capabilities, n_free_caps=0;
-         n_free_caps < n_wanted_caps && i != cap->no;
-         i = (i + 1) % n_capabilities) {
-        cap0 = capabilities[i];
-        if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
-            if (!emptyRunQueue(cap0)
-                || cap0->n_returning_tasks != 0
-                || !emptyInbox(cap0)) {
-                // it already has some work, we just grabbed it at
-                // the wrong moment.  Or maybe it's deadlocked!
-                releaseCapability(cap0);
-            } else {
-                free_caps[n_free_caps++] = cap0;
+    // First grab as many free Capabilities as we can.  We use capabilities
+    // on the same NUMA node preferably, but not exclusively: the threads
+    // we push keep their heap in our node's memory, and sparks point into
+    // it, so only go to other nodes if there aren't enough free
+    // capabilities on ours.  The free capabilities on our node come first
+    // in free_caps[], so they get the first share of the threads below.
+    n_free_caps = 0;
+    for (remote = 0; remote < (n_numa_nodes > 1 ? 2 : 1); remote++) {
+        for (i = (cap->no + 1) % n_capabilities;
+             n_free_caps < n_wanted_caps && i != cap->no;
+             i = (i + 1) % n_capabilities) {
+            cap0 = capabilities[i];
+            if (n_numa_nodes > 1 &&
+                (cap0->node != cap->node) != (remote != 0)) {
+                continue;
+            }
+            if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
+                if (!emptyRunQueue(cap0)
+                    || cap0->n_returning_tasks != 0
+                    || !emptyInbox(cap0)) {
+                    // it already has some work, we just grabbed it at
+                    // the wrong moment.  Or maybe it's deadlocked!
+                    releaseCapability(cap0);
+                } else {
+                    free_caps[n_free_caps++] = cap0;
+                }
             }
         }
     }
@@ -820,6 +855,7 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
             else {
                 appendToRunQueue(free_caps[i],t);
                 traceEventMigrateThread (cap, t, free_caps[i]->no);
+                countThreadMigration(cap, free_caps[i]);
 
                 if (t->bound) { t->bound->task->cap = free_caps[i]; }
                 t->cap = free_caps[i];
@@ -896,7 +932,7 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
     // run queue is empty, and there are no other tasks running, we
     // can wait indefinitely for something to happen.
     //
-    if ( !emptyQueue(blocked_queue_hd) || !emptyQueue(sleeping_queue) )
+    if ( !EMPTY_BLOCKED_QUEUE() || !EMPTY_SLEEPING_QUEUE() )
     {
         awaitEvent (emptyRunQueue(cap));
     }
@@ -1030,6 +1066,10 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
 
         RELEASE_LOCK(&cap->lock);
 
+        // The messages may wake up threads on other Capabilities, see
+        // Note [Batched wakeups] in Threads.c
+        beginWakeupBatch(cap);
+
         while (m != (Message*)END_TSO_QUEUE) {
             next = m->link;
             executeMessage(cap, m);
@@ -1044,6 +1084,8 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
             stgFree(p);
             p = pnext;
         }
+
+        endWakeupBatch(cap);
     }
 #endif
 }
@@ -1063,6 +1105,206 @@ scheduleActivateSpark(Capability *cap)
         debugTrace(DEBUG_sched, "creating a spark thread");
     }
 }
+
+/* ----------------------------------------------------------------------------
+ * Work-stealing run queues
+ *
+ * Note [Work-stealing run queues]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Normally a Capability only hands threads to idle Capabilities in
+ * schedulePushWork(), on its way round the scheduler loop.  A thread that
+ * forks a burst of threads and carries on running keeps them all on its
+ * own run queue until it blocks or its time slice runs out.
+ *
+ * With +RTS -qs, scheduleThread() (forkIO and friends) pushes each new
+ * unbound thread onto cap->offered_threads, a WSDeque, instead, and prods
+ * an idle Capability when the deque becomes non-empty.  Idle Capabilities
+ * look for offered threads in scheduleFindWork(), on their own NUMA node
+ * first, and steal the oldest one; a thief that leaves more behind prods
+ * another idle Capability.  The owner takes back whatever is left, in
+ * order, each time round its scheduler loop, so an offered thread never
+ * waits longer than it would have on the run queue.
+ *
+ * An offered thread is on no run queue, and its tso->cap is still the
+ * Capability that offered it.  Only new threads are offered, so nothing
+ * can be blocked on them, but they can be thrown to, so throwToMsg()
+ * asks ownsThread() before touching a runnable thread.  Ownership of an
+ * offered thread goes to whoever wins the cas() on tso->offered in
+ * claimOfferedThread():
+ *
+ *   TSO_OFFERED --cas--> TSO_CLAIMING --(set tso->cap)--> TSO_NOT_OFFERED
+ *
+ * so a Capability that reads TSO_NOT_OFFERED and then tso->cap sees the
+ * final owner.  When ownsThread() claims a thread, its entry stays in the
+ * deque; claiming it again fails, and whoever pops it just drops it.
+ *
+ * Offered threads are on no other queue, so the GC treats them as roots
+ * (markOfferedThreads()).
+ * ------------------------------------------------------------------------- */
+
+// Wake up a worker on an idle Capability, preferably on our NUMA node
+static void
+prodIdleCapability (Capability *cap)
+{
+    Capability *cap0;
+    uint32_t i, remote;
+
+    for (remote = 0; remote < (n_numa_nodes > 1 ? 2 : 1); remote++) {
+        for (i = 1; i < n_capabilities; i++) {
+            cap0 = capabilities[(cap->no + i) % n_capabilities];
+            if (n_numa_nodes > 1 &&
+                (cap0->node != cap->node) != (remote != 0)) {
+                continue;
+            }
+            if (!cap0->disabled && cap0->running_task == NULL) {
+                prodCapability(cap0, cap->running_task);
+                return;
+            }
+        }
+    }
+}
+
+static bool
+offerThread (Capability *cap, StgTSO *tso)
+{
+    bool was_empty;
+
+    if (cap->offered_threads == NULL || enabled_capabilities == 1
+        || cap->disabled || tso->bound != NULL || tsoLocked(tso)
+        || sched_state != SCHED_RUNNING) {
+        return false;
+    }
+
+    was_empty = looksEmptyWSDeque(cap->offered_threads);
+    tso->offered = TSO_OFFERED; // published by pushWSDeque()
+    if (!pushWSDeque(cap->offered_threads, tso)) {
+        tso->offered = TSO_NOT_OFFERED; // full; nobody has seen it
+        return false;
+    }
+
+    if (was_empty) {
+        prodIdleCapability(cap);
+    }
+    return true;
+}
+
+// Take an offered thread from any deque and put it on our run queue.
+// Fails if someone else got there first.
+static bool
+claimOfferedThread (Capability *cap, StgTSO *tso)
+{
+    Capability *from;
+
+    if (cas((StgVolatilePtr)&tso->offered, TSO_OFFERED, TSO_CLAIMING)
+        != TSO_OFFERED) {
+        return false;
+    }
+
+    from = tso->cap;
+    if (from != cap) {
+        debugTrace(DEBUG_sched, "cap %d: stole thread %lu from cap %d",
+                   cap->no, (unsigned long)tso->id, from->no);
+        tso->cap = cap;
+        // We don't own from, so the event goes in our own buffer
+        traceEventStealThread(cap, tso, from->no);
+        countThreadMigration(from, cap);
+        cap->threads_stolen++;
+        if (from->node != cap->node) {
+            cap->threads_stolen_remote++;
+        }
+    }
+    write_barrier();
+    tso->offered = TSO_NOT_OFFERED;
+
+    appendToRunQueue(cap, tso);
+    return true;
+}
+
+bool
+reclaimOfferedThread (Capability *cap, StgTSO *tso)
+{
+    while (true) {
+        switch (VOLATILE_LOAD(&tso->offered)) {
+        case TSO_OFFERED:
+            if (tso->cap != cap) {
+                return false; // let its owner take it back
+            }
+            if (claimOfferedThread(cap, tso)) {
+                return true;
+            }
+            break; // lost the race, look again
+        case TSO_NOT_OFFERED:
+            load_load_barrier();
+            return tso->cap == cap;
+        default:
+            // another Capability is taking it; wait until it has set
+            // tso->cap
+            busy_wait_nop();
+            break;
+        }
+    }
+}
+
+// Put the threads we offered that nobody has stolen back on our run
+// queue, oldest first
+static void
+reclaimOfferedThreads (Capability *cap)
+{
+    StgTSO *tso;
+
+    while ((tso = stealWSDeque(cap->offered_threads)) != NULL) {
+        claimOfferedThread(cap, tso); // fails for stale entries
+    }
+}
+
+static void
+scheduleStealThread (Capability *cap)
+{
+    Capability *victim;
+    StgTSO *tso;
+    uint32_t i, remote;
+
+    reclaimOfferedThreads(cap);
+
+    if (!emptyRunQueue(cap) || cap->disabled) {
+        return;
+    }
+
+    for (remote = 0; remote < (n_numa_nodes > 1 ? 2 : 1); remote++) {
+        for (i = 1; i < n_capabilities; i++) {
+            victim = capabilities[(cap->no + i) % n_capabilities];
+            if (n_numa_nodes > 1 &&
+                (victim->node != cap->node) != (remote != 0)) {
+                continue;
+            }
+            if (emptyOfferedThreadsCap(victim)) {
+                continue;
+            }
+            while ((tso = stealWSDeque(victim->offered_threads)) != NULL) {
+                if (claimOfferedThread(cap, tso)) {
+                    if (!emptyOfferedThreadsCap(victim)) {
+                        prodIdleCapability(cap);
+                    }
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void
+markOfferedThreads (evac_fn evac, void *user, Capability *cap)
+{
+    WSDeque *q = cap->offered_threads;
+    StgWord i;
+
+    if (q == NULL) {
+        return;
+    }
+    for (i = q->top; i < q->bottom; i++) {
+        evac(user, (StgClosure **)&q->elements[i & q->moduloSize]);
+    }
+}
 #endif // THREADED_RTS
 
 /* ----------------------------------------------------------------------------
@@ -1247,11 +1489,7 @@ scheduleHandleYield( Capability *cap, StgTSO *t, uint32_t prev_what_next )
  * -------------------------------------------------------------------------- */
 
 static void
-scheduleHandleThreadBlocked( StgTSO *t
-#if !defined(DEBUG)
-    STG_UNUSED
-#endif
-    )
+scheduleHandleThreadBlocked( StgTSO *t )
 {
 
       // We don't need to do anything.  The thread is blocked, and it
@@ -1264,6 +1502,13 @@ scheduleHandleThreadBlocked( StgTSO *t
     //      threadPaused() might have raised a blocked throwTo
     //      exception, see maybePerformBlockedException().
 
+    // See Note [MVar wakeup statistics] in Threads.c
+    if (RTS_UNLIKELY(mvar_timing_enabled) &&
+        (t->why_blocked == BlockedOnMVar ||
+         t->why_blocked == BlockedOnMVarRead)) {
+        t->block_start = getMonotonicNSec();
+    }
+
 #if defined(DEBUG)
     traceThreadStatus(DEBUG_sched, t);
 #endif
@@ -1447,6 +1692,8 @@ static bool requestSync (
 {
     PendingSync *sync;
 
+    // before we publish the sync; see Note [Time to safepoint]
+    new_sync->start = getProcessElapsedTime();
     sync = (PendingSync*)cas((StgVolatilePtr)&pending_sync,
                              (StgWord)NULL,
                              (StgWord)new_sync);
@@ -1520,6 +1767,7 @@ static void acquireAllCapabilities(Capability *cap, Task *task)
             if (tmpcap->no != i) {
                 barf("acquireAllCapabilities: got the wrong capability");
             }
+            recordSyncStop(tmpcap, NULL);
         }
     }
     task->cap = cap == NULL ? tmpcap : cap;
@@ -1549,6 +1797,87 @@ void releaseAllCapabilities(uint32_t n, Capability *keep_cap, Task *task)
 }
 #endif
 
+/* -----------------------------------------------------------------------------
+ * Write out the eventlog flight recorder, as requested by a signal.  See
+ * Note [Eventlog flight recorder] in eventlog/EventLog.c.
+ * -------------------------------------------------------------------------- */
+
+#if defined(TRACING)
+static void
+scheduleDumpEventLog (Capability **pcap USED_IF_THREADS,
+                      Task *task USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    stopAllCapabilities(pcap, task);
+#endif
+
+    // Another capability may have written the dump while we were waiting
+    if (eventlog_dump_requested) {
+        eventlog_dump_requested = 0;
+        dumpEventLog();
+    }
+
+#if defined(THREADED_RTS)
+    releaseAllCapabilities(n_capabilities, *pcap, task);
+#endif
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Note [Time to safepoint]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Before a GC, every Capability has to stop running Haskell code (see
+ * requestSync()), and a Capability only notices the request when its
+ * thread next returns to the scheduler, which a thread in a loop that does
+ * not allocate may not do for a long time.  Meanwhile all the other
+ * Capabilities sit idle.  To find such threads, we record for each GC
+ * which Capability was the last to stop, how long after the sync was
+ * requested that was, and what it had been running.
+ *
+ * requestSync() stamps the PendingSync with its start time before
+ * publishing it.  Each Capability records its first stop for a sync in
+ * cap->sync_stop with recordSyncStop():
+ *
+ *  - in schedule(), when a thread returns while a sync is pending: we
+ *    record the thread and the code it was running (the return address on
+ *    top of its stack, see stoppedThreadInfo() in Capability.c), and with
+ *    profiling its cost-centre stack;
+ *
+ *  - in yieldCapability(), for a Capability that was not running a thread
+ *    but had to be woken up, and
+ *
+ *  - when the GC leader grabs a Capability with waitForCapability(), for
+ *    example one that was in a foreign call.
+ *
+ * Once everyone has stopped, reportSyncStop() picks the record with the
+ * latest time and reports it with a GC_SYNC_LAST event (with +RTS -lg)
+ * and to the stats, which show the slowest sync of the run in +RTS -s.
+ * -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+static void
+reportSyncStop (Capability *cap, PendingSync *sync)
+{
+    Capability *last = NULL;
+    uint32_t i;
+
+    for (i = 0; i < n_capabilities; i++) {
+        Capability *c = capabilities[i];
+        // Capabilities we didn't have to wait for have no record
+        if (c == cap || c->sync_stop.elapsed < sync->start) continue;
+        if (last == NULL || c->sync_stop.elapsed > last->sync_stop.elapsed) {
+            last = c;
+        }
+    }
+    if (last != NULL) {
+        Time delay = last->sync_stop.elapsed - sync->start;
+        traceGcSyncLast(cap, last, delay);
+        stat_gcSyncLast(last, delay);
+    }
+}
+#endif
+
 /* -----------------------------------------------------------------------------
  * Perform a garbage collection if necessary
  * -------------------------------------------------------------------------- */
@@ -1747,6 +2076,7 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
                         Capability *tmpcap = capabilities[i];
                         task->cap = tmpcap;
                         waitForCapability(&tmpcap, task);
+                        recordSyncStop(tmpcap, NULL);
                         n_idle_caps++;
                     }
                 }
@@ -1786,6 +2116,8 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
         ASSERT(checkSparkCountInvariant());
     }
 
+    reportSyncStop(cap, &sync);
+
 #endif
 
     IF_DEBUG(scheduler, printAllThreads());
@@ -1809,6 +2141,11 @@ delete_threads_and_gc:
                 sparkPoolSize(capabilities[i]->sparks);
             // No race here since all Caps are stopped.
             discardSparksCap(capabilities[i]);
+            // Leave the killed offered threads on the run queues with
+            // the other zombies
+            if (capabilities[i]->offered_threads != NULL) {
+                reclaimOfferedThreads(capabilities[i]);
+            }
         }
 #endif
         sched_state = SCHED_SHUTTING_DOWN;
@@ -1827,7 +2164,10 @@ delete_threads_and_gc:
         tmp_cap = capabilities[i];
         ASSERT(tmp_cap->disabled);
         if (i != cap->no) {
-            dest_cap = capabilities[i % enabled_capabilities];
+            if (tmp_cap->offered_threads != NULL) {
+                reclaimOfferedThreads(tmp_cap);
+            }
+            dest_cap = enabledCapabilityNear(i);
             while (!emptyRunQueue(tmp_cap)) {
                 tso = popRunQueue(tmp_cap);
                 migrateThread(tmp_cap, tso, dest_cap);
@@ -1861,6 +2201,7 @@ delete_threads_and_gc:
     }
 
     traceSparkCounters(cap);
+    traceMVarCounters(cap);
 
     switch (recent_activity) {
     case ACTIVITY_INACTIVE:
@@ -2030,6 +2371,7 @@ forkProcess(HsStablePtr *entry
 
 #if defined(THREADED_RTS)
     ACQUIRE_LOCK(&all_tasks_mutex);
+    ACQUIRE_LOCK(&cfinalizer_mutex);
 #endif
 
     stopTimer(); // See #4074
@@ -2053,6 +2395,7 @@ forkProcess(HsStablePtr *entry
 #if defined(THREADED_RTS)
         /* N.B. releaseCapability_ below may need to take all_tasks_mutex */
         RELEASE_LOCK(&all_tasks_mutex);
+        RELEASE_LOCK(&cfinalizer_mutex);
 #endif
 
         for (i=0; i < n_capabilities; i++) {
@@ -2114,6 +2457,12 @@ forkProcess(HsStablePtr *entry
 
         discardTasksExcept(task);
 
+#if defined(THREADED_RTS)
+        // The finalizer threads are gone too, and their Tasks with them.
+        // This re-initialises cfinalizer_mutex.
+        resetChildCFinalizerThreads();
+#endif
+
         for (i=0; i < n_capabilities; i++) {
             cap = capabilities[i];
 
@@ -2131,6 +2480,10 @@ forkProcess(HsStablePtr *entry
             cap->n_suspended_ccalls = 0;
 
 #if defined(THREADED_RTS)
+            if (cap->offered_threads != NULL) {
+                discardElements(cap->offered_threads);
+            }
+
             // Wipe our spare workers list, they no longer exist.  New
             // workers will be created if necessary.
             cap->spare_workers = NULL;
@@ -2161,6 +2514,11 @@ forkProcess(HsStablePtr *entry
         initTimer();
         startTimer();
 
+#if !defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+        // Don't share the parent's epoll instance
+        resetFdQueues();
+#endif
+
         // TODO: need to trace various other things in the child
         // like startup event, capabilities, process info etc
         traceTaskCreate(task, cap);
@@ -2347,7 +2705,7 @@ deleteAllThreads ()
     // being GC'd, and we don't want the "main thread has been GC'd" panic.
 
 #if !defined(THREADED_RTS)
-    ASSERT(blocked_queue_hd == END_TSO_QUEUE);
+    ASSERT(EMPTY_BLOCKED_QUEUE());
     ASSERT(sleeping_queue == END_TSO_QUEUE);
 #endif
 }
@@ -2454,6 +2812,8 @@ suspendThread (StgRegTable *reg, bool interruptible)
   // Otherwise allocate() will write to invalid memory.
   cap->r.rCurrentTSO = NULL;
 
+  stmThreadDescheduled(tso);
+
   ACQUIRE_LOCK(&cap->lock);
 
   suspendTask(cap,task);
@@ -2549,6 +2909,13 @@ resumeThread (void *task_)
 void
 scheduleThread(Capability *cap, StgTSO *tso)
 {
+#if defined(THREADED_RTS)
+    // With +RTS -qs, let idle Capabilities take it;
+    // see Note [Work-stealing run queues]
+    if (cap->offered_threads != NULL && offerThread(cap, tso)) {
+        return;
+    }
+#endif
     // The thread goes at the *end* of the run-queue, to avoid possible
     // starvation of any threads already on the queue.
     appendToRunQueue(cap,tso);
@@ -2676,6 +3043,12 @@ initScheduler(void)
   sched_state    = SCHED_RUNNING;
   recent_activity = ACTIVITY_YES;
 
+  // See Note [MVar wakeup statistics] in Threads.c
+  mvar_timing_enabled = RtsFlags.GcFlags.giveStats != NO_GC_STATS;
+#if defined(TRACING)
+  mvar_timing_enabled = mvar_timing_enabled || TRACE_sched;
+#endif
+
 #if defined(THREADED_RTS)
   /* Initialise the mutex and condition variables used by
    * the scheduler. */
@@ -2763,6 +3136,9 @@ void markScheduler (evac_fn evac USED_IF_NOT_THREADS,
     evac(user, (StgClosure **)(void *)&blocked_queue_hd);
     evac(user, (StgClosure **)(void *)&blocked_queue_tl);
     evac(user, (StgClosure **)(void *)&sleeping_queue);
+#if !defined(mingw32_HOST_OS)
+    markFdQueues(evac, user);
+#endif
 #endif
 }
 
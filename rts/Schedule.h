@@ -56,6 +56,12 @@ void scheduleWorker (Capability *cap, Task *task);
 void stopAllCapabilitiesWith (Capability **pCap, Task *task, SyncType sync_type);
 void stopAllCapabilities (Capability **pCap, Task *task);
 void releaseAllCapabilities(uint32_t n, Capability *keep_cap, Task *task);
+
+// Work-stealing run queues (+RTS -qs), see Note [Work-stealing run queues]
+#define OFFERED_THREADS_SIZE 4096
+
+void markOfferedThreads   (evac_fn evac, void *user, Capability *cap);
+bool reclaimOfferedThread (Capability *cap, StgTSO *tso);
 #endif
 
 /* The state of the scheduler.  This is used to control the sequence
@@ -107,6 +113,9 @@ extern volatile StgWord recent_activity;
 #if !defined(THREADED_RTS)
 extern  StgTSO *blocked_queue_hd, *blocked_queue_tl;
 extern  StgTSO *sleeping_queue;
+#if !defined(mingw32_HOST_OS)
+extern  StgWord n_fd_waiters;   // see Note [epoll backend for awaitEvent]
+#endif
 #endif
 
 extern bool heap_overflow;
@@ -191,6 +200,30 @@ popRunQueue (Capability *cap)
     return t;
 }
 
+#if defined(THREADED_RTS)
+/* True if tso belongs to cap, taking it back first if cap had offered it
+ * to other Capabilities.  A Capability must check this before touching a
+ * runnable thread other than the one it is running; see Note
+ * [Work-stealing run queues] in Schedule.c.
+ */
+INLINE_HEADER bool
+ownsThread (Capability *cap, StgTSO *tso)
+{
+    if (RTS_LIKELY(tso->offered == TSO_NOT_OFFERED)) {
+        // pairs with the write_barrier() in claimOfferedThread()
+        load_load_barrier();
+        return tso->cap == cap;
+    }
+    return reclaimOfferedThread(cap, tso);
+}
+#else
+INLINE_HEADER bool
+ownsThread (Capability *cap, StgTSO *tso)
+{
+    return tso->cap == cap;
+}
+#endif
+
 INLINE_HEADER StgTSO *
 peekRunQueue (Capability *cap)
 {
@@ -238,7 +271,11 @@ truncateRunQueue(Capability *cap)
 }
 
 #if !defined(THREADED_RTS)
+#if defined(mingw32_HOST_OS)
 #define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd))
+#else
+#define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd) && n_fd_waiters == 0)
+#endif
 #define EMPTY_SLEEPING_QUEUE() (emptyQueue(sleeping_queue))
 #endif
 
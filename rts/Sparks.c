@@ -20,10 +20,17 @@
 
 #if defined(THREADED_RTS)
 
+/* Spark pools start small and grow on demand up to -e (see Note [Growing
+ * a WSDeque]), so that a burst of sparks isn't dropped on the floor
+ * without every capability paying for a huge pool up front. */
+#define SPARK_POOL_INITIAL_SIZE 1024
+
 SparkPool *
 allocSparkPool( void )
 {
-    return newWSDeque(RtsFlags.ParFlags.maxLocalSparks);
+    return newGrowableWSDeque(stg_min(SPARK_POOL_INITIAL_SIZE,
+                                      RtsFlags.ParFlags.maxLocalSparks),
+                              RtsFlags.ParFlags.maxLocalSparks);
 }
 
 void
@@ -266,9 +273,13 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
 
     debugTrace(DEBUG_sparks, "pruned %d sparks", pruned_sparks);
 
+    // Nobody is stealing during GC, so we can free the arrays the pool
+    // has outgrown and give back space if it has emptied out.
+    shrinkWSDeque(pool);
+
     debugTrace(DEBUG_sparks,
-               "new spark queue len=%ld; (hd=%ld; tl=%ld)",
-               sparkPoolSize(pool), pool->bottom, pool->top);
+               "new spark queue len=%ld; (hd=%ld; tl=%ld; size=%ld)",
+               sparkPoolSize(pool), pool->bottom, pool->top, pool->size);
 
     ASSERT_WSDEQUE_INVARIANTS(pool);
 }
@@ -22,6 +22,8 @@ typedef struct {
     StgWord converted;
     StgWord gcd;
     StgWord fizzled;
+    StgWord stolen;         // converted sparks taken from another pool
+    StgWord stolen_remote;  // ... on another NUMA node
 } SparkCounters;
 
 #if defined(THREADED_RTS)
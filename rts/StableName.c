@@ -16,6 +16,8 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StableName.h"
+#include "sm/GC.h" // for N
+#include "sm/CNF.h" // for objectGetCompact
 
 #include <string.h>
 
@@ -24,6 +26,55 @@ static snEntry *stable_name_free = NULL;
 unsigned int SNT_size = 0;
 #define INIT_SNT_SIZE 64
 
+/* Note [Generational stable name table]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * After each GC we have to update the stable name table for the objects that
+ * moved or died, and re-hash them in addrToStableHash.  Programs that memoise
+ * using StableNames can have millions of them, mostly for old objects, so
+ * walking the whole table on every minor GC would make a minor GC cost
+ * O(number of stable names).
+ *
+ * Instead every entry in use is on the list of one generation, sn_gen_lists.
+ * An entry is listed in a generation no older than the youngest of its
+ * object (addr) and its StableName object (sn_obj), so a GC that collects
+ * generations 0..N only needs to look at the entries on the lists of those
+ * generations: no other entry can have a pointer that moves or dies.  New
+ * entries go on generation 0's list, as their StableName object is about to
+ * be allocated in the nursery.  After a minor GC, updateStableNameTable()
+ * moves each entry that it visits to the list of the generation it now
+ * belongs to; after a major GC it rebuilds all the lists along with the hash
+ * table.  Since objects only ever get older, an entry is never listed in a
+ * generation older than it belongs to.  Entries whose object is static are
+ * treated as belonging to the oldest generation, since isAlive() treats
+ * static objects as always alive.
+ *
+ * Outside GC, every entry in use has old == addr, and addrToStableHash maps
+ * addr to the entry.  rememberOldStableNameAddresses() therefore only needs
+ * to visit the collected generations too.  The nonmoving collector's sweep
+ * keeps this invariant by removing dead objects from the hash table as it
+ * goes (clearSnEntryAddr).
+ *
+ * sn_gen_info records, for each entry, which list it is on and where, so that
+ * an entry can be removed from its list in constant time when it is freed.
+ */
+
+typedef struct {
+    uint32_t *sns;          // indices of the entries on this list
+    uint32_t n_sns;
+    uint32_t size;
+} SnGenList;
+
+typedef struct {
+    uint32_t gen;           // generation whose list the entry is on, or
+                            // NO_SN_GEN
+    uint32_t pos;           // index of the entry in that list
+} SnGenInfo;
+
+#define NO_SN_GEN ((uint32_t)-1)
+
+static SnGenList *sn_gen_lists = NULL;
+static SnGenInfo *sn_gen_info = NULL;
+
 #if defined(THREADED_RTS)
 Mutex stable_name_mutex;
 #endif
@@ -63,11 +114,69 @@ initSnEntryFreeList(snEntry *table, uint32_t n, snEntry *free)
     p->addr   = (P_)free;
     p->old    = NULL;
     p->sn_obj = NULL;
+    sn_gen_info[p - stable_name_table].gen = NO_SN_GEN;
     free = p;
   }
   stable_name_free = table;
 }
 
+/* -----------------------------------------------------------------------------
+ * The per-generation lists; see Note [Generational stable name table]
+ * -------------------------------------------------------------------------- */
+
+static void
+addSnToGen(uint32_t sn, uint32_t g)
+{
+    SnGenList *list = &sn_gen_lists[g];
+    if (list->n_sns == list->size) {
+        list->size = list->size == 0 ? INIT_SNT_SIZE : list->size * 2;
+        list->sns = stgReallocBytes(list->sns, list->size * sizeof(uint32_t),
+                                    "addSnToGen");
+    }
+    sn_gen_info[sn].gen = g;
+    sn_gen_info[sn].pos = list->n_sns;
+    list->sns[list->n_sns++] = sn;
+}
+
+static void
+removeSnFromGen(uint32_t sn)
+{
+    SnGenInfo *info = &sn_gen_info[sn];
+    if (info->gen == NO_SN_GEN) return;
+    SnGenList *list = &sn_gen_lists[info->gen];
+    uint32_t last = list->sns[--list->n_sns];
+    list->sns[info->pos] = last;
+    sn_gen_info[last].pos = info->pos;
+    info->gen = NO_SN_GEN;
+}
+
+/* The generation of an object pointed to by a stable name entry. */
+static uint32_t
+snPtrGen(StgPtr p)
+{
+    if (p == NULL || !HEAP_ALLOCED_GC(p)) {
+        return oldest_gen->no;
+    }
+    bdescr *bd = Bdescr(p);
+    if (bd->flags & BF_COMPACT) {
+        // only the first block of a compact region has its generation set
+        bd = Bdescr((P_)objectGetCompact((StgClosure *)p));
+    }
+    return bd->gen_no;
+}
+
+/* The generation whose list an entry should be on after a GC. */
+static uint32_t
+snEntryGen(snEntry *p)
+{
+    uint32_t g = snPtrGen((StgPtr)p->sn_obj);
+    if (p->addr != NULL) {
+        uint32_t ga = snPtrGen(p->addr);
+        if (ga < g) g = ga;
+    }
+    return g;
+}
+
 void
 initStableNameTable(void)
 {
@@ -75,6 +184,11 @@ initStableNameTable(void)
     SNT_size = INIT_SNT_SIZE;
     stable_name_table = stgMallocBytes(SNT_size * sizeof(snEntry),
                                        "initStableNameTable");
+    sn_gen_info = stgMallocBytes(SNT_size * sizeof(SnGenInfo),
+                                 "initStableNameTable");
+    sn_gen_lists = stgCallocBytes(RtsFlags.GcFlags.generations,
+                                  sizeof(SnGenList), "initStableNameTable");
+    sn_gen_info[0].gen = NO_SN_GEN;
     /* we don't use index 0 in the stable name table, because that
      * would conflict with the hash table lookup operations which
      * return NULL if an entry isn't found in the hash table.
@@ -102,6 +216,10 @@ enlargeStableNameTable(void)
         stgReallocBytes(stable_name_table,
                         SNT_size * sizeof(snEntry),
                         "enlargeStableNameTable");
+    sn_gen_info =
+        stgReallocBytes(sn_gen_info,
+                        SNT_size * sizeof(SnGenInfo),
+                        "enlargeStableNameTable");
 
     initSnEntryFreeList(stable_name_table + old_SNT_size, old_SNT_size, NULL);
 }
@@ -118,6 +236,16 @@ exitStableNameTable(void)
         freeHashTable(addrToStableHash, NULL);
     addrToStableHash = NULL;
 
+    if (sn_gen_lists) {
+        for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+            stgFree(sn_gen_lists[g].sns);
+        }
+        stgFree(sn_gen_lists);
+        stgFree(sn_gen_info);
+    }
+    sn_gen_lists = NULL;
+    sn_gen_info = NULL;
+
     if (stable_name_table)
         stgFree(stable_name_table);
     stable_name_table = NULL;
@@ -133,10 +261,21 @@ freeSnEntry(snEntry *sn)
 {
   ASSERT(sn->sn_obj == NULL);
   removeHashTable(addrToStableHash, (W_)sn->old, NULL);
+  removeSnFromGen(sn - stable_name_table);
   sn->addr = (P_)stable_name_free;
   stable_name_free = sn;
 }
 
+/* The object of a stable name died outside of a moving GC (i.e. in the
+ * nonmoving collector's sweep). Must be holding stable_name_mutex. */
+void
+clearSnEntryAddr(snEntry *sn)
+{
+  removeHashTable(addrToStableHash, (W_)sn->old, NULL);
+  sn->addr = NULL;
+  sn->old = NULL;
+}
+
 /* -----------------------------------------------------------------------------
  * Looking up
  * -------------------------------------------------------------------------- */
@@ -203,9 +342,13 @@ lookupStableName (StgPtr p)
   sn = stable_name_free - stable_name_table;
   stable_name_free  = (snEntry*)(stable_name_free->addr);
   stable_name_table[sn].addr = p;
+  stable_name_table[sn].old = p;
   stable_name_table[sn].sn_obj = NULL;
   /* debugTrace(DEBUG_stable, "new stable name %d at %p\n",sn,p); */
 
+  /* the StableName object will be in the nursery */
+  addSnToGen(sn, 0);
+
   /* add the new stable name to the hash table */
   insertHashTable(addrToStableHash, (W_)p, (void *)sn);
 
@@ -218,11 +361,25 @@ lookupStableName (StgPtr p)
  * Remember old stable name addresses
  * -------------------------------------------------------------------------- */
 
+/* Visit the entries on the lists of generations 0..N, with the lists of the
+ * older generations first. */
+#define FOR_EACH_COLLECTED_STABLE_NAME(p, CODE)                         \
+    do {                                                                \
+        for (int32_t __g = N; __g >= 0; __g--) {                        \
+            SnGenList *__list = &sn_gen_lists[__g];                     \
+            for (int64_t __i = (int64_t)__list->n_sns - 1; __i >= 0; __i--) { \
+                snEntry *p = &stable_name_table[__list->sns[__i]];      \
+                do { CODE } while(0);                                   \
+            }                                                           \
+        }                                                               \
+    } while(0)
+
 void
 rememberOldStableNameAddresses(void)
 {
-    /* TODO: Only if !full GC */
-    FOR_EACH_STABLE_NAME(p, p->old = p->addr;);
+    // Outside of GC old == addr for entries in use already, but be
+    // conservative; see Note [Generational stable name table].
+    FOR_EACH_COLLECTED_STABLE_NAME(p, p->old = p->addr;);
 }
 
 /* -----------------------------------------------------------------------------
@@ -266,10 +423,14 @@ gcStableNameTable( void )
     // We must take the stable name lock lest we race with the nonmoving
     // collector (namely nonmovingSweepStableNameTable).
     stableNameLock();
-    FOR_EACH_STABLE_NAME(
+    // Only entries on the lists of the collected generations can have died
+    // or moved; see Note [Generational stable name table]. Freeing an entry
+    // removes it from its list by moving the last entry of the list into
+    // its place, which has already been visited.
+    FOR_EACH_COLLECTED_STABLE_NAME(
         p, {
-            // FOR_EACH_STABLE_NAME traverses free entries too, so
-            // check sn_obj
+            // An entry whose StableName object is still being allocated by
+            // stg_makeStableNamezh has sn_obj == NULL
             if (p->sn_obj != NULL) {
                 // Update the pointer to the StableName object, if there is one
                 p->sn_obj = isAlive(p->sn_obj);
@@ -304,21 +465,32 @@ gcStableNameTable( void )
 void
 updateStableNameTable(bool full)
 {
+    stableNameLock();
+
     if (full && addrToStableHash != NULL && 0 != keyCountHashTable(addrToStableHash)) {
         freeHashTable(addrToStableHash,NULL);
         addrToStableHash = allocHashTable();
     }
 
     if(full) {
+        for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+            sn_gen_lists[g].n_sns = 0;
+        }
         FOR_EACH_STABLE_NAME(
             p, {
+                if (p->sn_obj != NULL) {
+                    addSnToGen(p - stable_name_table, snEntryGen(p));
+                }
                 if (p->addr != NULL) {
                     // Target still alive, Re-hash this stable name
                     insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
                 }
+                p->old = p->addr;
             });
     } else {
-        FOR_EACH_STABLE_NAME(
+        // Visiting the older generations' lists first means that an entry
+        // moved to an older list isn't visited again.
+        FOR_EACH_COLLECTED_STABLE_NAME(
             p, {
                 if (p->addr != p->old) {
                     removeHashTable(addrToStableHash, (W_)p->old, NULL);
@@ -326,7 +498,18 @@ updateStableNameTable(bool full)
                     if (p->addr != NULL) {
                         insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
                     }
+                    p->old = p->addr;
+                }
+                if (p->sn_obj != NULL) {
+                    uint32_t sn = p - stable_name_table;
+                    uint32_t g = snEntryGen(p);
+                    if (g != sn_gen_info[sn].gen) {
+                        removeSnFromGen(sn);
+                        addSnToGen(sn, g);
+                    }
                 }
             });
     }
+
+    stableNameUnlock();
 }
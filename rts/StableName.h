@@ -12,6 +12,7 @@
 
 void    initStableNameTable   ( void );
 void    freeSnEntry           ( snEntry *sn );
+void    clearSnEntryAddr      ( snEntry *sn );
 void    exitStableNameTable   ( void );
 StgWord lookupStableName      ( StgPtr p );
 
@@ -16,6 +16,7 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StablePtr.h"
+#include "Capability.h"
 
 #include <string.h>
 
@@ -112,6 +113,10 @@ static uint32_t n_old_SPTs = 0;
 
 #if defined(THREADED_RTS)
 Mutex stable_ptr_mutex;
+
+/* Odd while enlargeStablePtrTable() is copying the table; see Note
+ * [Per-capability stable pointer caches]. */
+static volatile StgWord spt_enlarge_seq = 0;
 #endif
 
 static void enlargeStablePtrTable(void);
@@ -183,11 +188,19 @@ enlargeStablePtrTable(void)
     new_stable_ptr_table =
         stgMallocBytes(SPT_size * sizeof(spEntry),
                        "enlargeStablePtrTable");
+    ASSERT(n_old_SPTs < MAX_N_OLD_SPTS);
+    old_SPTs[n_old_SPTs++] = stable_ptr_table;
+
+#if defined(THREADED_RTS)
+    /* Tell setSpEntry() that entries written from now on may be missed by
+     * the copy; see Note [Per-capability stable pointer caches]. */
+    spt_enlarge_seq++;
+    store_load_barrier();
+#endif
+
     memcpy(new_stable_ptr_table,
            stable_ptr_table,
            old_SPT_size * sizeof(spEntry));
-    ASSERT(n_old_SPTs < MAX_N_OLD_SPTS);
-    old_SPTs[n_old_SPTs++] = stable_ptr_table;
 
     /* When using the threaded RTS, the update of stable_ptr_table is assumed to
      * be atomic, so that another thread simultaneously dereferencing a stable
@@ -195,6 +208,11 @@ enlargeStablePtrTable(void)
      */
     stable_ptr_table = new_stable_ptr_table;
 
+#if defined(THREADED_RTS)
+    write_barrier();
+    spt_enlarge_seq++;
+#endif
+
     initSpEntryFreeList(stable_ptr_table + old_SPT_size, old_SPT_size, NULL);
 }
 
@@ -258,9 +276,113 @@ freeStablePtrUnsafe(StgStablePtr sp)
     freeSpEntry(&stable_ptr_table[(StgWord)sp]);
 }
 
+/* Note [Per-capability stable pointer caches]
+ *
+ * Programs that make heavy use of callbacks can create and free millions of
+ * stable pointers per second from many OS threads, so in the threaded RTS
+ * taking stable_ptr_mutex for every getStablePtr() and freeStablePtr() would
+ * serialise them.  Instead each Capability keeps a small cache of free
+ * slots (cap->spt_cache), which only the Task that owns the Capability may
+ * touch.  getStablePtr() takes a slot from the cache when the calling OS
+ * thread owns a Capability, as it does in makeStablePtr# and in C code
+ * called by an unsafe foreign call; otherwise it takes the lock and uses the
+ * global free list as before.  When the cache is empty, getStablePtr()
+ * takes stable_ptr_mutex and refills the cache with
+ * STABLE_PTR_CACHE_SIZE/2 slots from the global free list.  freeStablePtr()
+ * likewise pushes the slot on the cache, and returns half of the cache to
+ * the global free list when it is full.
+ *
+ * A cached slot has addr == NULL, so markStablePtrTable() and
+ * threadStablePtrTable() treat it as free, just like slots on the global free
+ * list (whose addr points into the table).  The global free list is still
+ * only touched with the lock held.
+ *
+ * The tricky part is writing the slot's entry without the lock: a
+ * concurrent enlargeStablePtrTable() may be copying the table, and if it
+ * copies our slot before we write it, the write is lost.  So the table is
+ * guarded by a sequence lock: spt_enlarge_seq is odd while the table is
+ * being copied.  setSpEntry() reads the sequence number, writes the entry
+ * into the current table, and checks that the sequence number is unchanged.
+ * If the sequence number was odd or has changed, then an enlargement has
+ * happened in the meantime, and the caller takes stable_ptr_mutex (which
+ * waits for the enlargement to finish) and writes the entry again into the
+ * new table.  Enlargement and GC (which frees the old tables) never happen
+ * during a write: enlargement is caught by the sequence number, and GC needs
+ * all Capabilities, including the one owned by the writer.
+ */
+
+#if defined(THREADED_RTS)
+/* The Capability owned by the calling OS thread, if any. */
+STATIC_INLINE Capability *
+ownedCapability(void)
+{
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL || task->cap->running_task != task) {
+        return NULL;
+    }
+    return task->cap;
+}
+
+/* Write an entry of the table without holding stable_ptr_mutex. Returns
+ * false if the table was enlarged in the meantime and the write must be
+ * redone with the lock held. */
+STATIC_INLINE bool
+setSpEntry(StgWord sp, StgPtr addr)
+{
+    StgWord seq = spt_enlarge_seq;
+    if (seq & 1) return false;
+    load_load_barrier();
+    stable_ptr_table[sp].addr = addr;
+    store_load_barrier();
+    return spt_enlarge_seq == seq;
+}
+
+/* Take half a cache's worth of slots from the global free list. Must be
+ * holding stable_ptr_mutex. */
+static void
+refillStablePtrCache(Capability *cap)
+{
+    while (cap->n_spt_cache < STABLE_PTR_CACHE_SIZE / 2) {
+        if (!stable_ptr_free) enlargeStablePtrTable();
+        spEntry *free = stable_ptr_free;
+        stable_ptr_free = (spEntry*)(free->addr);
+        free->addr = NULL;
+        cap->spt_cache[cap->n_spt_cache++] = free - stable_ptr_table;
+    }
+}
+
+/* Return half of the cache to the global free list. Must be holding
+ * stable_ptr_mutex. */
+static void
+drainStablePtrCache(Capability *cap)
+{
+    while (cap->n_spt_cache > STABLE_PTR_CACHE_SIZE / 2) {
+        freeSpEntry(&stable_ptr_table[cap->spt_cache[--cap->n_spt_cache]]);
+    }
+}
+#endif
+
 void
 freeStablePtr(StgStablePtr sp)
 {
+#if defined(THREADED_RTS)
+    Capability *cap = ownedCapability();
+    if (cap != NULL) {
+        ASSERT((StgWord)sp < SPT_size);
+        if (cap->n_spt_cache == STABLE_PTR_CACHE_SIZE) {
+            stablePtrLock();
+            drainStablePtrCache(cap);
+            stablePtrUnlock();
+        }
+        if (!setSpEntry((StgWord)sp, NULL)) {
+            stablePtrLock();
+            stable_ptr_table[(StgWord)sp].addr = NULL;
+            stablePtrUnlock();
+        }
+        cap->spt_cache[cap->n_spt_cache++] = (StgWord)sp;
+        return;
+    }
+#endif
     stablePtrLock();
     freeStablePtrUnsafe(sp);
     stablePtrUnlock();
@@ -275,6 +397,24 @@ getStablePtr(StgPtr p)
 {
   StgWord sp;
 
+#if defined(THREADED_RTS)
+  Capability *cap = ownedCapability();
+  if (cap != NULL) {
+      if (cap->n_spt_cache == 0) {
+          stablePtrLock();
+          refillStablePtrCache(cap);
+          stablePtrUnlock();
+      }
+      sp = cap->spt_cache[--cap->n_spt_cache];
+      if (!setSpEntry(sp, p)) {
+          stablePtrLock();
+          stable_ptr_table[sp].addr = p;
+          stablePtrUnlock();
+      }
+      return (StgStablePtr)(sp);
+  }
+#endif
+
   stablePtrLock();
   if (!stable_ptr_free) enlargeStablePtrTable();
   sp = stable_ptr_free - stable_ptr_table;
@@ -18,6 +18,10 @@
 
 #include "BeginPrivate.h"
 
+// Number of free slots each Capability may cache, see Note [Per-capability
+// stable pointer caches] in StablePtr.c.
+#define STABLE_PTR_CACHE_SIZE 64
+
 void    freeStablePtr         ( StgStablePtr sp );
 
 /* Use the "Unsafe" one after only when manually locking and
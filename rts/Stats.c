@@ -18,11 +18,15 @@
 #include "sm/Storage.h"
 #include "sm/GCThread.h"
 #include "sm/BlockAlloc.h"
+#include "sm/OSMem.h"
 
 // for spin/yield counters
 #include "sm/GC.h"
 #include "ThreadPaused.h"
 #include "Messages.h"
+#if !defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+#include "posix/Select.h"
+#endif
 
 #include <string.h> // for memset
 
@@ -64,6 +68,32 @@ static Time *GC_coll_cpu = NULL;
 static Time *GC_coll_elapsed = NULL;
 static Time *GC_coll_max_pause = NULL;
 
+#if defined(THREADED_RTS)
+// Time-to-safepoint of each GC, that is the time it took to stop all the
+// capabilities (stats.gc.sync_elapsed_ns), as a histogram. Bucket 0 counts
+// syncs shorter than 1us, bucket b > 0 those in [2^(b-1), 2^b) us, and the
+// last bucket all the longer ones.
+#define GC_SYNC_BUCKETS 24
+static StgWord64 GC_sync_hist[GC_SYNC_BUCKETS];
+static Time GC_sync_max = 0;
+
+// The GC that waited longest for the last Capability to stop, and what
+// that Capability was running; see Note [Time to safepoint] in Schedule.c
+static Time GC_slowest_sync = 0;
+static uint32_t GC_slowest_sync_cap = 0;
+static SyncStop GC_slowest_sync_stop;
+#endif
+
+// Indexed by mark worker; NULL unless --nonmoving-mark-threads > 1
+static NonmovingMarkWorkerStats *nonmoving_mark_worker_stats = NULL;
+// CPU time of the mark helper threads during the current nonmoving collection
+static Time nonmoving_mark_helpers_cpu = 0;
+// Work done for the nonmoving collector by idle capabilities; see Note
+// [Idle-time nonmoving GC work] in NonMoving.c
+static volatile StgWord nonmoving_idle_slices = 0;
+static volatile StgWord nonmoving_idle_entries = 0;
+static volatile StgWord nonmoving_idle_segments = 0;
+
 static void statsPrintf( char *s, ... ) GNUC3_ATTRIBUTE(format (PRINTF, 1, 2));
 static void statsFlush( void );
 static void statsClose( void );
@@ -129,6 +159,14 @@ initStats0(void)
     start_nonmoving_gc_elapsed = 0;
     start_nonmoving_gc_sync_elapsed = 0;
 
+#if defined(THREADED_RTS)
+    memset(GC_sync_hist, 0, sizeof(GC_sync_hist));
+    GC_sync_max = 0;
+    GC_slowest_sync = 0;
+    GC_slowest_sync_cap = 0;
+    memset(&GC_slowest_sync_stop, 0, sizeof(GC_slowest_sync_stop));
+#endif
+
     start_exit_cpu    = 0;
     start_exit_elapsed = 0;
     start_exit_gc_cpu    = 0;
@@ -171,6 +209,8 @@ initStats0(void)
         .any_work = 0,
         .no_work = 0,
         .scav_find_work = 0,
+        .steal_success = 0,
+        .steal_fail = 0,
         .init_cpu_ns = 0,
         .init_elapsed_ns = 0,
         .mutator_cpu_ns = 0,
@@ -196,6 +236,8 @@ initStats0(void)
             .copied_bytes = 0,
             .par_max_copied_bytes = 0,
             .par_balanced_copied_bytes = 0,
+            .par_steal_success = 0,
+            .par_steal_fail = 0,
             .sync_elapsed_ns = 0,
             .cpu_ns = 0,
             .elapsed_ns = 0,
@@ -231,6 +273,13 @@ initStats1 (void)
         (Time *)stgMallocBytes(
             sizeof(Time)*RtsFlags.GcFlags.generations,
             "initStats");
+    if (RtsFlags.GcFlags.useNonmoving
+        && RtsFlags.GcFlags.nonmovingMarkThreads > 1) {
+        const size_t sz = sizeof(NonmovingMarkWorkerStats)
+                          * RtsFlags.GcFlags.nonmovingMarkThreads;
+        nonmoving_mark_worker_stats = stgMallocBytes(sz, "initStats");
+        memset(nonmoving_mark_worker_stats, 0, sz);
+    }
     initGenerationStats();
 }
 
@@ -303,11 +352,24 @@ stat_startGCSync (gc_thread *gct)
     gct->gc_sync_start_elapsed = getProcessElapsedTime();
 }
 
+#if defined(THREADED_RTS)
+void
+stat_gcSyncLast (Capability *last, Time sync_time)
+{
+    if (sync_time > GC_slowest_sync) {
+        GC_slowest_sync = sync_time;
+        GC_slowest_sync_cap = last->no;
+        GC_slowest_sync_stop = last->sync_stop;
+    }
+}
+#endif
+
 void
 stat_startNonmovingGc ()
 {
     start_nonmoving_gc_cpu = getCurrentThreadCPUTime();
     start_nonmoving_gc_elapsed = getProcessCPUTime();
+    nonmoving_mark_helpers_cpu = 0;
 }
 
 void
@@ -318,7 +380,10 @@ stat_endNonmovingGc ()
     stats.gc.nonmoving_gc_elapsed_ns = elapsed - start_nonmoving_gc_elapsed;
     stats.nonmoving_gc_elapsed_ns += stats.gc.nonmoving_gc_elapsed_ns;
 
-    stats.gc.nonmoving_gc_cpu_ns = cpu - start_nonmoving_gc_cpu;
+    // The mark helper threads run alongside the thread doing the collection,
+    // so their CPU time is not included in its per-thread clock.
+    stats.gc.nonmoving_gc_cpu_ns =
+        cpu - start_nonmoving_gc_cpu + nonmoving_mark_helpers_cpu;
     stats.nonmoving_gc_cpu_ns += stats.gc.nonmoving_gc_cpu_ns;
 
     stats.nonmoving_gc_max_elapsed_ns =
@@ -326,6 +391,37 @@ stat_endNonmovingGc ()
               stats.nonmoving_gc_max_elapsed_ns);
 }
 
+/* Called at the end of each nonmoving collection by the collector for each
+ * parallel mark worker. Worker 0 is the collector itself.
+ */
+void
+stat_nonmovingMarkWorker (uint32_t worker, Time cpu_ns, W_ entries,
+                          W_ stolen, W_ donated)
+{
+    if (worker > 0) {
+        nonmoving_mark_helpers_cpu += cpu_ns;
+    }
+    if (nonmoving_mark_worker_stats == NULL) {
+        return;
+    }
+    NonmovingMarkWorkerStats *s = &nonmoving_mark_worker_stats[worker];
+    s->cpu_ns += cpu_ns;
+    s->entries += entries;
+    s->stolen += stolen;
+    s->donated += donated;
+}
+
+/* Called by an idle capability after a slice of nonmoving collector work,
+ * which may run concurrently with other slices.
+ */
+void
+stat_nonmovingIdleSlice (W_ entries, W_ segments)
+{
+    atomic_inc(&nonmoving_idle_slices, 1);
+    atomic_inc(&nonmoving_idle_entries, entries);
+    atomic_inc(&nonmoving_idle_segments, segments);
+}
+
 void
 stat_startNonmovingGcSync ()
 {
@@ -448,6 +544,21 @@ stat_startGC (Capability *cap, gc_thread *gct)
     updateNurseriesStats();
 }
 
+#if defined(THREADED_RTS)
+// The GC_sync_hist bucket for a sync that took t
+static uint32_t
+syncBucket (Time t)
+{
+    StgWord64 us = TimeToUS(t);
+    uint32_t b = 0;
+    while (us > 0 && b < GC_SYNC_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+#endif
+
 /* -----------------------------------------------------------------------------
    Called at the end of each GC
    -------------------------------------------------------------------------- */
@@ -457,7 +568,7 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
             uint32_t gen, uint32_t par_n_threads, gc_thread **gc_threads,
             W_ par_max_copied, W_ par_balanced_copied, W_ gc_spin_spin, W_ gc_spin_yield,
             W_ mut_spin_spin, W_ mut_spin_yield, W_ any_work, W_ no_work,
-            W_ scav_find_work)
+            W_ scav_find_work, W_ steal_success, W_ steal_fail)
 {
     // -------------------------------------------------
     // Collect all the stats about this GC in stats.gc. We always do this since
@@ -480,6 +591,8 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
     stats.gc.copied_bytes = copied * sizeof(W_);
     stats.gc.par_max_copied_bytes = par_max_copied * sizeof(W_);
     stats.gc.par_balanced_copied_bytes = par_balanced_copied * sizeof(W_);
+    stats.gc.par_steal_success = steal_success;
+    stats.gc.par_steal_fail = steal_fail;
 
     bool stats_enabled =
         RtsFlags.GcFlags.giveStats != NO_GC_STATS ||
@@ -498,6 +611,10 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
 
         stats.gc.sync_elapsed_ns =
             initiating_gct->gc_start_elapsed - initiating_gct->gc_sync_start_elapsed;
+#if defined(THREADED_RTS)
+        GC_sync_hist[syncBucket(stats.gc.sync_elapsed_ns)]++;
+        GC_sync_max = stg_max(GC_sync_max, stats.gc.sync_elapsed_ns);
+#endif
         stats.gc.elapsed_ns = current_elapsed - initiating_gct->gc_start_elapsed;
         stats.gc.cpu_ns = 0;
         for (unsigned int i=0; i < par_n_threads; i++) {
@@ -529,6 +646,8 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
         stats.any_work += any_work;
         stats.no_work += no_work;
         stats.scav_find_work += scav_find_work;
+        stats.steal_success += steal_success;
+        stats.steal_fail += steal_fail;
         stats.gc_spin_spin += gc_spin_spin;
         stats.gc_spin_yield += gc_spin_yield;
         stats.mut_spin_spin += mut_spin_spin;
@@ -818,10 +937,18 @@ static void report_summary(const RTSSummaryStats* sum)
     statsPrintf("%16s bytes maximum slop\n", temp);
 
     statsPrintf("%16" FMT_Word64 " MiB total memory in use (%"
-                FMT_Word64 " MB lost due to fragmentation)\n\n",
+                FMT_Word64 " MB lost due to fragmentation)\n",
                 stats.max_mem_in_use_bytes  / (1024 * 1024),
                 sum->fragmentation_bytes / (1024 * 1024));
 
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+        statsPrintf("%16" FMT_Word64 " MiB of heap in huge pages (%"
+                    FMT_Word64 " 2MB pages)\n",
+                    sum->huge_page_bytes / (1024 * 1024),
+                    sum->huge_page_bytes / (2 * 1024 * 1024));
+    }
+    statsPrintf("\n");
+
     /* Print garbage collections in each gen */
     statsPrintf("                                     Tot time (elapsed)  Avg pause  Max pause\n");
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
@@ -854,6 +981,26 @@ static void report_summary(const RTSSummaryStats* sum)
                     TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
     }
 
+    if (nonmoving_mark_worker_stats != NULL) {
+        statsPrintf("\n  Nonmoving mark workers:   CPU time"
+                    "            Marked      Stolen     Donated\n");
+        for (uint32_t i = 0; i < RtsFlags.GcFlags.nonmovingMarkThreads; i++) {
+            const NonmovingMarkWorkerStats *w = &nonmoving_mark_worker_stats[i];
+            showStgWord64(w->entries, temp, true/*commas*/);
+            statsPrintf("    Worker %3" FMT_Word32 "          %8.3fs  %16s"
+                        "  %10" FMT_Word64 "  %10" FMT_Word64 "\n",
+                        i, TimeToSecondsDbl(w->cpu_ns), temp,
+                        w->stolen, w->donated);
+        }
+    }
+
+    if (nonmoving_idle_slices > 0) {
+        showStgWord64(nonmoving_idle_entries, temp, true/*commas*/);
+        statsPrintf("\n  Nonmoving idle slices: %" FMT_Word " (%s entries marked"
+                    ", %" FMT_Word " segments swept)\n",
+                    nonmoving_idle_slices, temp, nonmoving_idle_segments);
+    }
+
     statsPrintf("\n");
 
 #if defined(THREADED_RTS)
@@ -862,6 +1009,46 @@ static void report_summary(const RTSSummaryStats* sum)
         statsPrintf("  Parallel GC work balance: "
                     "%.2f%% (serial 0%%, perfect 100%%)\n\n",
                     sum->work_balance * 100);
+        statsPrintf("  Parallel GC steals: %" FMT_Word64
+                    " (%" FMT_Word64 " failed)\n\n",
+                    stats.steal_success, stats.steal_fail);
+    }
+
+    if (n_capabilities > 1 && GC_sync_max > 0) {
+        uint32_t lo = 0, hi = GC_SYNC_BUCKETS - 1;
+        while (GC_sync_hist[lo] == 0) lo++;
+        while (GC_sync_hist[hi] == 0) hi--;
+        statsPrintf("  GC sync (time to stop all capabilities), max %.3fms:\n",
+                    TimeToSecondsDbl(GC_sync_max) * 1000);
+        for (uint32_t b = lo; b <= hi; b++) {
+            if (b == GC_SYNC_BUCKETS - 1) {
+                statsPrintf("    >= %7" FMT_Word64 "us: %10" FMT_Word64 "\n",
+                            (StgWord64)1 << (b - 1), GC_sync_hist[b]);
+            } else {
+                statsPrintf("    <  %7" FMT_Word64 "us: %10" FMT_Word64 "\n",
+                            (StgWord64)1 << b, GC_sync_hist[b]);
+            }
+        }
+        statsPrintf("\n");
+    }
+
+    if (n_capabilities > 1 && GC_slowest_sync > 0) {
+        const SyncStop *stop = &GC_slowest_sync_stop;
+        statsPrintf("  Slowest GC sync: %.3fms, waiting for capability %"
+                    FMT_Word32, TimeToSecondsDbl(GC_slowest_sync) * 1000,
+                    GC_slowest_sync_cap);
+        if (stop->tso != 0) {
+            statsPrintf(" (thread %" FMT_Word64 ", info %p",
+                        (StgWord64)stop->tso, (void *)stop->info);
+#if defined(PROFILING)
+            if (stop->ccs != NULL) {
+                statsPrintf(", cost centre %s.%s",
+                            stop->ccs->cc->module, stop->ccs->cc->label);
+            }
+#endif
+            statsPrintf(")");
+        }
+        statsPrintf("\n\n");
     }
 
     statsPrintf("  TASKS: %d "
@@ -877,8 +1064,81 @@ static void report_summary(const RTSSummaryStats* sum)
                 sum->sparks.converted, sum->sparks.overflowed,
                 sum->sparks.dud, sum->sparks.gcd,
                 sum->sparks.fizzled);
+
+    if (sum->threads_migrated > 0) {
+        statsPrintf("  Threads migrated: %" FMT_Word64 " (%" FMT_Word64
+                    " to another NUMA node)\n\n",
+                    sum->threads_migrated, sum->threads_migrated_remote);
+    }
+
+    if (sum->threads_stolen > 0) {
+        statsPrintf("  Threads stolen: %" FMT_Word64 " (%" FMT_Word64
+                    " from another NUMA node)\n\n",
+                    sum->threads_stolen, sum->threads_stolen_remote);
+    }
+
+    if (sum->sparks.stolen > 0) {
+        statsPrintf("  Sparks stolen: %" FMT_Word " (%" FMT_Word
+                    " from another NUMA node)\n\n",
+                    sum->sparks.stolen, sum->sparks.stolen_remote);
+    }
+
+    if (n_numa_nodes > 1) {
+        for (uint32_t n = 0; n < n_numa_nodes; n++) {
+            const SparkCounters *ns = &sum->node_sparks[n];
+            statsPrintf("  SPARKS on NUMA node %d: %" FMT_Word " converted, %"
+                        FMT_Word " overflowed, %" FMT_Word " GC'd, %"
+                        FMT_Word " fizzled\n",
+                        numa_map[n], ns->converted, ns->overflowed,
+                        ns->gcd, ns->fizzled);
+        }
+        for (uint32_t n = 0; n < n_numa_nodes; n++) {
+            statsPrintf("  Threads migrated from NUMA node %d: %" FMT_Word64
+                        " (%" FMT_Word64 " to another node)\n",
+                        numa_map[n], sum->node_threads_migrated[n],
+                        sum->node_threads_migrated_remote[n]);
+        }
+        statsPrintf("\n");
+    }
 #endif
 
+    if (sum->stm.commits + sum->stm.aborts + sum->stm.retries > 0) {
+        StgWord attempts = sum->stm.commits + sum->stm.aborts;
+        statsPrintf("  STM: %" FMT_Word " commits (%" FMT_Word " aborted, %"
+                    FMT_Word " retried, %" FMT_Word " of %" FMT_Word
+                    " TRec closures reused)\n",
+                    sum->stm.commits, sum->stm.aborts, sum->stm.retries,
+                    sum->stm.reused, sum->stm.allocated + sum->stm.reused);
+        if (sum->stm.serialised > 0) {
+            statsPrintf("       %" FMT_Word " transactions serialised after "
+                        "repeated aborts\n", sum->stm.serialised);
+        }
+        if (attempts > 0 && sum->stm.reads + sum->stm.writes > 0) {
+            statsPrintf("       average %.1f TVars read, %.1f written\n",
+                        (double)sum->stm.reads / attempts,
+                        (double)sum->stm.writes / attempts);
+        }
+        statsPrintf("\n");
+    }
+
+    if (sum->mvar.blocks > 0) {
+        statsPrintf("  MVar: %" FMT_Word " threads woken after blocking "
+                    "for %.3fms on average\n", sum->mvar.blocks,
+                    (double)sum->mvar.block_ns / sum->mvar.blocks / 1e6);
+        if (sum->mvar.handoffs > 0) {
+            statsPrintf("        %" FMT_Word " handed off between "
+                        "capabilities, %.1fus on average (%.1fus max)\n",
+                        sum->mvar.handoffs,
+                        (double)sum->mvar.handoff_ns / sum->mvar.handoffs / 1e3,
+                        (double)sum->mvar.max_handoff_ns / 1e3);
+        }
+        if (sum->mvar.batched > 0) {
+            statsPrintf("        %" FMT_Word " wakeups sent in batches\n",
+                        sum->mvar.batched);
+        }
+        statsPrintf("\n");
+    }
+
     statsPrintf("  INIT    time  %7.3fs  (%7.3fs elapsed)\n",
                 TimeToSecondsDbl(stats.init_cpu_ns),
                 TimeToSecondsDbl(stats.init_elapsed_ns));
@@ -972,8 +1232,9 @@ static void report_summary(const RTSSummaryStats* sum)
                     , col_width[1], "whitehole_lockClosure"
                     , col_width[2], whitehole_lockClosure_spin
                     , col_width[3], whitehole_lockClosure_yield);
-        // waitForGcThreads isn't really spin-locking(see the function)
-        // but these numbers still seem useful.
+        // gc_spin, mut_spin and waitForGcThreads aren't spin locks any
+        // more: their "Yields" are the times the thread parked, see
+        // Note [Parking GC threads] in GC.c.
         statsPrintf("%*s" "%*s" "%*" FMT_Word64 "%*" FMT_Word64 "\n"
                     , col_width[0], ""
                     , col_width[1], "waitForGcThreads"
@@ -1096,13 +1357,33 @@ static void report_machine_readable (const RTSSummaryStats * sum)
 #if !defined(THREADED_RTS) // THREADED_RTS
     MR_STAT("gc_cpu_percent", "f", sum->gc_cpu_percent);
     MR_STAT("gc_wall_percent", "f", sum->gc_cpu_percent);
+#if !defined(mingw32_HOST_OS)
+    MR_STAT("io_backend", "s", sum->io_backend);
+#endif
 #endif
     MR_STAT("fragmentation_bytes", FMT_Word64, sum->fragmentation_bytes);
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+        MR_STAT("huge_page_bytes", FMT_Word64, sum->huge_page_bytes);
+    }
     // average_bytes_used is done above
     MR_STAT("alloc_rate", FMT_Word64, sum->alloc_rate);
     MR_STAT("productivity_cpu_percent", "f", sum->productivity_cpu_percent);
     MR_STAT("productivity_wall_percent", "f",
             sum->productivity_elapsed_percent);
+    MR_STAT("stm_commits", FMT_Word, sum->stm.commits);
+    MR_STAT("stm_aborts", FMT_Word, sum->stm.aborts);
+    MR_STAT("stm_retries", FMT_Word, sum->stm.retries);
+    MR_STAT("stm_read_set", FMT_Word, sum->stm.reads);
+    MR_STAT("stm_write_set", FMT_Word, sum->stm.writes);
+    MR_STAT("stm_allocated", FMT_Word, sum->stm.allocated);
+    MR_STAT("stm_reused", FMT_Word, sum->stm.reused);
+    MR_STAT("stm_serialised", FMT_Word, sum->stm.serialised);
+    MR_STAT("mvar_blocks", FMT_Word, sum->mvar.blocks);
+    MR_STAT("mvar_block_ns", FMT_Word64, sum->mvar.block_ns);
+    MR_STAT("mvar_handoffs", FMT_Word, sum->mvar.handoffs);
+    MR_STAT("mvar_handoff_ns", FMT_Word64, sum->mvar.handoff_ns);
+    MR_STAT("mvar_max_handoff_ns", FMT_Word64, sum->mvar.max_handoff_ns);
+    MR_STAT("wakeups_batched", FMT_Word, sum->mvar.batched);
 
     // next, the THREADED_RTS fields in RTSSummaryStats
 
@@ -1114,7 +1395,36 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("sparks_dud ", FMT_Word, sum->sparks.dud);
     MR_STAT("sparks_gcd", FMT_Word, sum->sparks.gcd);
     MR_STAT("sparks_fizzled", FMT_Word, sum->sparks.fizzled);
+    MR_STAT("sparks_stolen", FMT_Word, sum->sparks.stolen);
+    MR_STAT("sparks_stolen_remote", FMT_Word, sum->sparks.stolen_remote);
+    MR_STAT("threads_migrated", FMT_Word64, sum->threads_migrated);
+    MR_STAT("threads_migrated_remote", FMT_Word64,
+            sum->threads_migrated_remote);
+    MR_STAT("threads_stolen", FMT_Word64, sum->threads_stolen);
+    MR_STAT("threads_stolen_remote", FMT_Word64,
+            sum->threads_stolen_remote);
     MR_STAT("work_balance", "f", sum->work_balance);
+    MR_STAT("gc_steal_success", FMT_Word64, stats.steal_success);
+    MR_STAT("gc_steal_fail", FMT_Word64, stats.steal_fail);
+    MR_STAT("gc_sync_max_ns", FMT_Word64, (StgWord64)TimeToNS(GC_sync_max));
+    MR_STAT("gc_slowest_sync_ns", FMT_Word64,
+            (StgWord64)TimeToNS(GC_slowest_sync));
+    MR_STAT("gc_slowest_sync_cap", FMT_Word32, GC_slowest_sync_cap);
+    MR_STAT("gc_slowest_sync_thread", FMT_Word64,
+            (StgWord64)GC_slowest_sync_stop.tso);
+    MR_STAT("gc_slowest_sync_info", FMT_HexWord,
+            (StgWord)GC_slowest_sync_stop.info);
+    // only the non-empty buckets of the histogram
+    for (uint32_t b = 0; b < GC_SYNC_BUCKETS - 1; b++) {
+        if (GC_sync_hist[b] == 0) continue;
+        statsPrintf(" ,(\"gc_sync_lt_%" FMT_Word64 "us\", \"%" FMT_Word64
+                    "\")\n", (StgWord64)1 << b, GC_sync_hist[b]);
+    }
+    if (GC_sync_hist[GC_SYNC_BUCKETS - 1] != 0) {
+        statsPrintf(" ,(\"gc_sync_ge_%" FMT_Word64 "us\", \"%" FMT_Word64
+                    "\")\n", (StgWord64)1 << (GC_SYNC_BUCKETS - 2),
+                    GC_sync_hist[GC_SYNC_BUCKETS - 1]);
+    }
 
     // next, globals (other than internal counters)
     MR_STAT("n_capabilities", FMT_Word32, n_capabilities);
@@ -1189,6 +1499,11 @@ static void report_machine_readable (const RTSSummaryStats * sum)
                 TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
         MR_STAT("nonmoving_concurrent_avg_pause_seconds", "f",
                 TimeToSecondsDbl(stats.nonmoving_gc_elapsed_ns) / n_major_colls);
+        MR_STAT("nonmoving_idle_slices", FMT_Word, nonmoving_idle_slices);
+        MR_STAT("nonmoving_idle_marked_entries", FMT_Word,
+                nonmoving_idle_entries);
+        MR_STAT("nonmoving_idle_swept_segments", FMT_Word,
+                nonmoving_idle_segments);
     }
 
 
@@ -1329,18 +1644,58 @@ stat_exit (void)
 
         // We populate the remainder (non-time elements) of sum
         {
+            for (uint32_t i = 0; i < n_capabilities; i++) {
+                StmCounters *stm = &capabilities[i]->stm_stats;
+                sum.stm.commits    += stm->commits;
+                sum.stm.aborts     += stm->aborts;
+                sum.stm.retries    += stm->retries;
+                sum.stm.reads      += stm->reads;
+                sum.stm.writes     += stm->writes;
+                sum.stm.allocated  += stm->allocated;
+                sum.stm.reused     += stm->reused;
+                sum.stm.serialised += stm->serialised;
+
+                MVarCounters *mvar = &capabilities[i]->mvar_stats;
+                sum.mvar.blocks     += mvar->blocks;
+                sum.mvar.block_ns   += mvar->block_ns;
+                sum.mvar.handoffs   += mvar->handoffs;
+                sum.mvar.handoff_ns += mvar->handoff_ns;
+                sum.mvar.max_handoff_ns =
+                    stg_max(sum.mvar.max_handoff_ns, mvar->max_handoff_ns);
+                sum.mvar.batched    += mvar->batched;
+            }
+
     #if defined(THREADED_RTS)
             sum.bound_task_count = taskCount - workerCount;
 
             for (uint32_t i = 0; i < n_capabilities; i++) {
-                sum.sparks.created   += capabilities[i]->spark_stats.created;
-                sum.sparks.dud       += capabilities[i]->spark_stats.dud;
-                sum.sparks.overflowed+=
-                  capabilities[i]->spark_stats.overflowed;
-                sum.sparks.converted +=
-                  capabilities[i]->spark_stats.converted;
-                sum.sparks.gcd       += capabilities[i]->spark_stats.gcd;
-                sum.sparks.fizzled   += capabilities[i]->spark_stats.fizzled;
+                SparkCounters *cs = &capabilities[i]->spark_stats;
+                SparkCounters *ns =
+                    &sum.node_sparks[capabilities[i]->node];
+                sum.sparks.created   += cs->created;
+                sum.sparks.dud       += cs->dud;
+                sum.sparks.overflowed+= cs->overflowed;
+                sum.sparks.converted += cs->converted;
+                sum.sparks.gcd       += cs->gcd;
+                sum.sparks.fizzled   += cs->fizzled;
+                sum.sparks.stolen    += cs->stolen;
+                sum.sparks.stolen_remote += cs->stolen_remote;
+                ns->converted        += cs->converted;
+                ns->overflowed       += cs->overflowed;
+                ns->gcd              += cs->gcd;
+                ns->fizzled          += cs->fizzled;
+
+                uint32_t node = capabilities[i]->node;
+                sum.threads_migrated += capabilities[i]->threads_migrated;
+                sum.threads_migrated_remote +=
+                    capabilities[i]->threads_migrated_remote;
+                sum.node_threads_migrated[node] +=
+                    capabilities[i]->threads_migrated;
+                sum.node_threads_migrated_remote[node] +=
+                    capabilities[i]->threads_migrated_remote;
+                sum.threads_stolen += capabilities[i]->threads_stolen;
+                sum.threads_stolen_remote +=
+                    capabilities[i]->threads_stolen_remote;
             }
 
             sum.sparks_count = sum.sparks.created
@@ -1362,6 +1717,9 @@ stat_exit (void)
                                   / stats.cpu_ns;
             sum.gc_elapsed_percent = stats.gc_elapsed_ns
                                   / stats.elapsed_ns;
+#if !defined(mingw32_HOST_OS)
+            sum.io_backend = ioBackendName();
+#endif
     #endif // THREADED_RTS
 
             sum.fragmentation_bytes =
@@ -1371,6 +1729,11 @@ stat_exit (void)
                          - hw_alloc_blocks * BLOCK_SIZE_W)
                 / (uint64_t)sizeof(W_);
 
+            // See Note [Huge pages] in posix/OSMem.c
+            sum.huge_page_bytes =
+                RtsFlags.GcFlags.hugePages == HUGE_PAGES_NONE ? 0 :
+                osHugePageBytes();
+
             sum.average_bytes_used = stats.major_gcs == 0 ? 0 :
                  stats.cumulative_live_bytes/stats.major_gcs,
 
@@ -1446,6 +1809,10 @@ stat_exit (void)
       stgFree(GC_coll_max_pause);
       GC_coll_max_pause = NULL;
     }
+    if (nonmoving_mark_worker_stats) {
+      stgFree(nonmoving_mark_worker_stats);
+      nonmoving_mark_worker_stats = NULL;
+    }
 }
 
 /* Note [Work Balance]
@@ -1585,6 +1952,9 @@ Parallel garbage collector counters:
     Incremented whenever any_work finds no work.
 * scav_find_work:
     Called to do work when any_work return true.
+* steal_success, steal_fail:
+    Calls to steal_todo_block which did or did not find a block to steal.
+    These are also shown in the regular +RTS -s output.
 
 */
 
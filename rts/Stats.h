@@ -11,6 +11,8 @@
 #include "GetTime.h"
 #include "sm/GC.h"
 #include "Sparks.h"
+#include "STM.h"
+#include "Threads.h"
 
 #include "BeginPrivate.h"
 
@@ -29,6 +31,9 @@ void      stat_startInit(void);
 void      stat_endInit(void);
 
 void      stat_startGCSync(struct gc_thread_ *_gct);
+#if defined(THREADED_RTS)
+void      stat_gcSyncLast(Capability *last, Time sync_time);
+#endif
 void      stat_startGC(Capability *cap, struct gc_thread_ *_gct);
 void      stat_startGCWorker (Capability *cap, struct gc_thread_ *_gct);
 void      stat_endGCWorker (Capability *cap, struct gc_thread_ *_gct);
@@ -38,12 +43,15 @@ void      stat_endGC  (Capability *cap, struct gc_thread_ *initiating_gct, W_ li
                        W_ par_max_copied, W_ par_balanced_copied,
                        W_ gc_spin_spin, W_ gc_spin_yield, W_ mut_spin_spin,
                        W_ mut_spin_yield, W_ any_work, W_ no_work,
-                       W_ scav_find_work);
+                       W_ scav_find_work, W_ steal_success, W_ steal_fail);
 
 void      stat_startNonmovingGcSync(void);
 void      stat_endNonmovingGcSync(void);
 void      stat_startNonmovingGc (void);
 void      stat_endNonmovingGc (void);
+void      stat_nonmovingMarkWorker (uint32_t worker, Time cpu_ns, W_ entries,
+                                    W_ stolen, W_ donated);
+void      stat_nonmovingIdleSlice (W_ entries, W_ segments);
 
 #if defined(PROFILING)
 void      stat_startRP(void);
@@ -86,6 +94,15 @@ typedef struct GenerationSummaryStats_ {
 #endif
 } GenerationSummaryStats;
 
+// Per-worker statistics of the parallel nonmoving mark, accumulated over all
+// major collections. See Note [Parallel marking in the nonmoving collector].
+typedef struct NonmovingMarkWorkerStats_ {
+    Time cpu_ns;
+    uint64_t entries;
+    uint64_t stolen;
+    uint64_t donated;
+} NonmovingMarkWorkerStats;
+
 typedef struct RTSSummaryStats_ {
     // These profiling times could potentially be in RTSStats. However, I'm not
     // confident enough to do this now, since there is some logic depending on
@@ -103,12 +120,25 @@ typedef struct RTSSummaryStats_ {
     uint32_t bound_task_count;
     uint64_t sparks_count;
     SparkCounters sparks;
+    SparkCounters node_sparks[MAX_NUMA_NODES]; // by logical NUMA node
+    uint64_t threads_migrated;
+    uint64_t threads_migrated_remote;
+    uint64_t node_threads_migrated[MAX_NUMA_NODES];        // from each node
+    uint64_t node_threads_migrated_remote[MAX_NUMA_NODES];
+    uint64_t threads_stolen;                    // with +RTS -qs
+    uint64_t threads_stolen_remote;
     double work_balance;
 #else // THREADED_RTS
     double gc_cpu_percent;
     double gc_elapsed_percent;
+#if !defined(mingw32_HOST_OS)
+    const char *io_backend; // awaitEvent backend, see posix/Select.c
+#endif
 #endif
+    StmCounters stm;
+    MVarCounters mvar;
     uint64_t fragmentation_bytes;
+    uint64_t huge_page_bytes; // only meaningful with --huge-pages
     uint64_t average_bytes_used; // This is not shown in the '+RTS -s' report
     uint64_t alloc_rate;
     double productivity_cpu_percent;
@@ -31,6 +31,11 @@
  */
 static StgThreadID next_thread_id = 1;
 
+/* Are we timing MVar blocking and handoffs?  Set by initScheduler().  See
+ * Note [MVar wakeup statistics].
+ */
+bool mvar_timing_enabled = false;
+
 /* The smallest stack size that makes any sense is:
  *    RESERVED_STACK_WORDS    (so we can get back from the stack overflow)
  *  + sizeofW(StgStopFrame)   (the stg_stop_thread_info frame)
@@ -105,6 +110,8 @@ createThread(Capability *cap, W_ size)
     tso->saved_errno = 0;
     tso->bound = NULL;
     tso->cap = cap;
+    tso->block_start = 0;
+    tso->offered = TSO_NOT_OFFERED;
 
     tso->stackobj       = stack;
     tso->tot_stack_size = stack->stack_size;
@@ -256,6 +263,132 @@ removeThreadFromDeQueue (Capability *cap,
     barf("removeThreadFromDeQueue: not found");
 }
 
+/* ----------------------------------------------------------------------------
+   Batched wakeups
+
+   Note [Batched wakeups]
+   ~~~~~~~~~~~~~~~~~~~~~~
+   To wake up a thread that belongs to another Capability, tryWakeupThread
+   sends that Capability a MSG_TRY_WAKEUP message, which means taking its
+   lock and interrupting it.  An operation that wakes up many threads at
+   once - a putMVar# that satisfies a queue of readMVar#s, or an STM commit
+   waking everything waiting on a TVar - would pay for that once per thread,
+   and keep interrupting the other Capabilities while they are trying to
+   get through their inboxes.
+
+   So such operations call beginWakeupBatch() first and endWakeupBatch()
+   when they are done.  In between, tryWakeupThread holds its messages back
+   in cap->wakeup_batches, chained per target Capability, and
+   endWakeupBatch() sends each chain with one sendMessages().  A chain is
+   executed in the order it was built, so threads blocked on an MVar are
+   still woken in FIFO order.
+
+   A batch only lasts as long as the operation, which can't GC, so the held
+   messages needn't be GC roots, and no wakeup is delayed by more than the
+   time it takes to wake up the rest of the batch.  The common case of a
+   putMVar# or takeMVar# handing over to a single thread isn't batched.
+
+   Note [MVar wakeup statistics]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS -s, or scheduler events in the eventlog, each Capability
+   counts in cap->mvar_stats:
+
+    - the time threads spend blocked on MVars, from the scheduler seeing
+      them block (when scheduleHandleThreadBlocked() stamps
+      tso->block_start) to their going back on the run queue;
+
+    - for threads woken by another Capability, the handoff latency: the
+      time from the MVar operation that woke them (when tryWakeupThread
+      stamps the MSG_TRY_WAKEUP) to their own Capability receiving the
+      message.  That is the cost of a cross-Capability wakeup, which
+      batching tries to keep down.
+
+   They are printed by +RTS -s and posted in MVAR_COUNTERS events at each
+   GC.  Otherwise we don't read the clock on every block and handoff.
+   ------------------------------------------------------------------------- */
+
+void
+beginWakeupBatch (Capability *cap USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    cap->wakeup_batch_depth++;
+#endif
+}
+
+#if defined(THREADED_RTS)
+static void
+flushWakeupBatch (Capability *cap)
+{
+    for (uint32_t i = 0; i < cap->n_wakeup_batches; i++) {
+        WakeupBatch *b = &cap->wakeup_batches[i];
+        sendMessages(cap, b->to, b->head, b->tail);
+        cap->mvar_stats.batched += b->n;
+    }
+    cap->n_wakeup_batches = 0;
+}
+
+static void
+batchWakeup (Capability *cap, Capability *to, Message *msg)
+{
+    for (uint32_t i = 0; i < cap->n_wakeup_batches; i++) {
+        WakeupBatch *b = &cap->wakeup_batches[i];
+        if (b->to == to) {
+            b->tail->link = msg;
+            b->tail = msg;
+            b->n++;
+            return;
+        }
+    }
+    if (cap->n_wakeup_batches == WAKEUP_BATCH_CAPS) {
+        flushWakeupBatch(cap);
+    }
+    cap->wakeup_batches[cap->n_wakeup_batches++] =
+        (WakeupBatch) { .to = to, .head = msg, .tail = msg, .n = 1 };
+}
+#endif
+
+void
+endWakeupBatch (Capability *cap USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    ASSERT(cap->wakeup_batch_depth > 0);
+    if (--cap->wakeup_batch_depth == 0) {
+        flushWakeupBatch(cap);
+    }
+#endif
+}
+
+static bool
+blockedOnMVar (StgTSO *tso)
+{
+    return tso->why_blocked == BlockedOnMVar ||
+           tso->why_blocked == BlockedOnMVarRead;
+}
+
+void
+countMVarHandoff (Capability *cap, StgTSO *tso, StgWord sent)
+{
+    if (blockedOnMVar(tso)) {
+        // StgWord arithmetic, in case the stamp was truncated
+        StgWord64 ns = (StgWord)getMonotonicNSec() - sent;
+        cap->mvar_stats.handoffs++;
+        cap->mvar_stats.handoff_ns += ns;
+        if (ns > cap->mvar_stats.max_handoff_ns) {
+            cap->mvar_stats.max_handoff_ns = ns;
+        }
+    }
+}
+
+static void
+countMVarWakeup (Capability *cap, StgTSO *tso)
+{
+    if (tso->block_start != 0) {
+        cap->mvar_stats.blocks++;
+        cap->mvar_stats.block_ns += getMonotonicNSec() - tso->block_start;
+        tso->block_start = 0;
+    }
+}
+
 /* ----------------------------------------------------------------------------
    tryWakeupThread()
 
@@ -276,10 +409,18 @@ tryWakeupThread (Capability *cap, StgTSO *tso)
         MessageWakeup *msg;
         msg = (MessageWakeup *)allocate(cap,sizeofW(MessageWakeup));
         msg->tso = tso;
+        msg->sent = 0;
+        if (RTS_UNLIKELY(mvar_timing_enabled) && blockedOnMVar(tso)) {
+            msg->sent = (StgWord)getMonotonicNSec();
+        }
         SET_HDR(msg, &stg_MSG_TRY_WAKEUP_info, CCS_SYSTEM);
         // Ensure that writes constructing Message are committed before sending.
         write_barrier();
-        sendMessage(cap, tso->cap, (Message*)msg);
+        if (cap->wakeup_batch_depth > 0) {
+            batchWakeup(cap, tso->cap, (Message*)msg);
+        } else {
+            sendMessage(cap, tso->cap, (Message*)msg);
+        }
         debugTraceCap(DEBUG_sched, cap, "message: try wakeup thread %ld on cap %d",
                       (W_)tso->id, tso->cap->no);
         return;
@@ -293,6 +434,9 @@ tryWakeupThread (Capability *cap, StgTSO *tso)
     {
         if (tso->_link == END_TSO_QUEUE) {
             tso->block_info.closure = (StgClosure*)END_TSO_QUEUE;
+            if (RTS_UNLIKELY(mvar_timing_enabled)) {
+                countMVarWakeup(cap, tso);
+            }
             goto unblock;
         } else {
             return;
@@ -358,6 +502,9 @@ void
 migrateThread (Capability *from, StgTSO *tso, Capability *to)
 {
     traceEventMigrateThread (from, tso, to->no);
+#if defined(THREADED_RTS)
+    countThreadMigration(from, to);
+#endif
     // ThreadMigrating tells the target cap that it needs to be added to
     // the run queue when it receives the MSG_TRY_WAKEUP.
     tso->why_blocked = ThreadMigrating;
@@ -772,6 +919,7 @@ bool performTryPutMVar(Capability *cap, StgMVar *mvar, StgClosure *value)
     const StgInfoTable *qinfo;
     StgMVarTSOQueue *q;
     StgTSO *tso;
+    bool batching = false;
 
     info = lockClosure((StgClosure*)mvar);
 
@@ -792,6 +940,9 @@ loop:
 
         mvar->value = value;
         unlockClosure((StgClosure*)mvar, &stg_MVAR_DIRTY_info);
+        if (batching) {
+            endWakeupBatch(cap);
+        }
         return true;
     }
 
@@ -827,6 +978,13 @@ loop:
         dirty_STACK(cap, stack);
     }
 
+    // Waking up readMVar#s may wake up many threads, see
+    // Note [Batched wakeups]
+    if (why_blocked == BlockedOnMVarRead && !batching) {
+        beginWakeupBatch(cap);
+        batching = true;
+    }
+
     tryWakeupThread(cap, tso);
 
     // If it was a readMVar, then we can still do work,
@@ -840,6 +998,9 @@ loop:
 
     unlockClosure((StgClosure*)mvar, info);
 
+    if (batching) {
+        endWakeupBatch(cap);
+    }
     return true;
 }
 
@@ -12,11 +12,42 @@
 
 #define END_BLOCKED_EXCEPTIONS_QUEUE ((MessageThrowTo*)END_TSO_QUEUE)
 
+/* Per-Capability MVar counters, see Note [MVar wakeup statistics] */
+typedef struct {
+    StgWord   blocks;         /* threads woken after blocking on an MVar */
+    StgWord64 block_ns;       /* total time they spent blocked */
+    StgWord   handoffs;       /* ... of those, woken by another Capability */
+    StgWord64 handoff_ns;     /* total time from handoff to wakeup */
+    StgWord64 max_handoff_ns; /* longest time from handoff to wakeup */
+    StgWord   batched;        /* wakeup messages sent in batches */
+} MVarCounters;
+
+/* Wakeup messages for one Capability, held back until the end of a batch
+ * of wakeups; see Note [Batched wakeups] */
+typedef struct {
+    Capability *to;
+    Message    *head, *tail;
+    uint32_t    n;
+} WakeupBatch;
+
+#define WAKEUP_BATCH_CAPS 8
+
+extern bool mvar_timing_enabled;
+
+/* Values of tso->offered, see Note [Work-stealing run queues] in
+ * Schedule.c */
+#define TSO_NOT_OFFERED 0
+#define TSO_OFFERED     1
+#define TSO_CLAIMING    2   /* being taken by another Capability */
+
 StgTSO * unblockOne (Capability *cap, StgTSO *tso);
 StgTSO * unblockOne_ (Capability *cap, StgTSO *tso, bool allow_migrate);
 
 void checkBlockingQueues (Capability *cap, StgTSO *tso);
 void tryWakeupThread     (Capability *cap, StgTSO *tso);
+void beginWakeupBatch    (Capability *cap);
+void endWakeupBatch      (Capability *cap);
+void countMVarHandoff    (Capability *cap, StgTSO *tso, StgWord sent);
 void migrateThread       (Capability *from, StgTSO *tso, Capability *to);
 
 // Wakes up a thread on a Capability (probably a different Capability
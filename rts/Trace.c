@@ -31,6 +31,7 @@
 int TRACE_sched;
 int TRACE_gc;
 int TRACE_nonmoving_gc;
+int TRACE_stm;
 int TRACE_spark_sampled;
 int TRACE_spark_full;
 int TRACE_user;
@@ -67,6 +68,9 @@ void initTracing (void)
     TRACE_nonmoving_gc =
         RtsFlags.TraceFlags.nonmoving_gc;
 
+    TRACE_stm =
+        RtsFlags.TraceFlags.stm;
+
     TRACE_spark_sampled =
         RtsFlags.TraceFlags.sparks_sampled;
 
@@ -91,9 +95,17 @@ void initTracing (void)
      */
     initEventLogging();
 
-    if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG
-            && rtsConfig.eventlog_writer != NULL) {
-        startEventLogging(rtsConfig.eventlog_writer);
+    if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG) {
+        const EventLogWriter *writer = rtsConfig.eventlog_writer;
+#if !defined(mingw32_HOST_OS)
+        // --eventlog-socket overrides the writer given by the RtsConfig
+        if (RtsFlags.TraceFlags.trace_socket != NULL) {
+            writer = &SocketEventLogWriter;
+        }
+#endif
+        if (writer != NULL) {
+            startEventLogging(writer);
+        }
     }
 }
 
@@ -200,6 +212,10 @@ static void traceSchedEvent_stderr (Capability *cap, EventTypeNum tag,
         debugBelch("cap %d: waking up thread %" FMT_Word " on cap %d\n",
                    cap->no, (W_)tso->id, (int)info1);
         break;
+    case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
+        debugBelch("cap %d: stole thread %" FMT_Word " from cap %d\n",
+                   cap->no, (W_)tso->id, (int)info1);
+        break;
 
     case EVENT_STOP_THREAD:     // (cap, thread, status)
         if (info1 == 6 + BlockedOnBlackHole) {
@@ -550,6 +566,18 @@ void traceSparkCounters_ (Capability *cap,
     }
 }
 
+void traceMVarCounters_ (Capability *cap, MVarCounters counters)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* we don't do debug tracing of MVar stats either */
+    } else
+#endif
+    {
+        postMVarCountersEvent(cap, counters);
+    }
+}
+
 void traceTaskCreate_ (Task       *task,
                        Capability *cap)
 {
@@ -854,6 +882,53 @@ void traceNonmovingHeapCensus(uint32_t log_blk_size,
         postNonmovingHeapCensus(log_blk_size, census);
 }
 
+void traceCFinalizersQueued(uint32_t n_finalizers, uint32_t queue_depth)
+{
+    if (eventlog_enabled && TRACE_gc)
+        postCFinalizersQueued(n_finalizers, queue_depth);
+}
+
+void traceCFinalizersRan(uint32_t n_finalizers, StgWord64 latency)
+{
+    if (eventlog_enabled && TRACE_gc)
+        postCFinalizersRan(n_finalizers, latency);
+}
+
+void traceSTMCommit_ (Capability *cap, uint32_t reads, uint32_t writes)
+{
+    if (eventlog_enabled) {
+        postSTMCommit(cap, cap->r.rCurrentTSO, reads, writes);
+    }
+}
+
+void traceSTMAbort_ (Capability *cap, StgTVar *tvar, uint32_t aborts)
+{
+    if (eventlog_enabled) {
+        postSTMAbort(cap, cap->r.rCurrentTSO, tvar, aborts);
+    }
+}
+
+#if defined(THREADED_RTS)
+void traceGcSyncLast_ (Capability *cap, Capability *last, Time sync_time)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        ACQUIRE_LOCK(&trace_utx);
+        tracePreface();
+        debugBelch("cap %d: last to stop for GC was cap %d (thread %"
+                   FMT_Word64 ", info %p) after %" FMT_Word64 "ns\n",
+                   cap->no, last->no, (StgWord64)last->sync_stop.tso,
+                   (void *)last->sync_stop.info,
+                   (StgWord64)TimeToNS(sync_time));
+        RELEASE_LOCK(&trace_utx);
+    } else
+#endif
+    {
+        postGcSyncLast(cap, last, TimeToNS(sync_time));
+    }
+}
+#endif
+
 void traceThreadStatus_ (StgTSO *tso USED_IF_DEBUG)
 {
 #if defined(DEBUG)
@@ -74,6 +74,7 @@ extern int TRACE_spark_full;
 /* extern int TRACE_user; */  // only used in Trace.c
 extern int TRACE_cap;
 extern int TRACE_nonmoving_gc;
+extern int TRACE_stm;
 
 // -----------------------------------------------------------------------------
 // Posting events
@@ -281,6 +282,8 @@ void traceSparkCounters_ (Capability *cap,
                           SparkCounters counters,
                           StgWord remaining);
 
+void traceMVarCounters_ (Capability *cap, MVarCounters counters);
+
 void traceTaskCreate_ (Task       *task,
                        Capability *cap);
 
@@ -319,6 +322,37 @@ void traceConcSweepEnd(void);
 void traceConcUpdRemSetFlush(Capability *cap);
 void traceNonmovingHeapCensus(uint32_t log_blk_size,
                               const struct NonmovingAllocCensus *census);
+void traceCFinalizersQueued(uint32_t n_finalizers, uint32_t queue_depth);
+void traceCFinalizersRan(uint32_t n_finalizers, StgWord64 latency);
+
+/*
+ * Record an STM commit or abort
+ */
+#define traceSTMCommit(cap, reads, writes)      \
+    if (RTS_UNLIKELY(TRACE_stm)) {              \
+        traceSTMCommit_(cap, reads, writes);    \
+    }
+
+#define traceSTMAbort(cap, tvar, aborts)        \
+    if (RTS_UNLIKELY(TRACE_stm)) {              \
+        traceSTMAbort_(cap, tvar, aborts);      \
+    }
+
+void traceSTMCommit_ (Capability *cap, uint32_t reads, uint32_t writes);
+void traceSTMAbort_ (Capability *cap, StgTVar *tvar, uint32_t aborts);
+
+/*
+ * Record the last Capability to stop for a GC, see Note [Time to
+ * safepoint] in Schedule.c
+ */
+#define traceGcSyncLast(cap, last, sync_time)   \
+    if (RTS_UNLIKELY(TRACE_gc)) {               \
+        traceGcSyncLast_(cap, last, sync_time); \
+    }
+
+#if defined(THREADED_RTS)
+void traceGcSyncLast_ (Capability *cap, Capability *last, Time sync_time);
+#endif
 
 void flushTrace(void);
 
@@ -349,6 +383,7 @@ void flushTrace(void);
 #define traceWallClockTime_() /* nothing */
 #define traceOSProcessInfo_() /* nothing */
 #define traceSparkCounters_(cap, counters, remaining) /* nothing */
+#define traceMVarCounters_(cap, counters) /* nothing */
 #define traceTaskCreate_(taskID, cap) /* nothing */
 #define traceTaskMigrate_(taskID, cap, new_cap) /* nothing */
 #define traceTaskDelete_(taskID) /* nothing */
@@ -368,6 +403,11 @@ void flushTrace(void);
 #define traceConcSweepEnd() /* nothing */
 #define traceConcUpdRemSetFlush(cap) /* nothing */
 #define traceNonmovingHeapCensus(blk_size, census) /* nothing */
+#define traceCFinalizersQueued(n_finalizers, queue_depth) /* nothing */
+#define traceCFinalizersRan(n_finalizers, latency) /* nothing */
+#define traceSTMCommit(cap, reads, writes) /* nothing */
+#define traceSTMAbort(cap, tvar, aborts) /* nothing */
+#define traceGcSyncLast(cap, last, sync_time) /* nothing */
 
 #define flushTrace() /* nothing */
 
@@ -595,6 +635,13 @@ INLINE_HEADER void traceEventMigrateThread(Capability *cap     STG_UNUSED,
                         (EventCapNo)new_cap);
 }
 
+INLINE_HEADER void traceEventStealThread(Capability *cap     STG_UNUSED,
+                                         StgTSO     *tso     STG_UNUSED,
+                                         uint32_t    from    STG_UNUSED)
+{
+    traceSchedEvent(cap, EVENT_STEAL_THREAD, tso, from);
+}
+
 INLINE_HEADER void traceCapCreate(Capability *cap STG_UNUSED)
 {
     traceCapEvent(cap, EVENT_CAP_CREATE);
@@ -828,6 +875,13 @@ INLINE_HEADER void traceSparkCounters(Capability *cap STG_UNUSED)
 #endif
 }
 
+INLINE_HEADER void traceMVarCounters(Capability *cap STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceMVarCounters_(cap, cap->mvar_stats);
+    }
+}
+
 INLINE_HEADER void traceEventSparkCreate(Capability *cap STG_UNUSED)
 {
     traceSparkEvent(cap, EVENT_SPARK_CREATE);
@@ -32,6 +32,9 @@
  *
  * Both popWSDeque and stealWSDeque also return NULL when the queue is empty.
  *
+ * A deque made with newGrowableWSDeque() grows when it is full, see
+ * Note [Growing a WSDeque].
+ *
  * Testing: see testsuite/tests/rts/testwsdeque.c.  If
  * there's anything wrong with the deque implementation, this test
  * will probably catch it.
@@ -68,8 +71,24 @@ roundUp2(StgWord val)
     return rounded;
 }
 
+/* An elements array, preceded by its bitmask (see WSDEQUE_MASK) */
+static void **
+allocElements (StgWord size)
+{
+    StgWord *p = stgMallocBytes((size + 1) * sizeof(StgWord), /* dataspace */
+                                "newWSDeque:data space");
+    p[0] = size - 1; /* n % size == n & moduloSize  */
+    return (void **)(p + 1);
+}
+
+static void
+freeElements (void **elements)
+{
+    stgFree((StgWord *)elements - 1);
+}
+
 WSDeque *
-newWSDeque (uint32_t size)
+newGrowableWSDeque (uint32_t size, uint32_t max_size)
 {
     StgWord realsize;
     WSDeque *q;
@@ -78,30 +97,138 @@ newWSDeque (uint32_t size)
 
     q = (WSDeque*) stgMallocBytes(sizeof(WSDeque),   /* admin fields */
                                   "newWSDeque");
-    q->elements = stgMallocBytes(realsize * sizeof(StgClosurePtr), /* dataspace */
-                                 "newWSDeque:data space");
+    q->elements = allocElements(realsize);
+    q->retired = NULL;
     q->top=0;
     q->bottom=0;
     q->topBound=0; /* read by writer, updated each time top is read */
 
     q->size = realsize;  /* power of 2 */
     q->moduloSize = realsize - 1; /* n % size == n & moduloSize  */
+    q->minSize = realsize;
+    q->maxSize = stg_max(realsize, roundUp2(max_size));
 
     ASSERT_WSDEQUE_INVARIANTS(q);
     return q;
 }
 
+WSDeque *
+newWSDeque (uint32_t size)
+{
+    return newGrowableWSDeque(size, size);
+}
+
 /* -----------------------------------------------------------------------------
  * freeWSDeque
  * -------------------------------------------------------------------------- */
 
+static void
+freeRetiredElements (WSDeque *q)
+{
+    WSDequeRetired *r, *next;
+    for (r = q->retired; r != NULL; r = next) {
+        next = r->next;
+        freeElements(r->elements);
+        stgFree(r);
+    }
+    q->retired = NULL;
+}
+
 void
 freeWSDeque (WSDeque *q)
 {
-    stgFree(q->elements);
+    freeRetiredElements(q);
+    freeElements(q->elements);
     stgFree(q);
 }
 
+/* -----------------------------------------------------------------------------
+ * Growing and shrinking
+ *
+ * Note [Growing a WSDeque]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ * When the owner finds a growable deque full, rather than failing the push
+ * it copies the elements between top and bottom into an array twice the
+ * size, at the same indices modulo the new size, and then publishes the new
+ * array (Chase and Lev, section 3).  Only the owner changes bottom or the
+ * array, and thieves only ever increment top, so the copy is good whatever
+ * the thieves do meanwhile: an element they take from the old array just
+ * becomes one below the new top.
+ *
+ * A thief may still be reading the old array, so it can't be freed yet.
+ * We keep it on q->retired until shrinkWSDeque() is called at a point
+ * where there can't be any thieves (the spark pools do this at GC).  For
+ * the same reason the array carries its own bitmask: a thief that loaded
+ * the old array must index it with the old mask, and reading the mask
+ * from the array itself makes the pair consistent (see WSDEQUE_MASK).
+ *
+ * The new array must be written out before it is published, and it must be
+ * published before any element pushed into it is: the write_barrier()s in
+ * growWSDeque() and pushWSDeque() pair with the load_load_barrier()s in
+ * stealWSDeque_(), which loads bottom before the array.
+ * -------------------------------------------------------------------------- */
+
+static void
+resizeWSDeque (WSDeque *q, StgWord new_size, bool retire)
+{
+    void **old = q->elements;
+    void **new = allocElements(new_size);
+    StgWord i;
+
+    for (i = q->top; i != q->bottom; i++) {
+        new[i & (new_size - 1)] = old[i & q->moduloSize];
+    }
+
+    if (retire) {
+        WSDequeRetired *r = stgMallocBytes(sizeof(WSDequeRetired),
+                                           "resizeWSDeque");
+        r->elements = old;
+        r->next = q->retired;
+        q->retired = r;
+    } else {
+        freeElements(old);
+    }
+
+    // the new array must be complete before thieves can see it
+    write_barrier();
+    q->elements = new;
+    q->size = new_size;
+    q->moduloSize = new_size - 1;
+}
+
+static bool
+growWSDeque (WSDeque *q)
+{
+    if (q->size >= q->maxSize) {
+        return false;
+    }
+    resizeWSDeque(q, q->size * 2, true);
+    ASSERT_WSDEQUE_INVARIANTS(q);
+    return true;
+}
+
+void
+shrinkWSDeque (WSDeque *q)
+{
+    StgWord n, new_size;
+
+    freeRetiredElements(q);
+
+    n = q->bottom > q->top ? q->bottom - q->top : 0;
+    new_size = q->size;
+    while (new_size > q->minSize && n * 4 < new_size) {
+        new_size /= 2;
+    }
+    if (new_size != q->size) {
+        if (q->top > q->bottom) {
+            q->top = q->bottom;
+        }
+        resizeWSDeque(q, new_size, false);
+        q->topBound = q->top;
+    }
+    ASSERT_WSDEQUE_INVARIANTS(q);
+}
+
 /* -----------------------------------------------------------------------------
  *
  * popWSDeque: remove an element from the write end of the queue.
@@ -199,8 +326,9 @@ stealWSDeque_ (WSDeque *q)
     // q->elements[t & q-> moduloSize]. See comment "KG:..." below
     // and Ticket #13633.
     load_load_barrier();
-    /* now access array, see pushBottom() */
-    stolen = q->elements[t & q->moduloSize];
+    /* now access array, see pushBottom() and Note [Growing a WSDeque] */
+    void **elements = q->elements;
+    stolen = elements[t & WSDEQUE_MASK(elements)];
 
     /* now decide whether we have won */
     if ( !(CASTOP(&(q->top),t,t+1)) ) {
@@ -232,10 +360,8 @@ stealWSDeque (WSDeque *q)
  * pushWSQueue
  * -------------------------------------------------------------------------- */
 
-#define DISCARD_NEW
-
-/* enqueue an element. Should always succeed by resizing the array
-   (not implemented yet, silently fails in that case). */
+/* enqueue an element.  If the array is full, a growable deque is resized
+   (see Note [Growing a WSDeque]); otherwise the push fails. */
 bool
 pushWSDeque (WSDeque* q, void * elem)
 {
@@ -260,24 +386,14 @@ pushWSDeque (WSDeque* q, void * elem)
         q->topBound = t;
         if (b - t >= sz) { /* really no space left :-( */
             /* reallocate the array, copying the values. Concurrent steal()s
-               will in the meantime use the old one and modify only top.
-               This means: we cannot safely free the old space! Can keep it
-               on a free list internally here...
-
-               Potential bug in combination with steal(): if array is
-               replaced, it is unclear which one concurrent steal operations
-               use. Must read the array base address in advance in steal().
+               will in the meantime use the old one and modify only top,
+               so the old array is kept until shrinkWSDeque().
             */
-#if defined(DISCARD_NEW)
-            ASSERT_WSDEQUE_INVARIANTS(q);
-            return false; // we didn't push anything
-#else
-            /* could make room by incrementing the top position here.  In
-             * this case, should use CASTOP. If this fails, someone else has
-             * removed something, and new room will be available.
-             */
-            ASSERT_WSDEQUE_INVARIANTS(q);
-#endif
+            if (!growWSDeque(q)) {
+                ASSERT_WSDEQUE_INVARIANTS(q);
+                return false; // we didn't push anything
+            }
+            sz = q->moduloSize;
         }
     }
 
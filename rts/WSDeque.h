@@ -14,6 +14,11 @@ typedef struct WSDeque_ {
     StgWord size;
     StgWord moduloSize; /* bitmask for modulo */
 
+    // The deque grows up to maxSize elements when it is full, see
+    // Note [Growing a WSDeque].  maxSize == size for a fixed-size deque.
+    StgWord minSize;
+    StgWord maxSize;
+
     // top, index where multiple readers steal() (protected by a cas)
     volatile StgWord top;
 
@@ -29,15 +34,30 @@ typedef struct WSDeque_ {
     // inside pushBottom
     volatile StgWord topBound;
 
-    // The elements array
+    // The elements array.  It is preceded by a copy of its moduloSize,
+    // see WSDEQUE_MASK.
     void ** elements;
 
     //  Please note: the dataspace cannot follow the admin fields
     //  immediately, as it should be possible to enlarge it without
     //  disposing the old one automatically (as realloc would)!
 
+    // Element arrays replaced by bigger ones, which thieves may still be
+    // reading.  Freed by shrinkWSDeque().
+    struct WSDequeRetired_ *retired;
+
 } WSDeque;
 
+typedef struct WSDequeRetired_ {
+    void **elements;
+    struct WSDequeRetired_ *next;
+} WSDequeRetired;
+
+// The bitmask for indexing an elements array.  A thief reads this rather
+// than moduloSize, so that it gets the mask and the array it belongs to
+// with a single load of q->elements.
+#define WSDEQUE_MASK(elements) (((StgWord *)(elements))[-1])
+
 /* INVARIANTS, in this order: reasonable size,
    topBound consistent, space pointer, space accessible to us.
 
@@ -47,8 +67,10 @@ typedef struct WSDeque_ {
 */
 #define ASSERT_WSDEQUE_INVARIANTS(p)         \
   ASSERT((p)->size > 0);                        \
+  ASSERT((p)->size <= (p)->maxSize);            \
   ASSERT((p)->topBound <= (p)->top);            \
   ASSERT((p)->elements != NULL);                \
+  ASSERT(WSDEQUE_MASK((p)->elements) == (p)->moduloSize); \
   ASSERT(*((p)->elements) || 1);                \
   ASSERT(*((p)->elements - 1  + ((p)->size)) || 1);
 
@@ -67,14 +89,20 @@ typedef struct WSDeque_ {
 
 // Allocation, deallocation
 WSDeque * newWSDeque  (uint32_t size);
+WSDeque * newGrowableWSDeque (uint32_t size, uint32_t max_size);
 void      freeWSDeque (WSDeque *q);
 
+// Free the arrays that a growable deque has outgrown, and shrink it
+// towards its initial size if it is mostly empty.  Only safe when nobody
+// can be stealing from the deque (e.g. during GC).
+void      shrinkWSDeque (WSDeque *q);
+
 // Take an element from the "write" end of the pool.  Can be called
 // by the pool owner only.
 void* popWSDeque (WSDeque *q);
 
 // Push onto the "write" end of the pool.  Return true if the push
-// succeeded, or false if the deque is full.
+// succeeded, or false if the deque is full and can't grow any more.
 bool pushWSDeque (WSDeque *q, void *elem);
 
 // Removes all elements from the deque
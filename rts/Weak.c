@@ -69,6 +69,300 @@ runAllCFinalizers(StgWeak *list)
     }
 }
 
+#if defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+   Note [C finalizer threads]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   By default the C finalizers of dead weak pointers are run by idle
+   capabilities, see "Incrementally running C finalizers" below. That
+   works well when finalizers are cheap, but a program that frees many
+   foreign objects with expensive finalizers (closing files, releasing
+   GPU buffers, ...) ties up its capabilities running them, and because
+   they all have to be run before the next GC can start (the weak pointers
+   on finalizer_list are heap objects) a busy program runs the whole
+   backlog inside the GC sync.
+
+   With +RTS --finalizer-threads=<n> we instead start <n> OS threads at
+   startup that do nothing but run C finalizers. scheduleFinalizers()
+   copies the C finalizers (function, argument and environment, which are
+   all outside the heap) of each dead weak pointer into a malloc'd
+   CFinalizerBatch, so the weak pointers themselves are not needed after
+   the GC, and appends the batches to a queue protected by cfinalizer_mutex.
+   The finalizer threads take a batch at a time and run it without holding
+   a capability, so finalizers run in parallel with each other, with the
+   mutator and with later GCs.
+
+   The finalizers attached to a single weak pointer always go in the same
+   batch, so they are still run in order by one thread; there is no
+   ordering between the finalizers of different weak pointers, as before.
+
+   Finalizer threads have a Task with running_finalizers set, so a
+   finalizer calling back into Haskell fails the same way it does when it
+   is run by a capability.
+
+   hs_exit() calls exitCFinalizerThreads() after the final GC, which waits
+   for the threads to empty the queue and exit; the C finalizers of the
+   weak pointers that are still alive are then run by runAllCFinalizers()
+   as usual.
+
+   forkProcess() holds cfinalizer_mutex over the fork, like the other RTS
+   locks, so the child gets a consistent copy of the queue but none of the
+   finalizer threads. resetChildCFinalizerThreads() then throws away the
+   queued batches, which the parent will run, and starts a new pool, so
+   that the child's own finalizers run and its hs_exit() doesn't wait for
+   threads that don't exist.
+
+   With the eventlog's GC events enabled we post C_FINALIZERS_QUEUED after
+   queueing the finalizers from a GC, with the resulting queue depth, and
+   C_FINALIZERS_RAN after each batch, with the time it spent queued and
+   running.
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    void (*fptr)(void);
+    void *ptr;
+    void *eptr;
+    StgWord flag;
+} CFinalizer;
+
+typedef struct CFinalizerBatch_ {
+    struct CFinalizerBatch_ *link;
+    StgWord64 queued;           // getMonotonicNSec() when queued
+    uint32_t n;                 // number of finalizers in the batch
+    uint32_t size;              // room for this many finalizers
+    CFinalizer finalizers[];
+} CFinalizerBatch;
+
+// Put this many finalizers in a batch, unless a single weak pointer has
+// more than this.
+#define CFINALIZER_BATCH_SIZE 100
+
+Mutex cfinalizer_mutex;
+// signalled when batches are queued, or the threads should exit
+static Condition cfinalizer_cond;
+// signalled when a finalizer thread exits
+static Condition cfinalizer_exit_cond;
+
+// All protected by cfinalizer_mutex
+static CFinalizerBatch *cfinalizer_queue_hd = NULL;
+static CFinalizerBatch *cfinalizer_queue_tl = NULL;
+static uint32_t n_cfinalizers_queued = 0;
+static uint32_t n_cfinalizer_threads = 0;
+static bool cfinalizer_threads_stop = false;
+
+// true while the finalizer threads are running; only changed when there
+// are no GCs
+static bool cfinalizer_threads_enabled = false;
+
+static CFinalizerBatch *
+newCFinalizerBatch(uint32_t size)
+{
+    CFinalizerBatch *batch =
+        stgMallocBytes(sizeof(CFinalizerBatch) + size * sizeof(CFinalizer),
+                       "newCFinalizerBatch");
+    batch->link = NULL;
+    batch->n = 0;
+    batch->size = size;
+    return batch;
+}
+
+static void
+runCFinalizerBatch(CFinalizerBatch *batch)
+{
+    for (uint32_t i = 0; i < batch->n; i++) {
+        CFinalizer *f = &batch->finalizers[i];
+        if (f->flag)
+            ((void (*)(void *, void *))f->fptr)(f->eptr, f->ptr);
+        else
+            ((void (*)(void *))f->fptr)(f->ptr);
+    }
+}
+
+static void *
+cfinalizerThread(void *arg STG_UNUSED)
+{
+    Task *task = getTask();
+    task->running_finalizers = true;
+
+    ACQUIRE_LOCK(&cfinalizer_mutex);
+    while (true) {
+        CFinalizerBatch *batch = cfinalizer_queue_hd;
+        if (batch == NULL) {
+            if (cfinalizer_threads_stop) break;
+            waitCondition(&cfinalizer_cond, &cfinalizer_mutex);
+            continue;
+        }
+        cfinalizer_queue_hd = batch->link;
+        if (cfinalizer_queue_hd == NULL) {
+            cfinalizer_queue_tl = NULL;
+        }
+        n_cfinalizers_queued -= batch->n;
+        RELEASE_LOCK(&cfinalizer_mutex);
+
+        runCFinalizerBatch(batch);
+        traceCFinalizersRan(batch->n, getMonotonicNSec() - batch->queued);
+        stgFree(batch);
+
+        ACQUIRE_LOCK(&cfinalizer_mutex);
+    }
+    RELEASE_LOCK(&cfinalizer_mutex);
+
+    task->running_finalizers = false;
+    freeMyTask();
+
+    ACQUIRE_LOCK(&cfinalizer_mutex);
+    n_cfinalizer_threads--;
+    signalCondition(&cfinalizer_exit_cond);
+    RELEASE_LOCK(&cfinalizer_mutex);
+    return NULL;
+}
+
+static void
+startCFinalizerThreads(void)
+{
+    uint32_t n = RtsFlags.GcFlags.finalizerThreads;
+    if (n == 0) return;
+
+    cfinalizer_threads_stop = false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        OSThreadId tid;
+        if (createOSThread(&tid, "ghc_finalizer", cfinalizerThread, NULL) != 0) {
+            barf("initCFinalizerThreads: failed to create thread");
+        }
+        ACQUIRE_LOCK(&cfinalizer_mutex);
+        n_cfinalizer_threads++;
+        RELEASE_LOCK(&cfinalizer_mutex);
+    }
+    cfinalizer_threads_enabled = true;
+}
+
+void
+initCFinalizerThreads(void)
+{
+    initMutex(&cfinalizer_mutex);
+    initCondition(&cfinalizer_cond);
+    initCondition(&cfinalizer_exit_cond);
+    startCFinalizerThreads();
+}
+
+// Called in the child of forkProcess(), where the finalizer threads are
+// gone.  See Note [C finalizer threads].
+void
+resetChildCFinalizerThreads(void)
+{
+    CFinalizerBatch *batch, *next;
+
+    initMutex(&cfinalizer_mutex);
+    initCondition(&cfinalizer_cond);
+    initCondition(&cfinalizer_exit_cond);
+
+    for (batch = cfinalizer_queue_hd; batch; batch = next) {
+        next = batch->link;
+        stgFree(batch);
+    }
+    cfinalizer_queue_hd = NULL;
+    cfinalizer_queue_tl = NULL;
+    n_cfinalizers_queued = 0;
+    n_cfinalizer_threads = 0;
+    cfinalizer_threads_enabled = false;
+
+    startCFinalizerThreads();
+}
+
+void
+exitCFinalizerThreads(void)
+{
+    if (cfinalizer_threads_enabled) {
+        ACQUIRE_LOCK(&cfinalizer_mutex);
+        cfinalizer_threads_stop = true;
+        broadcastCondition(&cfinalizer_cond);
+        while (n_cfinalizer_threads > 0) {
+            waitCondition(&cfinalizer_exit_cond, &cfinalizer_mutex);
+        }
+        ASSERT(cfinalizer_queue_hd == NULL);
+        RELEASE_LOCK(&cfinalizer_mutex);
+
+        cfinalizer_threads_enabled = false;
+    }
+
+    closeCondition(&cfinalizer_exit_cond);
+    closeCondition(&cfinalizer_cond);
+    closeMutex(&cfinalizer_mutex);
+}
+
+//
+// Copy the C finalizers of the dead weak pointers on the list into batches
+// and hand them to the finalizer threads. Returns false if there are no
+// finalizer threads, in which case the caller must arrange to run the
+// finalizers itself. See Note [C finalizer threads].
+//
+static bool
+queueCFinalizers(StgWeak *list)
+{
+    if (!cfinalizer_threads_enabled) return false;
+
+    CFinalizerBatch *hd = NULL, *tl = NULL, *batch = NULL;
+    uint32_t total = 0;
+
+    for (StgWeak *w = list; w; w = w->link) {
+        uint32_t n = 0;
+        StgCFinalizerList *c;
+        for (c = (StgCFinalizerList *)w->cfinalizers;
+             (StgClosure *)c != &stg_NO_FINALIZER_closure;
+             c = (StgCFinalizerList *)c->link) {
+            n++;
+        }
+        if (n == 0) continue;
+
+        // keep the finalizers of one weak pointer together
+        if (batch == NULL || batch->n + n > batch->size) {
+            batch = newCFinalizerBatch(stg_max(n, CFINALIZER_BATCH_SIZE));
+            if (tl == NULL) {
+                hd = batch;
+            } else {
+                tl->link = batch;
+            }
+            tl = batch;
+        }
+
+        for (c = (StgCFinalizerList *)w->cfinalizers;
+             (StgClosure *)c != &stg_NO_FINALIZER_closure;
+             c = (StgCFinalizerList *)c->link) {
+            CFinalizer *f = &batch->finalizers[batch->n++];
+            f->fptr = c->fptr;
+            f->ptr = c->ptr;
+            f->eptr = c->eptr;
+            f->flag = c->flag;
+        }
+        total += n;
+    }
+
+    if (hd == NULL) return true;
+
+    StgWord64 now = getMonotonicNSec();
+    for (batch = hd; batch; batch = batch->link) {
+        batch->queued = now;
+    }
+
+    ACQUIRE_LOCK(&cfinalizer_mutex);
+    if (cfinalizer_queue_tl == NULL) {
+        cfinalizer_queue_hd = hd;
+    } else {
+        cfinalizer_queue_tl->link = hd;
+    }
+    cfinalizer_queue_tl = tl;
+    n_cfinalizers_queued += total;
+    debugTrace(DEBUG_weak, "weak: queued %d C finalizers, %d waiting",
+               total, n_cfinalizers_queued);
+    traceCFinalizersQueued(total, n_cfinalizers_queued);
+    broadcastCondition(&cfinalizer_cond);
+    RELEASE_LOCK(&cfinalizer_mutex);
+    return true;
+}
+#endif /* THREADED_RTS */
+
 /*
  * scheduleFinalizers() is called on the list of weak pointers found
  * to be dead after a garbage collection.  It overwrites each object
@@ -98,14 +392,23 @@ scheduleFinalizers(Capability *cap, StgWeak *list)
     // doIdleGcWork()) before appending the list with more finalizers.
     ASSERT(RtsFlags.GcFlags.useNonmoving || n_finalizers == 0);
 
-    // Append finalizer_list with the new list. TODO: Perhaps cache tail of the
-    // list for faster append. NOTE: We can't append `list` here! Otherwise we
-    // end up traversing already visited weaks in the loops below.
-    StgWeak **tl = &finalizer_list;
-    while (*tl) {
-        tl = &(*tl)->link;
+    // Hand the C finalizers to the finalizer threads, if there are any.
+#if defined(THREADED_RTS)
+    bool queued = queueCFinalizers(list);
+#else
+    bool queued = false;
+#endif
+
+    // Otherwise append finalizer_list with the new list. TODO: Perhaps cache
+    // tail of the list for faster append. NOTE: We can't append `list` here!
+    // Otherwise we end up traversing already visited weaks in the loops below.
+    if (!queued) {
+        StgWeak **tl = &finalizer_list;
+        while (*tl) {
+            tl = &(*tl)->link;
+        }
+        *tl = list;
     }
-    *tl = list;
 
     // Traverse the list and
     //  * count the number of Haskell finalizers
@@ -140,7 +443,9 @@ scheduleFinalizers(Capability *cap, StgWeak *list)
         SET_HDR(w, &stg_DEAD_WEAK_info, w->header.prof.ccs);
     }
 
-    n_finalizers += i;
+    if (!queued) {
+        n_finalizers += i;
+    }
 
     // No Haskell finalizers to run?
     if (n == 0) return;
@@ -21,4 +21,12 @@ void scheduleFinalizers(Capability *cap, StgWeak *w);
 void markWeakList(void);
 bool runSomeFinalizers(bool all);
 
+#if defined(THREADED_RTS)
+extern Mutex cfinalizer_mutex;
+
+void initCFinalizerThreads(void);
+void resetChildCFinalizerThreads(void);
+void exitCFinalizerThreads(void);
+#endif
+
 #include "EndPrivate.h"
@@ -15,6 +15,7 @@
 #include "Capability.h"
 #include "RtsUtils.h"
 #include "Stats.h"
+#include "Schedule.h"
 #include "EventLog.h"
 
 #include <string.h>
@@ -30,10 +31,94 @@ bool eventlog_enabled;
 
 static const EventLogWriter *event_log_writer = NULL;
 
-#define EVENT_LOG_SIZE 2 * (1024 * 1024) // 2MB
-
 static int flushCount;
 
+/* Note [Asynchronous eventlog writer]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   By default a capability whose EventsBuf fills up writes it out itself,
+   via printAndClearEventBuf(), which means that the mutator is stalled for
+   as long as the EventLogWriter takes to write the whole buffer (for the
+   file writer, an fwrite() under a global lock).
+
+   With +RTS --eventlog-async in the threaded RTS we instead start a
+   dedicated writer thread (eventLogWriterThread) and give each capability
+   an EventsBufRing of EVENT_BUF_RING_SIZE buffers.  The capability always
+   fills ring->bufs[ring->head % EVENT_BUF_RING_SIZE]; the buffers between
+   ring->tail and ring->head are full and waiting for the writer.  When the
+   current buffer fills, queueEventsBuf() bumps ring->head and carries on in
+   the next buffer of the ring, so the mutator's cost is a pointer swap and
+   one uncontended lock (writer_mutex protects head and tail; the writer
+   never holds it while writing).  The writer visits the capabilities'
+   rings round-robin, writes the oldest full buffer, and bumps ring->tail.
+
+   If the writer cannot keep up and every other buffer in the ring is still
+   queued, we do not block the mutator: the contents of the current buffer
+   are discarded and their events counted in ring->dropped.  The next
+   buffer the capability starts then begins with an EVENT_EVENTLOG_DROPPED
+   event carrying that count, so consumers can tell that (and how much of)
+   the stream is missing.  Each buffer starts with its own block marker, so
+   the stream remains well formed.
+
+   Only the per-capability buffers go through the writer thread.  The
+   global eventBuf is written synchronously as before; it is protected by
+   eventBufMutex and receives comparatively few events.  Stopping the
+   eventlog (endEventLogging) first waits for the writer to drain all the
+   rings, and flushEventLog waits for the same, so that data posted before
+   either call has been handed to the EventLogWriter when it returns.
+*/
+
+/* Note [Eventlog flight recorder]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS --eventlog-flight-recorder=<size> nothing is written while the
+   program runs.  Instead each EventsBuf (one per capability, and eventBuf)
+   gets an EventsBufRecorder: <size> bytes of memory split into buffers of
+   the usual size.  When the current buffer fills, recordEventsBuf() moves
+   on to the next buffer of the recorder, overwriting the oldest one.  So
+   we always hold the most recent <size> bytes of events, give or take a
+   buffer, and the only cost of tracing is that of posting the events.
+
+   The recorder is written out by dumpEventLog(), which produces a complete
+   eventlog: the header, each recorder's buffers from oldest to newest,
+   and the end-of-data marker.  Every buffer begins with a block marker, so
+   the consumer knows which capability each buffer belongs to.  The
+   EventLogWriter is initialised for each dump and stopped afterwards; for
+   the file writer that means each dump replaces the previous one.  Events
+   stay in the recorder after a dump, so consecutive dumps overlap.
+
+   We dump
+     - at the end of the program, from endEventLogging(),
+     - when the RTS crashes, since barf() calls endEventLogging(),
+     - on SIGUSR2.  The signal handler merely sets eventlog_dump_requested;
+       the next capability to enter the scheduler stops all the others and
+       writes the dump, see scheduleDumpEventLog().  So that an idle RTS
+       dumps too, the handler also wakes the IO manager (threaded RTS), and
+       awaitEvent() returns to the scheduler when a signal interrupts it
+       with a dump pending (non-threaded RTS).
+
+   The flight recorder replaces the asynchronous writer (see Note
+   [Asynchronous eventlog writer]): there is nothing to write until a dump.
+*/
+
+typedef struct _EventsBufRecorder {
+  StgInt8 **bufs;       // n_bufs buffers, each of EventsBuf.size bytes
+  StgWord64 *filled;    // bytes used in each complete buffer
+  uint32_t n_bufs;
+  uint32_t cur;         // the buffer being filled
+  uint32_t n_retained;  // complete buffers before cur still held
+} EventsBufRecorder;
+
+#if defined(THREADED_RTS)
+#define EVENT_BUF_RING_SIZE 4
+
+typedef struct _EventsBufRing {
+  StgInt8 *bufs[EVENT_BUF_RING_SIZE];
+  StgWord64 filled[EVENT_BUF_RING_SIZE]; // bytes used in each queued buffer
+  StgWord head;      // bumped by the capability when it queues a buffer
+  StgWord tail;      // bumped by the writer when it has written a buffer
+  StgWord64 dropped; // events dropped since we last said so (owner only)
+} EventsBufRing;
+#endif
+
 // Struct for record keeping of buffer to store event types and events.
 typedef struct _EventsBuf {
   StgInt8 *begin;
@@ -41,13 +126,30 @@ typedef struct _EventsBuf {
   StgInt8 *marker;
   StgWord64 size;
   EventCapNo capno; // which capability this buffer belongs to, or -1
+  uint32_t n_events; // events posted since the buffer was last reset
+  EventsBufRecorder *recorder; // see Note [Eventlog flight recorder], or NULL
+#if defined(THREADED_RTS)
+  EventsBufRing *ring; // see Note [Asynchronous eventlog writer], or NULL
+#endif
 } EventsBuf;
 
 EventsBuf *capEventBuf; // one EventsBuf for each Capability
 
 EventsBuf eventBuf; // an EventsBuf not associated with any Capability
+
+static bool flight_recorder = false; // see Note [Eventlog flight recorder]
+volatile StgWord eventlog_dump_requested = 0;
 #if defined(THREADED_RTS)
 Mutex eventBufMutex; // protected by this mutex
+
+// State of the writer thread, see Note [Asynchronous eventlog writer]
+static Mutex writer_mutex;
+static Condition writer_wakeup;   // a buffer was queued, or we should stop
+static Condition writer_progress; // a buffer was written, or we stopped
+static OSThreadId writer_thread;
+static bool writer_running = false;
+static bool writer_stop = false;
+static uint32_t n_rings = 0;      // capEventBuf[0..n_rings-1] have rings
 #endif
 
 char *EventDesc[] = {
@@ -119,7 +221,15 @@ char *EventDesc[] = {
   [EVENT_CONC_SWEEP_BEGIN]       = "Begin concurrent sweep",
   [EVENT_CONC_SWEEP_END]         = "End concurrent sweep",
   [EVENT_CONC_UPD_REM_SET_FLUSH] = "Update remembered set flushed",
-  [EVENT_NONMOVING_HEAP_CENSUS]  = "Nonmoving heap census"
+  [EVENT_NONMOVING_HEAP_CENSUS]  = "Nonmoving heap census",
+  [EVENT_EVENTLOG_DROPPED]       = "Events dropped by the eventlog writer",
+  [EVENT_C_FINALIZERS_QUEUED]    = "C finalizers queued",
+  [EVENT_C_FINALIZERS_RAN]       = "C finalizers ran",
+  [EVENT_STM_COMMIT]             = "STM commit",
+  [EVENT_STM_ABORT]              = "STM abort",
+  [EVENT_MVAR_COUNTERS]          = "MVar counters",
+  [EVENT_GC_SYNC_LAST]           = "Last capability to stop for GC",
+  [EVENT_STEAL_THREAD]           = "Steal thread"
 };
 
 // Event type.
@@ -135,6 +245,17 @@ EventType eventTypes[NUM_GHC_EVENT_TAGS];
 static void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno);
 static void resetEventsBuf(EventsBuf* eb);
 static void printAndClearEventBuf (EventsBuf *eventsBuf);
+static void initEventsBufRecorder(EventsBuf *eb);
+static void freeEventsBufRecorder(EventsBuf *eb);
+static void recordEventsBuf(EventsBuf *eb);
+static void writeEventsBufRecorder(EventsBuf *eb);
+static void dumpEventLog_(void);
+#if defined(THREADED_RTS)
+static void initEventsBufRing(EventsBuf *eb);
+static void freeEventsBufRing(EventsBuf *eb);
+static bool queueEventsBuf(EventsBuf *eb);
+static void postEventsDropped(EventsBuf *eb);
+#endif
 
 static void postEventType(EventsBuf *eb, EventType *et);
 
@@ -231,6 +352,7 @@ static inline void postEventHeader(EventsBuf *eb, EventTypeNum type)
 {
     postEventTypeNum(eb, type);
     postTimestamp(eb);
+    eb->n_events++;
 }
 
 static inline void postInt8(EventsBuf *eb, StgInt8 i)
@@ -270,9 +392,128 @@ stopEventLogWriter(void)
     }
 }
 
+#if defined(THREADED_RTS)
+/*
+ * The eventlog writer thread; see Note [Asynchronous eventlog writer].
+ */
+
+// Are there any queued buffers left to write?  Call with writer_mutex held.
+static bool
+eventsBufRingsPending(void)
+{
+    for (uint32_t c = 0; c < n_rings; ++c) {
+        EventsBufRing *ring = capEventBuf[c].ring;
+        if (ring->tail != ring->head) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *
+eventLogWriterThread(void *arg STG_UNUSED)
+{
+    uint32_t next = 0;
+
+    ACQUIRE_LOCK(&writer_mutex);
+    while (true) {
+        // Take the oldest queued buffer of the next capability with
+        // anything queued, round-robin so that no capability is starved.
+        EventsBufRing *ring = NULL;
+        for (uint32_t i = 0; i < n_rings; ++i) {
+            EventsBufRing *r = capEventBuf[(next + i) % n_rings].ring;
+            if (r->tail != r->head) {
+                ring = r;
+                next = (next + i + 1) % n_rings;
+                break;
+            }
+        }
+
+        if (ring == NULL) {
+            if (writer_stop) {
+                break;
+            }
+            waitCondition(&writer_wakeup, &writer_mutex);
+            continue;
+        }
+
+        // The capability will not touch a queued buffer until we bump
+        // ring->tail, so it can be written without holding the lock.
+        StgWord slot = ring->tail % EVENT_BUF_RING_SIZE;
+        RELEASE_LOCK(&writer_mutex);
+        if (!writeEventLog(ring->bufs[slot], ring->filled[slot])) {
+            debugBelch("eventLogWriterThread: could not write event log\n");
+        }
+        ACQUIRE_LOCK(&writer_mutex);
+        ring->tail++;
+        broadcastCondition(&writer_progress);
+    }
+
+    writer_running = false;
+    broadcastCondition(&writer_progress);
+    RELEASE_LOCK(&writer_mutex);
+    return NULL;
+}
+
+static void
+startEventLogWriterThread(void)
+{
+    if (n_rings == 0) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&writer_mutex);
+    writer_stop = false;
+    writer_running = true;
+    RELEASE_LOCK(&writer_mutex);
+
+    if (createOSThread(&writer_thread, "ghc_eventlog",
+                       eventLogWriterThread, NULL) != 0) {
+        // Carry on writing synchronously.
+        errorBelch("could not create the eventlog writer thread");
+        ACQUIRE_LOCK(&writer_mutex);
+        writer_running = false;
+        RELEASE_LOCK(&writer_mutex);
+    }
+}
+
+// Wait for the writer thread to write every queued buffer and exit.
+static void
+stopEventLogWriterThread(void)
+{
+    ACQUIRE_LOCK(&writer_mutex);
+    if (writer_running && osThreadId() == writer_thread) {
+        // We are being called from the writer itself (barf() during a
+        // write): there is nobody to wait for, so let the caller flush
+        // the buffers synchronously.
+        writer_running = false;
+    }
+    writer_stop = true;
+    signalCondition(&writer_wakeup);
+    while (writer_running) {
+        waitCondition(&writer_progress, &writer_mutex);
+    }
+    RELEASE_LOCK(&writer_mutex);
+}
+
+// Wait until the writer thread has written every queued buffer.
+static void
+waitEventLogWriterThread(void)
+{
+    ACQUIRE_LOCK(&writer_mutex);
+    while (writer_running && eventsBufRingsPending()) {
+        waitCondition(&writer_progress, &writer_mutex);
+    }
+    RELEASE_LOCK(&writer_mutex);
+}
+#endif
+
 void
 flushEventLog(void)
 {
+#if defined(THREADED_RTS)
+    waitEventLogWriterThread();
+#endif
     if (event_log_writer != NULL &&
             event_log_writer->flushEventLog != NULL) {
         event_log_writer->flushEventLog();
@@ -296,6 +537,7 @@ init_event_types(void)
 
         case EVENT_MIGRATE_THREAD:  // (cap, thread, new_cap)
         case EVENT_THREAD_WAKEUP:   // (cap, thread, other_cap)
+        case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
             eventTypes[t].size =
                 sizeof(EventThreadID) + sizeof(EventCapNo);
             break;
@@ -487,6 +729,39 @@ init_event_types(void)
             eventTypes[t].size = 13;
             break;
 
+        case EVENT_EVENTLOG_DROPPED: // (cap, dropped_events)
+            eventTypes[t].size = sizeof(StgWord64);
+            break;
+
+        case EVENT_C_FINALIZERS_QUEUED: // (n_finalizers, queue_depth)
+            eventTypes[t].size = 2 * sizeof(StgWord32);
+            break;
+
+        case EVENT_C_FINALIZERS_RAN: // (n_finalizers, latency)
+            eventTypes[t].size = sizeof(StgWord32) + sizeof(StgWord64);
+            break;
+
+        case EVENT_MVAR_COUNTERS: // (cap, 6*counter)
+            eventTypes[t].size = 6 * sizeof(StgWord64);
+            break;
+
+        case EVENT_GC_SYNC_LAST: // (cap, thread, sync_ns, info, ccs)
+            eventTypes[t].size =
+                sizeof(EventCapNo) + sizeof(EventThreadID)
+                + 2 * sizeof(StgWord64) + sizeof(StgWord32);
+            break;
+
+        case EVENT_STM_COMMIT: // (thread, reads, writes)
+            eventTypes[t].size = sizeof(EventThreadID) + 2 * sizeof(StgWord32);
+            break;
+
+        case EVENT_STM_ABORT: // (thread, tvar, tvar_conflicts,
+                              //  consecutive_aborts)
+            eventTypes[t].size =
+                sizeof(EventThreadID) + 2 * sizeof(StgWord64)
+                + sizeof(StgWord32);
+            break;
+
         default:
             continue; /* ignore deprecated events */
         }
@@ -494,28 +769,28 @@ init_event_types(void)
 }
 
 static void
-postHeaderEvents(void)
+postHeaderEvents(EventsBuf *eb)
 {
     // Write in buffer: the header begin marker.
-    postInt32(&eventBuf, EVENT_HEADER_BEGIN);
+    postInt32(eb, EVENT_HEADER_BEGIN);
 
     // Mark beginning of event types in the header.
-    postInt32(&eventBuf, EVENT_HET_BEGIN);
+    postInt32(eb, EVENT_HET_BEGIN);
 
     for (int t = 0; t < NUM_GHC_EVENT_TAGS; ++t) {
         // Write in buffer: the start event type.
         if (eventTypes[t].desc)
-            postEventType(&eventBuf, &eventTypes[t]);
+            postEventType(eb, &eventTypes[t]);
     }
 
     // Mark end of event types in the header.
-    postInt32(&eventBuf, EVENT_HET_END);
+    postInt32(eb, EVENT_HET_END);
 
     // Write in buffer: the header end marker.
-    postInt32(&eventBuf, EVENT_HEADER_END);
+    postInt32(eb, EVENT_HEADER_END);
 
     // Prepare event buffer for events (data).
-    postInt32(&eventBuf, EVENT_DATA_BEGIN);
+    postInt32(eb, EVENT_DATA_BEGIN);
 }
 
 static uint32_t
@@ -550,9 +825,19 @@ initEventLogging()
      * Use a single buffer to store the header with event types, then flush
      * the buffer so all buffers are empty for writing events.
      */
+    flight_recorder = RtsFlags.TraceFlags.flight_recorder_size != 0;
+#if defined(THREADED_RTS)
+    initMutex(&writer_mutex);
+    initCondition(&writer_wakeup);
+    initCondition(&writer_progress);
+#endif
     moreCapEventBufs(0, get_n_capabilities());
 
-    initEventsBuf(&eventBuf, EVENT_LOG_SIZE, (EventCapNo)(-1));
+    initEventsBuf(&eventBuf, RtsFlags.TraceFlags.buffer_size,
+                  (EventCapNo)(-1));
+    if (flight_recorder) {
+        initEventsBufRecorder(&eventBuf);
+    }
 #if defined(THREADED_RTS)
     initMutex(&eventBufMutex);
 #endif
@@ -571,20 +856,30 @@ eventLogStatus(void)
 static bool
 startEventLogging_(void)
 {
-    initEventLogWriter();
+    if (flight_recorder) {
+        // The header is written with each dump, see
+        // Note [Eventlog flight recorder]
+        postBlockMarker(&eventBuf);
+    } else {
+        initEventLogWriter();
 
-    postHeaderEvents();
+        postHeaderEvents(&eventBuf);
 
-    // Flush capEventBuf with header.
-    /*
-     * Flush header and data begin marker to the file, thus preparing the
-     * file to have events written to it.
-     */
-    printAndClearEventBuf(&eventBuf);
+        // Flush capEventBuf with header.
+        /*
+         * Flush header and data begin marker to the file, thus preparing
+         * the file to have events written to it.
+         */
+        printAndClearEventBuf(&eventBuf);
+    }
 
     for (uint32_t c = 0; c < get_n_capabilities(); ++c) {
         postBlockMarker(&capEventBuf[c]);
     }
+
+#if defined(THREADED_RTS)
+    startEventLogWriterThread();
+#endif
     return true;
 }
 
@@ -604,8 +899,15 @@ startEventLogging(const EventLogWriter *ev_writer)
 void
 restartEventLogging(void)
 {
+#if defined(THREADED_RTS)
+    // The writer thread did not survive the fork. The buffers it had
+    // queued were written by flushEventLog() before forking.
+    writer_running = false;
+#endif
     freeEventLogging();
-    stopEventLogWriter();
+    if (!flight_recorder) {
+        stopEventLogWriter(); // the flight recorder stops it after each dump
+    }
     initEventLogging();  // allocate new per-capability buffers
     if (event_log_writer != NULL) {
         startEventLogging_(); // child starts its own eventlog
@@ -618,6 +920,21 @@ endEventLogging(void)
     if (!eventlog_enabled)
         return;
 
+#if defined(THREADED_RTS)
+    // Write out the buffers queued for the writer thread first, so that
+    // each capability's blocks reach the EventLogWriter in order.
+    stopEventLogWriterThread();
+#endif
+
+    if (flight_recorder) {
+        // Nothing has been written yet: dump what we have kept. We don't
+        // take eventBufMutex, as we may be called from barf().
+        dumpEventLog_();
+        event_log_writer = NULL;
+        eventlog_enabled = false;
+        return;
+    }
+
     // Flush all events remaining in the buffers.
     for (uint32_t c = 0; c < n_capabilities; ++c) {
         printAndClearEventBuf(&capEventBuf[c]);
@@ -636,9 +953,70 @@ endEventLogging(void)
     eventlog_enabled = false;
 }
 
+/*
+ * Write out the flight recorder as a complete eventlog; see
+ * Note [Eventlog flight recorder].  The caller must have stopped all the
+ * capabilities.
+ */
+static void
+dumpEventLog_(void)
+{
+    EventsBuf header;
+    initEventsBuf(&header, RtsFlags.TraceFlags.buffer_size, (EventCapNo)(-1));
+    postHeaderEvents(&header);
+
+    initEventLogWriter();
+    writeEventLog(header.begin, header.pos - header.begin);
+
+    writeEventsBufRecorder(&eventBuf);
+    for (uint32_t c = 0; c < n_capabilities; ++c) {
+        writeEventsBufRecorder(&capEventBuf[c]);
+    }
+
+    resetEventsBuf(&header);
+    postEventTypeNum(&header, EVENT_DATA_END);
+    writeEventLog(header.begin, header.pos - header.begin);
+    stopEventLogWriter();
+
+    stgFree(header.begin);
+}
+
+void
+dumpEventLog(void)
+{
+    if (!eventlog_enabled || !flight_recorder) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&eventBufMutex);
+    dumpEventLog_();
+    RELEASE_LOCK(&eventBufMutex);
+}
+
+// Called from a signal handler: just ask the scheduler to dump the
+// eventlog at the next opportunity.
+void
+requestEventLogDump(void)
+{
+    if (flight_recorder) {
+        eventlog_dump_requested = 1;
+        contextSwitchAllCapabilities();
+#if defined(THREADED_RTS)
+        // If every capability is idle nobody will notice the request until
+        // something else happens, so get a thread into the scheduler
+        wakeUpRts();
+#endif
+    }
+}
+
 void
 moreCapEventBufs (uint32_t from, uint32_t to)
 {
+#if defined(THREADED_RTS)
+    // The writer thread may be looking at capEventBuf
+    ACQUIRE_LOCK(&writer_mutex);
+#endif
+
     if (from > 0) {
         capEventBuf = stgReallocBytes(capEventBuf, to * sizeof(EventsBuf),
                                       "moreCapEventBufs");
@@ -648,9 +1026,22 @@ moreCapEventBufs (uint32_t from, uint32_t to)
     }
 
     for (uint32_t c = from; c < to; ++c) {
-        initEventsBuf(&capEventBuf[c], EVENT_LOG_SIZE, c);
+        initEventsBuf(&capEventBuf[c], RtsFlags.TraceFlags.buffer_size, c);
+        if (flight_recorder) {
+            initEventsBufRecorder(&capEventBuf[c]);
+        }
+#if defined(THREADED_RTS)
+        else if (RtsFlags.TraceFlags.async_writer) {
+            initEventsBufRing(&capEventBuf[c]);
+        }
+#endif
     }
 
+#if defined(THREADED_RTS)
+    n_rings = RtsFlags.TraceFlags.async_writer && !flight_recorder ? to : 0;
+    RELEASE_LOCK(&writer_mutex);
+#endif
+
     // The from == 0 already covered in initEventLogging, so we are interested
     // only in case when we are increasing capabilities number
     if (from > 0) {
@@ -666,9 +1057,22 @@ freeEventLogging(void)
 {
     // Free events buffer.
     for (uint32_t c = 0; c < n_capabilities; ++c) {
+        if (capEventBuf[c].recorder != NULL) {
+            freeEventsBufRecorder(&capEventBuf[c]);
+            continue;
+        }
+#if defined(THREADED_RTS)
+        if (capEventBuf[c].ring != NULL) {
+            freeEventsBufRing(&capEventBuf[c]);
+            continue;
+        }
+#endif
         if (capEventBuf[c].begin != NULL)
             stgFree(capEventBuf[c].begin);
     }
+#if defined(THREADED_RTS)
+    n_rings = 0;
+#endif
     if (capEventBuf != NULL)  {
         stgFree(capEventBuf);
     }
@@ -707,6 +1111,7 @@ postSchedEvent (Capability *cap,
 
     case EVENT_MIGRATE_THREAD:  // (cap, thread, new_cap)
     case EVENT_THREAD_WAKEUP:   // (cap, thread, other_cap)
+    case EVENT_STEAL_THREAD:    // (cap, thread, victim_cap)
     {
         postThreadID(eb,thread);
         postCapNo(eb,info1 /* new_cap | victim_cap | other_cap */);
@@ -783,6 +1188,21 @@ postSparkCountersEvent (Capability *cap,
     postWord64(eb,remaining);
 }
 
+void
+postMVarCountersEvent (Capability *cap, MVarCounters counters)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_MVAR_COUNTERS);
+
+    postEventHeader(eb, EVENT_MVAR_COUNTERS);
+    postWord64(eb,counters.blocks);
+    postWord64(eb,counters.block_ns);
+    postWord64(eb,counters.handoffs);
+    postWord64(eb,counters.handoff_ns);
+    postWord64(eb,counters.max_handoff_ns);
+    postWord64(eb,counters.batched);
+}
+
 void
 postCapEvent (EventTypeNum  tag,
               EventCapNo    capno)
@@ -1250,6 +1670,67 @@ void postNonmovingHeapCensus(int log_blk_size,
     RELEASE_LOCK(&eventBufMutex);
 }
 
+void postCFinalizersQueued(StgWord32 n_finalizers, StgWord32 queue_depth)
+{
+    ACQUIRE_LOCK(&eventBufMutex);
+    ensureRoomForEvent(&eventBuf, EVENT_C_FINALIZERS_QUEUED);
+    postEventHeader(&eventBuf, EVENT_C_FINALIZERS_QUEUED);
+    postWord32(&eventBuf, n_finalizers);
+    postWord32(&eventBuf, queue_depth);
+    RELEASE_LOCK(&eventBufMutex);
+}
+
+void postCFinalizersRan(StgWord32 n_finalizers, StgWord64 latency)
+{
+    ACQUIRE_LOCK(&eventBufMutex);
+    ensureRoomForEvent(&eventBuf, EVENT_C_FINALIZERS_RAN);
+    postEventHeader(&eventBuf, EVENT_C_FINALIZERS_RAN);
+    postWord32(&eventBuf, n_finalizers);
+    postWord64(&eventBuf, latency);
+    RELEASE_LOCK(&eventBufMutex);
+}
+
+void postSTMCommit(Capability *cap, StgTSO *tso,
+                   StgWord32 reads, StgWord32 writes)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_STM_COMMIT);
+    postEventHeader(eb, EVENT_STM_COMMIT);
+    postThreadID(eb, tso == NULL ? 0 : tso->id);
+    postWord32(eb, reads);
+    postWord32(eb, writes);
+}
+
+void postSTMAbort(Capability *cap, StgTSO *tso,
+                  StgTVar *tvar, StgWord32 aborts)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_STM_ABORT);
+    postEventHeader(eb, EVENT_STM_ABORT);
+    postThreadID(eb, tso == NULL ? 0 : tso->id);
+    postWord64(eb, (StgWord64)(StgWord)tvar);
+    postWord64(eb, tvar == NULL ? 0 : tvar->num_conflicts);
+    postWord32(eb, aborts);
+}
+
+#if defined(THREADED_RTS)
+void postGcSyncLast(Capability *cap, Capability *last, StgWord64 sync_ns)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_GC_SYNC_LAST);
+    postEventHeader(eb, EVENT_GC_SYNC_LAST);
+    postCapNo(eb, last->no);
+    postThreadID(eb, last->sync_stop.tso);
+    postWord64(eb, sync_ns);
+    postWord64(eb, last->sync_stop.info);
+#if defined(PROFILING)
+    postWord32(eb, last->sync_stop.ccs == NULL ? 0 : last->sync_stop.ccs->ccsID);
+#else
+    postWord32(eb, 0);
+#endif
+}
+#endif
+
 void closeBlockMarker (EventsBuf *ebuf)
 {
     if (ebuf->marker)
@@ -1274,7 +1755,9 @@ void postBlockMarker (EventsBuf *eb)
     closeBlockMarker(eb);
 
     eb->marker = eb->pos;
-    postEventHeader(eb, EVENT_BLOCK_MARKER);
+    // not via postEventHeader: block markers don't count towards n_events
+    postEventTypeNum(eb, EVENT_BLOCK_MARKER);
+    postTimestamp(eb);
     postWord32(eb,0); // these get filled in later by closeBlockMarker();
     postWord64(eb,0);
     postCapNo(eb, eb->capno);
@@ -1478,6 +1961,20 @@ void printAndClearEventBuf (EventsBuf *ebuf)
 
     if (ebuf->begin != NULL && ebuf->pos != ebuf->begin)
     {
+        if (ebuf->recorder != NULL) {
+            recordEventsBuf(ebuf);
+            postBlockMarker(ebuf);
+            return;
+        }
+
+#if defined(THREADED_RTS)
+        if (ebuf->ring != NULL && queueEventsBuf(ebuf)) {
+            postBlockMarker(ebuf);
+            postEventsDropped(ebuf);
+            return;
+        }
+#endif
+
         size_t elog_size = ebuf->pos - ebuf->begin;
         if (!writeEventLog(ebuf->begin, elog_size)) {
             debugBelch(
@@ -1500,14 +1997,160 @@ void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno)
     eb->size = size;
     eb->marker = NULL;
     eb->capno = capno;
+    eb->n_events = 0;
+    eb->recorder = NULL;
+#if defined(THREADED_RTS)
+    eb->ring = NULL;
+#endif
 }
 
 void resetEventsBuf(EventsBuf* eb)
 {
     eb->pos = eb->begin;
     eb->marker = NULL;
+    eb->n_events = 0;
+}
+
+// Give eb the memory for its flight recorder.  The buffer eb is currently
+// using becomes the first buffer of the recorder.
+void initEventsBufRecorder(EventsBuf *eb)
+{
+    EventsBufRecorder *rec = stgMallocBytes(sizeof(EventsBufRecorder),
+                                            "initEventsBufRecorder");
+    rec->n_bufs = RtsFlags.TraceFlags.flight_recorder_size / eb->size;
+    if (rec->n_bufs < 2) {
+        rec->n_bufs = 2;
+    }
+    rec->bufs = stgMallocBytes(rec->n_bufs * sizeof(StgInt8 *),
+                               "initEventsBufRecorder");
+    rec->filled = stgMallocBytes(rec->n_bufs * sizeof(StgWord64),
+                                 "initEventsBufRecorder");
+    rec->bufs[0] = eb->begin;
+    for (uint32_t i = 1; i < rec->n_bufs; ++i) {
+        rec->bufs[i] = stgMallocBytes(eb->size, "initEventsBufRecorder");
+    }
+    rec->cur = 0;
+    rec->n_retained = 0;
+    eb->recorder = rec;
+}
+
+void freeEventsBufRecorder(EventsBuf *eb)
+{
+    EventsBufRecorder *rec = eb->recorder;
+    for (uint32_t i = 0; i < rec->n_bufs; ++i) {
+        stgFree(rec->bufs[i]);
+    }
+    stgFree(rec->bufs);
+    stgFree(rec->filled);
+    stgFree(rec);
+    eb->recorder = NULL;
+    eb->begin = eb->pos = NULL;
+}
+
+// eb is full: keep it, and carry on in the oldest buffer of the recorder.
+void recordEventsBuf(EventsBuf *eb)
+{
+    EventsBufRecorder *rec = eb->recorder;
+
+    rec->filled[rec->cur] = eb->pos - eb->begin;
+    rec->cur = (rec->cur + 1) % rec->n_bufs;
+    if (rec->n_retained < rec->n_bufs - 1) {
+        rec->n_retained++;
+    }
+    eb->begin = rec->bufs[rec->cur];
+    resetEventsBuf(eb);
+}
+
+// Write out eb's retained buffers, oldest first, and then the buffer it is
+// currently filling.
+void writeEventsBufRecorder(EventsBuf *eb)
+{
+    EventsBufRecorder *rec = eb->recorder;
+
+    closeBlockMarker(eb);
+    for (uint32_t i = rec->n_retained; i > 0; --i) {
+        uint32_t b = (rec->cur + rec->n_bufs - i) % rec->n_bufs;
+        writeEventLog(rec->bufs[b], rec->filled[b]);
+    }
+    if (eb->pos != eb->begin) {
+        writeEventLog(eb->begin, eb->pos - eb->begin);
+    }
+
+    // Events posted from now on go in a new block
+    postBlockMarker(eb);
+}
+
+#if defined(THREADED_RTS)
+// Give eb the spare buffers it needs for the writer thread.  The buffer
+// eb is currently using becomes the first buffer of the ring.
+void initEventsBufRing(EventsBuf *eb)
+{
+    EventsBufRing *ring = stgMallocBytes(sizeof(EventsBufRing),
+                                         "initEventsBufRing");
+    ring->bufs[0] = eb->begin;
+    for (int i = 1; i < EVENT_BUF_RING_SIZE; ++i) {
+        ring->bufs[i] = stgMallocBytes(eb->size, "initEventsBufRing");
+    }
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    eb->ring = ring;
 }
 
+void freeEventsBufRing(EventsBuf *eb)
+{
+    for (int i = 0; i < EVENT_BUF_RING_SIZE; ++i) {
+        stgFree(eb->ring->bufs[i]);
+    }
+    stgFree(eb->ring);
+    eb->ring = NULL;
+    eb->begin = eb->pos = NULL;
+}
+
+/*
+ * Hand the full buffer eb over to the writer thread and switch eb to the
+ * next buffer of its ring.  If the writer hasn't finished with that one yet
+ * we drop eb's contents rather than wait.  Returns false if there is no
+ * writer thread, in which case the caller must write eb itself.
+ */
+bool queueEventsBuf(EventsBuf *eb)
+{
+    EventsBufRing *ring = eb->ring;
+
+    ACQUIRE_LOCK(&writer_mutex);
+    if (!writer_running) {
+        RELEASE_LOCK(&writer_mutex);
+        return false;
+    }
+
+    if (ring->head + 1 - ring->tail < EVENT_BUF_RING_SIZE) {
+        ring->filled[ring->head % EVENT_BUF_RING_SIZE] = eb->pos - eb->begin;
+        ring->head++;
+        eb->begin = ring->bufs[ring->head % EVENT_BUF_RING_SIZE];
+        signalCondition(&writer_wakeup);
+    } else {
+        ring->dropped += eb->n_events;
+    }
+    RELEASE_LOCK(&writer_mutex);
+
+    resetEventsBuf(eb);
+    return true;
+}
+
+// Tell the consumer about events we dropped since the last time we said so.
+void postEventsDropped(EventsBuf *eb)
+{
+    EventsBufRing *ring = eb->ring;
+
+    if (ring->dropped != 0) {
+        ensureRoomForEvent(eb, EVENT_EVENTLOG_DROPPED);
+        postEventHeader(eb, EVENT_EVENTLOG_DROPPED);
+        postWord64(eb, ring->dropped);
+        ring->dropped = 0;
+    }
+}
+#endif
+
 StgBool hasRoomForEvent(EventsBuf *eb, EventTypeNum eNum)
 {
   uint32_t size = sizeof(EventTypeNum) + sizeof(EventTimestamp) + eventTypes[eNum].size;
@@ -31,6 +31,13 @@ void abortEventLogging(void); // #4512 - after fork child needs to abort
 void flushEventLog(void);     // event log inherited from parent
 void moreCapEventBufs (uint32_t from, uint32_t to);
 
+/*
+ * The flight recorder, see Note [Eventlog flight recorder] in EventLog.c
+ */
+extern volatile StgWord eventlog_dump_requested;
+void dumpEventLog(void);        // all capabilities must be stopped
+void requestEventLogDump(void); // safe to call from a signal handler
+
 /*
  * Post a scheduler event to the capability's event buffer (an event
  * that has an associated thread).
@@ -172,6 +179,16 @@ void postConcUpdRemSetFlush(Capability *cap);
 void postConcMarkEnd(StgWord32 marked_obj_count);
 void postNonmovingHeapCensus(int log_blk_size,
                              const struct NonmovingAllocCensus *census);
+void postCFinalizersQueued(StgWord32 n_finalizers, StgWord32 queue_depth);
+void postCFinalizersRan(StgWord32 n_finalizers, StgWord64 latency);
+void postMVarCountersEvent (Capability *cap, MVarCounters counters);
+void postSTMCommit(Capability *cap, StgTSO *tso,
+                   StgWord32 reads, StgWord32 writes);
+void postSTMAbort(Capability *cap, StgTSO *tso,
+                  StgTVar *tvar, StgWord32 aborts);
+#if defined(THREADED_RTS)
+void postGcSyncLast(Capability *cap, Capability *last, StgWord64 sync_ns);
+#endif
 
 #else /* !TRACING */
 
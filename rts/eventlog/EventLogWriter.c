@@ -21,15 +21,25 @@
 #if defined(HAVE_UNISTD_H)
 #include <unistd.h>
 #endif
+#if !defined(mingw32_HOST_OS)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
 
 // PID of the process that writes to event_log_filename (#4512)
 static pid_t event_log_pid = -1;
 
+// Are we a forked child, writing to <prog>.<pid>.eventlog? (#4512)
+static bool event_log_forked = false;
+
 // File for logging events
 static FILE *event_log_file = NULL;
 
 #if defined(THREADED_RTS)
-// Protects event_log_file
+// Protects event_log_file, or the state of the socket writer
 static Mutex event_log_mutex;
 
 static void acquire_event_log_lock(void) { ACQUIRE_LOCK(&event_log_mutex); }
@@ -68,14 +78,18 @@ static char *outputFileName(void)
                                         + 10 /* .eventlog */,
                                         "initEventLogFileWriter");
 
-        if (event_log_pid == -1) { // #4512
-            // Single process
+        if (event_log_pid == -1 ||
+            (event_log_pid == getpid() && !event_log_forked)) { // #4512
+            // Single process. We may be opening the file again, to write
+            // out the flight recorder: see Note [Eventlog flight recorder]
+            // in EventLog.c.
             sprintf(filename, "%s.eventlog", prog);
             event_log_pid = getpid();
         } else {
             // Forked process, eventlog already started by the parent
             // before fork
             event_log_pid = getpid();
+            event_log_forked = true;
             // We don't have a FMT* symbol for pid_t, so we go via Word64
             // to be sure of not losing range. It would be nicer to have a
             // FMT* symbol or similar, though.
@@ -151,3 +165,218 @@ const EventLogWriter FileEventLogWriter = {
     .flushEventLog = flushEventLogFile,
     .stopEventLogWriter = stopEventLogFileWriter
 };
+
+#if !defined(mingw32_HOST_OS)
+/* Note [Eventlog socket writer]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   SocketEventLogWriter streams the eventlog to a consumer listening on the
+   Unix domain socket given by +RTS --eventlog-socket=<path>, so that a
+   monitoring agent can follow a running program.  The RTS is the client:
+   each time the writer is initialised (that is, by startEventLogging) it
+   connects afresh, so the consumer sees a complete eventlog, header
+   first, on each connection.  A program can therefore hand its eventlog
+   to a restarted agent by calling endEventLogging() and then
+   startEventLogging(&SocketEventLogWriter).
+
+   The socket is non-blocking: we never stall the caller of writeEventLog
+   (a capability, or the eventlog writer thread) waiting for the consumer.
+   Whatever the socket won't take goes on socket_backlog, and we try to
+   send that first on every later write or flush.  The backlog is bounded
+   to EVENT_LOG_SOCKET_BACKLOG eventlog buffers; once it is full we drop
+   whole writes.  Each write is a complete header or a sequence of complete
+   blocks, so dropping one keeps the stream parseable.  We never drop the
+   remainder of a write that has been partly sent.
+
+   If we can't connect, or the consumer goes away, the events are
+   discarded until the next startEventLogging.  When the writer is stopped
+   we wait up to a second for the consumer to take the backlog.
+*/
+
+#define EVENT_LOG_SOCKET_BACKLOG 4
+
+#if defined(MSG_NOSIGNAL)
+#define EVENT_LOG_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define EVENT_LOG_SEND_FLAGS 0  // we ignore SIGPIPE anyway (#1619)
+#endif
+
+static int event_log_socket = -1;
+
+static StgWord8 *socket_backlog = NULL;
+static size_t socket_backlog_len = 0;   // bytes waiting to be sent
+static size_t socket_backlog_size = 0;  // bytes allocated
+static StgWord64 socket_dropped = 0;    // bytes we gave up on
+
+static void initEventLogSocketWriter(void);
+static bool writeEventLogSocket(void *eventlog, size_t eventlog_size);
+static void flushEventLogSocket(void);
+static void stopEventLogSocketWriter(void);
+
+static void
+closeEventLogSocket(void)
+{
+    close(event_log_socket);
+    event_log_socket = -1;
+    socket_backlog_len = 0;
+}
+
+// Send as much of buf as the socket takes without blocking, and return how
+// much that was.  Call with the event log lock held.
+static size_t
+sendEventLogSocket(const StgWord8 *buf, size_t size)
+{
+    size_t sent = 0;
+
+    while (sent < size && event_log_socket != -1) {
+        ssize_t r = send(event_log_socket, buf + sent, size - sent,
+                         EVENT_LOG_SEND_FLAGS);
+        if (r >= 0) {
+            sent += r;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            // The consumer has gone away
+            closeEventLogSocket();
+        }
+    }
+    return sent;
+}
+
+static void
+sendEventLogSocketBacklog(void)
+{
+    size_t sent = sendEventLogSocket(socket_backlog, socket_backlog_len);
+    if (sent > 0 && event_log_socket != -1) {
+        memmove(socket_backlog, socket_backlog + sent,
+                socket_backlog_len - sent);
+        socket_backlog_len -= sent;
+    }
+}
+
+static void
+appendEventLogSocketBacklog(const StgWord8 *buf, size_t size)
+{
+    if (socket_backlog_len + size > socket_backlog_size) {
+        socket_backlog_size = socket_backlog_len + size;
+        socket_backlog = stgReallocBytes(socket_backlog, socket_backlog_size,
+                                         "appendEventLogSocketBacklog");
+    }
+    memcpy(socket_backlog + socket_backlog_len, buf, size);
+    socket_backlog_len += size;
+}
+
+static void
+initEventLogSocketWriter(void)
+{
+    const char *path = RtsFlags.TraceFlags.trace_socket;
+    struct sockaddr_un addr;
+
+#if defined(THREADED_RTS)
+    initMutex(&event_log_mutex);
+#endif
+    socket_dropped = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+        errorBelch("initEventLogSocketWriter: invalid socket path %s",
+                   path ? path : "(none)");
+        return;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        sysErrorBelch("initEventLogSocketWriter: socket");
+        return;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        // Not fatal: the program carries on without an eventlog
+        sysErrorBelch("initEventLogSocketWriter: can't connect to %s", path);
+        close(fd);
+        return;
+    }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        sysErrorBelch("initEventLogSocketWriter: fcntl");
+        close(fd);
+        return;
+    }
+    event_log_socket = fd;
+}
+
+static bool
+writeEventLogSocket(void *eventlog, size_t eventlog_size)
+{
+    const StgWord8 *buf = eventlog;
+    size_t sent = 0;
+
+    acquire_event_log_lock();
+    if (socket_backlog_len > 0) {
+        sendEventLogSocketBacklog();
+    }
+    if (socket_backlog_len == 0) {
+        sent = sendEventLogSocket(buf, eventlog_size);
+    }
+
+    if (sent < eventlog_size && event_log_socket != -1) {
+        size_t limit =
+            EVENT_LOG_SOCKET_BACKLOG * RtsFlags.TraceFlags.buffer_size;
+        if (sent > 0 || socket_backlog_len + eventlog_size <= limit) {
+            appendEventLogSocketBacklog(buf + sent, eventlog_size - sent);
+        } else {
+            socket_dropped += eventlog_size;
+        }
+    }
+    release_event_log_lock();
+
+    // A consumer that has gone away or can't keep up is not an error
+    return true;
+}
+
+static void
+flushEventLogSocket(void)
+{
+    acquire_event_log_lock();
+    if (socket_backlog_len > 0) {
+        sendEventLogSocketBacklog();
+    }
+    release_event_log_lock();
+}
+
+static void
+stopEventLogSocketWriter(void)
+{
+    if (event_log_socket != -1 && socket_backlog_len > 0) {
+        // Give the consumer a last chance to take the backlog
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        fcntl(event_log_socket, F_SETFL,
+              fcntl(event_log_socket, F_GETFL) & ~O_NONBLOCK);
+        setsockopt(event_log_socket, SOL_SOCKET, SO_SNDTIMEO,
+                   &timeout, sizeof(timeout));
+        sendEventLogSocketBacklog();
+    }
+    if (event_log_socket != -1) {
+        closeEventLogSocket();
+    }
+    if (socket_dropped > 0) {
+        errorBelch("eventlog socket: the consumer could not keep up; "
+                   "%" FMT_Word64 " bytes of events were dropped",
+                   socket_dropped);
+    }
+
+    stgFree(socket_backlog);
+    socket_backlog = NULL;
+    socket_backlog_len = 0;
+    socket_backlog_size = 0;
+#if defined(THREADED_RTS)
+    closeMutex(&event_log_mutex);
+#endif
+}
+
+const EventLogWriter SocketEventLogWriter = {
+    .initEventLogWriter = initEventLogSocketWriter,
+    .writeEventLog = writeEventLogSocket,
+    .flushEventLog = flushEventLogSocket,
+    .stopEventLogWriter = stopEventLogSocketWriter
+};
+#endif /* !mingw32_HOST_OS */
@@ -74,9 +74,80 @@
 
 static void *next_request = 0;
 
+/* Note [Huge pages]
+ * ~~~~~~~~~~~~~~~~~
+ * On large heaps a measurable fraction of GC time goes to TLB misses while
+ * evacuating and scavenging. With --huge-pages we ask the kernel to back the
+ * heap (and hence the nursery, which is carved out of megablocks) with 2MB
+ * pages:
+ *
+ *  - In the default mode (HUGE_PAGES_THP) we mark all memory that we commit
+ *    with MADV_HUGEPAGE, so that transparent huge pages are used for it even
+ *    when the system-wide THP policy is "madvise". To make it possible for
+ *    the kernel to use a huge page for a pair of adjacent megablocks we align
+ *    the reserved heap on a HUGE_PAGE_SIZE boundary (see
+ *    osTryReserveHeapMemory). Decommitting part of a huge page (e.g. in
+ *    returnMemoryToOS) simply makes the kernel split it.
+ *
+ *  - With --huge-pages=hugetlb (HUGE_PAGES_HUGETLB) we instead commit memory
+ *    with MAP_HUGETLB, which takes pages from the pool that the administrator
+ *    has reserved in /proc/sys/vm/nr_hugepages. Such mappings must be made in
+ *    whole huge pages, so we map the heap in HUGE_PAGE_SIZE steps from the
+ *    bottom of the reserved address space and keep the end of the mapped area
+ *    in hugetlb_top. Memory below hugetlb_top stays mapped forever: committing
+ *    it again is a no-op and decommitting it releases only the huge pages
+ *    entirely contained in the range with MADV_DONTNEED (MADV_FREE is not
+ *    supported for hugetlb mappings). Touching such a page again faults in a
+ *    fresh huge page. If the pool runs dry we fall back to transparent huge
+ *    pages for the remainder of the heap. This mode requires the two-step
+ *    allocator (USE_LARGE_ADDRESS_SPACE) as we must control where memory is
+ *    committed; otherwise we behave as in the default mode.
+ *
+ * osHugePageBytes reports how much of the heap is actually backed by huge
+ * pages, which is shown in the +RTS -s output.
+ */
+#if defined(linux_HOST_OS) && defined(MADV_HUGEPAGE)
+#define USE_HUGE_PAGES 1
+#define HUGE_PAGE_SIZE ((W_)2 * 1024 * 1024)
+#endif
+
+#if defined(USE_HUGE_PAGES) && defined(MAP_HUGETLB) \
+    && defined(USE_LARGE_ADDRESS_SPACE)
+#define USE_HUGETLB 1
+// The end of the part of the heap which is mapped with MAP_HUGETLB
+static W_ hugetlb_top = 0;
+// Set when the hugetlb pool has been exhausted
+static bool hugetlb_failed = false;
+#endif
+
 void osMemInit(void)
 {
     next_request = (void *)RtsFlags.GcFlags.heapBase;
+
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+#if !defined(USE_HUGE_PAGES)
+        errorBelch("warning: --huge-pages is not supported on this platform");
+        RtsFlags.GcFlags.hugePages = HUGE_PAGES_NONE;
+#elif !defined(USE_HUGETLB)
+        RtsFlags.GcFlags.hugePages = HUGE_PAGES_THP;
+#endif
+    }
+}
+
+/* Advise the kernel to back a freshly committed range with transparent huge
+ * pages. See Note [Huge pages]. */
+static void
+advise_huge_pages(void *addr STG_UNUSED, W_ size STG_UNUSED)
+{
+#if defined(USE_HUGE_PAGES)
+    static bool warned = false;
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+        if (madvise(addr, size, MADV_HUGEPAGE) != 0 && !warned) {
+            sysErrorBelch("warning: unable to use transparent huge pages");
+            warned = true;
+        }
+    }
+#endif
 }
 
 /* -----------------------------------------------------------------------------
@@ -353,6 +424,7 @@ osGetMBlocks(uint32_t n)
   // ToDo: check that we haven't already grabbed the memory at next_request
   next_request = (char *)ret + size;
 
+  advise_huge_pages(ret, size);
   return ret;
 }
 
@@ -454,6 +526,42 @@ StgWord64 getPhysicalMemorySize (void)
     return physMemSize;
 }
 
+/* Returns the number of bytes of the heap which are backed by huge pages, or 0
+ * if this cannot be determined. See Note [Huge pages]. */
+StgWord64 osHugePageBytes (void)
+{
+    StgWord64 total = 0;
+#if defined(USE_HUGE_PAGES)
+    W_ lo = 0, hi = (W_)-1;
+#if defined(USE_LARGE_ADDRESS_SPACE)
+    lo = mblock_address_space.begin;
+    hi = mblock_address_space.end;
+#endif
+
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    // /proc/self/smaps consists of a header line giving the address range of
+    // each mapping followed by a number of "Field:  <n> kB" lines.
+    char line[256];
+    bool in_heap = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long start, end, kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            in_heap = start < hi && end > lo;
+        } else if (in_heap &&
+                   (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                    sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1)) {
+            total += (StgWord64)kb * 1024;
+        }
+    }
+    fclose(f);
+#endif
+    return total;
+}
+
 void setExecutable (void *p, W_ len, bool exec)
 {
     StgWord pageSize = getPageSize();
@@ -476,23 +584,31 @@ osTryReserveHeapMemory (W_ len, void *hint)
 {
     void *base, *top;
     void *start, *end;
+    W_ align = MBLOCK_SIZE;
 
     ASSERT((len & ~MBLOCK_MASK) == len);
 
-    /* We try to allocate len + MBLOCK_SIZE,
-       because we need memory which is MBLOCK_SIZE aligned,
-       and then we discard what we don't need */
+#if defined(USE_HUGE_PAGES)
+    // See Note [Huge pages].
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+        align = HUGE_PAGE_SIZE;
+    }
+#endif
+
+    /* We try to allocate len + align,
+       because we need memory which is align-aligned (that is, at least
+       MBLOCK_SIZE aligned), and then we discard what we don't need */
 
-    base = my_mmap(hint, len + MBLOCK_SIZE, MEM_RESERVE);
+    base = my_mmap(hint, len + align, MEM_RESERVE);
     if (base == NULL)
         return NULL;
 
-    top = (void*)((W_)base + len + MBLOCK_SIZE);
+    top = (void*)((W_)base + len + align);
 
-    if (((W_)base & MBLOCK_MASK) != 0) {
-        start = MBLOCK_ROUND_UP(base);
-        end = MBLOCK_ROUND_DOWN(top);
-        ASSERT(((W_)end - (W_)start) == len);
+    if (((W_)base & (align - 1)) != 0) {
+        start = (void*)roundUpToAlign((W_)base, align);
+        end = (void*)((W_)start + len);
+        ASSERT((W_)end <= (W_)top);
 
         if (munmap(base, (W_)start-(W_)base) < 0) {
             sysErrorBelch("unable to release slop before heap");
@@ -504,6 +620,9 @@ osTryReserveHeapMemory (W_ len, void *hint)
         start = base;
     }
 
+#if defined(USE_HUGETLB)
+    hugetlb_top = (W_)start;
+#endif
     return start;
 }
 
@@ -594,12 +713,64 @@ void *osReserveHeapMemory(void *startAddressPtr, W_ *len)
     return at;
 }
 
+#if defined(USE_HUGETLB)
+/* Try to commit [at, at+size) with MAP_HUGETLB, returning the part of the
+ * range which still needs committing with ordinary pages in *at and *size.
+ * See Note [Huge pages]. */
+static void
+commit_hugetlb(void **at, W_ *size)
+{
+    W_ start = (W_)*at;
+    W_ end = start + *size;
+
+    // Already mapped with huge pages?
+    if (end <= hugetlb_top) {
+        *size = 0;
+        return;
+    }
+    if (start < hugetlb_top) {
+        start = hugetlb_top;
+    }
+
+    if (RtsFlags.GcFlags.hugePages == HUGE_PAGES_HUGETLB && !hugetlb_failed) {
+        // We map contiguously from the bottom of the heap, so anything above
+        // hugetlb_top has never been committed.
+        ASSERT(start == hugetlb_top);
+        W_ top = roundUpToAlign(end, HUGE_PAGE_SIZE);
+        void *r = mmap((void*)start, top - start, PROT_READ | PROT_WRITE,
+                       MAP_FIXED | MAP_ANON | MAP_PRIVATE | MAP_HUGETLB,
+                       -1, 0);
+        if (r != MAP_FAILED) {
+            post_mmap_madvise(MEM_COMMIT, top - start, r);
+            hugetlb_top = top;
+            *size = 0;
+            return;
+        }
+        errorBelch("warning: unable to map huge pages (%s); "
+                   "falling back to transparent huge pages",
+                   strerror(errno));
+        hugetlb_failed = true;
+    }
+
+    *at = (void*)start;
+    *size = end - start;
+}
+#endif
+
 void osCommitMemory(void *at, W_ size)
 {
+#if defined(USE_HUGETLB)
+    commit_hugetlb(&at, &size);
+    if (size == 0) {
+        return;
+    }
+#endif
+
     void *r = my_mmap(at, size, MEM_COMMIT);
     if (r == NULL) {
         barf("Unable to commit %" FMT_Word " bytes of memory", size);
     }
+    advise_huge_pages(r, size);
 }
 
 /* Note [MADV_FREE and MADV_DONTNEED]
@@ -626,6 +797,26 @@ void osDecommitMemory(void *at, W_ size)
 {
     int r;
 
+#if defined(USE_HUGETLB)
+    // Memory mapped with MAP_HUGETLB can only be released in whole huge
+    // pages. See Note [Huge pages].
+    if ((W_)at < hugetlb_top) {
+        W_ end = stg_min((W_)at + size, hugetlb_top);
+        W_ first = roundUpToAlign((W_)at, HUGE_PAGE_SIZE);
+        W_ last = end & ~(HUGE_PAGE_SIZE - 1);
+        if (first < last) {
+            r = madvise((void*)first, last - first, MADV_DONTNEED);
+            if(r < 0)
+                sysErrorBelch("unable to decommit memory");
+        }
+        if ((W_)at + size <= hugetlb_top) {
+            return;
+        }
+        size = (W_)at + size - hugetlb_top;
+        at = (void*)hugetlb_top;
+    }
+#endif
+
     // First make the memory unaccessible (so that we get a segfault
     // at the next attempt to touch it)
     // We only do this in DEBUG because it forces the OS to remove
@@ -42,6 +42,18 @@
 #include <string.h>
 #endif
 
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_PTHREAD_CONDATTR_SETCLOCK) && defined(HAVE_CLOCK_GETTIME) \
+    && defined(_POSIX_MONOTONIC_CLOCK)
+#define COND_MONOTONIC_CLOCK 1
+#endif
+
 #if defined(darwin_HOST_OS) || defined(freebsd_HOST_OS)
 #include <sys/types.h>
 #include <sys/sysctl.h>
@@ -88,7 +100,17 @@
 void
 initCondition( Condition* pCond )
 {
+#if defined(COND_MONOTONIC_CLOCK)
+  // Use the monotonic clock for timedWaitCondition() deadlines, so that a
+  // jump in the wall clock can't stretch or cut short a timed wait.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(pCond, &attr);
+  pthread_condattr_destroy(&attr);
+#else
   pthread_cond_init(pCond, NULL);
+#endif
   return;
 }
 
@@ -117,6 +139,33 @@ waitCondition ( Condition* pCond, Mutex* pMut )
   return (pthread_cond_wait(pCond,pMut) == 0);
 }
 
+bool
+timedWaitCondition ( Condition* pCond, Mutex* pMut, Time timeout )
+{
+  struct timespec deadline;
+  Time ns;
+
+  // pthread_cond_timedwait() wants an absolute deadline on the clock the
+  // condition was created with (see initCondition())
+#if defined(COND_MONOTONIC_CLOCK)
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (Time)now.tv_nsec + TimeToNS(timeout);
+#else
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  ns = (Time)now.tv_usec * 1000 + TimeToNS(timeout);
+#endif
+  deadline.tv_sec  = now.tv_sec + ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+
+  int r = pthread_cond_timedwait(pCond, pMut, &deadline);
+  if (r != 0 && r != ETIMEDOUT) {
+      barf("timedWaitCondition: %s", strerror(r));
+  }
+  return r == 0;
+}
+
 void
 yieldThread(void)
 {
@@ -9,6 +9,10 @@
  *
  * ---------------------------------------------------------------------------*/
 
+#if defined(__linux__)
+#define _GNU_SOURCE // for syscall(), used to drive io_uring
+#endif
+
 #include "PosixSource.h"
 #include "Rts.h"
 
@@ -18,10 +22,12 @@
 #include "RaiseAsync.h"
 #include "RtsUtils.h"
 #include "Capability.h"
+#include "Threads.h"
 #include "Select.h"
 #include "AwaitEvent.h"
 #include "Stats.h"
 #include "GetTime.h"
+#include "eventlog/EventLog.h"
 
 # if defined(HAVE_SYS_SELECT_H)
 #  include <sys/select.h>
@@ -31,8 +37,28 @@
 #  include <sys/types.h>
 # endif
 
+# if defined(HAVE_SYS_EPOLL_H)
+#  include <sys/epoll.h>
+# endif
+
+# if defined(HAVE_LINUX_IO_URING_H)
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#   define USE_IO_URING 1
+#   include <sys/mman.h>
+#   include <poll.h>
+#   include <fcntl.h>
+#  endif
+# endif
+
+# if defined(HAVE_SYS_EPOLL_H) || defined(USE_IO_URING)
+#  define USE_FD_QUEUES 1
+# endif
+
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "Clock.h"
 
@@ -203,6 +229,827 @@ static enum FdState fdPollWriteState (int fd)
         return RTS_FD_IS_READY;
 }
 
+/* Note [epoll backend for awaitEvent]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The select() backend below keeps every thread blocked on I/O in
+   blocked_queue and rebuilds a pair of fd_sets from it on every call to
+   awaitEvent. That costs O(blocked threads) per call, even if only one fd
+   is ready, and select() can't handle fds at or above FD_SETSIZE at all.
+
+   Where epoll is available we use it instead:
+
+    * Threads blocked in waitRead#/waitWrite# are put on a per-fd queue
+      (fd_queues[fd].readers or .writers, linked through tso->_link) by
+      blockOnFd, rather than on blocked_queue. n_fd_waiters counts them, so
+      that the scheduler knows there is I/O to wait for (see
+      EMPTY_BLOCKED_QUEUE()). The queues are GC roots (markFdQueues).
+
+    * Each fd is registered with the epoll instance once and stays
+      registered. We use EPOLLONESHOT, so an fd's registration is disarmed
+      once it has reported an event; blockOnFd puts the fd on the dirty list
+      and awaitEvent re-arms it (EPOLL_CTL_MOD) with the events its waiters
+      need before waiting. An fd with no waiters is left disarmed rather than
+      removed, and events on it are ignored.
+
+    * epoll_wait() tells us which fds are ready, and we wake all the
+      threads waiting on them. So each call costs O(fds re-armed + fds
+      ready), independent of how many threads are blocked.
+
+   As with select(), fds that can't be polled (regular files, EPERM from
+   epoll_ctl) are always ready, and threads blocking on a closed fd get a
+   blockedOnBadFD exception (#4934).
+
+   Closing an fd while threads are waiting on it is harder. select() is
+   handed every fd again each time we wait, so it finds out with EBADF the
+   next time round. An epoll registration is simply dropped when the fd
+   is closed, though, without an event, so the waiters would wait
+   forever. Instead, while any thread is waiting on an fd we never wait
+   for longer than FD_REARM_INTERVAL, and when a wait finds nothing ready
+   rearmAllFds() re-arms every fd with waiters. Then EPOLL_CTL_MOD fails
+   with EBADF for a closed fd, whose waiters get blockedOnBadFD as before,
+   and with ENOENT for one whose number has been reused, which we register
+   afresh, so its waiters wait on the new file as they would with
+   select(). Either way the waiters find out within FD_REARM_INTERVAL of
+   the close, rather than straight away.
+
+   The backend is picked the first time a thread blocks on I/O; if
+   epoll_create1() fails we fall back to select(). After forkProcess the
+   child must not share the parent's epoll instance, so it starts again from
+   scratch (resetFdQueues).
+*/
+
+/* Note [io_uring backend for awaitEvent]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS --io-uring, and a kernel that supports it, the per-fd queues of
+   Note [epoll backend for awaitEvent] are driven by io_uring instead of
+   epoll. An fd is armed by queueing an IORING_OP_POLL_ADD request, which is
+   one-shot just like EPOLLONESHOT. The requests for every fd that needs
+   arming, together with an IORING_OP_TIMEOUT for the next threadDelay, are
+   submitted by the same io_uring_enter() call that waits for completions, so
+   each round of awaitEvent costs a single system call however many fds have
+   to be re-armed, where epoll needs one epoll_ctl() per fd.
+
+   Unlike an epoll registration, a pending poll request holds a reference to
+   the file, so it doesn't go away when the fd is closed. To avoid waiting on
+   a stale file after the fd number has been reused, we cancel the poll
+   (IORING_OP_POLL_REMOVE) when the last thread waiting on an fd goes away,
+   and each request carries the fd's current sequence number in its
+   user_data so that completions of cancelled or superseded requests are
+   ignored.
+
+   For the same reason a poll on an fd that is closed while threads wait on
+   it never completes. As with epoll, rearmAllFds() replaces the poll of
+   every fd with waiters when a wait finds nothing ready: the new
+   IORING_OP_POLL_ADD completes with -EBADF if the fd is closed, and the
+   waiters get blockedOnBadFD, or polls the new file if the number has
+   been reused.
+
+   Likewise the IORING_OP_TIMEOUT for the next threadDelay carries a
+   generation number, which we bump each time we replace the timeout, so
+   that the completion of a timeout we have removed (-ECANCELED) or that
+   fired just as we removed it is not taken for that of the current one.
+
+   We need IORING_FEAT_NODROP (Linux 5.5), which also implies the timeout
+   opcodes we use; if io_uring_setup() fails or the feature is missing we use
+   epoll.
+
+   Only readiness goes through the ring: the woken thread still does the
+   read() or write() itself. Submitting the whole operation would need new
+   primops and support in base, in the way that asyncRead# works on Windows.
+*/
+
+typedef enum {
+    IO_BACKEND_NONE,            // not decided yet
+    IO_BACKEND_SELECT,
+    IO_BACKEND_EPOLL,
+    IO_BACKEND_URING,
+} IOBackend;
+
+static IOBackend io_backend = IO_BACKEND_NONE;
+
+static void awaitEventSelect (bool wait);
+
+// Number of threads on the per-fd queues. See Note [epoll backend for
+// awaitEvent].
+StgWord n_fd_waiters = 0;
+
+#if defined(USE_FD_QUEUES)
+
+// Events that the threads waiting on an fd are interested in
+#define FD_READ  1
+#define FD_WRITE 2
+
+// Longest we wait while threads are waiting on fds, so that we notice fds
+// closed under them. See Note [epoll backend for awaitEvent].
+#define FD_REARM_INTERVAL SecondsToTime(1)
+
+typedef struct {
+    StgTSO   *readers;          // threads blocked reading, via tso->_link
+    StgTSO   *writers;          // threads blocked writing, via tso->_link
+    uint32_t  armed;            // FD_READ|FD_WRITE the fd is armed for
+    uint32_t  seq;              // io_uring: number of the current poll request
+    bool      registered;       // epoll: fd has been added to epoll_fd
+    bool      dirty;            // fd is on dirty_fds
+} FdQueue;
+
+static FdQueue *fd_queues = NULL;
+static uint32_t n_fd_queues = 0;
+
+// fds whose registration may need to be updated before we next wait
+static int *dirty_fds = NULL;
+static uint32_t n_dirty_fds = 0;
+static uint32_t max_dirty_fds = 0;
+
+static FdQueue *getFdQueue (int fd)
+{
+    if ((uint32_t)fd >= n_fd_queues) {
+        uint32_t n = stg_max(stg_max(n_fd_queues * 2, (uint32_t)fd + 1), 64);
+        fd_queues = stgReallocBytes(fd_queues, n * sizeof(FdQueue),
+                                    "getFdQueue");
+        for (uint32_t i = n_fd_queues; i < n; i++) {
+            fd_queues[i] = (FdQueue) {
+                .readers = END_TSO_QUEUE,
+                .writers = END_TSO_QUEUE,
+                .armed = 0,
+                .seq = 0,
+                .registered = false,
+                .dirty = false,
+            };
+        }
+        n_fd_queues = n;
+    }
+    return &fd_queues[fd];
+}
+
+static void markFdDirty (int fd, FdQueue *q)
+{
+    if (q->dirty) return;
+    if (n_dirty_fds == max_dirty_fds) {
+        max_dirty_fds = stg_max(max_dirty_fds * 2, 64);
+        dirty_fds = stgReallocBytes(dirty_fds, max_dirty_fds * sizeof(int),
+                                    "markFdDirty");
+    }
+    dirty_fds[n_dirty_fds++] = fd;
+    q->dirty = true;
+}
+
+static StgTSO **fdQueueFor (FdQueue *q, StgTSO *tso)
+{
+    return tso->why_blocked == BlockedOnRead ? &q->readers : &q->writers;
+}
+
+static uint32_t fdWanted (FdQueue *q)
+{
+    return (q->readers != END_TSO_QUEUE ? FD_READ  : 0)
+         | (q->writers != END_TSO_QUEUE ? FD_WRITE : 0);
+}
+
+/* Wake up, or raise blockedOnBadFD in, every thread on the given queue. */
+static void wakeFdWaiters (StgTSO **queue, bool bad_fd)
+{
+    StgTSO *tso, *next;
+
+    for (tso = *queue; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        tso->_link = END_TSO_QUEUE;
+        n_fd_waiters--;
+        if (bad_fd) {
+            IF_DEBUG(scheduler,
+                debugBelch("Killing blocked thread %lu on bad fd=%i\n",
+                           (unsigned long)tso->id, (int)tso->block_info.fd));
+            raiseAsync(&MainCapability, tso,
+                       (StgClosure *)blockedOnBadFD_closure, false, NULL);
+        } else {
+            IF_DEBUG(scheduler,
+                debugBelch("Waking up blocked thread %lu\n",
+                           (unsigned long)tso->id));
+            tso->why_blocked = NotBlocked;
+            pushOnRunQueue(&MainCapability,tso);
+        }
+    }
+    *queue = END_TSO_QUEUE;
+}
+
+/* Mark every fd that has waiters for re-arming the next time we wait, so
+ * that we find out about fds that have been closed. See Note [epoll backend
+ * for awaitEvent].
+ */
+#if defined(USE_IO_URING)
+static void cancelUringPoll (int fd, FdQueue *q);
+#endif
+
+static void rearmAllFds (void)
+{
+    for (uint32_t fd = 0; fd < n_fd_queues; fd++) {
+        FdQueue *q = &fd_queues[fd];
+        if (fdWanted(q) == 0) continue;
+#if defined(USE_IO_URING)
+        if (io_backend == IO_BACKEND_URING && q->armed != 0) {
+            cancelUringPoll(fd, q);
+        }
+#endif
+        q->armed = 0;
+        markFdDirty(fd, q);
+    }
+}
+
+/* The fd has been reported ready for 'ready' (FD_READ|FD_WRITE), and is no
+ * longer armed. Wake the threads waiting for those events, and re-arm the fd
+ * for anybody left.
+ */
+static void fdReady (int fd, uint32_t ready, bool bad_fd)
+{
+    FdQueue *q = &fd_queues[fd];
+
+    q->armed = 0;
+    if (ready & FD_READ) {
+        wakeFdWaiters(&q->readers, bad_fd);
+    }
+    if (ready & FD_WRITE) {
+        wakeFdWaiters(&q->writers, bad_fd);
+    }
+    if (fdWanted(q) != 0) {
+        markFdDirty(fd, q);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   epoll
+   -------------------------------------------------------------------------- */
+
+#if defined(HAVE_SYS_EPOLL_H)
+
+#define MAX_EPOLL_EVENTS 256
+
+static int epoll_fd = -1;
+
+static bool initEpoll (void)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        IF_DEBUG(scheduler,
+                 debugBelch("epoll_create1 failed (%s)\n", strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+/* Bring the epoll registration of each dirty fd up to date with the threads
+ * waiting on it.
+ */
+static void armDirtyFdsEpoll (void)
+{
+    for (uint32_t i = 0; i < n_dirty_fds; i++) {
+        int fd = dirty_fds[i];
+        FdQueue *q = &fd_queues[fd];
+        struct epoll_event ev;
+        uint32_t want;
+        int r;
+
+        q->dirty = false;
+        want = fdWanted(q);
+        if (want == 0 || want == q->armed) continue;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = (want & FD_READ  ? EPOLLIN  : 0)
+                  | (want & FD_WRITE ? EPOLLOUT : 0)
+                  | EPOLLONESHOT;
+        ev.data.fd = fd;
+        r = epoll_ctl(epoll_fd, q->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                      fd, &ev);
+        if (r < 0 && errno == ENOENT) {
+            // the fd was closed (and perhaps reopened) since we registered it,
+            // which removes it from the epoll set
+            r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        } else if (r < 0 && errno == EEXIST) {
+            r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        }
+
+        if (r == 0) {
+            q->registered = true;
+            q->armed = want;
+        } else if (errno == EPERM) {
+            // can't poll this fd (e.g. a regular file): select() would
+            // report it as always ready, so do the same
+            fdReady(fd, FD_READ | FD_WRITE, false);
+        } else if (errno == EBADF) {
+            fdReady(fd, FD_READ | FD_WRITE, true);
+        } else {
+            sysErrorBelch("epoll_ctl");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+    n_dirty_fds = 0;
+}
+
+/* Arm the dirty fds and wait for up to 'timeout' (forever if negative) for
+ * any of them to become ready. Returns false if interrupted by a signal.
+ */
+static bool pollFdsEpoll (Time timeout)
+{
+    static struct epoll_event events[MAX_EPOLL_EVENTS];
+    int numFound, ms;
+
+    armDirtyFdsEpoll();
+
+    if (timeout < 0) {
+        ms = -1;
+    } else if (!emptyRunQueue(&MainCapability)) {
+        // armDirtyFdsEpoll woke somebody up
+        ms = 0;
+    } else {
+        // round up, so that we don't spin
+        ms = (int)((TimeToNS(timeout) + 999999) / 1000000);
+    }
+
+    numFound = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, ms);
+    if (numFound < 0) {
+        if (errno != EINTR) {
+            sysErrorBelch("epoll_wait");
+            stg_exit(EXIT_FAILURE);
+        }
+        return false;
+    }
+
+    if (numFound == 0 && ms != 0) {
+        // timed out; look for closed fds before we wait again
+        rearmAllFds();
+    }
+
+    for (int i = 0; i < numFound; i++) {
+        uint32_t ev = events[i].events;
+        fdReady(events[i].data.fd,
+                (ev & (EPOLLIN  | EPOLLHUP | EPOLLERR) ? FD_READ  : 0) |
+                (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR) ? FD_WRITE : 0),
+                false);
+    }
+    return true;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* -----------------------------------------------------------------------------
+   io_uring
+   -------------------------------------------------------------------------- */
+
+#if defined(USE_IO_URING)
+
+#define URING_ENTRIES 256
+
+// user_data of our requests: the fd and its sequence number, a timeout and
+// its generation, or URING_IGNORE_UD
+#define URING_TIMEOUT_FD  (~(uint32_t)0)
+#define URING_IGNORE_UD   (~(uint64_t)1)
+#define URING_FD_UD(fd,seq) (((uint64_t)(seq) << 32) | (uint32_t)(fd))
+#define URING_TIMEOUT_UD(gen) URING_FD_UD(URING_TIMEOUT_FD, gen)
+
+static struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned sq_tail_local;     // includes SQEs not yet made visible
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    bool timeout_pending;
+    uint32_t timeout_gen;       // generation of the latest timeout
+} ring = { .fd = -1 };
+
+static void closeUring (void)
+{
+    if (ring.sq_ring != NULL) munmap(ring.sq_ring, ring.sq_ring_size);
+    if (ring.cq_ring != NULL) munmap(ring.cq_ring, ring.cq_ring_size);
+    if (ring.sqes != NULL) munmap(ring.sqes, ring.sqes_size);
+    if (ring.fd >= 0) close(ring.fd);
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+static bool initUring (void)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring.fd < 0) {
+        IF_DEBUG(scheduler,
+                 debugBelch("io_uring_setup failed (%s)\n", strerror(errno)));
+        ring.fd = -1;
+        return false;
+    }
+    if (!(p.features & IORING_FEAT_NODROP)) {
+        IF_DEBUG(scheduler, debugBelch("io_uring is too old\n"));
+        closeUring();
+        return false;
+    }
+    fcntl(ring.fd, F_SETFD, FD_CLOEXEC);
+
+    ring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size = p.cq_off.cqes
+                      + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring.fd, IORING_OFF_SQ_RING);
+    ring.cq_ring = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, ring.fd, IORING_OFF_CQ_RING);
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ring == MAP_FAILED || ring.cq_ring == MAP_FAILED
+        || ring.sqes == MAP_FAILED) {
+        IF_DEBUG(scheduler, debugBelch("io_uring mmap failed\n"));
+        if (ring.sq_ring == MAP_FAILED) ring.sq_ring = NULL;
+        if (ring.cq_ring == MAP_FAILED) ring.cq_ring = NULL;
+        if (ring.sqes == MAP_FAILED) ring.sqes = NULL;
+        closeUring();
+        return false;
+    }
+
+    ring.sq_head  = (unsigned *)((char *)ring.sq_ring + p.sq_off.head);
+    ring.sq_tail  = (unsigned *)((char *)ring.sq_ring + p.sq_off.tail);
+    ring.sq_mask  = (unsigned *)((char *)ring.sq_ring + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)((char *)ring.sq_ring + p.sq_off.array);
+    ring.cq_head  = (unsigned *)((char *)ring.cq_ring + p.cq_off.head);
+    ring.cq_tail  = (unsigned *)((char *)ring.cq_ring + p.cq_off.tail);
+    ring.cq_mask  = (unsigned *)((char *)ring.cq_ring + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)((char *)ring.cq_ring + p.cq_off.cqes);
+    ring.sq_entries = p.sq_entries;
+    ring.sq_tail_local = *ring.sq_tail;
+    ring.timeout_pending = false;
+    ring.timeout_gen = 0;
+    return true;
+}
+
+static int enterUring (unsigned min_complete, unsigned flags)
+{
+    // publish the SQEs we have queued
+    __atomic_store_n(ring.sq_tail, ring.sq_tail_local, __ATOMIC_RELEASE);
+    unsigned to_submit =
+        ring.sq_tail_local - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    return syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete,
+                   flags, NULL, 0);
+}
+
+static struct io_uring_sqe *getUringSqe (void)
+{
+    while (ring.sq_tail_local - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE)
+           >= ring.sq_entries) {
+        // the submission queue is full: hand it to the kernel now
+        if (enterUring(0, 0) < 0 && errno != EINTR && errno != EAGAIN
+            && errno != EBUSY) {
+            sysErrorBelch("io_uring_enter");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+    unsigned idx = ring.sq_tail_local & *ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[idx] = idx;
+    ring.sq_tail_local++;
+    return sqe;
+}
+
+static void cancelUringPoll (int fd, FdQueue *q)
+{
+    struct io_uring_sqe *sqe = getUringSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = URING_FD_UD(fd, q->seq);
+    sqe->user_data = URING_IGNORE_UD;
+    q->seq++;
+    q->armed = 0;
+}
+
+static void armDirtyFdsUring (void)
+{
+    for (uint32_t i = 0; i < n_dirty_fds; i++) {
+        int fd = dirty_fds[i];
+        FdQueue *q = &fd_queues[fd];
+        uint32_t want;
+
+        q->dirty = false;
+        want = fdWanted(q);
+        if (want == 0 || (want & ~q->armed) == 0) continue;
+
+        // replace any poll which doesn't cover everything we want
+        if (q->armed != 0) {
+            cancelUringPoll(fd, q);
+        }
+        struct io_uring_sqe *sqe = getUringSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll_events = (want & FD_READ  ? POLLIN  : 0)
+                         | (want & FD_WRITE ? POLLOUT : 0);
+        sqe->user_data = URING_FD_UD(fd, q->seq);
+        q->armed = want;
+    }
+    n_dirty_fds = 0;
+}
+
+/* Process the completions; returns the number of polls that completed */
+static uint32_t reapUring (void)
+{
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    uint32_t n = 0;
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+        uint64_t ud = cqe->user_data;
+        int res = cqe->res;
+
+        if (ud == URING_IGNORE_UD) continue;
+        if ((uint32_t)ud == URING_TIMEOUT_FD) {
+            // ignore timeouts we have replaced
+            if ((uint32_t)(ud >> 32) == ring.timeout_gen) {
+                ring.timeout_pending = false;
+            }
+            continue;
+        }
+
+        uint32_t fd = (uint32_t)ud;
+        if (fd >= n_fd_queues || fd_queues[fd].seq != (uint32_t)(ud >> 32)) {
+            continue; // cancelled or superseded
+        }
+        // a poll request completes exactly once; the next one gets a new
+        // number
+        fd_queues[fd].seq++;
+        n++;
+        if (res == -EBADF || (res >= 0 && (res & POLLNVAL))) {
+            fdReady(fd, FD_READ | FD_WRITE, true);
+        } else if (res < 0) {
+            // let the threads find out what's wrong when they retry
+            fdReady(fd, FD_READ | FD_WRITE, false);
+        } else {
+            fdReady(fd,
+                    (res & (POLLIN  | POLLHUP | POLLERR) ? FD_READ  : 0) |
+                    (res & (POLLOUT | POLLHUP | POLLERR) ? FD_WRITE : 0),
+                    false);
+        }
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* As pollFdsEpoll, but with a single io_uring_enter() call */
+static bool pollFdsUring (Time timeout)
+{
+    static struct __kernel_timespec ts;
+    unsigned min_complete = 0, flags = 0;
+    int r;
+
+    armDirtyFdsUring();
+
+    if (timeout != 0 && emptyRunQueue(&MainCapability)) {
+        if (timeout > 0) {
+            if (ring.timeout_pending) {
+                struct io_uring_sqe *sqe = getUringSqe();
+                sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                sqe->fd = -1;
+                sqe->addr = URING_TIMEOUT_UD(ring.timeout_gen);
+                sqe->user_data = URING_IGNORE_UD;
+            }
+            ring.timeout_gen++;
+            ts.tv_sec  = TimeToSeconds(timeout);
+            ts.tv_nsec = TimeToNS(timeout) % 1000000000;
+            struct io_uring_sqe *sqe = getUringSqe();
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t)(uintptr_t)&ts;
+            sqe->len = 1;
+            sqe->user_data = URING_TIMEOUT_UD(ring.timeout_gen);
+            ring.timeout_pending = true;
+        }
+        min_complete = 1;
+        flags = IORING_ENTER_GETEVENTS;
+    }
+
+    r = enterUring(min_complete, flags);
+    if (r < 0 && errno != EAGAIN && errno != EBUSY) {
+        if (errno != EINTR) {
+            sysErrorBelch("io_uring_enter");
+            stg_exit(EXIT_FAILURE);
+        }
+        reapUring();
+        return false;
+    }
+    if (reapUring() == 0 && min_complete != 0) {
+        // timed out; look for closed fds before we wait again
+        rearmAllFds();
+    }
+    return true;
+}
+
+#endif /* USE_IO_URING */
+
+/* awaitEvent for the per-fd queues */
+static void awaitEventFdQueues (bool wait)
+{
+    LowResTime now;
+    Time timeout;
+    bool ok;
+
+    do {
+
+      now = getLowResTimeOfDay();
+      if (wakeUpSleepingThreads(now)) {
+          return;
+      }
+
+      if (!wait) {
+          // just poll
+          timeout = 0;
+      } else if (sleeping_queue != END_TSO_QUEUE) {
+          // Truncate long timeouts as the select() code does: we'll just
+          // wait again if nothing happens.
+          const Time max_timeout = SecondsToTime(86400); // 1 day
+          timeout = LowResTimeToTime(sleeping_queue->block_info.target - now);
+          timeout = stg_min(timeout, max_timeout);
+      } else {
+          timeout = -1;
+      }
+
+      if (wait && n_fd_waiters > 0
+          && (timeout < 0 || timeout > FD_REARM_INTERVAL)) {
+          // see Note [epoll backend for awaitEvent]
+          timeout = FD_REARM_INTERVAL;
+      }
+
+#if defined(USE_IO_URING)
+      if (io_backend == IO_BACKEND_URING) {
+          ok = pollFdsUring(timeout);
+      } else
+#endif
+      {
+#if defined(HAVE_SYS_EPOLL_H)
+          ok = pollFdsEpoll(timeout);
+#else
+          barf("awaitEventFdQueues: no backend");
+#endif
+      }
+
+      if (!ok) {
+          // Interrupted by a signal; see the corresponding code in
+          // awaitEventSelect
+#if defined(RTS_USER_SIGNALS)
+          if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+              startSignalHandlers(&MainCapability);
+              return; /* still hold the lock */
+          }
+#endif
+          if (sched_state >= SCHED_INTERRUPTING) {
+              return; /* still hold the lock */
+          }
+#if defined(TRACING)
+          if (eventlog_dump_requested) {
+              return; /* still hold the lock */
+          }
+#endif
+          wakeUpSleepingThreads(getLowResTimeOfDay());
+      }
+
+    } while (wait && sched_state == SCHED_RUNNING
+             && emptyRunQueue(&MainCapability));
+}
+
+#endif /* USE_FD_QUEUES */
+
+/* The awaitEvent backend in use, for +RTS -t --machine-readable */
+const char *ioBackendName (void)
+{
+    switch (io_backend) {
+    case IO_BACKEND_SELECT: return "select";
+    case IO_BACKEND_EPOLL:  return "epoll";
+    case IO_BACKEND_URING:  return "io_uring";
+    default:                return "none";
+    }
+}
+
+/* Block the current thread, which has just set why_blocked to
+ * BlockedOnRead or BlockedOnWrite, until its fd is ready. Called from
+ * stg_waitReadzh and stg_waitWritezh.
+ */
+void blockOnFd (Capability *cap, StgTSO *tso)
+{
+    if (io_backend == IO_BACKEND_NONE) {
+        io_backend = IO_BACKEND_SELECT;
+#if defined(USE_IO_URING)
+        if (RtsFlags.MiscFlags.ioUring && initUring()) {
+            io_backend = IO_BACKEND_URING;
+        }
+#endif
+#if defined(HAVE_SYS_EPOLL_H)
+        if (io_backend == IO_BACKEND_SELECT && initEpoll()) {
+            io_backend = IO_BACKEND_EPOLL;
+        }
+#endif
+        IF_DEBUG(scheduler,
+                 debugBelch("I/O backend: %s\n", ioBackendName()));
+    }
+
+#if defined(USE_FD_QUEUES)
+    if (io_backend != IO_BACKEND_SELECT) {
+        int fd = tso->block_info.fd;
+        if (fd < 0) {
+            fdOutOfRange(fd);
+        }
+        FdQueue *q = getFdQueue(fd);
+        StgTSO **queue = fdQueueFor(q, tso);
+        setTSOLink(cap, tso, *queue);
+        *queue = tso;
+        n_fd_waiters++;
+        if ((q->armed & (tso->why_blocked == BlockedOnRead ? FD_READ : FD_WRITE))
+            == 0) {
+            markFdDirty(fd, q);
+        }
+        return;
+    }
+#endif
+
+    appendToBlockedQueue(tso);
+}
+
+/* Remove a thread blocked on I/O from whichever queue it is on, e.g. because
+ * it has received an asynchronous exception.
+ */
+void removeFromFdQueue (Capability *cap, StgTSO *tso)
+{
+#if defined(USE_FD_QUEUES)
+    if (io_backend != IO_BACKEND_SELECT) {
+        int fd = tso->block_info.fd;
+        FdQueue *q = &fd_queues[fd];
+        StgTSO **queue = fdQueueFor(q, tso);
+        StgTSO *t, *prev = NULL;
+
+        for (t = *queue; t != END_TSO_QUEUE; prev = t, t = t->_link) {
+            if (t == tso) {
+                if (prev == NULL) {
+                    *queue = t->_link;
+                } else {
+                    setTSOLink(cap, prev, t->_link);
+                }
+                t->_link = END_TSO_QUEUE;
+                n_fd_waiters--;
+#if defined(USE_IO_URING)
+                // See Note [io_uring backend for awaitEvent]
+                if (io_backend == IO_BACKEND_URING && q->armed != 0
+                    && fdWanted(q) == 0) {
+                    cancelUringPoll(fd, q);
+                }
+#endif
+                // Otherwise leave the fd armed; see Note [epoll backend for
+                // awaitEvent]
+                return;
+            }
+        }
+        barf("removeFromFdQueue: thread %lu not found", (unsigned long)tso->id);
+    }
+#endif
+
+    removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+}
+
+void markFdQueues (evac_fn evac STG_UNUSED, void *user STG_UNUSED)
+{
+#if defined(USE_FD_QUEUES)
+    if (n_fd_waiters == 0) return;
+    for (uint32_t fd = 0; fd < n_fd_queues; fd++) {
+        FdQueue *q = &fd_queues[fd];
+        if (q->readers != END_TSO_QUEUE) {
+            evac(user, (StgClosure **)(void *)&q->readers);
+        }
+        if (q->writers != END_TSO_QUEUE) {
+            evac(user, (StgClosure **)(void *)&q->writers);
+        }
+    }
+#endif
+}
+
+/* Called in the child of forkProcess, after all threads have been deleted. */
+void resetFdQueues (void)
+{
+    ASSERT(n_fd_waiters == 0);
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+#endif
+#if defined(USE_IO_URING)
+    closeUring();
+#endif
+#if defined(USE_FD_QUEUES)
+    stgFree(fd_queues);
+    fd_queues = NULL;
+    n_fd_queues = 0;
+    stgFree(dirty_fds);
+    dirty_fds = NULL;
+    n_dirty_fds = max_dirty_fds = 0;
+#endif
+    io_backend = IO_BACKEND_NONE;
+}
+
 /* Argument 'wait' says whether to wait for I/O to become available,
  * or whether to just check and return immediately.  If there are
  * other threads ready to run, we normally do the non-waiting variety,
@@ -219,14 +1066,6 @@ static enum FdState fdPollWriteState (int fd)
 void
 awaitEvent(bool wait)
 {
-    StgTSO *tso, *prev, *next;
-    fd_set rfd,wfd;
-    int numFound;
-    int maxfd = -1;
-    bool seen_bad_fd = false;
-    struct timeval tv, *ptv;
-    LowResTime now;
-
     IF_DEBUG(scheduler,
              debugBelch("scheduler: checking for threads blocked on I/O");
              if (wait) {
@@ -235,6 +1074,26 @@ awaitEvent(bool wait)
              debugBelch("\n");
              );
 
+#if defined(USE_FD_QUEUES)
+    if (io_backend == IO_BACKEND_EPOLL || io_backend == IO_BACKEND_URING) {
+        awaitEventFdQueues(wait);
+        return;
+    }
+#endif
+    awaitEventSelect(wait);
+}
+
+static void
+awaitEventSelect (bool wait)
+{
+    StgTSO *tso, *prev, *next;
+    fd_set rfd,wfd;
+    int numFound;
+    int maxfd = -1;
+    bool seen_bad_fd = false;
+    struct timeval tv, *ptv;
+    LowResTime now;
+
     /* loop until we've woken up some threads.  This loop is needed
      * because the select timing isn't accurate, we sometimes sleep
      * for a while but not long enough to wake up a thread in
@@ -361,6 +1220,16 @@ awaitEvent(bool wait)
               return; /* still hold the lock */
           }
 
+#if defined(TRACING)
+          /* SIGUSR2 asked for an eventlog dump, which the scheduler
+           * writes; see Note [Eventlog flight recorder] in
+           * eventlog/EventLog.c.
+           */
+          if (eventlog_dump_requested) {
+              return; /* still hold the lock */
+          }
+#endif
+
           /* check for threads that need waking up
            */
           wakeUpSleepingThreads(getLowResTimeOfDay());
@@ -12,3 +12,12 @@
 typedef StgWord LowResTime;
 
 RTS_PRIVATE LowResTime getDelayTarget (HsInt us);
+
+#if !defined(THREADED_RTS)
+// See Note [epoll backend for awaitEvent] in Select.c
+RTS_PRIVATE void blockOnFd         (Capability *cap, StgTSO *tso);
+RTS_PRIVATE void removeFromFdQueue (Capability *cap, StgTSO *tso);
+RTS_PRIVATE void markFdQueues      (evac_fn evac, void *user);
+RTS_PRIVATE void resetFdQueues     (void);
+RTS_PRIVATE const char *ioBackendName (void);
+#endif
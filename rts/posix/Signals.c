@@ -17,6 +17,7 @@
 #include "Ticker.h"
 #include "ThreadLabels.h"
 #include "Libdw.h"
+#include "eventlog/EventLog.h"
 
 #if defined(alpha_HOST_ARCH)
 # if defined(linux_HOST_OS)
@@ -540,6 +541,20 @@ backtrace_handler(int sig STG_UNUSED)
 #endif
 }
 
+#if defined(TRACING)
+/* -----------------------------------------------------------------------------
+ * SIGUSR2 handler, installed when the eventlog flight recorder is on.
+ *
+ * Write out the flight recorder; see Note [Eventlog flight recorder] in
+ * eventlog/EventLog.c.
+ * -------------------------------------------------------------------------- */
+static void
+eventlog_dump_handler(int sig STG_UNUSED)
+{
+    requestEventLogDump();
+}
+#endif
+
 /* -----------------------------------------------------------------------------
  * An empty signal handler, currently used for SIGPIPE
  * -------------------------------------------------------------------------- */
@@ -722,6 +737,18 @@ initDefaultHandlers(void)
         sysErrorBelch("warning: failed to install SIGQUIT handler");
     }
 
+#if defined(TRACING)
+    // Dump the eventlog flight recorder on SIGUSR2
+    if (RtsFlags.TraceFlags.flight_recorder_size != 0) {
+        action.sa_handler = eventlog_dump_handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = 0;
+        if (sigaction(SIGUSR2, &action, &oact) != 0) {
+            sysErrorBelch("warning: failed to install SIGUSR2 handler");
+        }
+    }
+#endif
+
     set_sigtstp_action(true);
 }
 
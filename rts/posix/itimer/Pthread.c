@@ -102,6 +102,19 @@ static void *itimer_thread_func(void *_handle_tick)
     uint64_t nticks;
     int timerfd = -1;
 
+#if !defined(THREADED_RTS) && defined(HAVE_SIGNAL_H)
+    // Leave asynchronous signals to the thread running Haskell code: a
+    // signal delivered here would not interrupt awaitEvent(), so an idle
+    // RTS would not see it (e.g. SIGUSR2 asking for an eventlog dump).
+    sigset_t mask;
+    sigfillset(&mask);
+    sigdelset(&mask, SIGSEGV);
+    sigdelset(&mask, SIGBUS);
+    sigdelset(&mask, SIGFPE);
+    sigdelset(&mask, SIGILL);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+#endif
+
 #if defined(USE_TIMERFD_FOR_ITIMER) && USE_TIMERFD_FOR_ITIMER
     struct itimerspec it;
     it.it_value.tv_sec  = TimeToSeconds(itimer_interval);
@@ -22,6 +22,7 @@
 #include "RtsUtils.h"
 #include "BlockAlloc.h"
 #include "OSMem.h"
+#include "Capability.h"
 
 #include <string.h>
 
@@ -689,10 +690,187 @@ bdescr* allocLargeChunk (W_ min, W_ max)
     return allocLargeChunkOnNode(nodeWithLeastBlocks(), min, max);
 }
 
+/* -----------------------------------------------------------------------------
+   Per-capability block caches
+   -------------------------------------------------------------------------- */
+
+/* Note [Per-capability block caches]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The free lists are protected by sm_mutex (or by gc_alloc_block_sync during
+   GC, see GCUtils.c), which becomes heavily contended when many Capabilities
+   allocate and free small block groups at once, e.g. mutable list blocks,
+   arenas, or blocks allocated by FFI code via allocBlock_lock.
+
+   To avoid this each Capability has a BlockCache holding up to
+   BLOCK_CACHE_MAX_GROUPS groups of each size from 1 to BLOCK_CACHE_MAX_BLOCKS
+   blocks. When the Task running a Capability allocates or frees such a group
+   on the Capability's NUMA node it uses the cache without any locking. Only
+   when the cache is empty (or full) do we take the lock, and then move
+   BLOCK_CACHE_BATCH groups between the cache and the free lists in one go
+   (refillBlockCache, drainBlockCache).
+
+   Cached groups look allocated as far as the rest of the block allocator is
+   concerned: they are counted in n_alloc_blocks and their bdescrs are not
+   marked free, so freeGroup will never try to coalesce them. This means that
+   memInventory and findMemoryLeak must account for them separately.
+
+   A cache may only be touched by the owner of its Capability: either
+   cap->running_task (see my_cache_cap) or, during GC, the GC thread of the
+   Capability (see allocGroup_sync). In particular code running without a
+   Capability (the nonmoving mark thread, foreign threads) always takes the
+   lock.
+
+   Cached blocks cannot be returned to the OS, so at each major GC
+   we return all of them to the free lists (flushBlockCaches) before
+   deciding how much memory to release.
+*/
+
+bdescr *
+popBlockCache (BlockCache *cache, W_ n)
+{
+    ASSERT(n >= 1 && n <= BLOCK_CACHE_MAX_BLOCKS);
+    bdescr *bd = cache->groups[n-1];
+    if (bd == NULL) {
+        return NULL;
+    }
+    cache->groups[n-1] = bd->link;
+    cache->n_groups[n-1]--;
+    ASSERT(bd->blocks == n);
+    initGroup(bd);
+    IF_DEBUG(zero_on_gc, memset(bd->start, 0xaa, bd->blocks * BLOCK_SIZE));
+    return bd;
+}
+
+bool
+pushBlockCache (BlockCache *cache, bdescr *bd)
+{
+    W_ n = bd->blocks;
+    ASSERT(n >= 1 && n <= BLOCK_CACHE_MAX_BLOCKS);
+    ASSERT(bd->free != (P_)-1);
+    if (cache->n_groups[n-1] >= BLOCK_CACHE_MAX_GROUPS) {
+        return false;
+    }
+
+    // Do what freeGroup would, other than marking the group as free
+#if defined(DEBUG)
+    for (uint32_t i=0; i < n; i++) {
+        bd[i].flags = 0;
+    }
+#endif
+    bd->gen = NULL;
+    bd->gen_no = 0;
+
+    bd->link = cache->groups[n-1];
+    cache->groups[n-1] = bd;
+    cache->n_groups[n-1]++;
+    return true;
+}
+
+void
+refillBlockCache (BlockCache *cache, uint32_t node, W_ n)
+{
+    ASSERT(n >= 1 && n <= BLOCK_CACHE_MAX_BLOCKS);
+
+    if (n == 1) {
+        // Take a contiguous chunk and split it into single blocks, as
+        // allocBlocks_sync does; this is kinder to fragmentation than
+        // allocating the blocks one at a time.
+        bdescr *bd = allocLargeChunkOnNode(node, 1, BLOCK_CACHE_BATCH);
+        W_ got = bd->blocks;
+        for (W_ i = 0; i < got; i++) {
+            bd[i].blocks = 1;
+            bd[i].free = bd[i].start;
+            bd[i].link = cache->groups[0];
+            cache->groups[0] = &bd[i];
+        }
+        cache->n_groups[0] += got;
+    } else {
+        for (uint32_t i = 0; i < BLOCK_CACHE_BATCH; i++) {
+            bdescr *bd = allocGroupOnNode(node, n);
+            bd->link = cache->groups[n-1];
+            cache->groups[n-1] = bd;
+        }
+        cache->n_groups[n-1] += BLOCK_CACHE_BATCH;
+    }
+}
+
+void
+drainBlockCache (BlockCache *cache, W_ n, uint32_t keep)
+{
+    ASSERT(n >= 1 && n <= BLOCK_CACHE_MAX_BLOCKS);
+    while (cache->n_groups[n-1] > keep) {
+        bdescr *bd = cache->groups[n-1];
+        cache->groups[n-1] = bd->link;
+        cache->n_groups[n-1]--;
+        freeGroup(bd);
+    }
+}
+
+void
+flushBlockCaches (void)
+{
+    for (uint32_t i = 0; i < n_capabilities; i++) {
+        for (W_ n = 1; n <= BLOCK_CACHE_MAX_BLOCKS; n++) {
+            drainBlockCache(&capabilities[i]->block_cache, n, 0);
+        }
+    }
+}
+
+#if defined(THREADED_RTS)
+// The Capability whose block cache the calling thread may use, if any. See
+// Note [Per-capability block caches].
+STATIC_INLINE Capability *
+my_cache_cap (void)
+{
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL || task->cap->running_task != task) {
+        return NULL;
+    }
+    return task->cap;
+}
+
+static bdescr *
+alloc_group_cached_lock (Capability *cap, W_ n)
+{
+    bdescr *bd = popBlockCache(&cap->block_cache, n);
+    if (bd == NULL) {
+        ACQUIRE_SM_LOCK;
+        refillBlockCache(&cap->block_cache, cap->node, n);
+        RELEASE_SM_LOCK;
+        bd = popBlockCache(&cap->block_cache, n);
+    }
+    return bd;
+}
+
+// Returns false if the group can't be cached, in which case the caller should
+// free it as usual.
+static bool
+free_group_cached_lock (Capability *cap, bdescr *p)
+{
+    if (p->blocks > BLOCK_CACHE_MAX_BLOCKS || p->node != cap->node) {
+        return false;
+    }
+    if (!pushBlockCache(&cap->block_cache, p)) {
+        ACQUIRE_SM_LOCK;
+        drainBlockCache(&cap->block_cache, p->blocks,
+                        BLOCK_CACHE_MAX_GROUPS - BLOCK_CACHE_BATCH);
+        RELEASE_SM_LOCK;
+        pushBlockCache(&cap->block_cache, p);
+    }
+    return true;
+}
+#endif
+
 bdescr *
 allocGroup_lock(W_ n)
 {
     bdescr *bd;
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (n <= BLOCK_CACHE_MAX_BLOCKS && cap != NULL) {
+        return alloc_group_cached_lock(cap, n);
+    }
+#endif
     ACQUIRE_SM_LOCK;
     bd = allocGroup(n);
     RELEASE_SM_LOCK;
@@ -703,6 +881,12 @@ bdescr *
 allocBlock_lock(void)
 {
     bdescr *bd;
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (cap != NULL) {
+        return alloc_group_cached_lock(cap, 1);
+    }
+#endif
     ACQUIRE_SM_LOCK;
     bd = allocBlock();
     RELEASE_SM_LOCK;
@@ -713,6 +897,12 @@ bdescr *
 allocGroupOnNode_lock(uint32_t node, W_ n)
 {
     bdescr *bd;
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (n <= BLOCK_CACHE_MAX_BLOCKS && cap != NULL && cap->node == node) {
+        return alloc_group_cached_lock(cap, n);
+    }
+#endif
     ACQUIRE_SM_LOCK;
     bd = allocGroupOnNode(node,n);
     RELEASE_SM_LOCK;
@@ -723,6 +913,12 @@ bdescr *
 allocBlockOnNode_lock(uint32_t node)
 {
     bdescr *bd;
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (cap != NULL && cap->node == node) {
+        return alloc_group_cached_lock(cap, 1);
+    }
+#endif
     ACQUIRE_SM_LOCK;
     bd = allocBlockOnNode(node);
     RELEASE_SM_LOCK;
@@ -878,6 +1074,12 @@ freeGroup(bdescr *p)
 void
 freeGroup_lock(bdescr *p)
 {
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (cap != NULL && free_group_cached_lock(cap, p)) {
+        return;
+    }
+#endif
     ACQUIRE_SM_LOCK;
     freeGroup(p);
     RELEASE_SM_LOCK;
@@ -897,6 +1099,24 @@ freeChain(bdescr *bd)
 void
 freeChain_lock(bdescr *bd)
 {
+#if defined(THREADED_RTS)
+    Capability *cap = my_cache_cap();
+    if (cap != NULL) {
+        // Cache what we can and free the rest in one go
+        bdescr *rest = NULL, *next;
+        for (; bd != NULL; bd = next) {
+            next = bd->link;
+            if (!free_group_cached_lock(cap, bd)) {
+                bd->link = rest;
+                rest = bd;
+            }
+        }
+        bd = rest;
+        if (bd == NULL) {
+            return;
+        }
+    }
+#endif
     ACQUIRE_SM_LOCK;
     freeChain(bd);
     RELEASE_SM_LOCK;
@@ -1129,6 +1349,24 @@ markBlocks (bdescr *bd)
     }
 }
 
+void
+markBlockCache (BlockCache *cache)
+{
+    for (uint32_t n = 0; n < BLOCK_CACHE_MAX_BLOCKS; n++) {
+        markBlocks(cache->groups[n]);
+    }
+}
+
+W_
+countBlockCacheBlocks (BlockCache *cache)
+{
+    W_ total = 0;
+    for (uint32_t n = 0; n < BLOCK_CACHE_MAX_BLOCKS; n++) {
+        total += countBlocks(cache->groups[n]);
+    }
+    return total;
+}
+
 void
 reportUnmarkedBlocks (void)
 {
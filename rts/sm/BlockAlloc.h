@@ -13,6 +13,36 @@
 bdescr *allocLargeChunk (W_ min, W_ max);
 bdescr *allocLargeChunkOnNode (uint32_t node, W_ min, W_ max);
 
+/* Per-capability block cache  --------------------------------------------- */
+
+// See Note [Per-capability block caches] in BlockAlloc.c.
+
+// Groups of up to this many blocks are cached
+#define BLOCK_CACHE_MAX_BLOCKS 4
+// Maximum number of groups of each size held in a cache
+#define BLOCK_CACHE_MAX_GROUPS 64
+// Number of groups moved between a cache and the free lists at once
+#define BLOCK_CACHE_BATCH      16
+
+typedef struct BlockCache_ {
+    // cached groups of (i+1) blocks, linked through bd->link
+    bdescr   *groups[BLOCK_CACHE_MAX_BLOCKS];
+    uint32_t  n_groups[BLOCK_CACHE_MAX_BLOCKS];
+} BlockCache;
+
+// Take a group of n blocks from the cache, returning NULL if there is none.
+// The caller must own the cache (e.g. be the Capability's running Task).
+bdescr *popBlockCache     (BlockCache *cache, W_ n);
+// Put a group in the cache, returning false if the cache is full.
+bool    pushBlockCache    (BlockCache *cache, bdescr *bd);
+// Move groups between the cache and the free lists. The caller must hold the
+// lock protecting the free lists (sm_mutex, or gc_alloc_block_sync during GC).
+void    refillBlockCache  (BlockCache *cache, uint32_t node, W_ n);
+void    drainBlockCache   (BlockCache *cache, W_ n, uint32_t keep);
+// Return all cached groups to the free lists. The caller must hold sm_mutex
+// and all Capabilities.
+void    flushBlockCaches  (void);
+
 /* Debugging  -------------------------------------------------------------- */
 
 extern W_ countBlocks       (bdescr *bd);
@@ -23,6 +53,8 @@ extern void returnMemoryToOS(uint32_t n);
 void checkFreeListSanity(void);
 W_   countFreeList(void);
 void markBlocks (bdescr *bd);
+void markBlockCache (BlockCache *cache);
+W_   countBlockCacheBlocks (BlockCache *cache);
 void reportUnmarkedBlocks (void);
 #endif
 
@@ -140,7 +140,7 @@ uint32_t n_gc_threads;
 static long copied;        // *words* copied & scavenged during this GC
 
 #if defined(PROF_SPIN) && defined(THREADED_RTS)
-// spin and yield counts for the quasi-SpinLock in waitForGcThreads
+// spin and park counts for waitForGcThreads, see Note [Parking GC threads]
 volatile StgWord64 waitForGcThreads_spin = 0;
 volatile StgWord64 waitForGcThreads_yield = 0;
 volatile StgWord64 whitehole_gc_spin = 0;
@@ -148,6 +148,27 @@ volatile StgWord64 whitehole_gc_spin = 0;
 
 bool work_stealing;
 
+#if defined(THREADED_RTS)
+// The GC leader parks here while it waits for the other GC threads; see
+// Note [Parking GC threads]
+static Mutex gc_sync_lock;
+static Condition gc_sync_cond;
+static volatile StgWord gc_sync_parked;
+static uint32_t gc_sync_spin_window;
+
+// GC threads waiting for parallel GC rounds, and the main GC thread waiting
+// for them, park here; see Note [Parallel GC rounds]
+static Mutex gc_round_lock;
+// signalled when gc_round changes
+static Condition gc_round_cond;
+// signalled when gc_round_waiting changes
+static Condition gc_round_ready_cond;
+// number of other GC threads parked on gc_round_cond
+static volatile StgWord gc_round_parked;
+// whether the main GC thread is parked on gc_round_ready_cond
+static volatile StgWord gc_round_leader_parked;
+#endif
+
 uint32_t static_flag = STATIC_FLAG_B;
 uint32_t prev_static_flag = STATIC_FLAG_A;
 
@@ -204,7 +225,7 @@ GarbageCollect (uint32_t collect_gen,
   generation *gen;
   StgWord live_blocks, live_words, par_max_copied, par_balanced_copied,
       gc_spin_spin, gc_spin_yield, mut_spin_spin, mut_spin_yield,
-      any_work, no_work, scav_find_work;
+      any_work, no_work, scav_find_work, steal_success, steal_fail;
 #if defined(THREADED_RTS)
   gc_thread *saved_gct;
 #endif
@@ -347,6 +368,11 @@ GarbageCollect (uint32_t collect_gen,
   // and put them on the g0->large_object list.
   collect_pinned_object_blocks();
 
+  // trim the STM free lists, which we keep across the GC
+  for (n = 0; n < n_capabilities; n++) {
+      stmPreGCHook(capabilities[n]);
+  }
+
   // Initialise all the generations that we're collecting.
   for (g = 0; g <= N; g++) {
       prepare_collected_gen(&generations[g]);
@@ -462,6 +488,9 @@ GarbageCollect (uint32_t collect_gen,
       break;
   }
 
+  // let the other threads go; see Note [Parallel GC rounds]
+  endParallelGcRounds();
+
   shutdown_gc_threads(gct->thread_index, idle_cap);
 
   // Now see which stable names are still alive.
@@ -514,6 +543,8 @@ GarbageCollect (uint32_t collect_gen,
   any_work = 0;
   no_work = 0;
   scav_find_work = 0;
+  steal_success = 0;
+  steal_fail = 0;
   {
       uint32_t i;
       uint64_t par_balanced_copied_acc = 0;
@@ -536,17 +567,21 @@ GarbageCollect (uint32_t collect_gen,
                          thread->no_work);
               debugTrace(DEBUG_gc,"   scav_find_work %ld",
                          thread->scav_find_work);
+              debugTrace(DEBUG_gc,"   steals           %ld (%ld failed)",
+                         thread->steal_success, thread->steal_fail);
 
 #if defined(THREADED_RTS) && defined(PROF_SPIN)
-              gc_spin_spin += thread->gc_spin.spin;
-              gc_spin_yield += thread->gc_spin.yield;
-              mut_spin_spin += thread->mut_spin.spin;
-              mut_spin_yield += thread->mut_spin.yield;
+              gc_spin_spin += thread->gc_wait_spin;
+              gc_spin_yield += thread->gc_wait_park;
+              mut_spin_spin += thread->mut_wait_spin;
+              mut_spin_yield += thread->mut_wait_park;
 #endif
 
               any_work += thread->any_work;
               no_work += thread->no_work;
               scav_find_work += thread->scav_find_work;
+              steal_success += thread->steal_success;
+              steal_fail += thread->steal_fail;
 
               par_max_copied = stg_max(gc_threads[i]->copied, par_max_copied);
               par_balanced_copied_acc +=
@@ -869,6 +904,12 @@ GarbageCollect (uint32_t collect_gen,
       W_ need_prealloc, need_live, need, got;
       uint32_t i;
 
+#if defined(THREADED_RTS)
+      // Cached blocks can't be released; see Note [Per-capability block
+      // caches] in BlockAlloc.c.
+      flushBlockCaches();
+#endif
+
       need_live = 0;
       for (i = 0; i < RtsFlags.GcFlags.generations; i++) {
           need_live += genLiveBlocks(&generations[i]);
@@ -943,7 +984,7 @@ GarbageCollect (uint32_t collect_gen,
              N, n_gc_threads, gc_threads,
              par_max_copied, par_balanced_copied,
              gc_spin_spin, gc_spin_yield, mut_spin_spin, mut_spin_yield,
-             any_work, no_work, scav_find_work);
+             any_work, no_work, scav_find_work, steal_success, steal_fail);
 
 #if defined(RTS_USER_SIGNALS)
   if (RtsFlags.MiscFlags.install_signal_handlers) {
@@ -981,12 +1022,17 @@ new_gc_thread (uint32_t n, gc_thread *t)
 
 #if defined(THREADED_RTS)
     t->id = 0;
-    initSpinLock(&t->gc_spin);
-    initSpinLock(&t->mut_spin);
-    ACQUIRE_SPIN_LOCK(&t->gc_spin);
-    ACQUIRE_SPIN_LOCK(&t->mut_spin);
     t->wakeup = GC_THREAD_INACTIVE;  // starts true, so we can wait for the
                           // thread to start up, see wakeup_gc_threads
+    initMutex(&t->park_lock);
+    initCondition(&t->park_cond);
+    t->parked = 0;
+    t->spin_window = SPIN_COUNT;
+    t->gc_wait_spin = 0;
+    t->gc_wait_park = 0;
+    t->mut_wait_spin = 0;
+    t->mut_wait_park = 0;
+    t->steal_seed = (n + 1) * 2654435761u; // any non-zero seed will do
 #endif
 
     t->thread_index = n;
@@ -1047,6 +1093,15 @@ initGcThreads (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
     } else {
         gc_threads = stgMallocBytes (to * sizeof(gc_thread*),
                                      "initGcThreads");
+        initMutex(&gc_sync_lock);
+        initCondition(&gc_sync_cond);
+        gc_sync_parked = 0;
+        gc_sync_spin_window = SPIN_COUNT;
+        initMutex(&gc_round_lock);
+        initCondition(&gc_round_cond);
+        initCondition(&gc_round_ready_cond);
+        gc_round_parked = 0;
+        gc_round_leader_parked = 0;
     }
 
     for (i = from; i < to; i++) {
@@ -1077,9 +1132,16 @@ freeGcThreads (void)
             {
                 freeWSDeque(gc_threads[i]->gens[g].todo_q);
             }
+            closeMutex(&gc_threads[i]->park_lock);
+            closeCondition(&gc_threads[i]->park_cond);
             stgFree (gc_threads[i]);
         }
         stgFree (gc_threads);
+        closeMutex(&gc_sync_lock);
+        closeCondition(&gc_sync_cond);
+        closeMutex(&gc_round_lock);
+        closeCondition(&gc_round_cond);
+        closeCondition(&gc_round_ready_cond);
 #else
         for (g = 0; g < RtsFlags.GcFlags.generations; g++)
         {
@@ -1097,6 +1159,60 @@ freeGcThreads (void)
 
 static volatile StgWord gc_running_threads;
 
+/* ----------------------------------------------------------------------------
+   Note [Parallel GC rounds]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   Some of the work the GC does after the heap has been scavenged has to
+   start from a state in which nothing is being evacuated: deciding which
+   weak pointers have reachable keys, for example (traverseWeakPtrList()
+   relies on the invariant that the heap is idempotent). Traditionally
+   only the main GC thread did that work; the other GC threads left
+   scavenge_until_all_done() and went to sleep, and everything that the
+   main thread evacuated afterwards was scavenged by it alone.
+
+   Instead, if the main thread has asked for it by calling
+   requestParallelGcRounds() before it starts scavenging (initWeakForGC()
+   does so when there are enough weak pointers to make a parallel pass
+   worthwhile), then once the other GC threads have finished scavenging
+   they wait in gcWorkerRounds() for the main thread to call
+   parallelGcRound(fn).  Otherwise they go straight on to wait for the end
+   of the GC as usual.  The main thread can only finish its first
+   scavenge_until_all_done() after the request, so every thread sees it.
+   That waits until every thread is waiting, so that nobody is still
+   looking at gc_running_threads, then counts them all as running and
+   releases them. Every thread, including the main one, calls fn() and
+   then scavenge_until_all_done(), so parallelGcRound() returns with the
+   heap idempotent again. Since the scavenging at the end of a round is
+   also a barrier, fn() can be a read-only pass over the heap, with the
+   evacuation done by a second round.
+
+   endParallelGcRounds() releases the threads for good; the main thread
+   calls it after the last call to traverseWeakPtrList(). With a single
+   GC thread parallelGcRound() just runs fn() and scavenges.
+
+   The main thread may do a lot of serial work between rounds (resurrecting
+   threads, for example), so neither side spins for long.  After SPIN_COUNT
+   spins a worker parks on gc_round_cond until gc_round changes, and the
+   main thread parks on gc_round_ready_cond until every worker is waiting.
+   Each side sets a parked flag before it sleeps and the other side only
+   takes gc_round_lock to signal when it sees the flag, with a
+   store_load_barrier() on both sides between the store of one variable
+   and the load of the other, so that a wakeup is never lost.
+   ------------------------------------------------------------------------- */
+
+// bumped by the main GC thread to start a round
+static volatile StgWord gc_round;
+// number of other GC threads waiting for the next round
+static volatile StgWord gc_round_waiting;
+// what to do in the round, or NULL when there are no more rounds
+static void (*volatile gc_round_fn)(void);
+// number of other GC threads taking part in this GC
+static uint32_t n_gc_round_workers;
+// set by requestParallelGcRounds() if the other GC threads should wait for
+// rounds after scavenging
+static volatile StgWord gc_rounds_wanted;
+
 static StgWord
 inc_running (void)
 {
@@ -1140,9 +1256,10 @@ any_work (void)
 
 #if defined(THREADED_RTS)
     if (work_stealing) {
-        uint32_t n;
-        // look for work to steal
-        for (n = 0; n < n_gc_threads; n++) {
+        uint32_t i, n;
+        // look for work to steal; see Note [Randomised work stealing]
+        n = steal_victim_start();
+        for (i = 0; i < n_gc_threads; i++, n = n+1 == n_gc_threads ? 0 : n+1) {
             if (n == gct->thread_index) continue;
             for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
                 ws = &gc_threads[n]->gens[g];
@@ -1209,7 +1326,335 @@ loop:
     traceEventGcDone(gct->cap);
 }
 
+uint32_t
+parallelGcRoundWorkers (void)
+{
+    return n_gc_round_workers;
+}
+
+#if defined(THREADED_RTS)
+static void waitGcRoundWorkers (void);
+static void startGcRound (void);
+#endif
+
+void
+requestParallelGcRounds (void)
+{
+    gc_rounds_wanted = 1;
+}
+
+void
+parallelGcRound (void (*fn)(void))
+{
 #if defined(THREADED_RTS)
+    if (n_gc_round_workers > 0) {
+        ASSERT(gc_rounds_wanted);
+        waitGcRoundWorkers();
+        gc_round_waiting = 0;
+        gc_running_threads = n_gc_round_workers + 1;
+        gc_round_fn = fn;
+        startGcRound();
+    } else
+#endif
+    {
+        inc_running();
+    }
+
+    fn();
+    scavenge_until_all_done();
+}
+
+void
+endParallelGcRounds (void)
+{
+#if defined(THREADED_RTS)
+    if (n_gc_round_workers > 0 && gc_rounds_wanted) {
+        gc_round_fn = NULL;
+        startGcRound();
+    }
+#endif
+}
+
+#if defined(THREADED_RTS)
+
+/* ----------------------------------------------------------------------------
+   Note [Parking GC threads]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   A GC worker thread waits twice in each parallel GC: standing by
+   (GC_THREAD_STANDING_BY) until the leader wakes it up to start, and
+   waiting to continue (GC_THREAD_WAITING_TO_CONTINUE) until
+   releaseGCThreads() lets it go back to the mutator.  The leader waits in
+   waitForGcThreads() for every participating capability to stand by, and
+   in shutdown_gc_threads() for them all to finish.  Each of these waits is
+   for gc_thread->wakeup to change.
+
+   These waits used to spin and then call yieldThread() in a loop (the
+   gc_spin and mut_spin spin locks, and a prod-and-yield loop in
+   waitForGcThreads()).  When there are more OS threads than cores, as in a
+   container with a CPU quota, a yielding thread is soon scheduled again
+   ahead of the thread it is waiting for, so a GC sync could take millions
+   of yields, most of the CPU, and several scheduler time slices.
+
+   Now a waiter spins for a while and then parks: it sets a parked flag and
+   sleeps on a condition variable, and whoever changes the state it is
+   waiting for wakes it up (setGcThreadState(), wakeGcLeader()).  The
+   parked flag lets the waker skip the mutex when nobody is asleep, which
+   is the common case.  This is a Dekker-style handshake, with a
+   store_load_barrier() on each side between the store of one variable and
+   the load of the other:
+
+       waker                          waiter (holding the lock)
+       wakeup = new                   parked = true
+       store_load_barrier()           store_load_barrier()
+       if (parked) signal             while (wakeup != new) wait
+
+   so at least one of them sees the other's store.  The waker takes the
+   lock before signalling, so the signal cannot fall between the waiter's
+   test and its wait.
+
+   The spin window adapts (gc_thread->spin_window, gc_sync_spin_window): a
+   wait that ends while spinning moves the window towards twice the time
+   it took, and a wait that has to park halves it.  A thread whose partners
+   arrive promptly, as they do when every thread has a core to itself,
+   never sleeps; one that keeps waiting for descheduled partners soon stops
+   burning the CPU they need.
+
+   The leader parks with a timeout (GC_SYNC_PROD_INTERVAL) so that it can
+   prod and interrupt the capabilities that have not stopped yet again, and
+   call the longGCSync hooks.
+
+   We use the OSThreads Mutex and Condition rather than a raw futex: on
+   Linux a pthread condition variable is a futex underneath, and this way
+   the same code works on every platform.
+   ------------------------------------------------------------------------- */
+
+#define GC_SPIN_MIN            16
+#define GC_SPIN_MAX            (4 * SPIN_COUNT)
+#define GC_SYNC_PROD_INTERVAL  MSToTime(1)
+
+static uint32_t
+adaptSpinWindow (uint32_t window, uint32_t spins)
+{
+    int64_t w = (int64_t)window + ((int64_t)spins * 2 - (int64_t)window) / 8;
+    return (uint32_t)stg_min(stg_max(w, GC_SPIN_MIN), GC_SPIN_MAX);
+}
+
+// Change the state of a GC thread and wake it if it is parked waiting for
+// the change.
+static void
+setGcThreadState (gc_thread *t, StgWord state)
+{
+    write_barrier();
+    t->wakeup = state;
+    store_load_barrier();
+    if (t->parked) {
+        ACQUIRE_LOCK(&t->park_lock);
+        signalCondition(&t->park_cond);
+        RELEASE_LOCK(&t->park_lock);
+    }
+}
+
+// Wait until someone else sets t->wakeup to state.
+static void
+waitGcThreadState (gc_thread *t, StgWord state,
+                   StgWord64 *spin, StgWord64 *park)
+{
+    const uint32_t window = t->spin_window;
+    uint32_t i;
+    bool slept = false;
+
+    for (i = 0; i < window; i++) {
+        if (t->wakeup == state) {
+            load_load_barrier();
+            t->spin_window = adaptSpinWindow(window, i);
+            *spin += i;
+            return;
+        }
+        busy_wait_nop();
+    }
+    *spin += window;
+
+    ACQUIRE_LOCK(&t->park_lock);
+    t->parked = 1;
+    store_load_barrier();
+    while (t->wakeup != state) {
+        slept = true;
+        (*park)++;
+        waitCondition(&t->park_cond, &t->park_lock);
+    }
+    t->parked = 0;
+    RELEASE_LOCK(&t->park_lock);
+
+    if (slept) {
+        t->spin_window = stg_max(window / 2, GC_SPIN_MIN);
+    }
+}
+
+// Called by a GC worker after changing its own state, in case the leader
+// is parked waiting for it.
+static void
+wakeGcLeader (void)
+{
+    store_load_barrier();
+    if (gc_sync_parked) {
+        ACQUIRE_LOCK(&gc_sync_lock);
+        signalCondition(&gc_sync_cond);
+        RELEASE_LOCK(&gc_sync_lock);
+    }
+}
+
+static bool
+allGcThreadsIn (uint32_t me, bool idle_cap[], uint32_t n, StgWord state)
+{
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        if (i == me || idle_cap[i]) continue;
+        if (gc_threads[i]->wakeup != state) return false;
+    }
+    return true;
+}
+
+// Wait until every GC thread taking part in this GC, other than the
+// leader me, is in the given state.  Returns false if we gave up after
+// parking for timeout.
+static bool
+waitAllGcThreads (uint32_t me, bool idle_cap[], uint32_t n, StgWord state,
+                  Time timeout, StgWord64 *spin, StgWord64 *park)
+{
+    const uint32_t window = gc_sync_spin_window;
+    uint32_t i;
+    bool done;
+
+    for (i = 0; i < window; i++) {
+        if (allGcThreadsIn(me, idle_cap, n, state)) {
+            load_load_barrier();
+            gc_sync_spin_window = adaptSpinWindow(window, i);
+            *spin += i;
+            return true;
+        }
+        busy_wait_nop();
+    }
+    *spin += window;
+
+    ACQUIRE_LOCK(&gc_sync_lock);
+    gc_sync_parked = 1;
+    store_load_barrier();
+    while (!(done = allGcThreadsIn(me, idle_cap, n, state))) {
+        (*park)++;
+        if (!timedWaitCondition(&gc_sync_cond, &gc_sync_lock, timeout)) {
+            done = allGcThreadsIn(me, idle_cap, n, state);
+            break;
+        }
+    }
+    gc_sync_parked = 0;
+    RELEASE_LOCK(&gc_sync_lock);
+
+    gc_sync_spin_window = stg_max(window / 2, GC_SPIN_MIN);
+    return done;
+}
+
+// Start the next parallel GC round, waking any GC threads parked waiting
+// for it.  See Note [Parallel GC rounds].
+static void
+startGcRound (void)
+{
+    write_barrier();
+    gc_round++;
+    store_load_barrier();
+    if (gc_round_parked) {
+        ACQUIRE_LOCK(&gc_round_lock);
+        broadcastCondition(&gc_round_cond);
+        RELEASE_LOCK(&gc_round_lock);
+    }
+}
+
+// Wait until every other GC thread is waiting for the next round.
+static void
+waitGcRoundWorkers (void)
+{
+    uint32_t i;
+
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (gc_round_waiting == n_gc_round_workers) {
+            load_load_barrier();
+            return;
+        }
+        busy_wait_nop();
+    }
+
+    ACQUIRE_LOCK(&gc_round_lock);
+    gc_round_leader_parked = 1;
+    store_load_barrier();
+    while (gc_round_waiting != n_gc_round_workers) {
+        waitCondition(&gc_round_ready_cond, &gc_round_lock);
+    }
+    gc_round_leader_parked = 0;
+    RELEASE_LOCK(&gc_round_lock);
+}
+
+// Tell the main GC thread that we are waiting for the next round.
+static void
+readyForGcRound (void)
+{
+    // atomic_inc() is a full barrier, ordering it before the load of
+    // gc_round_leader_parked
+    atomic_inc(&gc_round_waiting, 1);
+    if (gc_round_leader_parked) {
+        ACQUIRE_LOCK(&gc_round_lock);
+        signalCondition(&gc_round_ready_cond);
+        RELEASE_LOCK(&gc_round_lock);
+    }
+}
+
+// Wait until the main GC thread starts a round after the given one, and
+// return the new round.
+static StgWord
+waitGcRound (StgWord round)
+{
+    uint32_t i;
+
+    for (i = 0; i < SPIN_COUNT; i++) {
+        if (gc_round != round) {
+            load_load_barrier();
+            return gc_round;
+        }
+        busy_wait_nop();
+    }
+
+    ACQUIRE_LOCK(&gc_round_lock);
+    gc_round_parked++;
+    store_load_barrier();
+    while (gc_round == round) {
+        waitCondition(&gc_round_cond, &gc_round_lock);
+    }
+    gc_round_parked--;
+    RELEASE_LOCK(&gc_round_lock);
+
+    load_load_barrier();
+    return gc_round;
+}
+
+static void
+gcWorkerRounds (void)
+{
+    StgWord round = 0;
+    void (*fn)(void);
+
+    // gc_rounds_wanted was set, if at all, before the main thread started
+    // scavenging, and we can only get here after it has finished.
+    load_load_barrier();
+    if (!gc_rounds_wanted) return;
+
+    for (;;) {
+        readyForGcRound();
+        round = waitGcRound(round);
+        fn = gc_round_fn;
+        if (fn == NULL) return;
+        fn();
+        scavenge_until_all_done();
+    }
+}
 
 void
 gcWorkerThread (Capability *cap)
@@ -1223,16 +1668,18 @@ gcWorkerThread (Capability *cap)
     gct->id = osThreadId();
     stat_startGCWorker (cap, gct);
 
-    // Wait until we're told to wake up
-    RELEASE_SPIN_LOCK(&gct->mut_spin);
+    // Wait until we're told to wake up; see Note [Parking GC threads]
     // yieldThread();
     //    Strangely, adding a yieldThread() here makes the CPU time
     //    measurements more accurate on Linux, perhaps because it syncs
     //    the CPU time across the multiple cores.  Without this, CPU time
     //    is heavily skewed towards GC rather than MUT.
+    write_barrier();
     gct->wakeup = GC_THREAD_STANDING_BY;
+    wakeGcLeader();
     debugTrace(DEBUG_gc, "GC thread %d standing by...", gct->thread_index);
-    ACQUIRE_SPIN_LOCK(&gct->gc_spin);
+    waitGcThreadState(gct, GC_THREAD_RUNNING,
+                      &gct->gc_wait_spin, &gct->gc_wait_park);
 
     init_gc_thread(gct);
 
@@ -1245,23 +1692,29 @@ gcWorkerThread (Capability *cap)
 
     scavenge_until_all_done();
 
+    // Help the main GC thread with weak pointers, if it has asked for
+    // help, until it's done with them. See Note [Parallel GC rounds].
+    gcWorkerRounds();
+
 #if defined(THREADED_RTS)
     // Now that the whole heap is marked, we discard any sparks that
-    // were found to be unreachable.  The main GC thread is currently
-    // marking heap reachable via weak pointers, so it is
-    // non-deterministic whether a spark will be retained if it is
-    // only reachable via weak pointers.  To fix this problem would
+    // were found to be unreachable.  The main GC thread may still be
+    // marking heap reachable via resurrected threads and finalizers,
+    // so it is non-deterministic whether a spark will be retained if
+    // it is only reachable that way.  To fix this problem would
     // require another GC barrier, which is too high a price.
     pruneSparkQueue(false, cap);
 #endif
 
     // Wait until we're told to continue
-    RELEASE_SPIN_LOCK(&gct->gc_spin);
+    write_barrier();
     gct->wakeup = GC_THREAD_WAITING_TO_CONTINUE;
+    wakeGcLeader();
     debugTrace(DEBUG_gc, "GC thread %d waiting to continue...",
                gct->thread_index);
     stat_endGCWorker (cap, gct);
-    ACQUIRE_SPIN_LOCK(&gct->mut_spin);
+    waitGcThreadState(gct, GC_THREAD_INACTIVE,
+                      &gct->mut_wait_spin, &gct->mut_wait_park);
     debugTrace(DEBUG_gc, "GC thread %d on my way...", gct->thread_index);
 
     SET_GCT(saved_gct);
@@ -1276,36 +1729,27 @@ waitForGcThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
 {
     const uint32_t n_threads = n_capabilities;
     const uint32_t me = cap->no;
-    uint32_t i, j;
-    bool retry = true;
+    uint32_t i;
+    bool done = false;
+    StgWord64 spin = 0, park = 0;
     Time t0, t1, t2;
 
     t0 = t1 = t2 = getProcessElapsedTime();
 
-    while(retry) {
+    while (!done) {
         for (i=0; i < n_threads; i++) {
             if (i == me || idle_cap[i]) continue;
             if (gc_threads[i]->wakeup != GC_THREAD_STANDING_BY) {
                 prodCapability(capabilities[i], cap->running_task);
-            }
-        }
-        for (j=0; j < 10; j++) {
-            retry = false;
-            for (i=0; i < n_threads; i++) {
-                if (i == me || idle_cap[i]) continue;
-                write_barrier();
                 interruptCapability(capabilities[i]);
-                if (gc_threads[i]->wakeup != GC_THREAD_STANDING_BY) {
-                    retry = true;
-                }
             }
-            if (!retry) break;
-#if defined(PROF_SPIN)
-            waitForGcThreads_yield++;
-#endif
-            yieldThread();
         }
 
+        // See Note [Parking GC threads]
+        done = waitAllGcThreads(me, idle_cap, n_threads,
+                                GC_THREAD_STANDING_BY, GC_SYNC_PROD_INTERVAL,
+                                &spin, &park);
+
         t2 = getProcessElapsedTime();
         if (RtsFlags.GcFlags.longGCSync != 0 &&
             t2 - t1 > RtsFlags.GcFlags.longGCSync) {
@@ -1313,15 +1757,12 @@ waitForGcThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
             rtsConfig.longGCSync(cap->no, t2 - t0);
             t1 = t2;
         }
-        if (retry) {
+    }
+
 #if defined(PROF_SPIN)
-            // This is a bit strange, we'll get more yields than spins.
-            // I guess that means it's not a spin-lock at all, but these
-            // numbers are still useful (I think).
-            waitForGcThreads_spin++;
+    waitForGcThreads_spin += spin;
+    waitForGcThreads_yield += park;
 #endif
-        }
-    }
 
     if (RtsFlags.GcFlags.longGCSync != 0 &&
         t2 - t0 > RtsFlags.GcFlags.longGCSync) {
@@ -1337,6 +1778,11 @@ start_gc_threads (void)
 #if defined(THREADED_RTS)
     gc_running_threads = 0;
 #endif
+    gc_round = 0;
+    gc_round_waiting = 0;
+    gc_round_fn = NULL;
+    n_gc_round_workers = 0;
+    gc_rounds_wanted = 0;
 }
 
 static void
@@ -1351,13 +1797,12 @@ wakeup_gc_threads (uint32_t me USED_IF_THREADS,
     for (i=0; i < n_gc_threads; i++) {
         if (i == me || idle_cap[i]) continue;
         inc_running();
+        n_gc_round_workers++;
         debugTrace(DEBUG_gc, "waking up gc thread %d", i);
         if (gc_threads[i]->wakeup != GC_THREAD_STANDING_BY)
             barf("wakeup_gc_threads");
 
-        gc_threads[i]->wakeup = GC_THREAD_RUNNING;
-        ACQUIRE_SPIN_LOCK(&gc_threads[i]->mut_spin);
-        RELEASE_SPIN_LOCK(&gc_threads[i]->gc_spin);
+        setGcThreadState(gc_threads[i], GC_THREAD_RUNNING);
     }
 #endif
 }
@@ -1370,16 +1815,14 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS,
                      bool idle_cap[] USED_IF_THREADS)
 {
 #if defined(THREADED_RTS)
-    uint32_t i;
+    StgWord64 spin = 0, park = 0;
 
     if (n_gc_threads == 1) return;
 
-    for (i=0; i < n_gc_threads; i++) {
-        if (i == me || idle_cap[i]) continue;
-        while (gc_threads[i]->wakeup != GC_THREAD_WAITING_TO_CONTINUE) {
-            busy_wait_nop();
-            write_barrier();
-        }
+    while (!waitAllGcThreads(me, idle_cap, n_gc_threads,
+                             GC_THREAD_WAITING_TO_CONTINUE,
+                             GC_SYNC_PROD_INTERVAL, &spin, &park)) {
+        // nothing to prod: the GC threads are all running
     }
 #endif
 }
@@ -1396,9 +1839,7 @@ releaseGCThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
         if (gc_threads[i]->wakeup != GC_THREAD_WAITING_TO_CONTINUE)
             barf("releaseGCThreads");
 
-        gc_threads[i]->wakeup = GC_THREAD_INACTIVE;
-        ACQUIRE_SPIN_LOCK(&gc_threads[i]->gc_spin);
-        RELEASE_SPIN_LOCK(&gc_threads[i]->mut_spin);
+        setGcThreadState(gc_threads[i], GC_THREAD_INACTIVE);
     }
 }
 #endif
@@ -1699,6 +2140,8 @@ init_gc_thread (gc_thread *t)
     t->any_work = 0;
     t->no_work = 0;
     t->scav_find_work = 0;
+    t->steal_success = 0;
+    t->steal_fail = 0;
 }
 
 /* -----------------------------------------------------------------------------
@@ -2015,7 +2458,20 @@ void gcCAFs(void)
      * false otherwise.
   -------------------------------------------------------------------------- */
 
-bool doIdleGCWork(Capability *cap STG_UNUSED, bool all)
+bool doIdleGCWork(Capability *cap USED_IF_THREADS, bool all)
 {
-    return runSomeFinalizers(all);
+    if (runSomeFinalizers(all)) {
+        return true;
+    }
+
+#if defined(THREADED_RTS)
+    // Help a concurrent nonmoving collection along. There is nothing to do
+    // when 'all' is set, as the collector finishes its own work.
+    // See Note [Idle-time nonmoving GC work] in NonMoving.c.
+    if (!all && RtsFlags.GcFlags.idleGCSlice != 0) {
+        return nonmovingIdleWork(cap);
+    }
+#endif
+
+    return false;
 }
@@ -57,6 +57,11 @@ extern volatile StgWord64 waitForGcThreads_yield;
 #endif
 
 void gcWorkerThread (Capability *cap);
+
+uint32_t parallelGcRoundWorkers (void);
+void requestParallelGcRounds (void);
+void parallelGcRound (void (*fn)(void));
+void endParallelGcRounds (void);
 void initGcThreads (uint32_t from, uint32_t to);
 void freeGcThreads (void);
 
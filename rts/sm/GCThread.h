@@ -125,9 +125,17 @@ typedef struct gc_thread_ {
 
 #if defined(THREADED_RTS)
     OSThreadId id;                 // The OS thread that this struct belongs to
-    SpinLock   gc_spin;
-    SpinLock   mut_spin;
     volatile StgWord wakeup;       // NB not StgWord8; only StgWord is guaranteed atomic
+    // Waiting for a change of wakeup; see Note [Parking GC threads] in GC.c
+    Mutex      park_lock;
+    Condition  park_cond;
+    volatile StgWord parked;       // sleeping on park_cond
+    uint32_t   spin_window;        // how long to spin before parking
+    StgWord64  gc_wait_spin;       // spins/parks waiting to start a GC
+    StgWord64  gc_wait_park;
+    StgWord64  mut_wait_spin;      // spins/parks waiting to go back to
+    StgWord64  mut_wait_park;      //   the mutator
+    uint32_t   steal_seed;         // PRNG state for choosing steal victims
 #endif
     uint32_t thread_index;         // a zero based index identifying the thread
 
@@ -184,6 +192,8 @@ typedef struct gc_thread_ {
     W_ any_work;
     W_ no_work;
     W_ scav_find_work;
+    W_ steal_success;              // todo blocks stolen from other threads
+    W_ steal_fail;                 // attempts to steal that found nothing
 
     Time gc_start_cpu;             // thread CPU time
     Time gc_end_cpu;               // thread CPU time
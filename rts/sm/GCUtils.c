@@ -22,6 +22,7 @@
 #include "GCUtils.h"
 #include "Printer.h"
 #include "Trace.h"
+#include "Capability.h"
 #if defined(THREADED_RTS)
 #include "WSDeque.h"
 #endif
@@ -30,10 +31,33 @@
 SpinLock gc_alloc_block_sync;
 #endif
 
+#if defined(THREADED_RTS)
+// During GC each GC thread owns the block cache of its Capability; see Note
+// [Per-capability block caches] in BlockAlloc.c.
+static bdescr *
+alloc_group_cached_sync(BlockCache *cache, uint32_t node, uint32_t n)
+{
+    bdescr *bd = popBlockCache(cache, n);
+    if (bd == NULL) {
+        ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
+        refillBlockCache(cache, node, n);
+        RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+        bd = popBlockCache(cache, n);
+    }
+    return bd;
+}
+#endif
+
 bdescr* allocGroup_sync(uint32_t n)
 {
     bdescr *bd;
     uint32_t node = capNoToNumaNode(gct->thread_index);
+#if defined(THREADED_RTS)
+    if (n <= BLOCK_CACHE_MAX_BLOCKS) {
+        return alloc_group_cached_sync(
+            &capabilities[gct->thread_index]->block_cache, node, n);
+    }
+#endif
     ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
     bd = allocGroupOnNode(node,n);
     RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
@@ -43,6 +67,13 @@ bdescr* allocGroup_sync(uint32_t n)
 bdescr* allocGroupOnNode_sync(uint32_t node, uint32_t n)
 {
     bdescr *bd;
+#if defined(THREADED_RTS)
+    if (n <= BLOCK_CACHE_MAX_BLOCKS
+        && node == capNoToNumaNode(gct->thread_index)) {
+        return alloc_group_cached_sync(
+            &capabilities[gct->thread_index]->block_cache, node, n);
+    }
+#endif
     ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
     bd = allocGroupOnNode(node,n);
     RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
@@ -76,6 +107,28 @@ allocBlocks_sync(uint32_t n, bdescr **hd)
 void
 freeChain_sync(bdescr *bd)
 {
+#if defined(THREADED_RTS)
+    BlockCache *cache = &capabilities[gct->thread_index]->block_cache;
+    uint32_t node = capNoToNumaNode(gct->thread_index);
+    bdescr *rest = NULL, *next;
+    for (; bd != NULL; bd = next) {
+        next = bd->link;
+        if (bd->blocks > BLOCK_CACHE_MAX_BLOCKS || bd->node != node) {
+            bd->link = rest;
+            rest = bd;
+        } else if (!pushBlockCache(cache, bd)) {
+            ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
+            drainBlockCache(cache, bd->blocks,
+                            BLOCK_CACHE_MAX_GROUPS - BLOCK_CACHE_BATCH);
+            RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+            pushBlockCache(cache, bd);
+        }
+    }
+    bd = rest;
+    if (bd == NULL) {
+        return;
+    }
+#endif
     ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
     freeChain(bd);
     RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
@@ -118,20 +171,40 @@ grab_local_todo_block (gen_workspace *ws)
 }
 
 #if defined(THREADED_RTS)
+/* Note [Randomised work stealing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Each gen_workspace keeps its todo blocks in a Chase-Lev work-stealing deque
+   (WSDeque.c): the owner pushes and pops at the bottom without
+   synchronisation, and idle GC threads steal from the top with a single CAS.
+
+   When looking for work an idle thread used to try the other threads in
+   order 0, 1, 2, ...  With many GC threads this means that every idle thread
+   hammers the deques of the low-numbered threads first, contending on the
+   same cache lines and CASing on the same 'top' index, while work queued on
+   high-numbered threads is found last. Instead each thread starts at a
+   victim chosen by a cheap per-thread PRNG (steal_victim_start) and then
+   tries every other thread once, so that thieves spread out.
+
+   We count successful and failed steals per GC thread (steal_success,
+   steal_fail); they are reported in the +RTS -s output and via getRTSStats.
+*/
 bdescr *
 steal_todo_block (uint32_t g)
 {
-    uint32_t n;
+    uint32_t i, n;
     bdescr *bd;
 
     // look for work to steal
-    for (n = 0; n < n_gc_threads; n++) {
+    n = steal_victim_start();
+    for (i = 0; i < n_gc_threads; i++, n = n+1 == n_gc_threads ? 0 : n+1) {
         if (n == gct->thread_index) continue;
         bd = stealWSDeque(gc_threads[n]->gens[g].todo_q);
         if (bd) {
+            gct->steal_success++;
             return bd;
         }
     }
+    gct->steal_fail++;
     return NULL;
 }
 #endif
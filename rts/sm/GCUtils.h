@@ -40,6 +40,20 @@ StgPtr  alloc_todo_block     (gen_workspace *ws, uint32_t size);
 bdescr *grab_local_todo_block  (gen_workspace *ws);
 #if defined(THREADED_RTS)
 bdescr *steal_todo_block       (uint32_t s);
+
+// The GC thread at which to start looking for work to steal.  See Note
+// [Randomised work stealing] in GCUtils.c.
+INLINE_HEADER uint32_t
+steal_victim_start (void)
+{
+    // xorshift32
+    uint32_t x = gct->steal_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gct->steal_seed = x;
+    return x % n_gc_threads;
+}
 #endif
 
 // Returns true if a block is partially full.  This predicate is used to try
@@ -24,6 +24,7 @@
 #include "Weak.h"
 #include "Storage.h"
 #include "Threads.h"
+#include "RtsUtils.h"
 
 #include "sm/GCUtils.h"
 #include "sm/MarkWeak.h"
@@ -71,6 +72,73 @@
 
    -------------------------------------------------------------------------- */
 
+/* -----------------------------------------------------------------------------
+   Note [Parallel weak pointer tidying]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   Each time round the loop in traverseWeakPtrList() we check the key of
+   every weak pointer that we haven't yet found to be alive. A program
+   with hundreds of thousands of weak pointers in the old generation pays
+   for that in every major GC, several times over if finalizers or
+   resurrected threads make more keys reachable, and all on the main GC
+   thread.
+
+   So initWeakForGC() copies the old_weak_ptr_lists of the generations
+   being collected into an array, cut into WeakChunks of at most
+   WEAK_CHUNK_SIZE weak pointers from a single generation, and
+   tidyWeakLists() processes the chunks in two passes:
+
+   - checkWeakChunks() looks up the key of each pending weak pointer with
+     isAlive(), and moves the weak pointers with live keys to the end of
+     their chunk. It doesn't evacuate anything, so its answers don't
+     depend on what the other threads are doing.
+
+   - evacuateLiveWeakChunks() scavenges the weak pointers found alive by
+     the previous pass (and only those), and puts them on the weak_ptr_list
+     of their generation.
+
+   A chunk only ever holds weak pointers that are still pending, so a
+   weak pointer found to be alive is never looked at again, and chunks
+   that are empty cost nothing. This is not incremental, though: each
+   pass still checks the key of every weak pointer that is pending, as the
+   serial loop did, and the pending ones whose keys are still dead are
+   checked again by every later pass. What we gain is spreading the checks
+   over the GC threads.
+
+   When there are enough weak pointers (WEAK_PAR_THRESHOLD) and more than
+   one GC thread, each pass is a parallel GC round (see Note [Parallel GC
+   rounds] in GC.c): every GC thread claims chunks from next_weak_chunk
+   until there are none left, and the evacuation pass is followed by
+   parallel scavenging. Otherwise the main GC thread runs both passes and
+   leaves the scavenging to the loop in GarbageCollect(), as before.
+
+   Once the weak pointers left in the chunks are known to be dead they are
+   put back on the old_weak_ptr_lists for collectDeadWeakPtrs().
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    StgWeak **weaks;     // pending weak pointers, then the ones found alive
+    uint32_t n_pending;
+    uint32_t n_live;
+    uint32_t gen_no;
+} WeakChunk;
+
+#define WEAK_CHUNK_SIZE    256
+#define WEAK_PAR_THRESHOLD (16 * WEAK_CHUNK_SIZE)
+
+// kept from one GC to the next, and only ever grown
+static StgWeak **weak_todo = NULL;
+static WeakChunk *weak_chunks = NULL;
+static uint32_t weak_todo_size = 0;
+static uint32_t weak_chunks_size = 0;
+static uint32_t n_weak_chunks = 0;
+static bool weak_par = false;
+
+// the next chunk for a GC thread to claim in this pass
+static volatile StgWord next_weak_chunk;
+// set when a pass finds a live key
+static volatile StgWord weak_tidy_flag;
+
 /* Which stage of processing various kinds of weak pointer are we at?
  * (see traverseWeakPtrList() below for discussion).
  */
@@ -78,7 +146,8 @@ typedef enum { WeakPtrs, WeakThreads, WeakDone } WeakStage;
 static WeakStage weak_stage;
 
 static void    collectDeadWeakPtrs (generation *gen, StgWeak **dead_weak_ptr_list);
-static bool tidyWeakList (generation *gen);
+static bool tidyWeakLists (void);
+static void    finishWeakChunks (void);
 static bool resurrectUnreachableThreads (generation *gen, StgTSO **resurrected_threads);
 static void    tidyThreadList (generation *gen);
 
@@ -86,11 +155,58 @@ void
 initWeakForGC(void)
 {
     uint32_t g;
+    uint32_t n = 0, n_chunks = 0;
 
     for (g = 0; g <= N; g++) {
         generation *gen = &generations[g];
+        uint32_t n_gen = 0;
         gen->old_weak_ptr_list = gen->weak_ptr_list;
         gen->weak_ptr_list = NULL;
+        for (StgWeak *w = gen->old_weak_ptr_list; w != NULL; w = w->link) {
+            n_gen++;
+        }
+        n += n_gen;
+        n_chunks += (n_gen + WEAK_CHUNK_SIZE - 1) / WEAK_CHUNK_SIZE;
+    }
+
+    // Copy the lists into chunks; see Note [Parallel weak pointer tidying]
+    n_weak_chunks = n_chunks;
+    if (n > 0) {
+        if (n > weak_todo_size) {
+            weak_todo = stgReallocBytes(weak_todo, n * sizeof(StgWeak *),
+                                        "initWeakForGC");
+            weak_todo_size = n;
+        }
+        if (n_chunks > weak_chunks_size) {
+            weak_chunks = stgReallocBytes(weak_chunks,
+                                          n_chunks * sizeof(WeakChunk),
+                                          "initWeakForGC");
+            weak_chunks_size = n_chunks;
+        }
+        StgWeak **p = weak_todo;
+        WeakChunk *c = weak_chunks;
+        for (g = 0; g <= N; g++) {
+            generation *gen = &generations[g];
+            StgWeak *w = gen->old_weak_ptr_list;
+            while (w != NULL) {
+                c->weaks = p;
+                c->n_pending = 0;
+                c->n_live = 0;
+                c->gen_no = g;
+                for (; w != NULL && c->n_pending < WEAK_CHUNK_SIZE;
+                     w = w->link) {
+                    c->weaks[c->n_pending++] = w;
+                }
+                p += c->n_pending;
+                c++;
+            }
+            gen->old_weak_ptr_list = NULL;
+        }
+    }
+    weak_par = n >= WEAK_PAR_THRESHOLD && parallelGcRoundWorkers() > 0;
+    if (weak_par) {
+        // keep the other GC threads around; see Note [Parallel GC rounds]
+        requestParallelGcRounds();
     }
 
     weak_stage = WeakThreads;
@@ -120,10 +236,8 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
 
       // Use weak pointer relationships (value is reachable if
       // key is reachable):
-      for (g = 0; g <= N; g++) {
-          if (tidyWeakList(&generations[g])) {
-              flag = true;
-          }
+      if (tidyWeakLists()) {
+          flag = true;
       }
 
       // if we evacuated anything new, we must scavenge thoroughly
@@ -155,10 +269,8 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
 
       // resurrecting threads might have made more weak pointers
       // alive, so traverse those lists again:
-      for (g = 0; g <= N; g++) {
-          if (tidyWeakList(&generations[g])) {
-              flag = true;
-          }
+      if (tidyWeakLists()) {
+          flag = true;
       }
 
       /* If we didn't make any changes, then we can go round and kill all
@@ -166,6 +278,7 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
        * of pending finalizers later on.
        */
       if (flag == false) {
+          finishWeakChunks();
           for (g = 0; g <= N; g++) {
               collectDeadWeakPtrs(&generations[g], dead_weak_ptr_list);
           }
@@ -233,93 +346,162 @@ static bool resurrectUnreachableThreads (generation *gen, StgTSO **resurrected_t
     return flag;
 }
 
-static bool tidyWeakList(generation *gen)
+// First pass: find the pending weak pointers in the chunks we claim whose
+// keys are alive, and move them to the end of their chunk. Evacuates
+// nothing. See Note [Parallel weak pointer tidying].
+static void checkWeakChunks(void)
 {
-    StgWeak *w, **last_w, *next_w;
-    const StgInfoTable *info;
-    StgClosure *new;
     bool flag = false;
-    last_w = &gen->old_weak_ptr_list;
-    for (w = gen->old_weak_ptr_list; w != NULL; w = next_w) {
 
-        info = w->header.info;
-        /* N.B. This function is executed only during the serial part of GC
-         * so consequently there is no potential for data races and therefore
-         * no need for memory barriers.
-         */
-
-        /* There might be a DEAD_WEAK on the list if finalizeWeak# was
-         * called on a live weak pointer object.  Just remove it.
-         */
-        if (info == &stg_DEAD_WEAK_info) {
-            next_w = w->link;
-            *last_w = next_w;
-            continue;
-        }
+    for (;;) {
+        StgWord i = atomic_inc(&next_weak_chunk, 1) - 1;
+        if (i >= n_weak_chunks) break;
+
+        WeakChunk *c = &weak_chunks[i];
+        StgWeak **weaks = c->weaks;
+        StgWeak *live_weaks[WEAK_CHUNK_SIZE];
+        uint32_t n = c->n_pending, pending = 0, live = 0;
+        ASSERT(c->n_live == 0);
+
+        for (uint32_t j = 0; j < n; j++) {
+            StgWeak *w = weaks[j];
+            const StgInfoTable *info = w->header.info;
 
-        info = INFO_PTR_TO_STRUCT(info);
-        switch (info->type) {
+            /* There might be a DEAD_WEAK on the list if finalizeWeak# was
+             * called on a live weak pointer object.  Just remove it.
+             */
+            if (info == &stg_DEAD_WEAK_info) {
+                continue;
+            }
+
+            info = INFO_PTR_TO_STRUCT(info);
+            if (info->type != WEAK) {
+                barf("checkWeakChunks: not WEAK: %d, %p", info->type, w);
+            }
 
-        case WEAK:
             /* Now, check whether the key is reachable.
              */
-            new = isAlive(w->key);
+            StgClosure *new = isAlive(w->key);
             if (new != NULL) {
-                generation *new_gen;
-
                 w->key = new;
+                live_weaks[live++] = w;
+            } else {
+                weaks[pending++] = w;
+            }
+        }
 
-                // Find out which generation this weak ptr is in, and
-                // move it onto the weak ptr list of that generation.
-
-                new_gen = Bdescr((P_)w)->gen;
-                gct->evac_gen_no = new_gen->no;
-                gct->failed_to_evac = false;
+        // the live ones go after the ones that are still pending
+        for (uint32_t j = 0; j < live; j++) {
+            weaks[pending + j] = live_weaks[j];
+        }
+        c->n_pending = pending;
+        c->n_live = live;
+        if (live > 0) {
+            flag = true;
+        }
+    }
 
-                // evacuate the fields of the weak ptr
-                scavengeLiveWeak(w);
+    if (flag) {
+        weak_tidy_flag = true;
+    }
+}
 
-                if (gct->failed_to_evac) {
-                    debugTrace(DEBUG_weak,
-                               "putting weak pointer %p into mutable list",
-                               w);
-                    gct->failed_to_evac = false;
-                    recordMutableGen_GC((StgClosure *)w, new_gen->no);
-                }
+// Second pass: scavenge the weak pointers found alive by the first pass,
+// and put them on the weak pointer list of their new generation.
+static void evacuateLiveWeakChunks(void)
+{
+    for (;;) {
+        StgWord i = atomic_inc(&next_weak_chunk, 1) - 1;
+        if (i >= n_weak_chunks) break;
 
-                // remove this weak ptr from the old_weak_ptr list
-                *last_w = w->link;
-                next_w  = w->link;
+        WeakChunk *c = &weak_chunks[i];
+        for (uint32_t j = 0; j < c->n_live; j++) {
+            StgWeak *w = c->weaks[c->n_pending + j];
+            generation *new_gen;
 
-                // and put it on the correct weak ptr list.
-                w->link = new_gen->weak_ptr_list;
-                new_gen->weak_ptr_list = w;
-                flag = true;
+            // Find out which generation this weak ptr is in, and
+            // move it onto the weak ptr list of that generation.
 
-                if (gen->no != new_gen->no) {
-                    debugTrace(DEBUG_weak,
-                      "moving weak pointer %p from %d to %d",
-                      w, gen->no, new_gen->no);
-                }
+            new_gen = Bdescr((P_)w)->gen;
+            gct->evac_gen_no = new_gen->no;
+            gct->failed_to_evac = false;
 
+            // evacuate the fields of the weak ptr
+            scavengeLiveWeak(w);
 
+            if (gct->failed_to_evac) {
                 debugTrace(DEBUG_weak,
-                           "weak pointer still alive at %p -> %p",
-                           w, w->key);
-                continue;
+                           "putting weak pointer %p into mutable list",
+                           w);
+                gct->failed_to_evac = false;
+                recordMutableGen_GC((StgClosure *)w, new_gen->no);
             }
-            else {
-                last_w = &(w->link);
-                next_w = w->link;
-                continue;
+
+            // put it on the correct weak ptr list; other GC threads may
+            // be doing the same.
+            StgWeak *old;
+            do {
+                old = new_gen->weak_ptr_list;
+                w->link = old;
+            } while (cas((StgVolatilePtr)&new_gen->weak_ptr_list,
+                         (StgWord)old, (StgWord)w) != (StgWord)old);
+
+            if (c->gen_no != new_gen->no) {
+                debugTrace(DEBUG_weak,
+                  "moving weak pointer %p from %d to %d",
+                  w, c->gen_no, new_gen->no);
             }
 
-        default:
-            barf("tidyWeakList: not WEAK: %d, %p", info->type, w);
+
+            debugTrace(DEBUG_weak,
+                       "weak pointer still alive at %p -> %p",
+                       w, w->key);
         }
+        c->n_live = 0;
     }
+}
 
-    return flag;
+// Move the weak pointers with newly reachable keys from the
+// old_weak_ptr_lists to the weak_ptr_lists, evacuating their fields.
+// Returns true if it found any.
+static bool tidyWeakLists(void)
+{
+    weak_tidy_flag = false;
+
+    if (weak_par) {
+        next_weak_chunk = 0;
+        parallelGcRound(checkWeakChunks);
+        if (weak_tidy_flag) {
+            next_weak_chunk = 0;
+            parallelGcRound(evacuateLiveWeakChunks);
+        }
+    } else {
+        next_weak_chunk = 0;
+        checkWeakChunks();
+        if (weak_tidy_flag) {
+            next_weak_chunk = 0;
+            evacuateLiveWeakChunks();
+        }
+    }
+
+    return weak_tidy_flag;
+}
+
+// Put the weak pointers that are still pending, and so have dead keys,
+// back on the old_weak_ptr_lists.
+static void finishWeakChunks(void)
+{
+    for (uint32_t i = 0; i < n_weak_chunks; i++) {
+        WeakChunk *c = &weak_chunks[i];
+        generation *gen = &generations[c->gen_no];
+        ASSERT(c->n_live == 0);
+        for (uint32_t j = c->n_pending; j > 0; j--) {
+            StgWeak *w = c->weaks[j - 1];
+            w->link = gen->old_weak_ptr_list;
+            gen->old_weak_ptr_list = w;
+        }
+    }
+    n_weak_chunks = 0;
 }
 
 static void tidyThreadList (generation *gen)
@@ -148,8 +148,8 @@ Mutex concurrent_coll_finished_lock;
  *     this file).
  *
  *  2. [STW] Snapshot update: Here we update the segment snapshot metadata
- *     (see nonmovingPrepareMark) and move the filled segments to
- *     nonmovingHeap.sweep_list, which is the set of segments which we will
+ *     (see nonmovingPrepareMark) and move the filled segments to the
+ *     allocators' sweep_lists, which are the set of segments which we will
  *     sweep this GC cycle.
  *
  *  3. [STW] Root collection: Here we walk over a variety of root sources
@@ -157,15 +157,19 @@ Mutex concurrent_coll_finished_lock;
  *
  *  4. [CONC] Concurrent marking: Here we do the majority of marking concurrently
  *     with mutator execution (but with the write barrier enabled; see
- *     Note [Update remembered set]).
+ *     Note [Update remembered set]). With +RTS -Is idle capabilities help by
+ *     marking the update remembered set (see Note [Idle-time nonmoving GC
+ *     work]).
  *
  *  5. [STW] Final sync: Here we interrupt the mutators, ask them to
  *     flush their final update remembered sets, and mark any new references
  *     we find.
  *
- *  6. [CONC] Sweep: Here we walk over the nonmoving segments on sweep_list
- *     and place them back on either the active, current, or filled list,
- *     depending upon how much live data they contain.
+ *  6. [CONC] Sweep: Here we walk over the nonmoving segments on the
+ *     sweep_lists and place them back on either the active, current, or
+ *     filled list, depending upon how much live data they contain. Mutators
+ *     which run out of segments sweep some themselves (see Note [Lazy
+ *     sweeping] in NonMovingSweep.c), as do idle capabilities with +RTS -Is.
  *
  *
  * === Marking ===
@@ -232,6 +236,9 @@ Mutex concurrent_coll_finished_lock;
  *    how we use the DIRTY flags associated with MUT_VARs and TVARs to improve
  *    barrier efficiency.
  *
+ *  - Note [Idle-time nonmoving GC work] (NonMoving.c) describes how idle
+ *    capabilities take part in a concurrent collection.
+ *
  *
  * Note [Concurrent non-moving collection]
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -474,6 +481,49 @@ Mutex concurrent_coll_finished_lock;
  * remembered set during the preparatory GC. This allows us to safely skip the
  * non-moving write barrier without jeopardizing the snapshot invariant.
  *
+ *
+ * Note [Idle-time nonmoving GC work]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The scheduler calls doIdleGCWork whenever a capability runs out of threads
+ * to run. With +RTS -Is<secs> (RtsFlags.GcFlags.idleGCSlice), and while a
+ * concurrent collection is running, this lets the capability do a slice of
+ * the collector's work in nonmovingIdleWork rather than go to sleep:
+ *
+ *  - During concurrent marking it takes a block of the update remembered set
+ *    (upd_rem_set_block_list) and marks it with a private mark queue
+ *    (nonmovingMarkIdle). Any entries left at the end of the slice are put
+ *    back onto the update remembered set. Every remembered set entry that is
+ *    marked before the final sync is one fewer that the collector has to mark
+ *    while the mutators are stopped.
+ *
+ *  - During the sweep it sweeps segments from the sweep lists
+ *    (nonmovingSweepIdle), exactly as the mark workers do; see Note [Lazy
+ *    sweeping] in NonMovingSweep.c. Free memory then becomes available sooner.
+ *    Since the sweep has plenty of independent work, the collector wakes idle
+ *    capabilities when it begins sweeping (nonmovingProdIdleCapabilities).
+ *
+ * A slice ends after idleGCSlice has elapsed or, much sooner, as soon as the
+ * capability has something better to do: a thread on its run queue, a message
+ * in its inbox, a returning foreign call or a pending sync
+ * (nonmovingIdleSliceOver). The capability then returns to the scheduler with
+ * no collector state left on it, so a slice never delays a thread by more
+ * than the time needed to mark a few dozen entries or sweep one segment.
+ *
+ * Idle-time marking is safe for the same reasons as parallel marking (see
+ * Note [Parallel marking in the nonmoving collector] in NonMovingMark.c), with
+ * one difference: an idle capability is not one of the mark workers and does
+ * not take part in their termination protocol. A mark pass may therefore end
+ * while an idle capability still holds some of the update remembered set.
+ * This is fine since every pass before the final sync is merely an
+ * approximation; the final sync stops all capabilities, which must first end
+ * their slices and return their work. To prevent new slices from starting
+ * after the final sync we only hand out work while
+ * nonmoving_write_barrier_enabled is set.
+ *
+ * The other collectors of the oldest generation (copying and compacting) run
+ * entirely within a stop-the-world GC and there is no outstanding work to give
+ * to idle capabilities; for those +RTS -Is has no effect.
+ *
  */
 
 memcount nonmoving_live_words = 0;
@@ -671,6 +721,12 @@ void *nonmovingAllocate(Capability *cap, StgWord sz)
         // first look for a new segment in the active list
         struct NonmovingSegment *new_current = pop_active_segment(alloca);
 
+        // then try sweeping a segment which the collector hasn't got to yet.
+        // See Note [Lazy sweeping] in NonMovingSweep.c.
+        if (new_current == NULL && VOLATILE_LOAD(&nonmovingHeap.lazy_sweep)) {
+            new_current = nonmovingSweepLazily(alloca);
+        }
+
         // there are no active segments, allocate new segment
         if (new_current == NULL) {
             new_current = nonmovingAllocSegment(cap->node);
@@ -796,7 +852,7 @@ static void nonmovingPrepareMark(void)
         static_flag == STATIC_FLAG_A ? STATIC_FLAG_B : STATIC_FLAG_A;
 
     // Should have been cleared by the last sweep
-    ASSERT(nonmovingHeap.sweep_list == NULL);
+    ASSERT(!nonmovingHeap.lazy_sweep);
 
     nonmovingBumpEpoch();
     for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
@@ -810,6 +866,7 @@ static void nonmovingPrepareMark(void)
 
         // Save the filled segments for later processing during the concurrent
         // mark phase.
+        ASSERT(alloca->sweep_list == NULL);
         alloca->saved_filled = alloca->filled;
         alloca->filled = NULL;
 
@@ -1036,9 +1093,10 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
     stat_startNonmovingGc();
 
     // Walk the list of filled segments that we collected during preparation,
-    // updated their snapshot pointers and move them to the sweep list.
+    // updated their snapshot pointers and move them to the sweep lists.
     for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
-        struct NonmovingSegment *filled = nonmovingHeap.allocators[alloca_idx]->saved_filled;
+        struct NonmovingAllocator *alloca = nonmovingHeap.allocators[alloca_idx];
+        struct NonmovingSegment *filled = alloca->saved_filled;
         uint32_t n_filled = 0;
         if (filled) {
             struct NonmovingSegment *seg = filled;
@@ -1052,12 +1110,15 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
                     break;
             }
             // add filled segments to sweep_list
-            seg->link = nonmovingHeap.sweep_list;
-            nonmovingHeap.sweep_list = filled;
+            seg->link = alloca->sweep_list;
+            alloca->sweep_list = filled;
         }
     }
 
     // Do concurrent marking; most of the heap will get marked here.
+#if defined(THREADED_RTS)
+    nonmovingStartMarkWorkers();
+#endif
     nonmovingMarkThreadsWeaks(mark_queue);
 
 #if defined(THREADED_RTS)
@@ -1066,7 +1127,7 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
     // If at this point if we've decided to exit then just return
     if (sched_state > SCHED_RUNNING) {
         // Note that we break our invariants here and leave segments in
-        // nonmovingHeap.sweep_list, don't free nonmoving_large_objects etc.
+        // the allocators' sweep_lists, don't free nonmoving_large_objects etc.
         // However because we won't be running mark-sweep in the final GC this
         // is OK.
 
@@ -1082,6 +1143,7 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
         nonmoving_old_weak_ptr_list = NULL;
         nonmoving_weak_ptr_list = NULL;
 
+        nonmovingStopMarkWorkers();
         goto finish;
     }
 
@@ -1198,8 +1260,12 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
     nonmovingSweepCompactObjects();
     nonmovingSweepStableNameTable();
 
+    // The mark workers also help sweeping; see Note [Lazy sweeping] in
+    // NonMovingSweep.c.
     nonmovingSweep();
-    ASSERT(nonmovingHeap.sweep_list == NULL);
+#if defined(THREADED_RTS)
+    nonmovingStopMarkWorkers();
+#endif
     debugTrace(DEBUG_nonmoving_gc, "Finished sweeping.");
     traceConcSweepEnd();
 #if defined(DEBUG)
@@ -1229,6 +1295,62 @@ finish:
 #endif
 }
 
+#if defined(THREADED_RTS)
+/* Does an idle capability have something better to do than help the
+ * collector?
+ */
+static bool idleCapabilityWanted(Capability *cap)
+{
+    return !emptyRunQueue(cap) || !emptyInbox(cap)
+        || cap->n_returning_tasks != 0
+        || pending_sync != NULL;
+}
+
+/* Should an idle-time slice end? See Note [Idle-time nonmoving GC work]. */
+bool nonmovingIdleSliceOver(Capability *cap, Time deadline)
+{
+    return idleCapabilityWanted(cap) || getProcessElapsedTime() >= deadline;
+}
+
+/* Do a slice of the concurrent collector's work on an idle capability. Returns
+ * true if there may be more to do. See Note [Idle-time nonmoving GC work].
+ */
+bool nonmovingIdleWork(Capability *cap)
+{
+    if (!VOLATILE_LOAD(&concurrent_coll_running) || idleCapabilityWanted(cap)) {
+        return false;
+    }
+
+    const Time deadline = getProcessElapsedTime() + RtsFlags.GcFlags.idleGCSlice;
+    bool more;
+    if (VOLATILE_LOAD(&nonmovingHeap.lazy_sweep)) {
+        more = nonmovingSweepIdle(cap, deadline);
+    } else {
+        more = nonmovingMarkIdle(cap, deadline);
+    }
+
+    // If the slice was cut short the scheduler must attend to the capability
+    // before we come back for more.
+    return more && !idleCapabilityWanted(cap);
+}
+
+/* Wake up the capabilities which are idle so that they can help with the
+ * collection. Called by the mark thread. See Note [Idle-time nonmoving GC
+ * work].
+ */
+void nonmovingProdIdleCapabilities(void)
+{
+    if (RtsFlags.GcFlags.idleGCSlice == 0 || sched_state != SCHED_RUNNING) {
+        return;
+    }
+
+    Task *task = myTask();
+    for (uint32_t i = 0; i < enabled_capabilities; i++) {
+        prodCapability(capabilities[i], task);
+    }
+}
+#endif
+
 #if defined(DEBUG)
 
 // Use this with caution: this doesn't work correctly during scavenge phase
@@ -1251,15 +1373,15 @@ void assert_in_nonmoving_heap(StgPtr p)
         return;
     }
 
-    // Search snapshot segments
-    for (struct NonmovingSegment *seg = nonmovingHeap.sweep_list; seg; seg = seg->link) {
-        if (p >= (P_)seg && p < (((P_)seg) + NONMOVING_SEGMENT_SIZE_W)) {
-            return;
-        }
-    }
-
     for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
         struct NonmovingAllocator *alloca = nonmovingHeap.allocators[alloca_idx];
+        // Search snapshot segments
+        for (struct NonmovingSegment *seg = alloca->sweep_list; seg; seg = seg->link) {
+            if (p >= (P_)seg && p < (((P_)seg) + NONMOVING_SEGMENT_SIZE_W)) {
+                return;
+            }
+        }
+
         // Search current segments
         for (uint32_t cap_idx = 0; cap_idx < n_capabilities; ++cap_idx) {
             struct NonmovingSegment *seg = alloca->current[cap_idx];
@@ -1467,8 +1589,11 @@ void nonmovingPrintSweepList()
 {
     debugBelch("==== SWEEP LIST =====\n");
     int i = 0;
-    for (struct NonmovingSegment *seg = nonmovingHeap.sweep_list; seg; seg = seg->link) {
-        debugBelch("%d: %p\n", i++, (void*)seg);
+    for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
+        struct NonmovingAllocator *alloca = nonmovingHeap.allocators[alloca_idx];
+        for (struct NonmovingSegment *seg = alloca->sweep_list; seg; seg = seg->link) {
+            debugBelch("%d: %p\n", i++, (void*)seg);
+        }
     }
     debugBelch("= END OF SWEEP LIST =\n");
 }
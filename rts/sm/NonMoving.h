@@ -64,6 +64,12 @@ struct NonmovingAllocator {
     struct NonmovingSegment *filled;
     struct NonmovingSegment *saved_filled;
     struct NonmovingSegment *active;
+    // The set of segments being swept in this GC. Segments are moved here from
+    // saved_filled when marking starts and moved back to either the filled,
+    // active, or free lists during sweep, either by the collector or lazily by
+    // nonmovingAllocate (see Note [Lazy sweeping] in NonMovingSweep.c).
+    // Should be NULL before mark and after sweep.
+    struct NonmovingSegment *sweep_list;
     // indexed by capability number
     struct NonmovingSegment *current[];
 };
@@ -91,11 +97,10 @@ struct NonmovingHeap {
     // records the current length of the nonmovingAllocator.current arrays
     unsigned int n_caps;
 
-    // The set of segments being swept in this GC. Segments are moved here from
-    // the filled list during preparation and moved back to either the filled,
-    // active, or free lists during sweep.  Should be NULL before mark and
-    // after sweep.
-    struct NonmovingSegment *sweep_list;
+    // Set while the sweep phase is running and mutators may sweep segments
+    // from the sweep lists themselves. See Note [Lazy sweeping] in
+    // NonMovingSweep.c.
+    StgWord lazy_sweep;
 };
 
 extern struct NonmovingHeap nonmovingHeap;
@@ -104,6 +109,11 @@ extern memcount nonmoving_live_words;
 
 #if defined(THREADED_RTS)
 extern bool concurrent_coll_running;
+
+// See Note [Idle-time nonmoving GC work]
+bool nonmovingIdleWork(Capability *cap);
+bool nonmovingIdleSliceOver(Capability *cap, Time deadline);
+void nonmovingProdIdleCapabilities(void);
 #endif
 
 void nonmovingInit(void);
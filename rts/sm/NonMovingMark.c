@@ -13,10 +13,12 @@
 #include "NonMovingMark.h"
 #include "NonMovingShortcut.h"
 #include "NonMoving.h"
+#include "NonMovingSweep.h"
 #include "BlockAlloc.h"  /* for countBlocks */
 #include "HeapAlloc.h"
 #include "Task.h"
 #include "Trace.h"
+#include "RtsUtils.h"
 #include "HeapUtils.h"
 #include "Printer.h"
 #include "Schedule.h"
@@ -90,9 +92,11 @@ memcount n_nonmoving_marked_compact_blocks = 0;
  * move the same large object to nonmoving_marked_large_objects more than once.
  */
 static Mutex nonmoving_large_objects_mutex;
-// Note that we don't need a similar lock for compact objects because we never
-// mark a compact object eagerly in a write barrier; all compact objects are
-// marked by the mark thread, so there can't be any races here.
+// We never mark a compact object eagerly in a write barrier; all compact
+// objects are marked by the mark workers. However, with parallel marking (see
+// Note [Parallel marking in the nonmoving collector]) several workers may race
+// to mark the same compact region so we also take this lock when moving
+// compact objects to nonmoving_marked_compact_objects.
 #endif
 
 /*
@@ -237,6 +241,11 @@ static volatile StgWord upd_rem_set_flush_count = 0;
 
 /* Signaled by each capability when it has flushed its update remembered set */
 static Condition upd_rem_set_flushed_cond;
+
+/* Words marked by idle capabilities since the last mark pass ended. Protected
+ * by upd_rem_set_lock. See Note [Idle-time nonmoving GC work] in NonMoving.c.
+ */
+static memcount idle_marked_words = 0;
 #endif
 
 /* Indicates to mutators that the write barrier must be respected. Set while
@@ -249,12 +258,109 @@ StgWord nonmoving_write_barrier_enabled = false;
  */
 MarkQueue *current_mark_queue = NULL;
 
+/* Note [Parallel marking in the nonmoving collector]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With --nonmoving-mark-threads=<n> the mark phase is carried out by n
+ * workers: the thread running nonmovingMark_ (the "leader", which owns the
+ * mark queue seeded with the roots) and n-1 helper threads which are started
+ * by nonmovingStartMarkWorkers at the beginning of a major collection and
+ * stopped by nonmovingStopMarkWorkers once the sweep has finished. Each call to
+ * nonmovingMark is a "pass" in which all n workers take part. The workers
+ * also take part in a final sweep pass (nonmovingParSweep); see Note [Lazy
+ * sweeping] in NonMovingSweep.c.
+ *
+ * A MarkQueue is not capable of concurrent access, so every worker owns a
+ * private queue and work is shared at the granularity of MarkQueue blocks,
+ * the same unit in which update remembered sets are handed to the collector:
+ *
+ *  - When a worker notices that some of its peers are idle and the shared
+ *    pool (nonmoving_mark_pool) is empty it donates work: the first block
+ *    below the top of its queue or, if it has only one block, the older half
+ *    of the entries of that block.
+ *
+ *  - A worker whose queue runs dry becomes idle and steals a block from the
+ *    pool, refilling the pool from the global update remembered set
+ *    (upd_rem_set_block_list) if necessary. The stolen block replaces the
+ *    (empty) block of its queue.
+ *
+ *  - A pass ends when all workers are idle and both the pool and the update
+ *    remembered set are empty. This is the same condition under which the
+ *    single-threaded mark loop returns.
+ *
+ * The pool, the idle count and pass bookkeeping are protected by
+ * mark_pool_lock. Lock order: mark_pool_lock before upd_rem_set_lock.
+ *
+ * Marking is idempotent, so two workers racing to trace the same object is
+ * benign; both will push the object's fields and the duplicates will be found
+ * to be marked when popped. The non-idempotent parts of mark_closure are:
+ *
+ *  - moving large and compact objects to the marked lists, which is done under
+ *    nonmoving_large_objects_mutex,
+ *
+ *  - the live data accounting, where only the worker whose CAS sets the mark
+ *    bit counts the object. Counts are kept per queue (MarkQueue.marked_words)
+ *    to avoid contending on a global counter,
+ *
+ *  - stacks, which are claimed via stack->marking exactly as between the
+ *    collector and a mutator (see Note [StgStack dirtiness flags and
+ *    concurrent marking]).
+ *
+ * Per-worker statistics (CPU time, entries marked, blocks stolen and donated)
+ * are reported to Stats.c when the workers are stopped.
+ */
+
+typedef struct MarkWorker_ {
+    uint32_t no;
+    MarkQueue *queue;
+    Time cpu_ns;        // CPU time spent in mark passes
+    StgWord entries;    // mark queue entries processed
+    StgWord stolen;     // blocks taken from nonmoving_mark_pool
+    StgWord donated;    // blocks given to nonmoving_mark_pool
+#if defined(THREADED_RTS)
+    OSThreadId thread;
+    uint32_t pass;      // last pass this helper took part in
+#endif
+} MarkWorker;
+
+// How many workers take part in marking. 1 unless parallel marking is in
+// progress.
+uint32_t n_nonmoving_mark_workers = 1;
+
+// Blocks of mark queue entries shared between the mark workers.
+bdescr *nonmoving_mark_pool = NULL;
+
+// Don't split the top block of a worker's queue to donate work unless it has
+// at least this many entries.
+#define MARK_DONATE_MIN_ENTRIES 64
+
+#if defined(THREADED_RTS)
+static MarkWorker *mark_workers = NULL;
+static Mutex mark_pool_lock;
+// Signalled when work is donated to the pool or when a pass ends.
+static Condition mark_work_cond;
+// Signalled when a pass starts, when a helper finishes a pass, and when
+// helpers are asked to exit.
+static Condition mark_pass_cond;
+static uint32_t n_idle_mark_workers = 0;
+static uint32_t n_running_mark_helpers = 0;
+static uint32_t n_live_mark_helpers = 0;
+static uint32_t mark_pass = 0;
+static bool mark_pass_done = false;
+static bool mark_helpers_exit = false;
+// Is the current pass a sweep rather than a mark? See Note [Lazy sweeping] in
+// NonMovingSweep.c.
+static bool mark_pass_sweep = false;
+#endif
+
 /* Initialise update remembered set data structures */
 void nonmovingMarkInitUpdRemSet() {
 #if defined(THREADED_RTS)
     initMutex(&upd_rem_set_lock);
     initCondition(&upd_rem_set_flushed_cond);
     initMutex(&nonmoving_large_objects_mutex);
+    initMutex(&mark_pool_lock);
+    initCondition(&mark_work_cond);
+    initCondition(&mark_pass_cond);
 #endif
 }
 
@@ -882,6 +988,7 @@ static void init_mark_queue_ (MarkQueue *queue)
     queue->blocks = bd;
     queue->top = (MarkQueueBlock *) bd->start;
     queue->top->head = 0;
+    queue->marked_words = 0;
 #if MARK_PREFETCH_QUEUE_DEPTH > 0
     memset(&queue->prefetch_queue, 0, sizeof(queue->prefetch_queue));
     queue->prefetch_head = 0;
@@ -1177,6 +1284,20 @@ bump_static_flag(StgClosure **link_field, StgClosure *q STG_UNUSED)
     }
 }
 
+/* May anyone else be marking the heap while we are? If so we must set mark bits
+ * atomically. See Note [Parallel marking in the nonmoving collector] and Note
+ * [Idle-time nonmoving GC work] in NonMoving.c.
+ */
+STATIC_INLINE bool
+mark_is_shared (void)
+{
+#if defined(THREADED_RTS)
+    return n_nonmoving_mark_workers > 1 || RtsFlags.GcFlags.idleGCSlice != 0;
+#else
+    return false;
+#endif
+}
+
 /* N.B. p0 may be tagged */
 static GNUC_ATTR_HOT void
 mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
@@ -1289,12 +1410,16 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
             }
 
             if (! (bd->flags & BF_MARKED)) {
-                dbl_link_remove(bd, &nonmoving_compact_objects);
-                dbl_link_onto(bd, &nonmoving_marked_compact_objects);
-                StgWord blocks = str->totalW / BLOCK_SIZE_W;
-                n_nonmoving_compact_blocks -= blocks;
-                n_nonmoving_marked_compact_blocks += blocks;
-                bd->flags |= BF_MARKED;
+                ACQUIRE_LOCK(&nonmoving_large_objects_mutex);
+                if (! (bd->flags & BF_MARKED)) {
+                    dbl_link_remove(bd, &nonmoving_compact_objects);
+                    dbl_link_onto(bd, &nonmoving_marked_compact_objects);
+                    StgWord blocks = str->totalW / BLOCK_SIZE_W;
+                    n_nonmoving_compact_blocks -= blocks;
+                    n_nonmoving_marked_compact_blocks += blocks;
+                    bd->flags |= BF_MARKED;
+                }
+                RELEASE_LOCK(&nonmoving_large_objects_mutex);
             }
 
             // N.B. the object being marked is in a compact region so by
@@ -1653,8 +1778,19 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         // TODO: Kill repetition
         struct NonmovingSegment *seg = nonmovingGetSegment((StgPtr) p);
         nonmoving_block_idx block_idx = nonmovingGetBlockIdx((StgPtr) p);
-        nonmovingSetMark(seg, block_idx);
-        nonmoving_live_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        if (!mark_is_shared()) {
+            nonmovingSetMark(seg, block_idx);
+            queue->marked_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        } else {
+            // Another worker, an idle capability or a mutator may be racing
+            // with us; only the one who sets the mark bit accounts for the
+            // object. See Note [Parallel marking in the nonmoving collector].
+            uint8_t mark = nonmovingGetMark(seg, block_idx);
+            if (mark != nonmovingMarkEpoch
+                && cas_word8(&seg->bitmap[block_idx], mark, nonmovingMarkEpoch) == mark) {
+                queue->marked_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+            }
+        }
     }
 
     // If we found a indirection to shortcut keep going.
@@ -1673,6 +1809,463 @@ done:
     }
 }
 
+/*********************************************************
+ * Sharing work between mark workers
+ *********************************************************/
+
+#if defined(THREADED_RTS)
+/* Give some of our work to the shared pool. Called when there are idle workers
+ * and the pool is empty. See Note [Parallel marking in the nonmoving
+ * collector].
+ */
+static void
+mark_donate_work (MarkWorker *w)
+{
+    MarkQueue *q = w->queue;
+    bdescr *bd;
+
+    if (q->blocks->link != NULL) {
+        // Hand over the block below the top of the queue.
+        bd = q->blocks->link;
+        q->blocks->link = bd->link;
+    } else if (q->top->head >= MARK_DONATE_MIN_ENTRIES) {
+        // We only have one block; hand over its older half.
+        ACQUIRE_SM_LOCK;
+        bd = allocGroup(MARK_QUEUE_BLOCKS);
+        RELEASE_SM_LOCK;
+        MarkQueueBlock *from = q->top;
+        MarkQueueBlock *to = (MarkQueueBlock *) bd->start;
+        uint32_t n = from->head / 2;
+        memcpy(to->entries, from->entries, n * sizeof(MarkQueueEnt));
+        memmove(from->entries, from->entries + n,
+                (from->head - n) * sizeof(MarkQueueEnt));
+        to->head = n;
+        from->head -= n;
+    } else {
+        return;
+    }
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    bd->link = nonmoving_mark_pool;
+    nonmoving_mark_pool = bd;
+    signalCondition(&mark_work_cond);
+    RELEASE_LOCK(&mark_pool_lock);
+    w->donated++;
+}
+
+STATIC_INLINE void
+mark_share_work (MarkWorker *w)
+{
+    if (VOLATILE_LOAD(&n_idle_mark_workers) != 0
+        && VOLATILE_LOAD(&nonmoving_mark_pool) == 0) {
+        mark_donate_work(w);
+    }
+}
+
+/* Called by a worker whose queue is empty. Either steals a block of work,
+ * returning true, or waits until the pass is over, returning false.
+ */
+static bool
+mark_steal_work (MarkWorker *w)
+{
+    MarkQueue *q = w->queue;
+    bool found = false;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    n_idle_mark_workers++;
+    while (true) {
+        // Perhaps the update remembered set has more to mark...
+        if (nonmoving_mark_pool == NULL && upd_rem_set_block_list != NULL) {
+            ACQUIRE_LOCK(&upd_rem_set_lock);
+            nonmoving_mark_pool = upd_rem_set_block_list;
+            upd_rem_set_block_list = NULL;
+            RELEASE_LOCK(&upd_rem_set_lock);
+        }
+
+        if (nonmoving_mark_pool != NULL) {
+            bdescr *bd = nonmoving_mark_pool;
+            nonmoving_mark_pool = bd->link;
+            n_idle_mark_workers--;
+            if (nonmoving_mark_pool != NULL) {
+                // There is more; wake up another idle worker.
+                signalCondition(&mark_work_cond);
+            }
+            RELEASE_LOCK(&mark_pool_lock);
+
+            // Our queue is empty; replace its only block with the stolen one.
+            ASSERT(markQueueIsEmpty(q));
+            bdescr *old = q->blocks;
+            bd->link = NULL;
+            q->blocks = bd;
+            q->top = (MarkQueueBlock *) bd->start;
+            ACQUIRE_SM_LOCK;
+            freeGroup(old);
+            RELEASE_SM_LOCK;
+            w->stolen++;
+            found = true;
+            break;
+        }
+
+        if (mark_pass_done) {
+            RELEASE_LOCK(&mark_pool_lock);
+            break;
+        }
+
+        if (n_idle_mark_workers == n_nonmoving_mark_workers) {
+            // Everyone is out of work: the pass is finished.
+            mark_pass_done = true;
+            broadcastCondition(&mark_work_cond);
+            RELEASE_LOCK(&mark_pool_lock);
+            break;
+        }
+
+        waitCondition(&mark_work_cond, &mark_pool_lock);
+    }
+    return found;
+}
+#endif
+
+/* Find more work for a worker whose queue is empty. Returns false if marking is
+ * finished.
+ */
+static bool
+mark_find_work (MarkWorker *w)
+{
+#if defined(THREADED_RTS)
+    if (n_nonmoving_mark_workers > 1) {
+        return mark_steal_work(w);
+    }
+#endif
+
+    // Perhaps the update remembered set has more to mark...
+    if (upd_rem_set_block_list) {
+        MarkQueue *queue = w->queue;
+        ACQUIRE_LOCK(&upd_rem_set_lock);
+        bdescr *old = queue->blocks;
+        queue->blocks = upd_rem_set_block_list;
+        queue->top = (MarkQueueBlock *) queue->blocks->start;
+        upd_rem_set_block_list = NULL;
+        RELEASE_LOCK(&upd_rem_set_lock);
+
+        ACQUIRE_SM_LOCK;
+        freeGroup(old);
+        RELEASE_SM_LOCK;
+        return true;
+    } else {
+        // Nothing more to do
+        return false;
+    }
+}
+
+/*********************************************************
+ * The mark loop
+ *********************************************************/
+
+/* Mark a single (non-null) mark queue entry. */
+STATIC_INLINE void
+mark_entry (MarkQueue *queue, MarkQueueEnt *ent)
+{
+    switch (nonmovingMarkQueueEntryType(ent)) {
+    case MARK_CLOSURE:
+        mark_closure(queue, ent->mark_closure.p, ent->mark_closure.origin);
+        break;
+    case MARK_ARRAY: {
+        const StgMutArrPtrs *arr = (const StgMutArrPtrs *)
+            UNTAG_CLOSURE((StgClosure *) ent->mark_array.array);
+        StgWord start = ent->mark_array.start_index;
+        StgWord end = start + MARK_ARRAY_CHUNK_LENGTH;
+        if (end < arr->ptrs) {
+            // There is more to be marked after this chunk.
+            markQueuePushArray(queue, arr, end);
+        } else {
+            end = arr->ptrs;
+        }
+        for (StgWord i = start; i < end; i++) {
+            markQueuePushClosure_(queue, arr->payload[i]);
+        }
+        break;
+    }
+    case NULL_ENTRY:
+        barf("mark_entry: NULL_ENTRY");
+    }
+}
+
+/* Mark until the worker runs out of work. */
+static GNUC_ATTR_HOT void
+mark_loop (MarkWorker *w)
+{
+    MarkQueue *queue = w->queue;
+    while (true) {
+        MarkQueueEnt ent = markQueuePop(queue);
+
+        if (nonmovingMarkQueueEntryType(&ent) == NULL_ENTRY) {
+            if (mark_find_work(w)) {
+                continue;
+            } else {
+                return;
+            }
+        }
+
+        mark_entry(queue, &ent);
+        w->entries++;
+#if defined(THREADED_RTS)
+        if (n_nonmoving_mark_workers > 1) {
+            mark_share_work(w);
+        }
+#endif
+    }
+}
+
+#if defined(THREADED_RTS)
+// How many entries an idle capability marks between checks for the end of its
+// slice.
+#define IDLE_MARK_CHECK_ENTRIES 64
+
+/* Mark the update remembered set on an idle capability until it is empty or
+ * the slice is over. Returns true if there may be more to mark. See Note
+ * [Idle-time nonmoving GC work] in NonMoving.c.
+ */
+bool nonmovingMarkIdle (Capability *cap, Time deadline)
+{
+    bdescr *bd = NULL;
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    if (nonmoving_write_barrier_enabled && upd_rem_set_block_list != NULL) {
+        bd = upd_rem_set_block_list;
+        upd_rem_set_block_list = bd->link;
+    }
+    RELEASE_LOCK(&upd_rem_set_lock);
+    if (bd == NULL) {
+        return false;
+    }
+
+    MarkQueue queue;
+    bd->link = NULL;
+    queue.blocks = bd;
+    queue.top = (MarkQueueBlock *) bd->start;
+    queue.is_upd_rem_set = false;
+    queue.marked_words = 0;
+#if MARK_PREFETCH_QUEUE_DEPTH > 0
+    memset(&queue.prefetch_queue, 0, sizeof(queue.prefetch_queue));
+    queue.prefetch_head = 0;
+#endif
+
+    StgWord entries = 0;
+    bool more = true;
+    while (entries % IDLE_MARK_CHECK_ENTRIES != 0
+           || !nonmovingIdleSliceOver(cap, deadline)) {
+        MarkQueueEnt ent = markQueuePop(&queue);
+        if (nonmovingMarkQueueEntryType(&ent) == NULL_ENTRY) {
+            more = VOLATILE_LOAD(&upd_rem_set_block_list) != 0;
+            break;
+        }
+        mark_entry(&queue, &ent);
+        entries++;
+    }
+
+#if MARK_PREFETCH_QUEUE_DEPTH > 0
+    // Don't lose the entries we have already popped for prefetching.
+    for (unsigned int i = 0; i < MARK_PREFETCH_QUEUE_DEPTH; i++) {
+        if (nonmovingMarkQueueEntryType(&queue.prefetch_queue[i]) != NULL_ENTRY) {
+            push(&queue, &queue.prefetch_queue[i]);
+        }
+    }
+#endif
+
+    // Hand whatever is left back to the collector.
+    if (markQueueIsEmpty(&queue)) {
+        freeChain_lock(queue.blocks);
+        queue.blocks = NULL;
+    }
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    if (queue.blocks != NULL) {
+        bdescr *end = queue.blocks;
+        while (end->link != NULL) {
+            end = end->link;
+        }
+        end->link = upd_rem_set_block_list;
+        upd_rem_set_block_list = queue.blocks;
+    }
+    idle_marked_words += queue.marked_words;
+    RELEASE_LOCK(&upd_rem_set_lock);
+
+    stat_nonmovingIdleSlice(entries, 0);
+    return more;
+}
+
+static void* nonmovingMarkHelper (void *user)
+{
+    MarkWorker *w = (MarkWorker *) user;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    while (true) {
+        while (w->pass == mark_pass && !mark_helpers_exit) {
+            waitCondition(&mark_pass_cond, &mark_pool_lock);
+        }
+        if (mark_helpers_exit) {
+            break;
+        }
+        w->pass = mark_pass;
+        const bool sweep = mark_pass_sweep;
+        RELEASE_LOCK(&mark_pool_lock);
+
+        Time start = getCurrentThreadCPUTime();
+        if (sweep) {
+            nonmovingSweepSegments();
+        } else {
+            mark_loop(w);
+        }
+        w->cpu_ns += getCurrentThreadCPUTime() - start;
+
+        ACQUIRE_LOCK(&mark_pool_lock);
+        n_running_mark_helpers--;
+        broadcastCondition(&mark_pass_cond);
+    }
+    n_live_mark_helpers--;
+    broadcastCondition(&mark_pass_cond);
+    RELEASE_LOCK(&mark_pool_lock);
+    return NULL;
+}
+
+/* Start the helper threads for a major collection. Does nothing unless
+ * --nonmoving-mark-threads is greater than one. The leader (worker 0) is set
+ * up in nonmovingMark, as its queue is only known then.
+ */
+void nonmovingStartMarkWorkers (void)
+{
+    const uint32_t n = RtsFlags.GcFlags.nonmovingMarkThreads;
+    if (n <= 1) return;
+
+    ASSERT(mark_workers == NULL);
+    mark_workers = stgMallocBytes(n * sizeof(MarkWorker), "nonmovingStartMarkWorkers");
+    memset(mark_workers, 0, n * sizeof(MarkWorker));
+
+    ACQUIRE_SM_LOCK;
+    for (uint32_t i = 1; i < n; i++) {
+        mark_workers[i].queue = stgMallocBytes(sizeof(MarkQueue), "mark worker queue");
+        initMarkQueue(mark_workers[i].queue);
+    }
+    RELEASE_SM_LOCK;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    mark_helpers_exit = false;
+    n_live_mark_helpers = n - 1;
+    for (uint32_t i = 0; i < n; i++) {
+        mark_workers[i].no = i;
+        mark_workers[i].pass = mark_pass;
+    }
+    n_nonmoving_mark_workers = n;
+    RELEASE_LOCK(&mark_pool_lock);
+
+    for (uint32_t i = 1; i < n; i++) {
+        if (createOSThread(&mark_workers[i].thread, "non-moving mark worker",
+                           nonmovingMarkHelper, &mark_workers[i]) != 0) {
+            barf("nonmovingStartMarkWorkers: failed to spawn mark worker: %s",
+                 strerror(errno));
+        }
+    }
+    debugTrace(DEBUG_nonmoving_gc, "Started %d mark workers", n - 1);
+}
+
+/* Stop the helper threads, report their statistics and free their queues. */
+void nonmovingStopMarkWorkers (void)
+{
+    if (mark_workers == NULL) return;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    mark_helpers_exit = true;
+    broadcastCondition(&mark_pass_cond);
+    while (n_live_mark_helpers > 0) {
+        waitCondition(&mark_pass_cond, &mark_pool_lock);
+    }
+    ASSERT(nonmoving_mark_pool == NULL);
+    RELEASE_LOCK(&mark_pool_lock);
+
+    for (uint32_t i = 0; i < n_nonmoving_mark_workers; i++) {
+        MarkWorker *w = &mark_workers[i];
+        stat_nonmovingMarkWorker(i, w->cpu_ns, w->entries, w->stolen, w->donated);
+        if (i > 0) {
+            ASSERT(markQueueIsEmpty(w->queue));
+            freeMarkQueue(w->queue);
+            stgFree(w->queue);
+        }
+    }
+    n_nonmoving_mark_workers = 1;
+    stgFree(mark_workers);
+    mark_workers = NULL;
+}
+
+MarkQueue *nonmovingMarkWorkerQueue (uint32_t i)
+{
+    ASSERT(i < n_nonmoving_mark_workers);
+    return mark_workers[i].queue;
+}
+
+/* Run a mark pass with all workers; the calling thread is the leader. */
+static void
+nonmovingParMark (MarkQueue *queue)
+{
+    MarkWorker *leader = &mark_workers[0];
+    leader->queue = queue;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    mark_pass++;
+    mark_pass_sweep = false;
+    mark_pass_done = false;
+    n_idle_mark_workers = 0;
+    n_running_mark_helpers = n_nonmoving_mark_workers - 1;
+    broadcastCondition(&mark_pass_cond);
+    RELEASE_LOCK(&mark_pool_lock);
+
+    Time start = getCurrentThreadCPUTime();
+    mark_loop(leader);
+    leader->cpu_ns += getCurrentThreadCPUTime() - start;
+
+    // Wait for the helpers to leave the pass; after this point we are the only
+    // one touching the heap until the next pass.
+    ACQUIRE_LOCK(&mark_pool_lock);
+    while (n_running_mark_helpers > 0) {
+        waitCondition(&mark_pass_cond, &mark_pool_lock);
+    }
+    RELEASE_LOCK(&mark_pool_lock);
+
+    for (uint32_t i = 1; i < n_nonmoving_mark_workers; i++) {
+        MarkQueue *q = mark_workers[i].queue;
+        nonmoving_live_words += q->marked_words;
+        q->marked_words = 0;
+    }
+}
+
+/* Sweep the nonmoving heap, with the help of the mark workers if there are
+ * any. See Note [Lazy sweeping] in NonMovingSweep.c.
+ */
+void
+nonmovingParSweep (void)
+{
+    if (mark_workers == NULL) {
+        nonmovingSweepSegments();
+        return;
+    }
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    mark_pass++;
+    mark_pass_sweep = true;
+    n_running_mark_helpers = n_nonmoving_mark_workers - 1;
+    broadcastCondition(&mark_pass_cond);
+    RELEASE_LOCK(&mark_pool_lock);
+
+    MarkWorker *leader = &mark_workers[0];
+    Time start = getCurrentThreadCPUTime();
+    nonmovingSweepSegments();
+    leader->cpu_ns += getCurrentThreadCPUTime() - start;
+
+    ACQUIRE_LOCK(&mark_pool_lock);
+    while (n_running_mark_helpers > 0) {
+        waitCondition(&mark_pass_cond, &mark_pool_lock);
+    }
+    RELEASE_LOCK(&mark_pool_lock);
+}
+#endif
+
 /* This is the main mark loop.
  * Invariants:
  *
@@ -1686,52 +2279,39 @@ nonmovingMark (MarkQueue *queue)
 {
     traceConcMarkBegin();
     debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
-    unsigned int count = 0;
-    while (true) {
-        count++;
-        MarkQueueEnt ent = markQueuePop(queue);
+    StgWord count STG_UNUSED;
 
-        switch (nonmovingMarkQueueEntryType(&ent)) {
-        case MARK_CLOSURE:
-            mark_closure(queue, ent.mark_closure.p, ent.mark_closure.origin);
-            break;
-        case MARK_ARRAY: {
-            const StgMutArrPtrs *arr = (const StgMutArrPtrs *)
-                UNTAG_CLOSURE((StgClosure *) ent.mark_array.array);
-            StgWord start = ent.mark_array.start_index;
-            StgWord end = start + MARK_ARRAY_CHUNK_LENGTH;
-            if (end < arr->ptrs) {
-                // There is more to be marked after this chunk.
-                markQueuePushArray(queue, arr, end);
-            } else {
-                end = arr->ptrs;
-            }
-            for (StgWord i = start; i < end; i++) {
-                markQueuePushClosure_(queue, arr->payload[i]);
-            }
-            break;
+#if defined(THREADED_RTS)
+    if (n_nonmoving_mark_workers > 1) {
+        StgWord entries_before = 0;
+        for (uint32_t i = 0; i < n_nonmoving_mark_workers; i++) {
+            entries_before += mark_workers[i].entries;
         }
-        case NULL_ENTRY:
-            // Perhaps the update remembered set has more to mark...
-            if (upd_rem_set_block_list) {
-                ACQUIRE_LOCK(&upd_rem_set_lock);
-                bdescr *old = queue->blocks;
-                queue->blocks = upd_rem_set_block_list;
-                queue->top = (MarkQueueBlock *) queue->blocks->start;
-                upd_rem_set_block_list = NULL;
-                RELEASE_LOCK(&upd_rem_set_lock);
-
-                ACQUIRE_SM_LOCK;
-                freeGroup(old);
-                RELEASE_SM_LOCK;
-            } else {
-                // Nothing more to do
-                debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
-                traceConcMarkEnd(count);
-                return;
-            }
+        nonmovingParMark(queue);
+        count = 0;
+        for (uint32_t i = 0; i < n_nonmoving_mark_workers; i++) {
+            count += mark_workers[i].entries;
         }
+        count -= entries_before;
+    } else
+#endif
+    {
+        MarkWorker w = { .no = 0, .queue = queue, .entries = 0 };
+        mark_loop(&w);
+        count = w.entries;
     }
+
+    nonmoving_live_words += queue->marked_words;
+    queue->marked_words = 0;
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    nonmoving_live_words += idle_marked_words;
+    idle_marked_words = 0;
+    RELEASE_LOCK(&upd_rem_set_lock);
+#endif
+
+    debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %" FMT_Word, count);
+    traceConcMarkEnd(count);
 }
 
 // A variant of `isAlive` that works for non-moving heap. Used for:
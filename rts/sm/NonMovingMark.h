@@ -94,6 +94,10 @@ typedef struct MarkQueue_ {
     // Is this a mark queue or a capability-local update remembered set?
     bool is_upd_rem_set;
 
+    // Words found to be live by the mark loop popping from this queue. Summed
+    // into nonmoving_live_words at the end of each mark pass.
+    memcount marked_words;
+
 #if MARK_PREFETCH_QUEUE_DEPTH > 0
     // A ring-buffer of entries which we will mark next
     MarkQueueEnt prefetch_queue[MARK_PREFETCH_QUEUE_DEPTH];
@@ -134,6 +138,10 @@ extern StgIndStatic *debug_caf_list_snapshot;
 extern MarkQueue *current_mark_queue;
 extern bdescr *upd_rem_set_block_list;
 
+// See Note [Parallel marking in the nonmoving collector]
+extern uint32_t n_nonmoving_mark_workers;
+extern bdescr *nonmoving_mark_pool;
+
 
 void nonmovingMarkInitUpdRemSet(void);
 
@@ -145,6 +153,12 @@ void updateRemembSetPushTSO(Capability *cap, StgTSO *tso);
 void updateRemembSetPushStack(Capability *cap, StgStack *stack);
 
 #if defined(THREADED_RTS)
+void nonmovingStartMarkWorkers(void);
+void nonmovingStopMarkWorkers(void);
+MarkQueue *nonmovingMarkWorkerQueue(uint32_t i);
+void nonmovingParSweep(void);
+bool nonmovingMarkIdle(Capability *cap, Time deadline);
+
 void nonmovingFlushCapUpdRemSetBlocks(Capability *cap);
 void nonmovingBeginFlush(Task *task);
 bool nonmovingWaitForFlush(void);
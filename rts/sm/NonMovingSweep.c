@@ -17,6 +17,7 @@
 #include "Trace.h"
 #include "StableName.h"
 #include "CNF.h" // compactFree
+#include "Stats.h"
 
 // On which list should a particular segment be placed?
 enum SweepResult {
@@ -127,33 +128,173 @@ clear_segment_free_blocks(struct NonmovingSegment* seg)
 
 #endif
 
+/* Note [Lazy sweeping]
+ * ~~~~~~~~~~~~~~~~~~~~
+ * Once marking has finished, every segment on an allocator's sweep_list is
+ * either free, partially filled or filled, and which one it is only depends
+ * upon its mark bitmap. Sweeping a segment (nonmovingSweepSegment) only touches
+ * the segment's own bitmap and next_free metadata, so segments can be swept
+ * independently and in any order. We exploit this in two ways:
+ *
+ *  - The collector sweeps with all of its mark workers (see Note [Parallel
+ *    marking in the nonmoving collector] in NonMovingMark.c), each of which
+ *    pops segments off of the sweep lists until they are empty.
+ *
+ *  - While the sweep is running (nonmovingHeap.lazy_sweep is set) a capability
+ *    whose allocator finds its current segment full and its active list empty
+ *    sweeps segments from that allocator's own sweep list (see
+ *    nonmovingSweepLazily) before resorting to a fresh segment. This means that
+ *    free memory becomes available to the mutator as soon as it is needed
+ *    rather than only once the collector has walked the whole heap, and that
+ *    part of the cost of the sweep is paid by the capabilities which benefit
+ *    from it.
+ *
+ * Segments are only ever removed from the sweep lists during the sweep, so
+ * popping with a simple CAS loop is free of ABA problems. The lists are only
+ * refilled by nonmovingMark_ when the next mark starts, after lazy_sweep has
+ * been cleared; since the next collection cannot start before all capabilities
+ * have synchronised, no capability can still be sweeping at that point.
+ *
+ * Note that nonmovingHeap.lazy_sweep must not be set during marking: the
+ * bitmaps of segments on the sweep lists are meaningless until the mark has
+ * finished.
+ */
+
+static struct NonmovingSegment *pop_sweep_segment(struct NonmovingAllocator *alloca)
+{
+    while (true) {
+        struct NonmovingSegment *seg =
+            (struct NonmovingSegment *) VOLATILE_LOAD(&alloca->sweep_list);
+        if (seg == NULL) {
+            return NULL;
+        }
+        if (cas((StgVolatilePtr) &alloca->sweep_list,
+                (StgWord) seg,
+                (StgWord) seg->link) == (StgWord) seg) {
+            return seg;
+        }
+    }
+}
+
+// Sweep a segment popped from a sweep list and put it on the appropriate list.
+static void sweep_popped_segment(struct NonmovingSegment *seg)
+{
+    enum SweepResult ret = nonmovingSweepSegment(seg);
+
+    switch (ret) {
+    case SEGMENT_FREE:
+        IF_DEBUG(sanity, clear_segment(seg));
+        nonmovingPushFreeSegment(seg);
+        break;
+    case SEGMENT_PARTIAL:
+        IF_DEBUG(sanity, clear_segment_free_blocks(seg));
+        nonmovingPushActiveSegment(seg);
+        break;
+    case SEGMENT_FILLED:
+        nonmovingPushFilledSegment(seg);
+        break;
+    default:
+        barf("nonmovingSweep: weird sweep return: %d\n", ret);
+    }
+}
+
+// Sweep segments until all sweep lists are empty. This is run by each of the
+// collector's mark workers concurrently. See Note [Lazy sweeping].
+GNUC_ATTR_HOT void nonmovingSweepSegments(void)
+{
+    for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
+        struct NonmovingAllocator *alloca = nonmovingHeap.allocators[alloca_idx];
+        struct NonmovingSegment *seg;
+        while ((seg = pop_sweep_segment(alloca)) != NULL) {
+            sweep_popped_segment(seg);
+        }
+    }
+}
+
+#if defined(THREADED_RTS)
+/* Sweep segments on an idle capability until the sweep lists are empty or the
+ * slice is over. Returns true if there may be more to sweep. See Note
+ * [Idle-time nonmoving GC work] in NonMoving.c.
+ */
+bool nonmovingSweepIdle(Capability *cap, Time deadline)
+{
+    W_ swept = 0;
+    bool more = false;
+    for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
+        struct NonmovingAllocator *alloca = nonmovingHeap.allocators[alloca_idx];
+        while (VOLATILE_LOAD(&alloca->sweep_list) != 0) {
+            if (nonmovingIdleSliceOver(cap, deadline)) {
+                more = true;
+                goto done;
+            }
+            struct NonmovingSegment *seg = pop_sweep_segment(alloca);
+            if (seg != NULL) {
+                sweep_popped_segment(seg);
+                swept++;
+            }
+        }
+    }
+
+done:
+    if (swept > 0) {
+        stat_nonmovingIdleSlice(0, swept);
+    }
+    return more;
+}
+#endif
+
 GNUC_ATTR_HOT void nonmovingSweep(void)
 {
-    while (nonmovingHeap.sweep_list) {
-        struct NonmovingSegment *seg = nonmovingHeap.sweep_list;
+    // Marking is done; allow allocators to sweep their own segments. The
+    // barrier ensures that they see the final mark bitmaps.
+    write_barrier();
+    nonmovingHeap.lazy_sweep = true;
 
-        // Pushing the segment to one of the free/active/filled segments
-        // updates the link field, so update sweep_list here
-        nonmovingHeap.sweep_list = seg->link;
+#if defined(THREADED_RTS)
+    nonmovingProdIdleCapabilities();
+    nonmovingParSweep();
+#else
+    nonmovingSweepSegments();
+#endif
 
+    nonmovingHeap.lazy_sweep = false;
+#if defined(DEBUG)
+    for (int alloca_idx = 0; alloca_idx < NONMOVING_ALLOCA_CNT; ++alloca_idx) {
+        ASSERT(nonmovingHeap.allocators[alloca_idx]->sweep_list == NULL);
+    }
+#endif
+}
+
+/* Sweep segments from alloca's sweep list on behalf of nonmovingAllocate until
+ * we find one with free blocks, which is returned (with its next_free set
+ * up) to become the capability's new current segment. Filled segments are
+ * moved to the filled list as usual. Returns NULL if the sweep list is empty.
+ * See Note [Lazy sweeping].
+ */
+struct NonmovingSegment *nonmovingSweepLazily(struct NonmovingAllocator *alloca)
+{
+    struct NonmovingSegment *seg;
+    while ((seg = pop_sweep_segment(alloca)) != NULL) {
         enum SweepResult ret = nonmovingSweepSegment(seg);
 
         switch (ret) {
         case SEGMENT_FREE:
+            // nonmovingSweepSegment has reset the segment's metadata, so
+            // unlike in nonmovingSweepSegments we can allocate into it without
+            // going via the free list.
             IF_DEBUG(sanity, clear_segment(seg));
-            nonmovingPushFreeSegment(seg);
-            break;
+            return seg;
         case SEGMENT_PARTIAL:
             IF_DEBUG(sanity, clear_segment_free_blocks(seg));
-            nonmovingPushActiveSegment(seg);
-            break;
+            return seg;
         case SEGMENT_FILLED:
             nonmovingPushFilledSegment(seg);
             break;
         default:
-            barf("nonmovingSweep: weird sweep return: %d\n", ret);
+            barf("nonmovingSweepLazily: weird sweep return: %d\n", ret);
         }
     }
+    return NULL;
 }
 
 /* Must a closure remain on the mutable list?
@@ -397,7 +538,7 @@ void nonmovingSweepStableNameTable()
                     freeSnEntry(p);
                 } else if (p->addr != NULL) {
                     if (!is_alive((StgClosure*)p->addr)) {
-                        p->addr = NULL;
+                        clearSnEntryAddr(p);
                     }
                 }
             }
@@ -12,6 +12,18 @@
 
 GNUC_ATTR_HOT void nonmovingSweep(void);
 
+// Sweep segments until the sweep lists are empty; may be run concurrently by
+// several threads.
+GNUC_ATTR_HOT void nonmovingSweepSegments(void);
+
+#if defined(THREADED_RTS)
+// Sweep segments on an idle capability for at most one slice
+bool nonmovingSweepIdle(Capability *cap, Time deadline);
+#endif
+
+// Sweep a segment for an allocator which has run out of segments
+struct NonmovingSegment *nonmovingSweepLazily(struct NonmovingAllocator *alloca);
+
 // Remove unmarked entries in oldest generation mut_lists
 void nonmovingSweepMutLists(void);
 
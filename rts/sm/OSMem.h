@@ -23,6 +23,7 @@ bool osNumaAvailable(void);
 uint32_t osNumaNodes(void);
 uint64_t osNumaMask(void);
 void osBindMBlocksToNode(void *addr, StgWord size, uint32_t node);
+StgWord64 osHugePageBytes(void);
 
 INLINE_HEADER size_t
 roundDownToPage (size_t x)
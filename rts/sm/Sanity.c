@@ -921,6 +921,7 @@ findMemoryLeak (void)
         markBlocks(gc_threads[i]->free_blocks);
         markBlocks(capabilities[i]->pinned_object_block);
         markBlocks(capabilities[i]->upd_rem_set.queue.blocks);
+        markBlockCache(&capabilities[i]->block_cache);
     }
 
     if (RtsFlags.GcFlags.useNonmoving) {
@@ -933,14 +934,20 @@ findMemoryLeak (void)
             struct NonmovingAllocator *alloc = nonmovingHeap.allocators[i];
             markNonMovingSegments(alloc->filled);
             markNonMovingSegments(alloc->active);
+            markNonMovingSegments(alloc->sweep_list);
             for (j = 0; j < n_capabilities; j++) {
                 markNonMovingSegments(alloc->current[j]);
             }
         }
-        markNonMovingSegments(nonmovingHeap.sweep_list);
         markNonMovingSegments(nonmovingHeap.free);
         if (current_mark_queue)
             markBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        markBlocks(nonmoving_mark_pool);
+        for (i = 1; i < n_nonmoving_mark_workers; i++) {
+            markBlocks(nonmovingMarkWorkerQueue(i)->blocks);
+        }
+#endif
     }
 
 #if defined(PROFILING)
@@ -1012,6 +1019,12 @@ genBlocks (generation *gen)
         ret += countNonMovingHeap(&nonmovingHeap);
         if (current_mark_queue)
             ret += countBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        ret += countBlocks(nonmoving_mark_pool);
+        for (uint32_t i = 1; i < n_nonmoving_mark_workers; i++) {
+            ret += countBlocks(nonmovingMarkWorkerQueue(i)->blocks);
+        }
+#endif
     } else {
         ASSERT(countBlocks(gen->blocks) == gen->n_blocks);
         ASSERT(countCompactBlocks(gen->compact_objects) == gen->n_compact_blocks);
@@ -1043,7 +1056,8 @@ static W_
 countNonMovingAllocator(struct NonmovingAllocator *alloc)
 {
     W_ ret = countNonMovingSegments(alloc->filled)
-           + countNonMovingSegments(alloc->active);
+           + countNonMovingSegments(alloc->active)
+           + countNonMovingSegments(alloc->sweep_list);
     for (uint32_t i = 0; i < n_capabilities; ++i) {
         ret += countNonMovingSegments(alloc->current[i]);
     }
@@ -1057,7 +1071,6 @@ countNonMovingHeap(struct NonmovingHeap *heap)
     for (int alloc_idx = 0; alloc_idx < NONMOVING_ALLOCA_CNT; alloc_idx++) {
         ret += countNonMovingAllocator(heap->allocators[alloc_idx]);
     }
-    ret += countNonMovingSegments(heap->sweep_list);
     ret += countNonMovingSegments(heap->free);
     return ret;
 }
@@ -1069,7 +1082,7 @@ memInventory (bool show)
   W_ gen_blocks[RtsFlags.GcFlags.generations];
   W_ nursery_blocks = 0, retainer_blocks = 0,
       arena_blocks = 0, exec_blocks = 0, gc_free_blocks = 0,
-      upd_rem_set_blocks = 0;
+      upd_rem_set_blocks = 0, block_cache_blocks = 0;
   W_ live_blocks = 0, free_blocks = 0;
   bool leak;
 
@@ -1101,6 +1114,7 @@ memInventory (bool show)
   for (i = 0; i < n_capabilities; i++) {
       W_ n = countBlocks(gc_threads[i]->free_blocks);
       gc_free_blocks += n;
+      block_cache_blocks += countBlockCacheBlocks(&capabilities[i]->block_cache);
       if (capabilities[i]->pinned_object_block != NULL) {
           nursery_blocks += capabilities[i]->pinned_object_block->blocks;
       }
@@ -1134,7 +1148,7 @@ memInventory (bool show)
   }
   live_blocks += nursery_blocks +
                + retainer_blocks + arena_blocks + exec_blocks + gc_free_blocks
-               + upd_rem_set_blocks;
+               + upd_rem_set_blocks + block_cache_blocks;
 
 #define MB(n) (((double)(n) * BLOCK_SIZE_W) / ((1024*1024)/sizeof(W_)))
 
@@ -1161,6 +1175,8 @@ memInventory (bool show)
                  exec_blocks, MB(exec_blocks));
       debugBelch("  GC free pool : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  gc_free_blocks, MB(gc_free_blocks));
+      debugBelch("  block caches : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 block_cache_blocks, MB(block_cache_blocks));
       debugBelch("  free         : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  free_blocks, MB(free_blocks));
       debugBelch("  UpdRemSet    : %5" FMT_Word " blocks (%6.1lf MB)\n",
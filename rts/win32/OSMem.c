@@ -49,6 +49,11 @@ osMemInit(void)
     allocs = NULL;
     free_blocks = NULL;
 
+    if (RtsFlags.GcFlags.hugePages != HUGE_PAGES_NONE) {
+        errorBelch("warning: --huge-pages is not supported on this platform");
+        RtsFlags.GcFlags.hugePages = HUGE_PAGES_NONE;
+    }
+
     /* Resolve and cache VirtualAllocExNuma. */
     if (osNumaAvailable() && RtsFlags.GcFlags.numa)
     {
@@ -437,6 +442,13 @@ StgWord64 getPhysicalMemorySize (void)
     return physMemSize;
 }
 
+/* We don't support --huge-pages on Windows; see Note [Huge pages] in
+ * posix/OSMem.c */
+StgWord64 osHugePageBytes (void)
+{
+    return 0;
+}
+
 void setExecutable (void *p, W_ len, bool exec)
 {
     DWORD dwOldProtect = 0;
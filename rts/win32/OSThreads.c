@@ -90,6 +90,17 @@ waitCondition ( Condition* pCond, Mutex* pMut )
   return true;
 }
 
+bool
+timedWaitCondition ( Condition* pCond, Mutex* pMut, Time timeout )
+{
+  DWORD r;
+
+  RELEASE_LOCK(pMut);
+  r = WaitForSingleObject(*pCond, (DWORD)TimeToMS(timeout));
+  ACQUIRE_LOCK(pMut);
+  return r == WAIT_OBJECT_0;
+}
+
 void
 yieldThread()
 {
@@ -0,0 +1,19 @@
+-- Bursts of forkIO from a thread that keeps running.  With +RTS -qs idle
+-- capabilities steal the new threads while main is still forking them
+-- (see Note [Work-stealing run queues] in rts/Schedule.c).
+import Control.Concurrent
+import Control.Monad
+import Data.List (foldl')
+
+work :: Int -> Int
+work n = foldl' (\acc x -> (acc * 31 + x) `rem` 1000003) 0 [1..n]
+
+main :: IO ()
+main = do
+  rs <- forM [1..10 :: Int] $ \_ -> do
+    vs <- forM [1..1000] $ \i -> do
+      v <- newEmptyMVar
+      _ <- forkIO $ putMVar v $! work (1000 + i `mod` 7)
+      return v
+    sum <$> mapM takeMVar vs
+  print (sum rs)
@@ -0,0 +1,18 @@
+import Control.Concurrent
+import Control.Monad
+import Debug.Trace
+
+-- Fill the per-capability eventlog buffers several times over from a few
+-- threads with +RTS --eventlog-async, so that buffers are handed to the
+-- writer thread (and possibly dropped) while other capabilities carry on.
+main :: IO ()
+main = do
+  dones <- forM [1 .. 4 :: Int] $ \n -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      forM_ [1 .. 50000 :: Int] $ \i ->
+        traceEventIO ("thread " ++ show n ++ " event " ++ show i)
+      putMVar done ()
+    return done
+  mapM_ takeMVar dones
+  putStrLn "done"
@@ -0,0 +1,11 @@
+module EventlogFlightRecorder where
+
+import Control.Monad
+import Debug.Trace
+
+foreign export ccall generate_events :: IO ()
+
+generate_events :: IO ()
+generate_events =
+  forM_ [1 .. 100000 :: Int] $ \i ->
+    traceEventIO ("event " ++ show i)
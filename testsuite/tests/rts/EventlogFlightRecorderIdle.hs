@@ -0,0 +1,8 @@
+module EventlogFlightRecorderIdle where
+
+import Control.Concurrent
+
+foreign export ccall idle :: IO ()
+
+idle :: IO ()
+idle = threadDelay 5000000
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <Rts.h>
+
+// Test that SIGUSR2 dumps the eventlog flight recorder even when the RTS
+// is idle: the Haskell side sleeps in threadDelay while a helper thread
+// sends the signal and waits for the dump.
+
+extern void idle(void);
+
+static volatile int dumps = 0;
+static int dumped_while_idle = 0;
+
+static void test_init(void) {
+}
+
+static bool test_write(void *eventlog STG_UNUSED,
+                       size_t eventlog_size STG_UNUSED) {
+  return true;
+}
+
+static void test_flush(void) {
+}
+
+static void test_stop(void) {
+  __atomic_add_fetch(&dumps, 1, __ATOMIC_SEQ_CST);
+}
+
+static const EventLogWriter writer = {
+  .initEventLogWriter = test_init,
+  .writeEventLog = test_write,
+  .flushEventLog = test_flush,
+  .stopEventLogWriter = test_stop
+};
+
+static void *signaller(void *arg STG_UNUSED) {
+  // leave the signal to the RTS's threads, so that it interrupts them
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  usleep(200000);
+  kill(getpid(), SIGUSR2);
+  // the Haskell side is idle for 5s; give the dump 3s
+  for (int i = 0; i < 300; i++) {
+    if (__atomic_load_n(&dumps, __ATOMIC_SEQ_CST) > 0) {
+      dumped_while_idle = 1;
+      break;
+    }
+    usleep(10000);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  RtsConfig conf = defaultRtsConfig;
+  conf.rts_opts_enabled = RtsOptsAll;
+  conf.eventlog_writer = &writer;
+  hs_init_ghc(&argc, &argv, conf);
+
+  pthread_t tid;
+  pthread_create(&tid, NULL, signaller, NULL);
+  idle();
+  pthread_join(tid, NULL);
+  printf("dumped while idle: %s\n", dumped_while_idle ? "yes" : "no");
+  fflush(stdout);
+
+  hs_exit();
+  exit(0);
+}
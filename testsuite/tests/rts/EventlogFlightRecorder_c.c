@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Rts.h>
+
+// Test that in flight recorder mode nothing is written until the program
+// exits, and that then only the most recent events are written.
+//
+// Run with +RTS --eventlog-buffer-size=64k --eventlog-flight-recorder=128k,
+// so that the recorder keeps two buffers for the capability and two for the
+// global buffer; the header takes well under a buffer.
+#define MAX_WRITTEN (5 * 64 * 1024)
+
+extern void generate_events(void);
+
+static size_t written = 0;
+
+static void test_init(void) {
+  printf("init\n");
+  fflush(stdout);
+}
+
+static bool test_write(void *eventlog STG_UNUSED, size_t eventlog_size) {
+  written += eventlog_size;
+  return true;
+}
+
+static void test_flush(void) {
+}
+
+static void test_stop(void) {
+  printf("stop: %s\n",
+         written > 0 && written <= MAX_WRITTEN ? "ok" : "wrong size");
+  fflush(stdout);
+}
+
+static const EventLogWriter writer = {
+  .initEventLogWriter = test_init,
+  .writeEventLog = test_write,
+  .flushEventLog = test_flush,
+  .stopEventLogWriter = test_stop
+};
+
+int main(int argc, char *argv[]) {
+  RtsConfig conf = defaultRtsConfig;
+  conf.rts_opts_enabled = RtsOptsAll;
+  conf.eventlog_writer = &writer;
+  hs_init_ghc(&argc, &argv, conf);
+
+  // a couple of megabytes of user events
+  generate_events();
+  printf("written before exit: %zu\n", written);
+  fflush(stdout);
+
+  hs_exit();
+  exit(0);
+}
@@ -0,0 +1,94 @@
+#include "Rts.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// A minimal local consumer for the eventlog socket writer (see Note
+// [Eventlog socket writer] in rts/eventlog/EventLogWriter.c). We listen on
+// SOCKET_PATH, the RTS connects when it starts with
+//   +RTS -l --eventlog-socket=EventlogSocket.sock
+// and again when we restart the eventlog with startEventLogging(). Each
+// connection must carry a complete eventlog: the header begin marker
+// first and the data end marker last.
+
+#define SOCKET_PATH "EventlogSocket.sock"
+#define CONNECTIONS 2
+
+static int listener;
+static volatile StgWord done = 0;
+
+static void *consumer (void *arg STG_UNUSED)
+{
+    for (int n = 1; n <= CONNECTIONS; n++) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            perror("accept");
+            exit(1);
+        }
+
+        unsigned char head[4] = {0}, tail[2] = {0}, buf[4096];
+        size_t total = 0;
+        ssize_t r;
+        while ((r = read(fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < r; i++) {
+                if (total + i < sizeof(head)) {
+                    head[total + i] = buf[i];
+                }
+                tail[0] = tail[1];
+                tail[1] = buf[i];
+            }
+            total += r;
+        }
+        close(fd);
+
+        bool ok = memcmp(head, "hdrb", 4) == 0 // EVENT_HEADER_BEGIN
+            && tail[0] == 0xff && tail[1] == 0xff; // EVENT_DATA_END
+        printf("connection %d: %s\n", n, ok ? "ok" : "bad eventlog");
+        fflush(stdout);
+    }
+    done = 1;
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCKET_PATH);
+
+    unlink(SOCKET_PATH);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0
+        || bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(listener, CONNECTIONS) != 0) {
+        perror("listen");
+        exit(1);
+    }
+
+    OSThreadId tid;
+    createOSThread(&tid, "consumer", consumer, NULL);
+
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    // reconnect
+    endEventLogging();
+    if (!startEventLogging(&SocketEventLogWriter)) {
+        printf("failed to restart eventlog\n");
+    }
+
+    hs_exit();
+
+    while (!done) {
+        yieldThread();
+    }
+    unlink(SOCKET_PATH);
+    exit(0);
+}
@@ -0,0 +1,31 @@
+-- Run C finalizers on the finalizer threads (+RTS --finalizer-threads),
+-- checking that all of them run and that the finalizers of one object still
+-- run in order.
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import System.Mem
+
+foreign import ccall "&mark_finalizer" markFinalizer :: FinalizerPtr Word
+foreign import ccall "&check_finalizer" checkFinalizer :: FinalizerPtr Word
+foreign import ccall unsafe "finalized" finalized :: IO Word
+
+n :: Int
+n = 10000
+
+main :: IO ()
+main = do
+  forM_ [1..n] $ \_ -> do
+    p <- mallocBytes (sizeOf (0 :: Word)) :: IO (Ptr Word)
+    poke p 0
+    fp <- newForeignPtr checkFinalizer p
+    addForeignPtrFinalizer markFinalizer fp
+  performMajorGC
+  let wait :: Int -> IO ()
+      wait 0 = return ()
+      wait k = do
+        m <- finalized
+        when (fromIntegral m < n) $ threadDelay 1000 >> wait (k - 1)
+  wait 10000
+  finalized >>= print
@@ -0,0 +1,42 @@
+-- forkProcess with C finalizer threads (+RTS --finalizer-threads): the
+-- child has none of the parent's finalizer threads, so it has to start its
+-- own, or its finalizers never run and its hs_exit() waits for them
+-- forever.
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import System.Mem
+import System.Posix.Process
+
+foreign import ccall "&count_finalizer" countFinalizer :: FinalizerPtr Word
+foreign import ccall unsafe "finalized" finalized :: IO Word
+foreign import ccall unsafe "reset_finalized" resetFinalized :: IO ()
+
+n :: Int
+n = 1000
+
+dropForeignPtrs :: IO ()
+dropForeignPtrs = do
+  forM_ [1..n] $ \_ -> do
+    p <- mallocBytes (sizeOf (0 :: Word)) :: IO (Ptr Word)
+    _ <- newForeignPtr countFinalizer p
+    return ()
+  performMajorGC
+
+waitFinalized :: Int -> IO ()
+waitFinalized 0 = return ()
+waitFinalized k = do
+  m <- finalized
+  when (fromIntegral m < n) $ threadDelay 1000 >> waitFinalized (k - 1)
+
+main :: IO ()
+main = do
+  -- leave some finalizers queued in the parent when it forks
+  dropForeignPtrs
+  pid <- forkProcess $ do
+    resetFinalized
+    dropForeignPtrs
+    waitFinalized 10000
+    finalized >>= print
+  getProcessStatus True False pid >>= print
@@ -0,0 +1,21 @@
+#include "Rts.h"
+
+#include <stdlib.h>
+
+static volatile StgWord n_finalized = 0;
+
+void count_finalizer (StgWord *p)
+{
+    free(p);
+    atomic_inc(&n_finalized, 1);
+}
+
+HsWord finalized (void)
+{
+    return n_finalized;
+}
+
+void reset_finalized (void)
+{
+    n_finalized = 0;
+}
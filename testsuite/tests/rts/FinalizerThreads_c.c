@@ -0,0 +1,25 @@
+#include "Rts.h"
+
+#include <stdlib.h>
+
+static volatile StgWord n_finalized = 0;
+
+// Runs first: the finalizers of one object run in order on one thread
+void mark_finalizer (StgWord *p)
+{
+    *p = 1;
+}
+
+void check_finalizer (StgWord *p)
+{
+    if (*p != 1) {
+        barf("check_finalizer: finalizers of %p ran out of order", p);
+    }
+    free(p);
+    atomic_inc(&n_finalized, 1);
+}
+
+HsWord finalized (void)
+{
+    return n_finalized;
+}
@@ -0,0 +1,25 @@
+-- Threads on every capability keep allocating while main forces GCs, so
+-- each GC has to wait for the other capabilities to stop (see Note [Time
+-- to safepoint] in rts/Schedule.c).
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+spin :: IORef Bool -> Int -> IO Int
+spin stop n = do
+  done <- readIORef stop
+  if done then return n else spin stop $! (n + length (show n) `rem` 3)
+
+main :: IO ()
+main = do
+  stop <- newIORef False
+  vs <- forM [1 .. 3] $ \c -> do
+    v <- newEmptyMVar
+    _ <- forkOn c $ spin stop 0 >>= putMVar v
+    return v
+  replicateM_ 50 (performGC >> threadDelay 1000)
+  writeIORef stop True
+  mapM_ takeMVar vs
+  putStrLn "done"
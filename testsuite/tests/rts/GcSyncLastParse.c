@@ -0,0 +1,92 @@
+// Parse an eventlog far enough to check the GC_SYNC_LAST events: the
+// header must declare the event type with its fixed size, and every such
+// event must name a capability that exists.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define EVENT_GC_SYNC_LAST 214
+#define GC_SYNC_LAST_SIZE  (2 + 4 + 8 + 8 + 4)
+#define EVENT_ET_BEGIN     0x65746200
+#define EVENT_HET_END      0x68657465
+#define EVENT_DATA_END     0xffff
+#define VARIABLE_SIZE      0xffff
+
+static unsigned char *buf;
+static size_t len, pos;
+
+static uint64_t get (int bytes)
+{
+  uint64_t r = 0;
+  if (pos + bytes > len) {
+    printf("truncated eventlog\n");
+    exit(1);
+  }
+  for (int i = 0; i < bytes; i++) r = (r << 8) | buf[pos++];
+  return r;
+}
+
+int main (int argc, char *argv[])
+{
+  static int sizes[65536];
+  FILE *f;
+  uint32_t n_caps;
+  long n_sync = 0, bad = 0;
+
+  if (argc != 3) return 1;
+  n_caps = atoi(argv[2]);
+  f = fopen(argv[1], "rb");
+  if (f == NULL) { perror(argv[1]); return 1; }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(len);
+  if (fread(buf, 1, len, f) != len) { perror(argv[1]); return 1; }
+  fclose(f);
+
+  for (int i = 0; i < 65536; i++) sizes[i] = -1;
+
+  get(4); // header begin
+  get(4); // event types begin
+  while (get(4) == EVENT_ET_BEGIN) {
+    uint16_t tag = get(2);
+    sizes[tag] = get(2);
+    pos += get(4);      // description
+    pos += get(4);      // extensions
+    get(4);             // event type end
+  }
+  get(4); // header end
+  get(4); // data begin
+
+  if (sizes[EVENT_GC_SYNC_LAST] != GC_SYNC_LAST_SIZE) {
+    printf("GC_SYNC_LAST declared with size %d\n", sizes[EVENT_GC_SYNC_LAST]);
+    return 1;
+  }
+
+  for (;;) {
+    uint16_t tag = get(2);
+    if (tag == EVENT_DATA_END) break;
+    if (sizes[tag] < 0) {
+      printf("undeclared event %d\n", tag);
+      return 1;
+    }
+    get(8); // timestamp
+    if (tag == EVENT_GC_SYNC_LAST) {
+      uint16_t cap = get(2);
+      get(4);                   // thread
+      uint64_t sync_ns = get(8);
+      get(8);                   // info
+      get(4);                   // cost-centre stack
+      n_sync++;
+      if (cap >= n_caps || sync_ns == 0) bad++;
+    } else if (sizes[tag] == VARIABLE_SIZE) {
+      pos += get(2);
+    } else {
+      pos += sizes[tag];
+    }
+  }
+
+  printf("GC_SYNC_LAST events: %s\n",
+         n_sync == 0 ? "none" : bad == 0 ? "ok" : "bad");
+  return 0;
+}
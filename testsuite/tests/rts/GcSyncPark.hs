@@ -0,0 +1,26 @@
+-- Stress the GC sync with many more capabilities than cores (see
+-- Note [Parking GC threads] in rts/sm/GC.c): lots of threads allocate and
+-- force frequent parallel GCs, so GC threads that lost their core must park
+-- and be woken again for every collection.
+
+import Control.Concurrent
+import Control.Monad
+import Data.List (foldl')
+import System.Mem
+
+worker :: Int -> MVar Int -> IO ()
+worker n done = do
+  rs <- forM [1 .. 20] $ \i -> do
+    let r = foldl' (+) 0 (map (* i) [n .. n + 5000])
+    r `seq` when (i `mod` 5 == 0) performGC
+    return r
+  putMVar done (sum rs)
+
+main :: IO ()
+main = do
+  dones <- forM [1 .. 64] $ \n -> do
+    done <- newEmptyMVar
+    _ <- forkIO (worker n done)
+    return done
+  rs <- mapM takeMVar dones
+  print (sum rs)
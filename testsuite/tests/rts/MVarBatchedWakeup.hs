@@ -0,0 +1,34 @@
+-- Threads on every capability block in readMVar and takeMVar, and each
+-- putMVar wakes all the readers at once, which sends the wakeups to each
+-- capability in a batch (see Note [Batched wakeups] in rts/Threads.c).
+-- Every thread must see every value, in order. Run with "-t" to print the
+-- throughput; run with +RTS -s to see the MVar handoff statistics.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import System.Environment
+import Text.Printf
+
+readers, rounds :: Int
+readers = 16
+rounds = 2000
+
+main :: IO ()
+main = do
+  args <- getArgs
+  n <- getNumCapabilities
+  boxes <- replicateM rounds newEmptyMVar
+  acks <- newEmptyMVar
+  start <- getMonotonicTime
+  forM_ [0 .. n * readers - 1] $ \i -> forkOn i $ do
+    ok <- and <$> zipWithM (\r box -> (== r) <$> readMVar box) [0 ..] boxes
+    putMVar acks ok
+  forM_ (zip [0 ..] boxes) $ \(r, box) -> do
+    putMVar box (r :: Int)
+    yield
+  oks <- replicateM (n * readers) (takeMVar acks)
+  end <- getMonotonicTime
+  when ("-t" `elem` args) $
+    printf "%d wakeups in %.3fs\n" (n * readers * rounds) (end - start)
+  print (and oks)
@@ -0,0 +1,33 @@
+-- Exercise idle-time nonmoving GC work (+RTS -Is): a single thread mutates a
+-- large old-generation structure, pausing now and then, while the other
+-- capabilities sit idle and help the concurrent mark and sweep.
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+data Tree = Leaf | Node Tree !Int Tree
+
+build :: Int -> Int -> Tree
+build lo hi
+  | lo > hi   = Leaf
+  | otherwise = Node (build lo (mid-1)) mid (build (mid+1) hi)
+  where mid = (lo + hi) `div` 2
+
+total :: Tree -> Int
+total Leaf = 0
+total (Node l x r) = total l + x + total r
+
+main :: IO ()
+main = do
+  refs <- forM [0..15] $ \i -> newIORef (build 0 (20000 + i))
+  forM_ [1..40 :: Int] $ \round -> do
+    performMajorGC
+    -- Overwrite references while the collector is marking so that the
+    -- update remembered set has work for the idle capabilities.
+    forM_ (zip [0..] refs) $ \(i, ref) ->
+      when ((i + round) `mod` 3 == 0) $ writeIORef ref (build 0 (20000 + i + round))
+    threadDelay 1000
+  sums <- mapM (fmap total . readIORef) refs
+  print (sum sums)
@@ -0,0 +1,29 @@
+-- Exercise the nonmoving collector with several concurrent mark threads.
+-- We keep a large, frequently mutated structure in the old generation so
+-- that each major collection has plenty of marking work to share.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+data Tree = Leaf | Node Tree !Int Tree
+
+build :: Int -> Int -> Tree
+build lo hi
+  | lo > hi   = Leaf
+  | otherwise = Node (build lo (mid-1)) mid (build (mid+1) hi)
+  where mid = (lo + hi) `div` 2
+
+total :: Tree -> Int
+total Leaf = 0
+total (Node l x r) = total l + x + total r
+
+main :: IO ()
+main = do
+  refs <- forM [0..15] $ \i -> newIORef (build 0 (20000 + i))
+  forM_ [1..40 :: Int] $ \round -> do
+    forM_ (zip [0..] refs) $ \(i, ref) ->
+      when ((i + round) `mod` 3 == 0) $ writeIORef ref (build 0 (20000 + i + round))
+    performMajorGC
+  sums <- mapM (fmap total . readIORef) refs
+  print (sum sums)
@@ -0,0 +1,53 @@
+-- Stress the parallel and lazy sweep of the nonmoving heap (see Note [Lazy
+-- sweeping] in rts/sm/NonMovingSweep.c).  Mutators on every capability keep
+-- replacing arrays of many different sizes, so objects of most allocator
+-- size classes are promoted into the nonmoving heap, and die there, while
+-- the mark threads are sweeping: the allocators have to sweep their own
+-- segments lazily to find free blocks.
+--
+-- It doubles as a benchmark.  Build it with the RTS from before and after
+-- the parallel sweep, with
+--
+--   ghc -O -threaded -rtsopts NonmovingParSweep.hs
+--
+-- and compare the "Gen  1" pause, the "Gen  1 concurrent" (mark and sweep)
+-- and the "GC" elapsed lines of
+--
+--   ./NonmovingParSweep +RTS -xn -N4 --nonmoving-mark-threads=4 -A64k -s -RTS
+--
+-- over several runs.
+
+import Control.Concurrent
+import Control.Monad
+import Data.Array
+import Data.IORef
+import System.Mem
+
+slots :: Int
+slots = 2000
+
+mkArr :: Int -> Int -> Array Int Int
+mkArr seed n = listArray (0, n - 1) [seed + i | i <- [0 .. n - 1]]
+
+checksum :: Array Int Int -> Int
+checksum a = sum (elems a) `rem` 1000003
+
+mutator :: Int -> MVar Int -> IO ()
+mutator c done = do
+  refs <- forM [0 .. slots - 1] $ \i -> newIORef (mkArr i (1 + i `mod` 97))
+  forM_ [1 .. 60 :: Int] $ \round -> do
+    forM_ (zip [0 ..] refs) $ \(i, ref) ->
+      when ((i + round + c) `mod` 4 == 0) $
+        writeIORef ref $! mkArr (i + round) (1 + (i * round) `mod` 97)
+    when (c == 0 && round `mod` 10 == 0) performMajorGC
+  rs <- mapM (fmap checksum . readIORef) refs
+  putMVar done (sum rs)
+
+main :: IO ()
+main = do
+  dones <- forM [0 .. 3] $ \c -> do
+    done <- newEmptyMVar
+    _ <- forkOn c (mutator c done)
+    return done
+  rs <- mapM takeMVar dones
+  print (sum rs)
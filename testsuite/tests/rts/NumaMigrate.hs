@@ -0,0 +1,39 @@
+-- Thread migration under (fake) NUMA, see enabledCapabilityNear and
+-- schedulePushWork in rts/Schedule.c.  Run with --debug-numa=2, so that
+-- even capabilities are on node 0 and odd ones on node 1.
+--
+--  push:   main forks threads and blocks, so schedulePushWork hands them
+--          out to the idle capabilities.
+--
+--  shrink: with -N6, threads blocked on capabilities 3, 4 and 5 are woken
+--          after setNumCapabilities 3, so each has to move to an enabled
+--          capability on its own node.
+
+import Control.Concurrent
+import Control.Monad
+import Data.List (foldl')
+import System.Environment
+
+work :: Int -> Int
+work n = foldl' (\acc x -> (acc * 31 + x) `rem` 1000003) 0 [1 .. 100000 + n]
+
+main :: IO ()
+main = do
+  [mode] <- getArgs
+  rs <- case mode of
+    "push" ->
+      forM [1 .. 8] $ \i -> do
+        v <- newEmptyMVar
+        _ <- forkIO $ putMVar v $! work i
+        return v
+    _ -> do
+      go <- newEmptyMVar
+      vs <- forM [3, 4, 5] $ \c -> do
+        v <- newEmptyMVar
+        _ <- forkOn c $ readMVar go >> (putMVar v $! work c)
+        return v
+      threadDelay 100000
+      setNumCapabilities 3
+      putMVar go ()
+      return vs
+  print . sum =<< mapM takeMVar rs
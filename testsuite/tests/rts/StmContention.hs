@@ -0,0 +1,44 @@
+-- Every capability increments the same few TVars, so most commits conflict
+-- and transactions get backed off and serialised (see Note [STM contention
+-- management] in rts/STM.c). No increment may be lost. Run with "-t" to
+-- print the throughput; comparing runs with different values of
+-- +RTS --stm-max-aborts benchmarks the contention manager.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import GHC.Conc
+import System.Environment
+import Text.Printf
+
+counters, iters :: Int
+counters = 4
+iters = 20000
+
+worker :: [TVar Int] -> Int -> MVar () -> IO ()
+worker tvs c done = do
+  forM_ [1 .. iters] $ \i -> atomically $ do
+    -- read all the counters, so that any other commit invalidates us
+    vs <- mapM readTVar tvs
+    let tv = tvs !! ((c + i) `mod` counters)
+    writeTVar tv . (+ 1) =<< readTVar tv
+    when (sum vs < 0) retry
+  putMVar done ()
+
+main :: IO ()
+main = do
+  args <- getArgs
+  n <- getNumCapabilities
+  tvs <- replicateM counters (newTVarIO 0)
+  start <- getMonotonicTime
+  dones <- forM [0 .. n - 1] $ \c -> do
+    done <- newEmptyMVar
+    _ <- forkOn c (worker tvs c done)
+    return done
+  mapM_ takeMVar dones
+  end <- getMonotonicTime
+  total <- sum <$> mapM readTVarIO tvs
+  when ("-t" `elem` args) $
+    printf "%d transactions in %.3fs: %.0f/s\n" (n * iters) (end - start)
+      (fromIntegral (n * iters) / (end - start) :: Double)
+  print (total == n * iters)
@@ -0,0 +1,30 @@
+-- Long transactions, and threads blocking in retry, with a tiny nursery so
+-- that lots of GCs happen while the Capabilities' STM free lists are in use
+-- (see Note [STM free lists] in rts/STM.c).
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Conc
+
+tvars, rounds :: Int
+tvars = 200
+rounds = 500
+
+main :: IO ()
+main = do
+  tvs <- replicateM tvars (newTVarIO (0 :: Int))
+  gate <- newTVarIO 0
+  done <- newEmptyMVar
+  -- each waiter blocks until the gate reaches its round
+  forM_ [1 .. 4] $ \w -> forkIO $ do
+    forM_ [1 .. rounds] $ \r -> atomically $ do
+      g <- readTVar gate
+      when (g < r) retry
+      forM_ tvs $ \tv -> readTVar tv >>= writeTVar tv . (+ w)
+    putMVar done ()
+  forM_ [1 .. rounds] $ \r -> do
+    atomically $ writeTVar gate r
+    yield
+  replicateM_ 4 (takeMVar done)
+  vals <- mapM readTVarIO tvs
+  print (all (== sum [1 .. 4] * rounds) vals)
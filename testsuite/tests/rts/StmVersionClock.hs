@@ -0,0 +1,64 @@
+-- Transfers between TVars on every capability, checked by read-only
+-- transactions that sum all the accounts: every sum must see a consistent
+-- snapshot (see Note [STM version clock] in rts/STM.c). Run with "-t" to
+-- print the throughput of this read-mostly mix; comparing runs with and
+-- without +RTS --stm-version-clock benchmarks the two commit schemes.
+
+import Control.Concurrent
+import Control.Monad
+import Data.Array
+import GHC.Clock
+import GHC.Conc
+import System.Environment
+import Text.Printf
+
+accounts, iters :: Int
+accounts = 1000
+iters = 20000
+
+next :: Int -> Int
+next s = (s * 1103515245 + 12345) `mod` 2147483648
+
+sumTVars :: [TVar Int] -> STM Int
+sumTVars = foldM (\acc tv -> (+ acc) <$> readTVar tv) 0
+
+worker :: Array Int (TVar Int) -> Int -> MVar Int -> IO ()
+worker tvs seed done = go seed 0 0
+  where
+    go _ i bad | i == iters = putMVar done bad
+    go s i bad = do
+      let s' = next s
+      bad' <- case i `mod` 64 of
+        0 -> do
+          total <- atomically $ sumTVars (elems tvs)
+          return (if total == accounts * 100 then bad else bad + 1)
+        n | n <= 8 -> do
+          let from = tvs ! (s' `mod` accounts)
+              to = tvs ! ((s' `div` accounts) `mod` accounts)
+          atomically $ do
+            readTVar from >>= writeTVar from . subtract 1
+            readTVar to >>= writeTVar to . (+ 1)
+          return bad
+        _ -> do
+          _ <- atomically $ sumTVars
+                 [ tvs ! ((s' + k * 61) `mod` accounts) | k <- [0 .. 15] ]
+          return bad
+      go s' (i + 1) bad'
+
+main :: IO ()
+main = do
+  args <- getArgs
+  n <- getNumCapabilities
+  tvs <- listArray (0, accounts - 1) <$> replicateM accounts (newTVarIO 100)
+  start <- getMonotonicTime
+  dones <- forM [0 .. n - 1] $ \c -> do
+    done <- newEmptyMVar
+    _ <- forkOn c (worker tvs (c + 1) done)
+    return done
+  bad <- sum <$> mapM takeMVar dones
+  end <- getMonotonicTime
+  total <- atomically $ sumTVars (elems tvs)
+  when ("-t" `elem` args) $
+    printf "%d transactions in %.3fs: %.0f/s\n" (n * iters) (end - start)
+      (fromIntegral (n * iters) / (end - start) :: Double)
+  print (bad, total)
@@ -0,0 +1,38 @@
+-- Tidy enough weak pointers in a parallel GC that every GC thread gets some
+-- (see Note [Parallel weak pointer tidying] in rts/sm/MarkWeak.c). Each chain
+-- has one live root, and the value of each weak pointer is the key of the
+-- next, so the keys become reachable over several rounds; the weak pointers
+-- in the other set have unreachable keys and must all be found dead.
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+import System.Mem.Weak
+
+chains, len :: Int
+chains = 5000
+len = 8
+
+chain :: Int -> IO (IORef Int, [Weak (IORef Int)])
+chain c = do
+  root <- newIORef c
+  let go _ 0 ws = return ws
+      go k i ws = do
+        k' <- newIORef (c * len + i)
+        w <- mkWeak k k' Nothing
+        go k' (i - 1) (w : ws)
+  ws <- go root len []
+  return (root, ws)
+
+main :: IO ()
+main = do
+  (roots, live) <- unzip <$> mapM chain [1 .. chains]
+  dead <- forM [1 .. chains * 2] $ \i -> do
+    k <- newIORef i
+    mkWeak k i Nothing
+  performMajorGC
+  performMajorGC
+  alive <- length . filter id <$> mapM (fmap (maybe False (const True)) . deRefWeak) (concat live)
+  gone <- length . filter id <$> mapM (fmap (maybe True (const False)) . deRefWeak) dead
+  print (alive, gone)
+  mapM_ readIORef roots
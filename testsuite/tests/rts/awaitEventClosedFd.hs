@@ -0,0 +1,50 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+-- In the non-threaded RTS, a thread waiting on an fd that is then closed
+-- gets blockedOnBadFD, as it does with select(), rather than waiting
+-- forever. If the fd number is reused before we notice, the thread waits
+-- on the new file instead.
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Foreign
+import Foreign.C
+import GHC.Conc (threadWaitRead)
+import GHC.IO.Exception
+import System.Posix.Types (Fd(..))
+
+foreign import ccall unsafe "pipe" c_pipe :: Ptr CInt -> IO CInt
+foreign import ccall unsafe "close" c_close :: CInt -> IO CInt
+foreign import ccall unsafe "write" c_write :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+
+newPipe :: IO (CInt, CInt)
+newPipe = allocaArray 2 $ \p -> do
+  throwErrnoIfMinus1_ "pipe" (c_pipe p)
+  [r, w] <- peekArray 2 p
+  return (r, w)
+
+main :: IO ()
+main = do
+  -- closed
+  (r, _) <- newPipe
+  result <- newEmptyMVar
+  _ <- forkIO $ try (threadWaitRead (Fd r)) >>= putMVar result
+  threadDelay 10000
+  throwErrnoIfMinus1_ "close" (c_close r)
+  res <- takeMVar result
+  case res of
+    Left e | ioe_errno e == Just (let Errno n = eBADF in n) ->
+      putStrLn "closed: blockedOnBadFD"
+    Left e -> putStrLn ("closed: " ++ show e)
+    Right () -> putStrLn "closed: woken"
+
+  -- closed and reused
+  (r1, _) <- newPipe
+  done <- newEmptyMVar
+  _ <- forkIO $ threadWaitRead (Fd r1) >> putMVar done ()
+  threadDelay 10000
+  throwErrnoIfMinus1_ "close" (c_close r1)
+  (r2, w2) <- newPipe
+  when (r2 /= r1) $ error "fd not reused"
+  _ <- with 0 $ \b -> c_write w2 b 1
+  takeMVar done
+  putStrLn "reused: woken"
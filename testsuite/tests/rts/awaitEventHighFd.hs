@@ -0,0 +1,41 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+-- In the non-threaded RTS, threads can wait on file descriptors at or above
+-- FD_SETSIZE when awaitEvent uses epoll.
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import Foreign.C
+import GHC.Conc (threadWaitRead)
+import System.Posix.Types (Fd(..))
+
+foreign import ccall unsafe "raise_nofile_limit" raiseNofileLimit :: CInt -> IO CInt
+foreign import ccall unsafe "pipe" c_pipe :: Ptr CInt -> IO CInt
+foreign import ccall unsafe "dup2" c_dup2 :: CInt -> CInt -> IO CInt
+foreign import ccall unsafe "write" c_write :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+
+nThreads :: Int
+nThreads = 64
+
+firstFd :: CInt
+firstFd = 1500
+
+main :: IO ()
+main = do
+  throwErrnoIfMinus1_ "setrlimit" $ raiseNofileLimit (firstFd + fromIntegral nThreads)
+  done <- newEmptyMVar
+  ws <- forM [0 .. nThreads - 1] $ \i -> do
+    (r, w) <- allocaArray 2 $ \p -> do
+      throwErrnoIfMinus1_ "pipe" (c_pipe p)
+      [r, w] <- peekArray 2 p
+      return (r, w)
+    let fd = firstFd + fromIntegral i
+    throwErrnoIfMinus1_ "dup2" (c_dup2 r fd)
+    _ <- forkIO $ threadWaitRead (Fd fd) >> putMVar done i
+    return w
+  threadDelay 10000
+  -- wake the threads up in reverse order, one at a time
+  forM_ (reverse (zip [0 ..] ws)) $ \(i, w) -> do
+    _ <- with 0 $ \b -> c_write w b 1
+    j <- takeMVar done
+    when (i /= j) $ error ("woke " ++ show j ++ ", expected " ++ show i)
+  putStrLn "ok"
@@ -0,0 +1,16 @@
+#include <sys/resource.h>
+
+/* Make sure we can open fds up to at least 'want'. */
+int raise_nofile_limit (int want)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        return -1;
+    }
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t)want) {
+        rl.rlim_cur = want;
+        return setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return 0;
+}
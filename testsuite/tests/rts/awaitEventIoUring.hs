@@ -0,0 +1,46 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+-- Blocking I/O, timeouts and threadDelay with the io_uring backend of
+-- awaitEvent (which falls back to epoll if the kernel lacks io_uring).
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import Foreign.C
+import GHC.Conc (threadWaitRead, threadWaitWrite)
+import System.Posix.Types (Fd(..))
+import System.Timeout
+
+foreign import ccall unsafe "pipe" c_pipe :: Ptr CInt -> IO CInt
+foreign import ccall unsafe "write" c_write :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+foreign import ccall unsafe "read" c_read :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+
+newPipe :: IO (CInt, CInt)
+newPipe = allocaArray 2 $ \p -> do
+  throwErrnoIfMinus1_ "pipe" (c_pipe p)
+  [r, w] <- peekArray 2 p
+  return (r, w)
+
+main :: IO ()
+main = do
+  -- a read that times out cancels its poll; the fd must still work afterwards
+  (r, w) <- newPipe
+  t <- timeout 10000 (threadWaitRead (Fd r))
+  print t
+  done <- newEmptyMVar
+  _ <- forkIO $ threadWaitRead (Fd r) >> putMVar done ()
+  threadDelay 10000
+  _ <- with 0 $ \b -> c_write w b 1
+  takeMVar done
+  _ <- with 0 $ \b -> c_read r b 1
+  putStrLn "read ok"
+
+  -- many readers and a writer, interleaved with delays
+  ps <- replicateM 100 newPipe
+  results <- newChan
+  forM_ (zip [0 :: Int ..] ps) $ \(i, (pr, _)) ->
+    forkIO $ threadWaitRead (Fd pr) >> writeChan results i
+  threadWaitWrite (Fd (snd (head ps)))
+  forM_ ps $ \(_, pw) -> do
+    threadDelay 100
+    with 0 $ \b -> c_write pw b 1
+  xs <- replicateM 100 (readChan results)
+  print (sum xs)
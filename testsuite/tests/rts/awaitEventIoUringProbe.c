@@ -0,0 +1,32 @@
+/* Prints the awaitEvent backend that +RTS --io-uring should pick on this
+ * kernel: io_uring if io_uring_setup() works and has IORING_FEAT_NODROP,
+ * epoll otherwise (see Note [io_uring backend for awaitEvent]
+ * in rts/posix/Select.c). */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    define HAVE_IO_URING 1
+#  endif
+#endif
+
+int main(void)
+{
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup)
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, 8, &p);
+    if (fd >= 0) {
+        close(fd);
+        if (p.features & IORING_FEAT_NODROP) {
+            printf("io_uring\n");
+            return 0;
+        }
+    }
+#endif
+    printf("epoll\n");
+    return 0;
+}
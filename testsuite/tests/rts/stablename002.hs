@@ -0,0 +1,30 @@
+import Control.Monad
+import System.Mem
+import System.Mem.StableName
+
+-- Stable names must survive GCs of every generation: the stable name table
+-- only visits the names in the generations being collected, so check names
+-- for old objects, young objects and StableName objects younger than their
+-- objects, across minor and major GCs.
+
+main :: IO ()
+main = do
+  old <- forM [1 .. 20000 :: Int] $ \i -> do
+    let x = [i, i + 1]
+    x `seq` return x
+  oldNames <- mapM makeStableName old
+  performMajorGC
+  oks <- forM [1 .. 50 :: Int] $ \r -> do
+    young <- forM [1 .. 1000 :: Int] $ \i -> do
+      let x = [r, i]
+      x `seq` return x
+    youngNames <- mapM makeStableName young
+    -- new StableName objects for old objects
+    let some = take 100 (drop (r * 100) old)
+    someNames <- mapM makeStableName some
+    if r `mod` 10 == 0 then performMajorGC else performMinorGC
+    youngNames' <- mapM makeStableName young
+    someNames' <- mapM makeStableName some
+    return (youngNames == youngNames' && someNames == someNames')
+  oldNames' <- mapM makeStableName old
+  print (and oks && oldNames == oldNames')
@@ -0,0 +1,100 @@
+#include "Rts.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Exercise the per-Capability block caches (see Note [Per-capability block
+// caches] in rts/sm/BlockAlloc.c): several OS threads each grab a Capability
+// with rts_lock() and then allocate and free small block groups in a tight
+// loop. Run with "-t" to print timings; this doubles as a microbenchmark of
+// block allocator contention.
+
+extern bdescr *allocGroup_lock(W_ n);
+extern bdescr *allocBlock_lock(void);
+extern void freeGroup_lock(bdescr *p);
+extern void freeChain_lock(bdescr *p);
+
+#define THREADS  4
+#define ARRSIZE  256
+#define LOOPS    2000
+#define MAXALLOC 6
+
+OSThreadId ids[THREADS];
+StgWord64 times[THREADS];
+volatile StgWord done = 0;
+
+static void *worker (void *arg)
+{
+    int n = (int)(StgWord)arg;
+    unsigned int seed = 0xf00f00 + n;
+    bdescr *a[ARRSIZE];
+
+    Capability *cap = rts_lock();
+    StgWord64 start = getMonotonicNSec();
+
+    for (int i = 0; i < LOOPS; i++)
+    {
+        for (int j = 0; j < ARRSIZE; j++)
+        {
+            // mostly single blocks, as used for mutable lists and
+            // foreign allocations, with some small groups
+            int b = (i + j) % 4 == 0 ? (rand_r(&seed) % MAXALLOC) + 1 : 1;
+            a[j] = b == 1 ? allocBlock_lock() : allocGroup_lock(b);
+            if (a[j]->blocks != (W_)b) {
+                barf("allocated %d blocks, wanted %d", (int)a[j]->blocks, b);
+            }
+            // scribble on the block to catch overlapping allocations
+            memset(a[j]->start, n, BLOCK_SIZE);
+        }
+        for (int j = 0; j < ARRSIZE; j++)
+        {
+            if (*(StgWord8*)a[j]->start != (StgWord8)n) {
+                barf("block %p overwritten", a[j]->start);
+            }
+        }
+        if (i % 2 == 0) {
+            for (int j = 0; j < ARRSIZE; j++) {
+                freeGroup_lock(a[j]);
+            }
+        } else {
+            for (int j = 0; j < ARRSIZE - 1; j++) {
+                a[j]->link = a[j+1];
+            }
+            a[ARRSIZE-1]->link = NULL;
+            freeChain_lock(a[0]);
+        }
+    }
+
+    times[n] = getMonotonicNSec() - start;
+    rts_unlock(cap);
+    hs_thread_done();
+    atomic_inc(&done, 1);
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    for (int n = 0; n < THREADS; n++) {
+        createOSThread(&ids[n], "blockcache", worker, (void*)(StgWord)n);
+    }
+    while (done != THREADS) {
+        yieldThread();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        for (int n = 0; n < THREADS; n++) {
+            printf("thread %d: %.3fs\n", n, (double)times[n] / 1e9);
+        }
+    }
+    printf("done\n");
+
+    hs_exit(); // will do a memory leak test
+
+    exit(0);
+}
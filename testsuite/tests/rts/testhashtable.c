@@ -0,0 +1,311 @@
+#include "Rts.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Check the RTS HashTable (see Note [Robin Hood hash tables] in rts/Hash.c)
+// against a copy of the linear hashing table with separate chaining that it
+// replaced, by inserting, looking up and removing the same keys in both.
+// Run with "-t" to also print timings for 10K to 10M keys; this doubles as a
+// microbenchmark of the two tables.
+
+typedef struct hashtable HashTable;
+extern HashTable *allocHashTable(void);
+extern void insertHashTable(HashTable *table, StgWord key, const void *data);
+extern void *lookupHashTable(const HashTable *table, StgWord key);
+extern void *removeHashTable(HashTable *table, StgWord key, const void *data);
+extern int keyCountHashTable(HashTable *table);
+extern void freeHashTable(HashTable *table, void (*freeDataFun)(void *));
+
+// -----------------------------------------------------------------------------
+// The old rts/Hash.c, cut down to what we use here
+
+#define HSEGSIZE    1024
+#define HDIRSIZE    1024
+#define HLOAD       5
+#define HCHUNK      (1024 * sizeof(W_) / sizeof(HashList))
+
+typedef struct hashlist {
+    StgWord key;
+    const void *data;
+    struct hashlist *next;
+} HashList;
+
+typedef struct chunklist {
+    HashList *chunk;
+    struct chunklist *next;
+} HashListChunk;
+
+typedef struct {
+    int split, max, mask1, mask2, kcount, bcount;
+    HashList **dir[HDIRSIZE];
+    HashList *freeList;
+    HashListChunk *chunks;
+} ChainedTable;
+
+static int chainedHash(const ChainedTable *table, StgWord key)
+{
+    key >>= sizeof(StgWord);
+    int bucket = key & table->mask1;
+    if (bucket < table->split) {
+        bucket = key & table->mask2;
+    }
+    return bucket;
+}
+
+static ChainedTable *allocChained(void)
+{
+    ChainedTable *table = malloc(sizeof(ChainedTable));
+    table->dir[0] = calloc(HSEGSIZE, sizeof(HashList *));
+    table->split = 0;
+    table->max = HSEGSIZE;
+    table->mask1 = HSEGSIZE - 1;
+    table->mask2 = 2 * HSEGSIZE - 1;
+    table->kcount = 0;
+    table->bcount = HSEGSIZE;
+    table->freeList = NULL;
+    table->chunks = NULL;
+    return table;
+}
+
+static void expandChained(ChainedTable *table)
+{
+    if (table->split + table->max >= HDIRSIZE * HSEGSIZE) return;
+
+    int oldsegment = table->split / HSEGSIZE;
+    int oldindex = table->split % HSEGSIZE;
+    int newbucket = table->max + table->split;
+    int newsegment = newbucket / HSEGSIZE;
+    int newindex = newbucket % HSEGSIZE;
+
+    if (newindex == 0) {
+        table->dir[newsegment] = malloc(HSEGSIZE * sizeof(HashList *));
+    }
+    if (++table->split == table->max) {
+        table->split = 0;
+        table->max *= 2;
+        table->mask1 = table->mask2;
+        table->mask2 = table->mask2 << 1 | 1;
+    }
+    table->bcount++;
+
+    HashList *old = NULL, *new = NULL, *next;
+    for (HashList *hl = table->dir[oldsegment][oldindex]; hl; hl = next) {
+        next = hl->next;
+        if (chainedHash(table, hl->key) == newbucket) {
+            hl->next = new;
+            new = hl;
+        } else {
+            hl->next = old;
+            old = hl;
+        }
+    }
+    table->dir[oldsegment][oldindex] = old;
+    table->dir[newsegment][newindex] = new;
+}
+
+static void insertChained(ChainedTable *table, StgWord key, const void *data)
+{
+    if (++table->kcount >= HLOAD * table->bcount) expandChained(table);
+
+    int bucket = chainedHash(table, key);
+    HashList *hl = table->freeList;
+    if (hl == NULL) {
+        hl = malloc(HCHUNK * sizeof(HashList));
+        HashListChunk *cl = malloc(sizeof(HashListChunk));
+        cl->chunk = hl;
+        cl->next = table->chunks;
+        table->chunks = cl;
+        for (HashList *p = hl + 1; p < hl + HCHUNK - 1; p++) p->next = p + 1;
+        hl[HCHUNK - 1].next = NULL;
+        table->freeList = hl + 1;
+    } else {
+        table->freeList = hl->next;
+    }
+    hl->key = key;
+    hl->data = data;
+    hl->next = table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE];
+    table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE] = hl;
+}
+
+static void *lookupChained(const ChainedTable *table, StgWord key)
+{
+    int bucket = chainedHash(table, key);
+    for (HashList *hl = table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE];
+         hl; hl = hl->next) {
+        if (hl->key == key) return (void *)hl->data;
+    }
+    return NULL;
+}
+
+static void *removeChained(ChainedTable *table, StgWord key)
+{
+    int bucket = chainedHash(table, key);
+    HashList **prev = &table->dir[bucket / HSEGSIZE][bucket % HSEGSIZE];
+    for (HashList *hl = *prev; hl; prev = &hl->next, hl = hl->next) {
+        if (hl->key == key) {
+            *prev = hl->next;
+            hl->next = table->freeList;
+            table->freeList = hl;
+            table->kcount--;
+            return (void *)hl->data;
+        }
+    }
+    return NULL;
+}
+
+static void freeChained(ChainedTable *table)
+{
+    for (int s = 0; s <= (table->max + table->split - 1) / HSEGSIZE; s++) {
+        free(table->dir[s]);
+    }
+    HashListChunk *next;
+    for (HashListChunk *cl = table->chunks; cl; cl = next) {
+        next = cl->next;
+        free(cl->chunk);
+        free(cl);
+    }
+    free(table);
+}
+
+// -----------------------------------------------------------------------------
+// Benchmark
+
+// Keys that look like heap addresses: word aligned, in a few megablocks'
+// worth of address space, in no particular order.
+static StgWord mkKey(StgWord i)
+{
+    return 0x4200000000 + ((i * 2654435761u) & 0xffffffff) * sizeof(W_);
+}
+
+static double elapsed(StgWord64 start)
+{
+    return (double)(getMonotonicNSec() - start) / 1e9;
+}
+
+static void bench(StgWord n, bool timings)
+{
+    StgWord64 start;
+    double ins[2], hit[2], miss[2], del[2];
+
+    // the RTS table
+    HashTable *t = allocHashTable();
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        insertHashTable(t, mkKey(i), (void *)(i + 1));
+    }
+    ins[0] = elapsed(start);
+    if (keyCountHashTable(t) != (int)n) barf("HashTable: wrong key count");
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        if (lookupHashTable(t, mkKey(i)) != (void *)(i + 1)) {
+            barf("HashTable: key %" FMT_Word " missing", i);
+        }
+    }
+    hit[0] = elapsed(start);
+    start = getMonotonicNSec();
+    for (StgWord i = n; i < 2 * n; i++) {
+        if (lookupHashTable(t, mkKey(i)) != NULL) {
+            barf("HashTable: key %" FMT_Word " present", i);
+        }
+    }
+    miss[0] = elapsed(start);
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        if (removeHashTable(t, mkKey(i), NULL) != (void *)(i + 1)) {
+            barf("HashTable: couldn't remove key %" FMT_Word, i);
+        }
+    }
+    del[0] = elapsed(start);
+    if (keyCountHashTable(t) != 0) barf("HashTable: not empty");
+    freeHashTable(t, NULL);
+
+    // the old chained table
+    ChainedTable *c = allocChained();
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        insertChained(c, mkKey(i), (void *)(i + 1));
+    }
+    ins[1] = elapsed(start);
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        if (lookupChained(c, mkKey(i)) != (void *)(i + 1)) {
+            barf("ChainedTable: key %" FMT_Word " missing", i);
+        }
+    }
+    hit[1] = elapsed(start);
+    start = getMonotonicNSec();
+    for (StgWord i = n; i < 2 * n; i++) {
+        if (lookupChained(c, mkKey(i)) != NULL) {
+            barf("ChainedTable: key %" FMT_Word " present", i);
+        }
+    }
+    miss[1] = elapsed(start);
+    start = getMonotonicNSec();
+    for (StgWord i = 0; i < n; i++) {
+        if (removeChained(c, mkKey(i)) != (void *)(i + 1)) {
+            barf("ChainedTable: couldn't remove key %" FMT_Word, i);
+        }
+    }
+    del[1] = elapsed(start);
+    freeChained(c);
+
+    if (timings) {
+        static const char *names[2] = { "robin hood", "chained" };
+        for (int k = 0; k < 2; k++) {
+            printf("%8" FMT_Word " keys, %-10s: insert %.3fs  hit %.3fs"
+                   "  miss %.3fs  remove %.3fs\n",
+                   n, names[k], ins[k], hit[k], miss[k], del[k]);
+        }
+    }
+}
+
+// Duplicate keys: a lookup finds the most recent insertion, and removing it
+// uncovers the previous one.
+static void duplicates(void)
+{
+    HashTable *t = allocHashTable();
+    for (StgWord i = 0; i < 1000; i++) {
+        insertHashTable(t, mkKey(i), (void *)1);
+    }
+    for (StgWord i = 0; i < 1000; i += 2) {
+        insertHashTable(t, mkKey(i), (void *)2);
+        insertHashTable(t, mkKey(i), (void *)3);
+    }
+    for (StgWord i = 0; i < 1000; i++) {
+        void *want = (void *)(StgWord)(i % 2 == 0 ? 3 : 1);
+        if (lookupHashTable(t, mkKey(i)) != want) {
+            barf("duplicates: wrong entry for key %" FMT_Word, i);
+        }
+    }
+    for (StgWord i = 0; i < 1000; i += 2) {
+        if (removeHashTable(t, mkKey(i), NULL) != (void *)3 ||
+            lookupHashTable(t, mkKey(i)) != (void *)2 ||
+            removeHashTable(t, mkKey(i), (void *)1) != (void *)1 ||
+            lookupHashTable(t, mkKey(i)) != (void *)2) {
+            barf("duplicates: wrong removal for key %" FMT_Word, i);
+        }
+    }
+    freeHashTable(t, NULL);
+}
+
+int main (int argc, char *argv[])
+{
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    bool timings = argc > 1 && strcmp(argv[1], "-t") == 0;
+
+    duplicates();
+    for (StgWord n = 10000; n <= (timings ? 10000000 : 100000); n *= 10) {
+        bench(n, timings);
+    }
+    printf("done\n");
+
+    hs_exit();
+
+    exit(0);
+}
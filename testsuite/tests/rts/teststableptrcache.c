@@ -0,0 +1,100 @@
+#include "Rts.h"
+#include "RtsAPI.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Exercise the per-Capability stable pointer caches (see Note [Per-capability
+// stable pointer caches] in rts/StablePtr.c): several OS threads create and
+// free stable pointers, some while owning a Capability (the lock-free path)
+// and some without (the locked path), while the table grows and the GC moves
+// the objects they point to. Run with "-t" to print timings.
+
+#define THREADS  4
+#define ARRSIZE  1000
+#define LOOPS    200
+
+OSThreadId ids[THREADS];
+StgWord64 times[THREADS];
+volatile StgWord done = 0;
+
+// big enough not to be a static INTLIKE closure
+static HsInt value (int n, int i, int j)
+{
+    return (HsInt)n * 1000000 + i * ARRSIZE + j + 1000;
+}
+
+static void check (StgStablePtr sp, HsInt want)
+{
+    HsInt got = rts_getInt((HaskellObj)deRefStablePtr(sp));
+    if (got != want) {
+        barf("stable pointer %p: got %" FMT_Int ", wanted %" FMT_Int,
+             sp, got, want);
+    }
+}
+
+static void *worker (void *arg)
+{
+    int n = (int)(StgWord)arg;
+    StgStablePtr a[ARRSIZE];
+    StgWord64 start = getMonotonicNSec();
+
+    for (int i = 0; i < LOOPS; i++)
+    {
+        Capability *cap = rts_lock();
+        for (int j = 0; j < ARRSIZE; j++) {
+            a[j] = getStablePtr((StgPtr)rts_mkInt(cap, value(n, i, j)));
+        }
+        rts_unlock(cap);
+
+        // let the objects move; stable pointers stay valid across the GC
+        if (i % 16 == n) {
+            performGC();
+        }
+
+        cap = rts_lock();
+        for (int j = 0; j < ARRSIZE; j++) {
+            check(a[j], value(n, i, j));
+        }
+        // free half with the Capability and half without
+        for (int j = 0; j < ARRSIZE / 2; j++) {
+            hs_free_stable_ptr(a[j]);
+        }
+        rts_unlock(cap);
+        for (int j = ARRSIZE / 2; j < ARRSIZE; j++) {
+            hs_free_stable_ptr(a[j]);
+        }
+    }
+
+    times[n] = getMonotonicNSec() - start;
+    hs_thread_done();
+    atomic_inc(&done, 1);
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    for (int n = 0; n < THREADS; n++) {
+        createOSThread(&ids[n], "stableptrcache", worker, (void*)(StgWord)n);
+    }
+    while (done != THREADS) {
+        yieldThread();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        for (int n = 0; n < THREADS; n++) {
+            printf("thread %d: %.3fs\n", n, (double)times[n] / 1e9);
+        }
+    }
+    printf("done\n");
+
+    hs_exit();
+
+    exit(0);
+}
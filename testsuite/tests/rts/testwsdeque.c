@@ -56,7 +56,8 @@ myStealWSDeque_ (WSDeque *q, uint32_t n)
     // and Ticket #13633.
     load_load_barrier();
     /* now access array, see pushBottom() */
-    stolen = q->elements[t & q->moduloSize];
+    void **elements = q->elements;
+    stolen = elements[t & WSDEQUE_MASK(elements)];
     
     /* now decide whether we have won */
     if ( !(CASTOP(&(q->top),t,t+1)) ) {
@@ -144,7 +145,8 @@ int main(int argc, char*argv[])
     uint32_t count = 0;
     void *p;
 
-    q = newWSDeque(1024);
+    // start small, so that the deque grows while the thieves are stealing
+    q = newGrowableWSDeque(64, SCRATCH_SIZE);
     done = 0;
     
     for (n=0; n < SCRATCH_SIZE; n++) {
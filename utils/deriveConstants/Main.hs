@@ -513,6 +513,7 @@ wanteds os = concat
           ,closureField C "StgTVar" "current_value"
           ,closureField C "StgTVar" "first_watch_queue_entry"
           ,closureField C "StgTVar" "num_updates"
+          ,closureField C "StgTVar" "num_conflicts"
 
           ,closureSize  C "StgWeak"
           ,closureField C "StgWeak" "link"